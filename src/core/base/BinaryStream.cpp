@@ -16,6 +16,7 @@
 #include "DebugIntf.h"
 #include "EventIntf.h"
 #include "UtilStreams.h"
+#include "FileWriteThread.h"
 #include "tjsError.h"
 
 
@@ -71,7 +72,11 @@ tTJSBinaryStream * TVPCreateBinaryStreamForWrite(const ttstr & name,
 		stream = TVPCreateStream(name, TJS_BS_UPDATE);
 		stream->SetPosition(ofs);
 	} else {
-		stream = TVPCreateStream(name, TJS_BS_WRITE);
+		// a: written atomically on the file writing thread
+		stream = NULL;
+		if(TJS_strchr(modestr.c_str(), TJS_W('a')) != NULL)
+			stream = TVPCreateAsyncWriteStream(name, TVPGetAsyncWriteCallback());
+		if(!stream) stream = TVPCreateStream(name, TJS_BS_WRITE);
 	}
 	return stream;
 }
@@ -11,10 +11,12 @@
 #include "tjsCommHead.h"
 
 #include <algorithm>
+#include <deque>
 #include "SysInitIntf.h"
 #include "EventIntf.h"
 #include "WindowIntf.h"
 #include "tjsDictionary.h"
+#include "tjsHashSearch.h"
 #include "MsgIntf.h"
 #include "ScriptMgnIntf.h"
 #include "TickCount.h"
@@ -38,6 +40,13 @@ class tTVPEvent
 	tjs_uint32 Flags;
 	tjs_uint64 Sequence;
 
+public:
+	// queue management; see TVPEnqueueEvent
+	tjs_uint64 QueueIndex; // absolute index in the queue of its priority
+	tjs_uint32 KeyHash; // hash of target/source/name
+	tTVPEvent *KeyPrev; // events which have the same target/source/name
+	tTVPEvent *KeyNext;
+
 public:
 	tTVPEvent(iTJSDispatch2 *target, iTJSDispatch2 *source,
 		ttstr &eventname, tjs_uint32 tag, tjs_uint numargs, tTJSVariant *args,
@@ -175,25 +184,193 @@ public:
 //---------------------------------------------------------------------------
 // event queue must be a globally sequential queue
 std::vector<tTVPBaseInputEvent *> TVPInputEventQueue;
-std::vector<tTVPEvent *> TVPEventQueue;
 std::vector<tTVPWinUpdateEvent> TVPWinUpdateEventQueue;
 bool TVPExclusiveEventPosted = false; // true if exclusive event is posted
 tjs_uint64 TVPEventSequenceNumber = 0; // event sequence number
 tjs_uint64 TVPEventSequenceNumberToProcess = 0;
 	// current event sequence which must be processed
+//---------------------------------------------------------------------------
+/*
+	script events are queued in a FIFO queue per priority. removed events
+	are left as NULL in the queue and skipped when they reach the front, so
+	removing an event does not move the others.
+	queued events are also linked by their target/source/name through
+	TVPEventIndex; TVP_EPT_REMOVE_POST and TVPCancelEvents only look at the
+	events which have the same target/source/name instead of the whole queue.
+*/
+#define TVP_EVENT_PRIO_COUNT ((TVP_EPT_PRIO_MASK >> 5) + 1)
+#define TVP_EVENT_PRIO_INDEX(flags) (((flags) & TVP_EPT_PRIO_MASK) >> 5)
+struct tTVPEventKey
+{
+	iTJSDispatch2 *Target;
+	iTJSDispatch2 *Source;
+	ttstr EventName;
+
+	tTVPEventKey(iTJSDispatch2 *target, iTJSDispatch2 *source,
+		const ttstr &eventname) :
+		Target(target), Source(source), EventName(eventname) {;}
+
+	bool operator == (const tTVPEventKey &ref) const
+	{
+		return Target == ref.Target && Source == ref.Source &&
+			EventName == ref.EventName;
+	}
+};
+class tTVPEventKeyHashFunc
+{
+public:
+	static tjs_uint32 Make(const tTVPEventKey &key)
+	{
+		tjs_uint32 ret = tTJSHashFunc<ttstr>::Make(key.EventName);
+		ret ^= tTJSHashFunc<iTJSDispatch2 *>::Make(key.Target);
+		ret += tTJSHashFunc<iTJSDispatch2 *>::Make(key.Source);
+		if(!ret) ret = (tjs_uint32)-1;
+		return ret;
+	}
+};
+struct tTVPEventChain
+{
+	tTVPEvent *First;
+	tTVPEvent *Last;
+};
+static std::deque<tTVPEvent *> TVPEventQueues[TVP_EVENT_PRIO_COUNT];
+static tjs_uint64 TVPEventQueueHeads[TVP_EVENT_PRIO_COUNT];
+	// absolute index of the front of each queue
+static tTJSHashTable<tTVPEventKey, tTVPEventChain, tTVPEventKeyHashFunc, 256>
+	TVPEventIndex;
+static tjs_uint TVPEventQueueCount = 0; // count of events in the queues
+static tTVPEventQueueStatistics TVPEventQueueStat;
+//---------------------------------------------------------------------------
+static void TVPEnqueueEvent(tTVPEvent *ev)
+{
+	tjs_int prio = TVP_EVENT_PRIO_INDEX(ev->GetFlags());
+	std::deque<tTVPEvent *> &queue = TVPEventQueues[prio];
+
+	tTVPEventKey key(ev->GetTargetNoAddRef(), ev->GetSourceNoAddRef(),
+		ev->GetEventName());
+	ev->KeyHash = tTVPEventKeyHashFunc::Make(key);
+	tTVPEventChain *chain = TVPEventIndex.FindWithHash(key, ev->KeyHash);
+	if(chain)
+	{
+		ev->KeyPrev = chain->Last;
+		ev->KeyNext = NULL;
+		chain->Last->KeyNext = ev;
+		chain->Last = ev;
+	}
+	else
+	{
+		tTVPEventChain newchain;
+		newchain.First = newchain.Last = ev;
+		ev->KeyPrev = ev->KeyNext = NULL;
+		TVPEventIndex.AddWithHash(key, ev->KeyHash, newchain);
+	}
 
+	ev->QueueIndex = TVPEventQueueHeads[prio] + queue.size();
+	queue.push_back(ev);
+
+	TVPEventQueueCount++;
+	if(TVPEventQueueStat.PeakCount < TVPEventQueueCount)
+		TVPEventQueueStat.PeakCount = TVPEventQueueCount;
+}
+//---------------------------------------------------------------------------
+static void TVPUnlinkEvent(tTVPEvent *ev)
+{
+	// remove the event from the queue and the index; this does not delete
+	// the event object.
+	tjs_int prio = TVP_EVENT_PRIO_INDEX(ev->GetFlags());
+	std::deque<tTVPEvent *> &queue = TVPEventQueues[prio];
+	tjs_uint64 &head = TVPEventQueueHeads[prio];
+	queue[(size_t)(ev->QueueIndex - head)] = NULL;
+	while(!queue.empty() && !queue.front()) queue.pop_front(), head++;
+
+	if(!ev->KeyPrev || !ev->KeyNext)
+	{
+		tTVPEventKey key(ev->GetTargetNoAddRef(), ev->GetSourceNoAddRef(),
+			ev->GetEventName());
+		if(!ev->KeyPrev && !ev->KeyNext)
+		{
+			TVPEventIndex.DeleteWithHash(key, ev->KeyHash);
+		}
+		else
+		{
+			tTVPEventChain *chain = TVPEventIndex.FindWithHash(key, ev->KeyHash);
+			if(!ev->KeyPrev) chain->First = ev->KeyNext;
+			if(!ev->KeyNext) chain->Last = ev->KeyPrev;
+		}
+	}
+	if(ev->KeyPrev) ev->KeyPrev->KeyNext = ev->KeyNext;
+	if(ev->KeyNext) ev->KeyNext->KeyPrev = ev->KeyPrev;
+	ev->KeyPrev = ev->KeyNext = NULL;
+
+	TVPEventQueueCount--;
+}
+//---------------------------------------------------------------------------
+static tTVPEvent * TVPGetFirstEventByKey(iTJSDispatch2 * source,
+	iTJSDispatch2 *target, const ttstr &eventname)
+{
+	// returns the first event which has the target/source/name; the others
+	// follow through tTVPEvent::KeyNext
+	tTVPEventKey key(target, source, eventname);
+	tTVPEventChain *chain = TVPEventIndex.Find(key);
+	return chain ? chain->First : NULL;
+}
+//---------------------------------------------------------------------------
+static void TVPDeleteEvents(std::vector<tTVPEvent *> &events)
+{
+	// delete events which are already unlinked.
+	// deletion of event object may cause other deletion of event objects,
+	// so the events are deleted after the queue is no longer touched.
+	for(std::vector<tTVPEvent *>::iterator i = events.begin();
+		i != events.end(); i++)
+	{
+		delete *i;
+	}
+}
+//---------------------------------------------------------------------------
+template <typename PredT>
+static tjs_int TVPRemoveEventsIf(PredT pred)
+{
+	// remove all events which match "pred", scanning the whole queue
+	std::vector<tTVPEvent *> removed;
+	for(tjs_int prio = 0; prio < TVP_EVENT_PRIO_COUNT; prio++)
+	{
+		std::deque<tTVPEvent *> &queue = TVPEventQueues[prio];
+		for(size_t i = 0; i < queue.size(); i++)
+		{
+			tTVPEvent *ev = queue[i];
+			if(ev && pred(ev)) removed.push_back(ev);
+		}
+	}
+	for(std::vector<tTVPEvent *>::iterator i = removed.begin();
+		i != removed.end(); i++)
+	{
+		TVPUnlinkEvent(*i);
+	}
+	TVPDeleteEvents(removed);
+	return (tjs_int)removed.size();
+}
+//---------------------------------------------------------------------------
+void TVPGetEventQueueStatistics(tTVPEventQueueStatistics &stat)
+{
+	stat = TVPEventQueueStat;
+	stat.Count = TVPEventQueueCount;
+}
+//---------------------------------------------------------------------------
 static void TVPDestroyEventQueue()
 {
 	// delete all event objects
 	// deletion of event object may cause other deletion of event objects.
 	{
-		std::vector<tTVPEvent *>::iterator i;
-		while(TVPEventQueue.size())
+		for(tjs_int prio = TVP_EVENT_PRIO_COUNT - 1; prio >= 0; prio--)
 		{
-			i = TVPEventQueue.end() -1;
-			tTVPEvent * ev = *i;
-			TVPEventQueue.erase(i);
-			delete ev;
+			std::deque<tTVPEvent *> &queue = TVPEventQueues[prio];
+			while(queue.size())
+			{
+				tTVPEvent * ev = queue.back();
+				if(!ev) { queue.pop_back(); continue; }
+				TVPUnlinkEvent(ev);
+				delete ev;
+			}
 		}
 	}
 //--
@@ -261,33 +438,30 @@ void TVPPostEvent(iTJSDispatch2 * source, iTJSDispatch2 *target,
 	}
 
 
+	std::vector<tTVPEvent *> removed;
 	if(method == TVP_EPT_REMOVE_POST)
 	{
 		// events in queue that have same target/source/name/tag are to be removed
-		std::vector<tTVPEvent *>::iterator i;
-		i = TVPEventQueue.begin();
-		while(/*TVPEventQueue.size() &&*/ i != TVPEventQueue.end())
+		tTVPEvent *next;
+		for(tTVPEvent *ev = TVPGetFirstEventByKey(source, target, eventname);
+			ev; ev = next)
 		{
-			if(source == (*i)->GetSourceNoAddRef() &&
-				target == (*i)->GetTargetNoAddRef() &&
-				eventname == (*i)->GetEventName() &&
-				((tag==0)?true:(tag==(*i)->GetTag())) )
+			next = ev->KeyNext;
+			if((tag==0)?true:(tag==ev->GetTag()))
 			{
-				tTVPEvent *ev = *i;
-				TVPEventQueue.erase(i);
-				i = TVPEventQueue.begin();
-				delete ev;
-			}
-			else
-			{
-				i++;
+				TVPUnlinkEvent(ev);
+				removed.push_back(ev);
 			}
 		}
+		TVPEventQueueStat.CoalescedCount += removed.size();
 	}
 
 	// put into queue
-	TVPEventQueue.push_back(new tTVPEvent(target, source, eventname, tag,
+	TVPEnqueueEvent(new tTVPEvent(target, source, eventname, tag,
 									numargs, args, flag));
+	TVPEventQueueStat.PostCount++;
+
+	TVPDeleteEvents(removed);
 
 	// is exclusive?
 	if((flag & TVP_EPT_PRIO_MASK) == TVP_EPT_EXCLUSIVE) TVPExclusiveEventPosted = true;
@@ -307,28 +481,21 @@ void TVPPostEvent(iTJSDispatch2 * source, iTJSDispatch2 *target,
 tjs_int TVPCancelEvents(iTJSDispatch2 * source, iTJSDispatch2 *target,
 	const ttstr &eventname, tjs_uint32 tag)
 {
-	tjs_int count = 0;
-	std::vector<tTVPEvent *>::iterator i;
-	i = TVPEventQueue.begin();
-	while(/*TVPEventQueue.size() &&*/ i != TVPEventQueue.end())
+	std::vector<tTVPEvent *> removed;
+	tTVPEvent *next;
+	for(tTVPEvent *ev = TVPGetFirstEventByKey(source, target, eventname);
+		ev; ev = next)
 	{
-		if(source == (*i)->GetSourceNoAddRef() &&
-			target == (*i)->GetTargetNoAddRef() &&
-			eventname == (*i)->GetEventName() &&
-				((tag==0)?true:(tag==(*i)->GetTag())) )
-		{
-			tTVPEvent *ev = *i;
-			TVPEventQueue.erase(i);
-			i = TVPEventQueue.begin();
-			delete ev;
-			count ++;
-		}
-		else
+		next = ev->KeyNext;
+		if((tag==0)?true:(tag==ev->GetTag()))
 		{
-			i++;
+			TVPUnlinkEvent(ev);
+			removed.push_back(ev);
 		}
 	}
-	return count;
+	TVPEventQueueStat.CancelCount += removed.size();
+	TVPDeleteEvents(removed);
+	return (tjs_int)removed.size();
 }
 //---------------------------------------------------------------------------
 
@@ -342,16 +509,11 @@ tjs_int TVPCancelEvents(iTJSDispatch2 * source, iTJSDispatch2 *target,
 bool TVPAreEventsInQueue(iTJSDispatch2 * source, iTJSDispatch2 *target,
 	const ttstr &eventname, tjs_uint32 tag)
 {
-	std::vector<tTVPEvent *>::iterator i;
-	i = TVPEventQueue.begin();
-	while(/*TVPEventQueue.size() &&*/ i != TVPEventQueue.end())
+	for(tTVPEvent *ev = TVPGetFirstEventByKey(source, target, eventname);
+		ev; ev = ev->KeyNext)
 	{
-		if(source == (*i)->GetSourceNoAddRef() &&
-			target == (*i)->GetTargetNoAddRef() &&
-			eventname == (*i)->GetEventName() &&
-				((tag==0)?true:(tag==(*i)->GetTag())) )
+		if((tag==0)?true:(tag==ev->GetTag()))
 		return true;
-		i++;
 	}
 	return false;
 }
@@ -368,16 +530,11 @@ tjs_int TVPCountEventsInQueue(iTJSDispatch2 * source, iTJSDispatch2 *target,
 	const ttstr &eventname, tjs_uint32 tag)
 {
 	tjs_int count = 0;
-	std::vector<tTVPEvent *>::iterator i;
-	i = TVPEventQueue.begin();
-	while(/*TVPEventQueue.size() &&*/ i != TVPEventQueue.end())
+	for(tTVPEvent *ev = TVPGetFirstEventByKey(source, target, eventname);
+		ev; ev = ev->KeyNext)
 	{
-		if(source == (*i)->GetSourceNoAddRef() &&
-			target == (*i)->GetTargetNoAddRef() &&
-			eventname == (*i)->GetEventName() &&
-				((tag==0)?true:(tag==(*i)->GetTag())) )
+		if((tag==0)?true:(tag==ev->GetTag()))
 		count ++;
-		i++;
 	}
 	return count;
 }
@@ -390,27 +547,24 @@ tjs_int TVPCountEventsInQueue(iTJSDispatch2 * source, iTJSDispatch2 *target,
 //---------------------------------------------------------------------------
 // TVPCancelEventByTag
 //---------------------------------------------------------------------------
-void TVPCancelEventsByTag(iTJSDispatch2 * source, iTJSDispatch2 *target,
-	tjs_uint32 tag)
+struct tTVPEventTagMatcher
 {
-	std::vector<tTVPEvent *>::iterator i;
-	i = TVPEventQueue.begin();
-	while(/*TVPEventQueue.size() &&*/ i != TVPEventQueue.end())
+	iTJSDispatch2 *Source;
+	iTJSDispatch2 *Target;
+	tjs_uint32 Tag;
+	bool operator () (const tTVPEvent *ev) const
 	{
-		if(source == (*i)->GetSourceNoAddRef() &&
-			target == (*i)->GetTargetNoAddRef() &&
-				((tag==0)?true:(tag==(*i)->GetTag())) )
-		{
-			tTVPEvent *ev = *i;
-			TVPEventQueue.erase(i);
-			i = TVPEventQueue.begin();
-			delete ev;
-		}
-		else
-		{
-			i++;
-		}
+		return Source == ev->GetSourceNoAddRef() &&
+			Target == ev->GetTargetNoAddRef() &&
+				((Tag==0)?true:(Tag==ev->GetTag()));
 	}
+};
+void TVPCancelEventsByTag(iTJSDispatch2 * source, iTJSDispatch2 *target,
+	tjs_uint32 tag)
+{
+	// the event name is not specified; the whole queue is scanned
+	tTVPEventTagMatcher matcher = { source, target, tag };
+	TVPEventQueueStat.CancelCount += TVPRemoveEventsIf(matcher);
 }
 //---------------------------------------------------------------------------
 
@@ -421,24 +575,17 @@ void TVPCancelEventsByTag(iTJSDispatch2 * source, iTJSDispatch2 *target,
 //---------------------------------------------------------------------------
 // TVPCancelSourceEvent
 //---------------------------------------------------------------------------
+struct tTVPEventSourceMatcher
+{
+	iTJSDispatch2 *Source;
+	bool operator () (const tTVPEvent *ev) const
+		{ return Source == ev->GetSourceNoAddRef(); }
+};
 void TVPCancelSourceEvents(iTJSDispatch2 * source)
 {
-	std::vector<tTVPEvent *>::iterator i;
-	i = TVPEventQueue.begin();
-	while(/*TVPEventQueue.size() &&*/ i != TVPEventQueue.end())
-	{
-		if(source == (*i)->GetSourceNoAddRef())
-		{
-			tTVPEvent *ev = *i;
-			TVPEventQueue.erase(i);
-			i = TVPEventQueue.begin();
-			delete ev;
-		}
-		else
-		{
-			i++;
-		}
-	}
+	if(!TVPEventQueueCount) return;
+	tTVPEventSourceMatcher matcher = { source };
+	TVPEventQueueStat.CancelCount += TVPRemoveEventsIf(matcher);
 }
 //---------------------------------------------------------------------------
 
@@ -449,24 +596,16 @@ void TVPCancelSourceEvents(iTJSDispatch2 * source)
 //---------------------------------------------------------------------------
 // TVPDiscardAllDiscardableEvents
 //---------------------------------------------------------------------------
+struct tTVPEventDiscardableMatcher
+{
+	bool operator () (const tTVPEvent *ev) const
+		{ return 0 != (ev->GetFlags() & TVP_EPT_DISCARDABLE); }
+};
 void TVPDiscardAllDiscardableEvents()
 {
-	std::vector<tTVPEvent *>::iterator i;
-	i = TVPEventQueue.begin();
-	while(/*TVPEventQueue.size() &&*/ i != TVPEventQueue.end())
-	{
-		if((*i)->GetFlags() & TVP_EPT_DISCARDABLE)
-		{
-			tTVPEvent *ev = *i;
-			TVPEventQueue.erase(i);
-			i = TVPEventQueue.begin();
-			delete ev;
-		}
-		else
-		{
-			i++;
-		}
-	}
+	if(!TVPEventQueueCount) return;
+	TVPEventQueueStat.DiscardCount +=
+		TVPRemoveEventsIf(tTVPEventDiscardableMatcher());
 }
 //---------------------------------------------------------------------------
 
@@ -479,23 +618,20 @@ void TVPDiscardAllDiscardableEvents()
 //---------------------------------------------------------------------------
 static void _TVPDeliverEventByPrio(tjs_uint prio)
 {
+	std::deque<tTVPEvent *> &queue = TVPEventQueues[TVP_EVENT_PRIO_INDEX(prio)];
 	while(true)
 	{
 		tTVPEvent *e;
 
 		// retrieve item to deliver
-		if(TVPEventQueue.size() == 0) break;
-		std::vector<tTVPEvent *>::iterator i =
-			TVPEventQueue.begin();
-		while(i != TVPEventQueue.end())
-		{
-			if((*i)->GetSequence() <= TVPEventSequenceNumberToProcess &&
-				(((*i)->GetFlags() & TVP_EPT_PRIO_MASK) == prio)) break;
-			i++;
-		}
-		if(i == TVPEventQueue.end()) break;
-		e = *i;
-		TVPEventQueue.erase(i);
+		// (the front is never a removed event, see TVPUnlinkEvent)
+		// events are queued in the order of the sequence number, so no
+		// event follows the front if the front is not to be processed yet.
+		if(queue.size() == 0) break;
+		e = queue.front();
+		if(e->GetSequence() > TVPEventSequenceNumberToProcess) break;
+		TVPUnlinkEvent(e);
+		TVPEventQueueStat.DeliverCount++;
 
 		// event delivering
 		try
@@ -648,7 +784,7 @@ void TVPDeliverAllEvents()
 		stop_profile();
 	}
 
-	if(TVPEventQueue.size() == 0)
+	if(TVPEventQueueCount == 0)
 	{
 		TVPEventSequenceNumber = 0; // reset the number
 	}
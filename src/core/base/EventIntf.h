@@ -128,6 +128,18 @@ TJS_EXP_FUNC_DEF(void, TVPCancelEventsByTag, (iTJSDispatch2 * source, iTJSDispat
 TJS_EXP_FUNC_DEF(void, TVPCancelSourceEvents, (iTJSDispatch2 * source));
 		// removes all events that has specified source.
 //---------------------------------------------------------------------------
+struct tTVPEventQueueStatistics
+{
+	tjs_uint Count; // events in the queue
+	tjs_uint PeakCount; // maximum count of the events in the queue
+	tjs_uint64 PostCount; // events posted into the queue
+	tjs_uint64 DeliverCount; // events delivered from the queue
+	tjs_uint64 CoalescedCount; // events replaced by TVP_EPT_REMOVE_POST
+	tjs_uint64 CancelCount; // events removed by TVPCancel*
+	tjs_uint64 DiscardCount; // events removed by TVPDiscardAllDiscardableEvents
+};
+extern void TVPGetEventQueueStatistics(tTVPEventQueueStatistics &stat);
+//---------------------------------------------------------------------------
 
 
 
@@ -0,0 +1,412 @@
+//---------------------------------------------------------------------------
+/*
+	TVP2 ( T Visual Presenter 2 )  A script authoring tool
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// Asynchronous file writing thread
+//---------------------------------------------------------------------------
+#include "tjsCommHead.h"
+
+#include "FileWriteThread.h"
+#include "ScriptMgnIntf.h"
+#include "ThreadIntf.h"
+#include "NativeEventQueue.h"
+#include "UserEvent.h"
+#include "StorageIntf.h"
+#include "StorageImpl.h"
+#include "MsgIntf.h"
+#include "DebugIntf.h"
+#include "UtilStreams.h"
+#include "Platform.h"
+#include <fcntl.h>
+#include <stdio.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+bool TVPWriteDataToFile(const ttstr &filepath, const void *data, unsigned int len);
+//---------------------------------------------------------------------------
+static tTJSVariant TVPAsyncWriteCallback;
+	// called for the 'a' mode streams, which have no callback of their own
+//---------------------------------------------------------------------------
+static bool TVPWriteTemporaryFile(const ttstr &name, const void *data, tjs_uint size)
+{
+#ifndef WIN32
+	// write directly to sync the data to the device before renaming
+	tTJSNarrowStringHolder holder(name.c_str());
+	int handle = open(holder, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(handle >= 0)
+	{
+		const tjs_uint8 *p = (const tjs_uint8 *)data;
+		tjs_uint rest = size;
+		bool ok = true;
+		while(ok && rest > 0)
+		{
+			int written = (int)write(handle, p, rest);
+			if(written <= 0) ok = false;
+			else p += written, rest -= written;
+		}
+		if(ok && fsync(handle) != 0) ok = false;
+		if(close(handle) != 0) ok = false;
+		if(ok) return true;
+	}
+#endif
+	// the platform writer; this can also write into the storages which are
+	// not accessible by the native file functions
+	return TVPWriteDataToFile(name, data, size);
+}
+//---------------------------------------------------------------------------
+static bool TVPReplaceFile(const ttstr &from, const ttstr &to)
+{
+	// rename which atomically replaces the existing destination
+#ifdef WIN32
+	return MoveFileExW(from.c_str(), to.c_str(),
+		MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(tTJSNarrowStringHolder(from.c_str()),
+		tTJSNarrowStringHolder(to.c_str())) == 0;
+#endif
+}
+//---------------------------------------------------------------------------
+bool TVPWriteFileAtomically(const ttstr &localname, const void *data, tjs_uint size)
+{
+	// write the data into a temporary file, and then rename it;
+	// the destination is never seen partially written.
+	ttstr tmpname = localname + TJS_W(".tmp");
+	if(!TVPWriteTemporaryFile(tmpname, data, size))
+	{
+		TVPDeleteFile(tmpname);
+		return false;
+	}
+	if(TVPReplaceFile(tmpname, localname)) return true;
+
+	// the storage can not be replaced in one step (e.g. it is accessible
+	// only through the platform functions); move the old file aside, and
+	// put it back if the new one can not take its place.
+	ttstr bakname = localname + TJS_W(".bak");
+	TVPDeleteFile(bakname);
+	bool hasold = TVPRenameFile(localname, bakname);
+	if(TVPRenameFile(tmpname, localname))
+	{
+		if(hasold) TVPDeleteFile(bakname);
+		return true;
+	}
+	if(hasold) TVPRenameFile(bakname, localname);
+	TVPDeleteFile(tmpname);
+	return false;
+}
+//---------------------------------------------------------------------------
+tTVPFileWriteCommand::tTVPFileWriteCommand() : data_(NULL), failed_(false) {}
+tTVPFileWriteCommand::~tTVPFileWriteCommand() {
+	delete data_;
+	data_ = NULL;
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTVPAsyncFileWriter
+//---------------------------------------------------------------------------
+tTVPAsyncFileWriter::tTVPAsyncFileWriter()
+: EventQueue(this,&tTVPAsyncFileWriter::Proc), tTVPThread(true), Writing(NULL)
+{
+	EventQueue.Allocate();
+}
+tTVPAsyncFileWriter::~tTVPAsyncFileWriter() {
+	// the thread writes all the pending data before exiting
+	ExitRequest();
+	WaitFor();
+	EventQueue.Clear();
+	EventQueue.Deallocate();
+	while( CommandQueue.size() > 0 ) {
+		tTVPFileWriteCommand* cmd = CommandQueue.front();
+		CommandQueue.pop_front();
+		delete cmd;
+	}
+	while( WrittenQueue.size() > 0 ) {
+		tTVPFileWriteCommand* cmd = WrittenQueue.front();
+		WrittenQueue.pop();
+		delete cmd;
+	}
+}
+void tTVPAsyncFileWriter::ExitRequest() {
+	Terminate();
+	PushCommandQueueEvent.Set();
+}
+void tTVPAsyncFileWriter::Execute() {
+	WritingThread();
+}
+void tTVPAsyncFileWriter::SendToWriteFinish( tTVPFileWriteCommand* cmd ) {
+	{	// Lock
+		tTJSCriticalSectionHolder cs(WrittenQueueCS);
+		WrittenQueue.push(cmd);
+	}
+	NativeEvent ev(TVP_EV_FILE_WRITE_THREAD);
+	EventQueue.PostEvent(ev);
+}
+void tTVPAsyncFileWriter::Proc( NativeEvent& ev )
+{
+	if(ev.Message != TVP_EV_FILE_WRITE_THREAD) {
+		EventQueue.HandlerDefault(ev);
+		return;
+	}
+	HandleWrittenCommand();
+}
+//---------------------------------------------------------------------------
+void tTVPAsyncFileWriter::HandleWrittenCommand() {
+	bool written;
+	do {
+		written = false;
+		tTVPFileWriteCommand* cmd = NULL;
+		{
+			tTJSCriticalSectionHolder cs(WrittenQueueCS);
+			if( WrittenQueue.size() > 0 ) {
+				cmd = WrittenQueue.front();
+				WrittenQueue.pop();
+				written = true;
+			}
+		}
+		if( cmd != NULL ) {
+			try {
+				try {
+					ttstr message;
+					if( cmd->failed_ )
+						message = TVPFormatMessage(TVPCannotOpenStorage, cmd->name_);
+					if( cmd->callbacks_.size() == 0 ) {
+						// nobody is waiting for the result
+						if( !message.IsEmpty() ) TVPAddImportantLog(message);
+					} else {
+						tTJSVariant param[3];
+						param[0] = cmd->name_;
+						param[1] = message.IsEmpty() ? 0 : 1; // is_error
+						param[2] = message; // error_mes
+						tTJSVariant *pparam[3] = { param, param+1, param+2 };
+						for( tjs_uint i = 0; i < cmd->callbacks_.size(); i++ ) {
+							cmd->callbacks_[i].AsObjectClosureNoAddRef().FuncCall(0, NULL, NULL,
+								NULL, 3, pparam, NULL);
+						}
+					}
+				}
+				TJS_CONVERT_TO_TJS_EXCEPTION
+			}
+			TVP_CATCH_AND_SHOW_SCRIPT_EXCEPTION(TJS_W("async file write"));
+			delete cmd;
+		}
+	} while(written);
+}
+//---------------------------------------------------------------------------
+void tTVPAsyncFileWriter::WriteCommand( tTVPFileWriteCommand* cmd ) {
+	// writing thread
+	tTVPMemoryStream *data = cmd->data_;
+	cmd->failed_ = !TVPWriteFileAtomically(cmd->localname_,
+		data->GetInternalBuffer(), (tjs_uint)data->GetSize());
+
+	// the data is not needed any more
+	delete cmd->data_;
+	cmd->data_ = NULL;
+}
+//---------------------------------------------------------------------------
+void tTVPAsyncFileWriter::WritingThread() {
+	while( true ) {
+		tTVPFileWriteCommand* cmd = NULL;
+		{ // Lock
+			tTJSCriticalSectionHolder cs(CommandQueueCS);
+			if( CommandQueue.size() ) {
+				cmd = CommandQueue.front();
+				CommandQueue.pop_front();
+				Writing = cmd;
+			}
+		}
+		if( cmd ) {
+			WriteCommand(cmd);
+			{ // Lock
+				tTJSCriticalSectionHolder cs(CommandQueueCS);
+				Writing = NULL;
+			}
+			WriteDoneEvent.Set();
+			SendToWriteFinish(cmd);
+			continue;
+		}
+		// pending data is always written before exiting
+		if( GetTerminated() ) break;
+
+		// wait for the next command
+		PushCommandQueueEvent.WaitFor(-1);
+	}
+}
+//---------------------------------------------------------------------------
+bool tTVPAsyncFileWriter::IsPending( const ttstr *localname ) {
+	// the queued command is moved to the front, so that the writing
+	// thread writes it next.
+	tTJSCriticalSectionHolder cs(CommandQueueCS);
+	if( Writing && ( !localname || Writing->localname_ == *localname ) )
+		return true;
+	std::deque<tTVPFileWriteCommand*>::iterator i;
+	for( i = CommandQueue.begin(); i != CommandQueue.end(); i++ ) {
+		if( !localname || (*i)->localname_ == *localname ) {
+			tTVPFileWriteCommand* cmd = *i;
+			if( i != CommandQueue.begin() ) {
+				CommandQueue.erase(i);
+				CommandQueue.push_front(cmd);
+			}
+			return true;
+		}
+	}
+	return false;
+}
+//---------------------------------------------------------------------------
+void tTVPAsyncFileWriter::Flush( const ttstr *localname ) {
+	// files are written only by the writing thread, so the same file is
+	// never written by two threads at once
+	while( IsPending(localname) ) {
+		PushCommandQueueEvent.Set();
+		WriteDoneEvent.WaitFor(-1);
+	}
+}
+//---------------------------------------------------------------------------
+void tTVPAsyncFileWriter::WriteRequest( const ttstr &name, const ttstr &localname,
+	tTVPMemoryStream *data, const tTJSVariant &callback ) {
+	// main thread
+	bool hascallback = callback.Type() == tvtObject &&
+		callback.AsObjectNoAddRef() != NULL;
+	{
+		tTJSCriticalSectionHolder cs(CommandQueueCS);
+		std::deque<tTVPFileWriteCommand*>::iterator i;
+		for( i = CommandQueue.begin(); i != CommandQueue.end(); i++ ) {
+			tTVPFileWriteCommand* cmd = *i;
+			if( cmd->localname_ == localname ) {
+				// the queued data is not written yet; only the latest one
+				// is written, and all the callbacks are called after that.
+				delete cmd->data_;
+				cmd->data_ = data;
+				if( hascallback ) cmd->callbacks_.push_back(callback);
+				return;
+			}
+		}
+
+		tTVPFileWriteCommand* cmd = new tTVPFileWriteCommand();
+		cmd->name_ = name;
+		cmd->localname_ = localname;
+		cmd->data_ = data;
+		if( hascallback ) cmd->callbacks_.push_back(callback);
+		CommandQueue.push_back(cmd);
+	}
+	PushCommandQueueEvent.Set();
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTVPAsyncWriteStream
+//---------------------------------------------------------------------------
+/*
+	memory stream which passes the whole content to the asynchronous file
+	writer when it is deleted. the callback is passed to the writer with it.
+*/
+class tTVPAsyncWriteStream : public tTJSBinaryStream
+{
+	ttstr Name;
+	ttstr LocalName;
+	tTVPMemoryStream *Data;
+	tTJSVariant Callback;
+
+public:
+	tTVPAsyncWriteStream(const ttstr &name, const ttstr &localname,
+		const tTJSVariant &callback)
+		: Name(name), LocalName(localname), Data(new tTVPMemoryStream()),
+		  Callback(callback) {}
+	~tTVPAsyncWriteStream()
+	{
+		TVPGetAsyncFileWriter()->WriteRequest(Name, LocalName, Data, Callback);
+	}
+
+	tjs_uint64 TJS_INTF_METHOD Seek(tjs_int64 offset, tjs_int whence)
+		{ return Data->Seek(offset, whence); }
+	tjs_uint TJS_INTF_METHOD Read(void *buffer, tjs_uint read_size)
+		{ return Data->Read(buffer, read_size); }
+	tjs_uint TJS_INTF_METHOD Write(const void *buffer, tjs_uint write_size)
+		{ return Data->Write(buffer, write_size); }
+	void TJS_INTF_METHOD SetEndOfStorage()
+		{ Data->SetEndOfStorage(); }
+	tjs_uint64 TJS_INTF_METHOD GetSize()
+		{ return Data->GetSize(); }
+};
+//---------------------------------------------------------------------------
+tTJSBinaryStream * TVPCreateAsyncWriteStream(const ttstr &name,
+	const tTJSVariant &callback)
+{
+	// main thread
+	ttstr normalized = TVPNormalizeStorageName(name);
+	if(normalized.IsEmpty()) return NULL;
+	ttstr localname = TVPGetLocallyAccessibleName(normalized);
+	if(localname.IsEmpty()) return NULL;
+
+	// create the folder here, as tTVPLocalFileStream does
+	const tjs_char *p = localname.c_str();
+	tjs_int i = localname.GetLen() - 1;
+	while(i >= 0 && p[i] != TJS_W('/') && p[i] != TJS_W('\\')) i--;
+	if(i > 0)
+	{
+		ttstr dirpath(p, i);
+		if(!TVPCheckExistentLocalFolder(dirpath) && !TVPCreateFolders(dirpath))
+			TVPThrowExceptionMessage(TVPCannotOpenStorage, name);
+	}
+
+	TVPClearStorageCaches();
+	return new tTVPAsyncWriteStream(normalized, localname, callback);
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+static tTVPAsyncFileWriter * TVPAsyncFileWriter = NULL;
+//---------------------------------------------------------------------------
+tTVPAsyncFileWriter * TVPGetAsyncFileWriter()
+{
+	if(!TVPAsyncFileWriter)
+	{
+		TVPAsyncFileWriter = new tTVPAsyncFileWriter();
+		TVPAsyncFileWriter->Resume();
+	}
+	return TVPAsyncFileWriter;
+}
+//---------------------------------------------------------------------------
+void TVPUninitAsyncFileWriter()
+{
+	// called before the script engine is released
+	TVPAsyncWriteCallback.Clear();
+	if(TVPAsyncFileWriter)
+	{
+		delete TVPAsyncFileWriter;
+		TVPAsyncFileWriter = NULL;
+	}
+}
+//---------------------------------------------------------------------------
+void TVPFlushAsyncFileWrite(const ttstr &localname)
+{
+	if(TVPAsyncFileWriter) TVPAsyncFileWriter->Flush(&localname);
+}
+//---------------------------------------------------------------------------
+void TVPFlushAsyncFileWrite()
+{
+	if(TVPAsyncFileWriter) TVPAsyncFileWriter->Flush(NULL);
+}
+//---------------------------------------------------------------------------
+const tTJSVariant & TVPGetAsyncWriteCallback()
+{
+	return TVPAsyncWriteCallback;
+}
+//---------------------------------------------------------------------------
+void TVPSetAsyncWriteCallback(const tTJSVariant &callback)
+{
+	TVPAsyncWriteCallback = callback;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,125 @@
+//---------------------------------------------------------------------------
+/*
+	TVP2 ( T Visual Presenter 2 )  A script authoring tool
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// Asynchronous file writing thread
+//---------------------------------------------------------------------------
+#ifndef __FILE_WRITE_THREAD_H__
+#define __FILE_WRITE_THREAD_H__
+
+#include <deque>
+#include <queue>
+#include <vector>
+#include "ThreadIntf.h"
+#include "NativeEventQueue.h"
+
+class tTVPMemoryStream;
+//---------------------------------------------------------------------------
+// tTVPFileWriteCommand
+//---------------------------------------------------------------------------
+struct tTVPFileWriteCommand {
+	// set by the main thread
+	ttstr					name_;		// storage name passed to the callbacks
+	ttstr					localname_;
+	tTVPMemoryStream*		data_;		// owned by the command
+	std::vector<tTJSVariant> callbacks_;	// never touched by the writing thread
+
+	// set by the writing thread
+	bool					failed_;
+	tTVPFileWriteCommand();
+	~tTVPFileWriteCommand();
+};
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTVPAsyncFileWriter
+//---------------------------------------------------------------------------
+/*
+	writes whole files on a background thread. each file is written into
+	a temporary file, synced and renamed over the destination, so the
+	destination always holds either the old or the new content even if
+	the process dies while writing.
+	a write request for a file which is still waiting in the queue replaces
+	the queued data, so frequent saves to the same slot do not pile up.
+	opening or removing a local file waits for its pending write (see
+	TVPFlushAsyncFileWrite), so the storage system never sees stale data.
+*/
+class tTVPAsyncFileWriter : public tTVPThread {
+	/** lock for the command queue and Writing */
+	tTJSCriticalSection CommandQueueCS;
+	/** lock for the written command queue */
+	tTJSCriticalSection WrittenQueueCS;
+
+	/** message queue to call the callbacks on the main thread */
+	NativeEventQueue<tTVPAsyncFileWriter> EventQueue;
+	/** event to tell the writing thread that a command is pushed */
+	tTVPThreadEvent PushCommandQueueEvent;
+	/** event to tell the waiting threads that a command is written */
+	tTVPThreadEvent WriteDoneEvent;
+
+	std::deque<tTVPFileWriteCommand*> CommandQueue;
+	std::queue<tTVPFileWriteCommand*> WrittenQueue;
+	tTVPFileWriteCommand* Writing;	// command being written by the thread
+
+private:
+	void SendToWriteFinish( tTVPFileWriteCommand* cmd );
+	void HandleWrittenCommand();
+
+	void WritingThread();
+	void WriteCommand( tTVPFileWriteCommand* cmd );
+	bool IsPending( const ttstr *localname );
+
+protected:
+	void Execute();
+
+public:
+	void Proc( NativeEvent& ev );
+
+public:
+	tTVPAsyncFileWriter();
+	~tTVPAsyncFileWriter();
+
+	void ExitRequest();
+
+	/**
+	 * request to write data into the local file ( main thread ).
+	 * data is owned by the writer after the call.
+	 * callback( name, is_error, error_mes ) is called on the main thread
+	 * after the file is written.
+	 */
+	void WriteRequest( const ttstr &name, const ttstr &localname,
+		tTVPMemoryStream *data, const tTJSVariant &callback );
+
+	/**
+	 * wait until the pending data of the local file is written; the file
+	 * is moved to the head of the queue. all files are flushed if
+	 * localname is NULL.
+	 */
+	void Flush( const ttstr *localname );
+};
+//---------------------------------------------------------------------------
+
+extern tTVPAsyncFileWriter * TVPGetAsyncFileWriter();
+extern void TVPUninitAsyncFileWriter();
+extern void TVPFlushAsyncFileWrite(const ttstr &localname);
+extern void TVPFlushAsyncFileWrite();
+	// these do nothing when no asynchronous write has been requested
+extern tTJSBinaryStream * TVPCreateAsyncWriteStream(const ttstr &name,
+	const tTJSVariant &callback = tTJSVariant());
+	// returns NULL if the storage is not a local file.
+	// callback( name, is_error, error_mes ) is called on the main thread
+	// after the stream is deleted and its content is written.
+extern const tTJSVariant & TVPGetAsyncWriteCallback();
+extern void TVPSetAsyncWriteCallback(const tTJSVariant &callback);
+	// the callback of the streams opened with 'a' mode
+	// ( Storages.asyncWriteCallback ); a failure is logged if this is void.
+extern bool TVPWriteFileAtomically(const ttstr &localname, const void *data,
+	tjs_uint size);
+
+#endif // __FILE_WRITE_THREAD_H__
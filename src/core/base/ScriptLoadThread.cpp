@@ -0,0 +1,287 @@
+//---------------------------------------------------------------------------
+/*
+	TVP2 ( T Visual Presenter 2 )  A script authoring tool
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// Asynchronous script loading thread
+//---------------------------------------------------------------------------
+#include "tjsCommHead.h"
+
+#include "ScriptLoadThread.h"
+#include "ScriptMgnIntf.h"
+#include "ThreadIntf.h"
+#include "NativeEventQueue.h"
+#include "UserEvent.h"
+#include "StorageIntf.h"
+#include "BinaryStream.h"
+#include "TextStream.h"
+#include "MsgIntf.h"
+#include "UtilStreams.h"
+#include "tjsScriptBlock.h"
+#include "tjsByteCodeLoader.h"
+#include "tjsBinarySerializer.h"
+
+//---------------------------------------------------------------------------
+tTVPScriptLoadCommand::tTVPScriptLoadCommand()
+	: context_(NULL), usecache_(false), cachechecked_(false) {}
+tTVPScriptLoadCommand::~tTVPScriptLoadCommand() {
+	if( context_ ) {
+		context_->Release();
+		context_ = NULL;
+	}
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTVPAsyncScriptLoader
+//---------------------------------------------------------------------------
+tTVPAsyncScriptLoader::tTVPAsyncScriptLoader()
+: EventQueue(this,&tTVPAsyncScriptLoader::Proc), tTVPThread(true)
+{
+	EventQueue.Allocate();
+}
+tTVPAsyncScriptLoader::~tTVPAsyncScriptLoader() {
+	ExitRequest();
+	WaitFor();
+	EventQueue.Clear();
+	EventQueue.Deallocate();
+	while( CommandQueue.size() > 0 ) {
+		tTVPScriptLoadCommand* cmd = CommandQueue.front();
+		CommandQueue.pop();
+		delete cmd;
+	}
+	while( LoadedQueue.size() > 0 ) {
+		tTVPScriptLoadCommand* cmd = LoadedQueue.front();
+		LoadedQueue.pop();
+		delete cmd;
+	}
+}
+void tTVPAsyncScriptLoader::ExitRequest() {
+	Terminate();
+	PushCommandQueueEvent.Set();
+}
+void tTVPAsyncScriptLoader::Execute() {
+	SetPriority(ttpLower);
+	LoadingThread();
+}
+void tTVPAsyncScriptLoader::SendToLoadFinish() {
+	NativeEvent ev(TVP_EV_SCRIPT_LOAD_THREAD);
+	EventQueue.PostEvent(ev);
+}
+void tTVPAsyncScriptLoader::Proc( NativeEvent& ev )
+{
+	if(ev.Message != TVP_EV_SCRIPT_LOAD_THREAD) {
+		EventQueue.HandlerDefault(ev);
+		return;
+	}
+	HandleLoadedScript();
+}
+//---------------------------------------------------------------------------
+void tTVPAsyncScriptLoader::HandleLoadedScript() {
+	bool loading;
+	do {
+		loading = false;
+		tTVPScriptLoadCommand* cmd = NULL;
+		{
+			tTJSCriticalSectionHolder cs(LoadedQueueCS);
+			if( LoadedQueue.size() > 0 ) {
+				cmd = LoadedQueue.front();
+				LoadedQueue.pop();
+				loading = true;
+			}
+		}
+		if( cmd != NULL ) {
+			try {
+				try {
+					bool hascallback = cmd->callback_.Type() == tvtObject &&
+						cmd->callback_.AsObjectNoAddRef() != NULL;
+					tTJSVariant result;
+					ttstr message = cmd->result_;
+					if( !hascallback ) {
+						// errors are shown as unhandled exceptions
+						if( !message.IsEmpty() ) TVPThrowExceptionMessage(message.c_str());
+						ExecuteLoadedScript( cmd, &result );
+					} else {
+						if( message.IsEmpty() ) {
+							try {
+								try {
+									ExecuteLoadedScript( cmd, &result );
+								}
+								TJS_CONVERT_TO_TJS_EXCEPTION
+							} catch(eTJS &e) {
+								result.Clear();
+								message = e.GetMessage();
+							}
+						}
+
+						tTJSVariant param[3];
+						param[0] = result;
+						param[1] = message.IsEmpty() ? 0 : 1; // is_error
+						param[2] = message; // error_mes
+						tTJSVariant *pparam[3] = { param, param+1, param+2 };
+						cmd->callback_.AsObjectClosureNoAddRef().FuncCall(0, NULL, NULL,
+							NULL, 3, pparam, NULL);
+					}
+				}
+				TJS_CONVERT_TO_TJS_EXCEPTION
+			}
+			TVP_CATCH_AND_SHOW_SCRIPT_EXCEPTION(TJS_W("async script"));
+			delete cmd;
+		}
+	} while(loading);
+}
+//---------------------------------------------------------------------------
+void tTVPAsyncScriptLoader::ExecuteLoadedScript( tTVPScriptLoadCommand* cmd, tTJSVariant *result ) {
+	// main thread
+	tTJS *engine = TVPGetScriptEngine();
+	if( !engine ) TVPThrowInternalError;
+
+	if( cmd->binary_.size() > 0 && !cmd->script_.IsEmpty() ) {
+		// bytecode read from the cache; the script text gives its line numbers
+		engine->LoadByteCode( &cmd->binary_[0], cmd->binary_.size(), result,
+			cmd->context_, cmd->shortname_.c_str(), cmd->script_.c_str() );
+		return;
+	}
+	if( cmd->binary_.size() > 0 ) {
+		// bytecode or binary dictionary/array read from the storage
+		tTVPMemoryStream stream( &cmd->binary_[0], (tjs_uint)cmd->binary_.size() );
+		// binary dictionary/array is ignored when the result is not needed
+		engine->LoadByteCode( &stream, result, cmd->context_, cmd->shortname_.c_str() );
+		return;
+	}
+
+	TVPExecuteStorageText( cmd->script_, cmd->shortname_, cmd->context_, result,
+		false, cmd->cachechecked_ );
+}
+//---------------------------------------------------------------------------
+void tTVPAsyncScriptLoader::LoadingThread() {
+	while( !GetTerminated() ) {
+		bool loading;
+		do {
+			loading = false;
+			tTVPScriptLoadCommand* cmd = NULL;
+
+			{ // Lock
+				tTJSCriticalSectionHolder cs(CommandQueueCS);
+				if( CommandQueue.size() ) {
+					cmd = CommandQueue.front();
+					CommandQueue.pop();
+				}
+			}
+			if( cmd ) {
+				loading = true;
+				LoadScriptFromCommand(cmd);
+				{	// Lock
+					tTJSCriticalSectionHolder cs(LoadedQueueCS);
+					LoadedQueue.push(cmd);
+				}
+				// Send to message
+				SendToLoadFinish();
+			}
+		} while( loading && !GetTerminated() );
+		if( GetTerminated() ) break;
+
+		// wait for the next command
+		PushCommandQueueEvent.WaitFor(-1);
+	}
+}
+//---------------------------------------------------------------------------
+void tTVPAsyncScriptLoader::LoadScriptFromCommand( tTVPScriptLoadCommand* cmd ) {
+	// loading thread; this must not touch the script engine
+	try {
+		tTJSBinaryStream* stream = TVPCreateBinaryStreamForRead(cmd->place_, cmd->modestr_);
+		if( stream ) {
+			try {
+				tjs_uint64 size = stream->GetSize();
+				if( size >= tTJSScriptBlock::BYTECODE_FILE_TAG_SIZE ) {
+					tjs_uint8 header[tTJSScriptBlock::BYTECODE_FILE_TAG_SIZE];
+					stream->ReadBuffer( header, tTJSScriptBlock::BYTECODE_FILE_TAG_SIZE );
+					if( tTJSByteCodeLoader::IsTJS2ByteCode( header ) ||
+						tTJSBinarySerializer::IsBinary( header ) ) {
+						stream->SetPosition( 0 );
+						cmd->binary_.resize( (tjs_uint)size );
+						stream->ReadBuffer( &cmd->binary_[0], (tjs_uint)size );
+					}
+				}
+			} catch(...) {
+				delete stream;
+				throw;
+			}
+			delete stream;
+			if( cmd->binary_.size() > 0 ) return;
+		}
+
+		iTJSTextReadStream * tstream = TVPCreateTextStreamForRead(cmd->place_, cmd->modestr_);
+		try {
+			tstream->Read(cmd->script_, 0);
+		} catch(...) {
+			tstream->Destruct();
+			throw;
+		}
+		tstream->Destruct();
+
+		if( cmd->usecache_ ) {
+			// the result is always requested, see HandleLoadedScript
+			if( !TVPReadScriptCache(cmd->script_, true, cmd->binary_) )
+				cmd->cachechecked_ = true;
+		}
+	} catch(eTJS &e) {
+		cmd->binary_.clear();
+		cmd->result_ = e.GetMessage();
+	} catch(...) {
+		cmd->binary_.clear();
+		cmd->result_ = TVPFormatMessage(TVPCannotOpenStorage, cmd->place_);
+	}
+}
+//---------------------------------------------------------------------------
+void tTVPAsyncScriptLoader::LoadRequest( const ttstr &name, const tTJSVariant &callback,
+	const ttstr &modestr, iTJSDispatch2 *context ) {
+	// main thread; missing storage is reported immediately
+	ttstr place(TVPSearchPlacedPath(name));
+
+	tTVPScriptLoadCommand* cmd = new tTVPScriptLoadCommand();
+	cmd->place_ = place;
+	cmd->shortname_ = TVPExtractStorageName(place);
+	cmd->modestr_ = modestr;
+	cmd->callback_ = callback;
+	cmd->context_ = context;
+	if( context ) context->AddRef();
+	cmd->usecache_ = TVPIsScriptCacheEnabled();
+	{
+		tTJSCriticalSectionHolder cs(CommandQueueCS);
+		CommandQueue.push(cmd);
+	}
+	PushCommandQueueEvent.Set();
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+static tTVPAsyncScriptLoader * TVPAsyncScriptLoader = NULL;
+//---------------------------------------------------------------------------
+tTVPAsyncScriptLoader * TVPGetAsyncScriptLoader()
+{
+	if(!TVPAsyncScriptLoader)
+	{
+		TVPAsyncScriptLoader = new tTVPAsyncScriptLoader();
+		TVPAsyncScriptLoader->Resume();
+	}
+	return TVPAsyncScriptLoader;
+}
+//---------------------------------------------------------------------------
+void TVPUninitAsyncScriptLoader()
+{
+	// called before the script engine is released
+	if(TVPAsyncScriptLoader)
+	{
+		delete TVPAsyncScriptLoader;
+		TVPAsyncScriptLoader = NULL;
+	}
+}
+//---------------------------------------------------------------------------
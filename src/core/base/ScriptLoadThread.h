@@ -0,0 +1,102 @@
+//---------------------------------------------------------------------------
+/*
+	TVP2 ( T Visual Presenter 2 )  A script authoring tool
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// Asynchronous script loading thread
+//---------------------------------------------------------------------------
+#ifndef __SCRIPT_LOAD_THREAD_H__
+#define __SCRIPT_LOAD_THREAD_H__
+
+#include <queue>
+#include <vector>
+#include "ThreadIntf.h"
+#include "NativeEventQueue.h"
+
+//---------------------------------------------------------------------------
+// tTVPScriptLoadCommand
+//---------------------------------------------------------------------------
+struct tTVPScriptLoadCommand {
+	// set by the main thread
+	ttstr					place_;
+	ttstr					shortname_;
+	ttstr					modestr_;
+	tTJSVariant				callback_;	// never touched by the loading thread
+	iTJSDispatch2*			context_;
+	bool					usecache_;
+
+	// set by the loading thread
+	std::vector<tjs_uint8>	binary_;	// bytecode or binary dictionary/array
+	ttstr					script_;	// decoded script text
+	bool					cachechecked_;
+	ttstr					result_;	// error message
+	tTVPScriptLoadCommand();
+	~tTVPScriptLoadCommand();
+};
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTVPAsyncScriptLoader
+//---------------------------------------------------------------------------
+/*
+	reads, decrypts and decodes script storages on a background thread, and
+	executes them on the main thread in the order of the requests.
+	the script engine itself is not thread safe (reference counters of the
+	objects, the global string map and the object created by the compiler
+	are not guarded), so compiling is done on the main thread; when the
+	bytecode cache is enabled, the cached bytecode is also read on the
+	loading thread and the main thread does not need to compile at all.
+*/
+class tTVPAsyncScriptLoader : public tTVPThread {
+	/** lock for the command queue */
+	tTJSCriticalSection CommandQueueCS;
+	/** lock for the loaded script queue */
+	tTJSCriticalSection LoadedQueueCS;
+
+	/** message queue to process loaded scripts on the main thread */
+	NativeEventQueue<tTVPAsyncScriptLoader> EventQueue;
+	/** event to tell the loading thread that a command is pushed */
+	tTVPThreadEvent PushCommandQueueEvent;
+
+	std::queue<tTVPScriptLoadCommand*> CommandQueue;
+	std::queue<tTVPScriptLoadCommand*> LoadedQueue;
+
+private:
+	void SendToLoadFinish();
+	void HandleLoadedScript();
+	void ExecuteLoadedScript( tTVPScriptLoadCommand* cmd, tTJSVariant *result );
+
+	void LoadingThread();
+	void LoadScriptFromCommand( tTVPScriptLoadCommand* cmd );
+
+protected:
+	void Execute();
+
+public:
+	void Proc( NativeEvent& ev );
+
+public:
+	tTVPAsyncScriptLoader();
+	~tTVPAsyncScriptLoader();
+
+	void ExitRequest();
+
+	/**
+	 * request to load the storage ( main thread ).
+	 * callback( result, is_error, error_mes ) is called on the main thread
+	 * after the script is executed.
+	 */
+	void LoadRequest( const ttstr &name, const tTJSVariant &callback,
+		const ttstr &modestr, iTJSDispatch2 *context );
+};
+//---------------------------------------------------------------------------
+
+extern tTVPAsyncScriptLoader * TVPGetAsyncScriptLoader();
+extern void TVPUninitAsyncScriptLoader();
+
+#endif // __SCRIPT_LOAD_THREAD_H__
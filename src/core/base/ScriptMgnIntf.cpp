@@ -13,6 +13,8 @@
 
 #include "tjs.h"
 #include "tjsDebug.h"
+#include "tjsCycleCollector.h"
+#include "tjsObjectPool.h"
 #include "tjsArray.h"
 #include "ScriptMgnIntf.h"
 #include "StorageIntf.h"
@@ -47,11 +49,17 @@
 #include "ImageFunction.h"
 #include "BitmapIntf.h"
 #include "tjsScriptBlock.h"
+#include "tjsByteCodeLoader.h"
+#include "tjsRegExp.h"
 #include "ApplicationSpecialPath.h"
 #include "SystemImpl.h"
 #include "BitmapLayerTreeOwner.h"
+#include "ScriptLoadThread.h"
+#include "FileWriteThread.h"
 #include "Extension.h"
 #include "Platform.h"
+#include "UtilStreams.h"
+#include "md5.h"
 
 //---------------------------------------------------------------------------
 // Script system initialization script
@@ -378,6 +386,9 @@ ttstr TVPStartupScriptName(TJS_W("startup.tjs"));
 //---------------------------------------------------------------------------
 // Garbage Collection stuff
 //---------------------------------------------------------------------------
+static const tjs_uint TVPCycleCollectorIdleBudget = 5; // in ms
+	// the cycle collector stops after this while the application is in use
+//---------------------------------------------------------------------------
 class tTVPTJSGCCallback : public tTVPCompactEventCallbackIntf
 {
 	void TJS_INTF_METHOD OnCompact(tjs_int level)
@@ -388,6 +399,9 @@ class tTVPTJSGCCallback : public tTVPCompactEventCallbackIntf
 		{
 			if(level >= TVP_COMPACT_LEVEL_IDLE)
 			{
+				// the remaining candidates are processed on the next event
+				TJSCollectCycles(level >= TVP_COMPACT_LEVEL_DEACTIVATE ?
+					0 : TVPCycleCollectorIdleBudget);
 				TVPScriptEngine->DoGarbageCollection();
 			}
 		}
@@ -447,6 +461,22 @@ void TVPInitScriptEngine()
 //			}
 		}
 	}
+
+	// Start script profiler
+	if(TVPGetCommandLine(TJS_W("-profile"), &val) )
+	{
+		ttstr str(val);
+		if(str == TJS_W("yes"))
+			TVPStartScriptProfile(0);
+	}
+
+	// Enable the reference cycle collector
+	if(TVPGetCommandLine(TJS_W("-cyclegc"), &val) )
+	{
+		ttstr str(val);
+		if(str == TJS_W("yes"))
+			TJSSetCycleCollectorEnabled(true);
+	}
 	// Set Read text encoding
 #if 0
 	if(TVPGetCommandLine(TJS_W("-readencoding"), &val) )
@@ -568,6 +598,19 @@ void TVPUninitScriptEngine()
 	if(TVPScriptEngineUninit) return;
 	TVPScriptEngineUninit = true;
 
+	TVPUninitAsyncScriptLoader();
+	TVPUninitAsyncFileWriter();
+
+	// write the profile which is still running
+	try
+	{
+		TVPStopScriptProfile(ttstr());
+	}
+	catch(...)
+	{
+		// ignore errors
+	}
+
 	//TVPScriptEngine->Shutdown();
 	TVPScriptEngine->Release();
 	/*
@@ -575,6 +618,9 @@ void TVPUninitScriptEngine()
 		freed here in some occations.
 	*/
 	TVPScriptEngine = NULL;
+
+	// forget the candidates which are still alive
+	TJSSetCycleCollectorEnabled(false);
 }
 //---------------------------------------------------------------------------
 
@@ -727,6 +773,290 @@ void TVPExecuteBytecode( const tjs_uint8* content, size_t len, iTJSDispatch2 *co
 //---------------------------------------------------------------------------
 
 
+//---------------------------------------------------------------------------
+// bytecode cache for TVPExecuteStorage
+//---------------------------------------------------------------------------
+/*
+	when "-scriptcache=yes" is specified, the bytecode compiled from a script
+	storage is stored in "scriptcache" folder under the data path, and is
+	used instead of compiling the script again at the next time.
+	the cache file is named after the MD5 digest of the script text, the
+	engine version and the compile options, so any change of them results
+	in a different cache file. the bytecode keeps the source positions, and
+	the script text is given to the loaded script block, so the errors
+	report the same line numbers as the scripts compiled from the text.
+	the cache is not used in debug mode.
+*/
+static tjs_int TVPScriptCacheOptionsGeneration = 0;
+static bool TVPScriptCacheEnabled = false;
+static const tjs_uint8 TVPScriptCacheTag[8] =
+	{ 'T', 'V', 'P', 'S', 'C', '1', '1', '0' };
+static const tjs_uint TVPScriptCacheHeaderSize = 8 + 16 + 4;
+	// tag + digest + bytecode size
+//---------------------------------------------------------------------------
+static void TVPInitScriptCacheOptions()
+{
+	if(TVPScriptCacheOptionsGeneration == TVPGetCommandLineArgumentGeneration()) return;
+	TVPScriptCacheOptionsGeneration = TVPGetCommandLineArgumentGeneration();
+
+	tTJSVariant val;
+	TVPScriptCacheEnabled = false;
+	if(TVPGetCommandLine(TJS_W("-scriptcache"), &val))
+	{
+		ttstr str(val);
+		if(str == TJS_W("yes"))
+			TVPScriptCacheEnabled = true;
+	}
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// script profiler
+//---------------------------------------------------------------------------
+static const tjs_int TVPScriptProfileDefaultInterval = 1; // in ms
+//---------------------------------------------------------------------------
+void TVPStartScriptProfile(tjs_int interval)
+{
+	if(interval <= 0) interval = TVPScriptProfileDefaultInterval;
+	TJSStartProfiler(interval);
+}
+//---------------------------------------------------------------------------
+tjs_uint TVPStopScriptProfile(const ttstr &storage)
+{
+	// stops the profiler and writes the samples in collapsed stack format.
+	// the samples are written to "profile.txt" in the data directory when
+	// storage is empty.
+	if(!TJSProfilerEnabled()) return 0;
+
+	ttstr name(storage);
+	if(name.IsEmpty())
+	{
+		TVPEnsureDataPathDirectory();
+		name = TVPDataPath + TJS_W("profile.txt");
+	}
+	return TJSStopProfiler(name);
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+static void TVPMakeScriptCacheDigest(const ttstr &script, bool isresultneeded,
+	md5_byte_t digest[16])
+{
+	md5_state_t state;
+	md5_init(&state);
+
+	// engine version and compile options
+	tjs_int32 options[6];
+	options[0] = TJSVersionHex;
+	options[1] = (tjs_int32)sizeof(tjs_char);
+	options[2] = isresultneeded;
+	options[3] = TJSEnableCodeOptimization;
+	options[4] = TJSUnaryAsteriskIgnoresPropAccess;
+	options[5] = TJSEvalOperatorIsOnGlobal;
+	md5_append(&state, (const md5_byte_t *)options, sizeof(options));
+	md5_append(&state, (const md5_byte_t *)TJSCompiledDate,
+		(int)(TJS_strlen(TJSCompiledDate) * sizeof(tjs_char)));
+
+	// script text
+	md5_append(&state, (const md5_byte_t *)script.c_str(),
+		(int)(script.GetLen() * sizeof(tjs_char)));
+
+	md5_finish(&state, digest);
+}
+//---------------------------------------------------------------------------
+static ttstr TVPGetScriptCacheFileName(const md5_byte_t digest[16])
+{
+	static const tjs_char hex[] = TJS_W("0123456789abcdef");
+	tjs_char name[33];
+	for(tjs_int i = 0; i < 16; i++)
+	{
+		name[i*2  ] = hex[digest[i] >> 4];
+		name[i*2+1] = hex[digest[i] & 0x0f];
+	}
+	name[32] = 0;
+	return ttstr(name) + TJS_W(".tjc");
+}
+//---------------------------------------------------------------------------
+static bool TVPLoadScriptCache(const ttstr &filename, const md5_byte_t digest[16],
+	std::vector<tjs_uint8> &bytecode)
+{
+	// read the cache file; returns false if the file does not exist or is
+	// not valid
+	ttstr storage = TVPDataPath + TJS_W("scriptcache/") + filename;
+	try
+	{
+		if(!TVPIsExistentStorageNoSearch(storage)) return false;
+
+		tTJSBinaryStream *stream = TVPCreateStream(storage, TJS_BS_READ);
+		try
+		{
+			tjs_uint64 size = stream->GetSize();
+			tjs_uint8 header[TVPScriptCacheHeaderSize];
+			if(size < TVPScriptCacheHeaderSize ||
+				stream->Read(header, TVPScriptCacheHeaderSize) !=
+					TVPScriptCacheHeaderSize ||
+				memcmp(header, TVPScriptCacheTag, 8) ||
+				memcmp(header + 8, digest, 16))
+			{
+				delete stream;
+				return false;
+			}
+			tjs_uint len = header[24] + (header[25] << 8) + (header[26] << 16) +
+				(header[27] << 24);
+			if(len == 0 || size != TVPScriptCacheHeaderSize + (tjs_uint64)len)
+			{
+				delete stream;
+				return false;
+			}
+			bytecode.resize(len);
+			if(stream->Read(&bytecode[0], len) != len)
+			{
+				delete stream;
+				return false;
+			}
+		}
+		catch(...)
+		{
+			delete stream;
+			throw;
+		}
+		delete stream;
+	}
+	catch(...)
+	{
+		return false;
+	}
+
+	return tTJSByteCodeLoader::IsTJS2ByteCode(&bytecode[0]);
+}
+//---------------------------------------------------------------------------
+static void TVPSaveScriptCache(const ttstr &filename, const md5_byte_t digest[16],
+	const tjs_uint8 *bytecode, tjs_uint len)
+{
+	// write the cache into a temporary file, and then rename it;
+	// the cache file is never seen partially written.
+	// failures are silently ignored.
+	try
+	{
+		TVPEnsureDataPathDirectory();
+		ttstr nativedir = TVPNativeDataPath + TJS_W("scriptcache/");
+		if(!TVPCheckExistentLocalFolder(nativedir))
+			TVPCreateFolders(nativedir);
+
+		ttstr tmpname = filename + TJS_W(".tmp");
+		tTJSBinaryStream *stream = TVPCreateStream(
+			TVPDataPath + TJS_W("scriptcache/") + tmpname, TJS_BS_WRITE);
+		bool ok;
+		try
+		{
+			tjs_uint8 header[TVPScriptCacheHeaderSize];
+			memcpy(header, TVPScriptCacheTag, 8);
+			memcpy(header + 8, digest, 16);
+			header[24] = (tjs_uint8)(len      );
+			header[25] = (tjs_uint8)(len >>  8);
+			header[26] = (tjs_uint8)(len >> 16);
+			header[27] = (tjs_uint8)(len >> 24);
+			ok = stream->Write(header, TVPScriptCacheHeaderSize) ==
+					TVPScriptCacheHeaderSize &&
+				stream->Write(bytecode, len) == len;
+		}
+		catch(...)
+		{
+			delete stream;
+			throw;
+		}
+		delete stream;
+
+		if(ok)
+		{
+			TVPRemoveFile(nativedir + filename);
+			ok = TVPRenameFile(nativedir + tmpname, nativedir + filename);
+		}
+		if(!ok) TVPRemoveFile(nativedir + tmpname);
+	}
+	catch(...)
+	{
+	}
+}
+//---------------------------------------------------------------------------
+bool TVPIsScriptCacheEnabled()
+{
+	TVPInitScriptCacheOptions();
+	return TVPScriptCacheEnabled && !TJSEnableDebugMode;
+}
+//---------------------------------------------------------------------------
+bool TVPReadScriptCache(const ttstr &script, bool isresultneeded,
+	std::vector<tjs_uint8> &bytecode)
+{
+	// read the cached bytecode of the script; this does not touch the
+	// script engine, so this can be called from the script loading thread.
+	md5_byte_t digest[16];
+	TVPMakeScriptCacheDigest(script, isresultneeded, digest);
+	if(TVPLoadScriptCache(TVPGetScriptCacheFileName(digest), digest, bytecode))
+		return true;
+	bytecode.clear();
+	return false;
+}
+//---------------------------------------------------------------------------
+static bool TVPExecuteStorageWithCache(const ttstr &script, const ttstr &shortname,
+	iTJSDispatch2 *context, tTJSVariant *result, bool cachechecked)
+{
+	// execute the script through the bytecode cache.
+	// returns false if the script should be executed normally.
+	// cachechecked is true if the caller already knows that the cache
+	// does not exist.
+	md5_byte_t digest[16];
+	TVPMakeScriptCacheDigest(script, result != NULL, digest);
+	ttstr filename = TVPGetScriptCacheFileName(digest);
+
+	std::vector<tjs_uint8> bytecode;
+	if(cachechecked || !TVPLoadScriptCache(filename, digest, bytecode))
+	{
+		// compile the script and store the bytecode
+		tTVPMemoryStream stream;
+		try
+		{
+			TVPScriptEngine->CompileScript(script.c_str(), &stream,
+				result != NULL, true, false, shortname.c_str(), 0);
+		}
+		catch(...)
+		{
+			// let the normal execution report the error
+			return false;
+		}
+		if(stream.GetSize() < tTJSScriptBlock::BYTECODE_FILE_TAG_SIZE) return false;
+		const tjs_uint8 *p = (const tjs_uint8 *)stream.GetInternalBuffer();
+		bytecode.assign(p, p + (tjs_uint)stream.GetSize());
+		TVPSaveScriptCache(filename, digest, &bytecode[0], (tjs_uint)bytecode.size());
+	}
+
+	TVPScriptEngine->LoadByteCode(&bytecode[0], bytecode.size(), result, context,
+		shortname.c_str(), script.c_str());
+	return true;
+}
+//---------------------------------------------------------------------------
+void TVPExecuteStorageText(const ttstr &script, const ttstr &shortname,
+	iTJSDispatch2 *context, tTJSVariant *result, bool isexpression,
+	bool cachechecked)
+{
+	// execute the script text read from the storage
+	if(!TVPScriptEngine) TVPThrowInternalError;
+
+	if(!isexpression && TVPIsScriptCacheEnabled() &&
+		TVPExecuteStorageWithCache(script, shortname, context, result, cachechecked))
+		return;
+
+	if(!isexpression)
+		TVPScriptEngine->ExecScript(script, result, context,
+			&shortname);
+	else
+		TVPScriptEngine->EvalExpression(script, result, context,
+			&shortname);
+}
 //---------------------------------------------------------------------------
 void TVPExecuteStorage(const ttstr &name, tTJSVariant *result, bool isexpression,
 	const tjs_char * modestr)
@@ -774,14 +1104,7 @@ void TVPExecuteStorage(const ttstr &name, iTJSDispatch2 *context, tTJSVariant *r
 	stream->Destruct();
 
 	if(TVPScriptEngine)
-	{
-		if(!isexpression)
-			TVPScriptEngine->ExecScript(buffer, result, context,
-				&shortname);
-		else
-			TVPScriptEngine->EvalExpression(buffer, result, context,
-				&shortname);
-	}
+		TVPExecuteStorageText(buffer, shortname, context, result, isexpression);
 }
 //---------------------------------------------------------------------------
 void TVPCompileStorage( const ttstr& name, bool isrequestresult, bool outputdebug, bool isexpression, const ttstr& outputpath ) {
@@ -1338,6 +1661,31 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/compileStorage) // bytecode
 }
 TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/compileStorage)
 //----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/compileStorageAsync)
+{
+	// read and decode the storage on the script loading thread, and
+	// execute it later on the main thread.
+	// callback( result, is_error, error_mes ) is called after the execution.
+	if(numparams < 1) return TJS_E_BADPARAMCOUNT;
+
+	ttstr name = *param[0];
+
+	tTJSVariant callback;
+	if(numparams >= 2 && param[1]->Type() != tvtVoid)
+		callback = *param[1];
+
+	ttstr modestr;
+	if(numparams >= 3 && param[2]->Type() != tvtVoid)
+		modestr = *param[2];
+
+	iTJSDispatch2 *context = numparams >= 4 && param[3]->Type() != tvtVoid ? param[3]->AsObjectNoAddRef() : NULL;
+
+	TVPGetAsyncScriptLoader()->LoadRequest(name, callback, modestr, context);
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/compileStorageAsync)
+//----------------------------------------------------------------------
 TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/exec)
 {
 	// execute given string as a script
@@ -1423,6 +1771,109 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/dumpStringHeap)
 TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/dumpStringHeap)
 #endif
 //----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/getStringHeapStatistics)
+{
+	// get the counters of the TJS2 string heap as a dictionary
+	if(!result) return TJS_S_OK;
+
+	tTJSStringHeapStatistics stat;
+	TJSGetStringHeapStatistics(stat);
+
+	iTJSDispatch2 * dic = TJSCreateDictionaryObject();
+	try
+	{
+		tTJSVariant val;
+		val = (tjs_int64)stat.AllocCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("allocations"), NULL, &val, dic);
+		val = (tjs_int64)stat.FreeCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("frees"), NULL, &val, dic);
+		val = (tjs_int64)stat.ContentionCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("contentions"), NULL, &val, dic);
+		val = (tjs_int64)stat.CellCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("cells"), NULL, &val, dic);
+		val = (tjs_int64)stat.BlockCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("blocks"), NULL, &val, dic);
+		*result = tTJSVariant(dic, dic);
+	}
+	catch(...)
+	{
+		dic->Release();
+		throw;
+	}
+	dic->Release();
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/getStringHeapStatistics)
+//----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/getObjectPoolStatistics)
+{
+	// get the counters of the TJS2 object pool as a dictionary
+	if(!result) return TJS_S_OK;
+
+	tTJSObjectPoolStatistics stat;
+	TJSGetObjectPoolStatistics(stat);
+
+	iTJSDispatch2 * dic = TJSCreateDictionaryObject();
+	try
+	{
+		tTJSVariant val;
+		val = (tjs_int64)stat.AllocCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("allocations"), NULL, &val, dic);
+		val = (tjs_int64)stat.ReuseCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("reuses"), NULL, &val, dic);
+		val = (tjs_int64)stat.FreeCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("frees"), NULL, &val, dic);
+		val = (tjs_int64)stat.PooledBytes;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("pooledBytes"), NULL, &val, dic);
+		*result = tTJSVariant(dic, dic);
+	}
+	catch(...)
+	{
+		dic->Release();
+		throw;
+	}
+	dic->Release();
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/getObjectPoolStatistics)
+//----------------------------------------------------------------------
+#ifndef TJS_NO_REGEXP
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/getRegExpCacheStatistics)
+{
+	// get the counters of the compiled regular expression cache
+	if(!result) return TJS_S_OK;
+
+	tTJSRegExpCacheStatistics stat;
+	TJSGetRegExpCacheStatistics(stat);
+
+	iTJSDispatch2 * dic = TJSCreateDictionaryObject();
+	try
+	{
+		tTJSVariant val;
+		val = (tjs_int64)stat.HitCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("hits"), NULL, &val, dic);
+		val = (tjs_int64)stat.MissCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("misses"), NULL, &val, dic);
+		val = (tjs_int64)stat.Count;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("count"), NULL, &val, dic);
+		val = (tjs_int64)stat.MaxCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("maxCount"), NULL, &val, dic);
+		*result = tTJSVariant(dic, dic);
+	}
+	catch(...)
+	{
+		dic->Release();
+		throw;
+	}
+	dic->Release();
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/getRegExpCacheStatistics)
+#endif
+//----------------------------------------------------------------------
 TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/setCallMissing) /* UNDOCUMENTED: subject to change */
 {
 	// set to call "missing" method
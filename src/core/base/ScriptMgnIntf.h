@@ -11,6 +11,7 @@
 #ifndef ScriptMgnImtfH
 #define ScriptMgnImtfH
 
+#include <vector>
 #include "tjs.h"
 
 #include "tjsNative.h"
@@ -43,6 +44,15 @@ TJS_EXP_FUNC_DEF(void, TVPDumpScriptEngine, ());
 
 TJS_EXP_FUNC_DEF(void, TVPExecuteBytecode, (const tjs_uint8* content, size_t len, iTJSDispatch2 *context, tTJSVariant *result = NULL, const tjs_char *name = NULL ));
 
+extern void TVPExecuteStorageText(const ttstr &script, const ttstr &shortname,
+	iTJSDispatch2 *context, tTJSVariant *result, bool isexpression,
+	bool cachechecked = false);
+extern bool TVPIsScriptCacheEnabled();
+extern void TVPStartScriptProfile(tjs_int interval);
+extern tjs_uint TVPStopScriptProfile(const ttstr &storage);
+extern bool TVPReadScriptCache(const ttstr &script, bool isresultneeded,
+	std::vector<tjs_uint8> &bytecode);
+
 extern void TVPExecuteStartupScript();
 TJS_EXP_FUNC_DEF(void, TVPCreateMessageMapFile, (const ttstr &filename));
 
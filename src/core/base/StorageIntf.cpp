@@ -22,6 +22,7 @@
 #include "SysInitIntf.h"
 #include "XP3Archive.h"
 #include "TickCount.h"
+#include "FileWriteThread.h"
 
 
 
@@ -1489,6 +1490,87 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/clearArchiveCache)
 	return TJS_S_OK;
 }
 TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/clearArchiveCache)
+//----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/flushAsyncWrite)
+{
+	// wait until the storage written with 'a' mode is written.
+	// all pending storages are flushed if the name is omitted.
+	if(numparams >= 1 && param[0]->Type() != tvtVoid)
+	{
+		ttstr localname = TVPGetLocallyAccessibleName(
+			TVPNormalizeStorageName(*param[0]));
+		if(!localname.IsEmpty()) TVPFlushAsyncFileWrite(localname);
+	}
+	else
+	{
+		TVPFlushAsyncFileWrite();
+	}
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/flushAsyncWrite)
+//----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/writeAsync)
+{
+	// writeAsync(name, data, callback = void)
+	// writes an octet as is, or a string in the same format as the text
+	// stream ( UTF-16LE with BOM ), on the asynchronous file writer.
+	// callback( name, is_error, error_mes ) is called after written.
+	if(numparams < 2) return TJS_E_BADPARAMCOUNT;
+
+	ttstr name = *param[0];
+	std::vector<tjs_uint8> buf;
+	if(param[1]->Type() == tvtOctet)
+	{
+		tTJSVariantOctet *oct = param[1]->AsOctetNoAddRef();
+		if(oct) buf.assign(oct->GetData(), oct->GetData() + oct->GetLength());
+	}
+	else
+	{
+		ttstr str = *param[1];
+		const tjs_char *p = str.c_str();
+		tjs_int len = str.GetLen();
+		buf.reserve(2 + len * 2);
+		buf.push_back(0xff);
+		buf.push_back(0xfe);
+		for(tjs_int i = 0; i < len; i++)
+		{
+			tjs_uint c = (tjs_uint)p[i];
+			if(c >= 0x10000) c = '?';
+			buf.push_back((tjs_uint8)(c & 0xff));
+			buf.push_back((tjs_uint8)(c >> 8));
+		}
+	}
+
+	tTJSVariant callback;
+	if(numparams >= 3) callback = *param[2];
+
+	tTJSBinaryStream *stream = TVPCreateAsyncWriteStream(name, callback);
+	if(!stream) TVPThrowExceptionMessage(TVPCannotOpenStorage, name);
+	if(!buf.empty()) stream->Write(&buf[0], (tjs_uint)buf.size());
+	delete stream; // passes the content to the writer
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/writeAsync)
+//----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_PROP_DECL(asyncWriteCallback)
+{
+	// callback( name, is_error, error_mes ) for the files which are saved
+	// with 'a' in the mode string ( saveStruct, Array.save and so on )
+	TJS_BEGIN_NATIVE_PROP_GETTER
+	{
+		*result = TVPGetAsyncWriteCallback();
+		return TJS_S_OK;
+	}
+	TJS_END_NATIVE_PROP_GETTER
+	TJS_BEGIN_NATIVE_PROP_SETTER
+	{
+		TVPSetAsyncWriteCallback(*param);
+		return TJS_S_OK;
+	}
+	TJS_END_NATIVE_PROP_SETTER
+}
+TJS_END_NATIVE_STATIC_PROP_DECL(asyncWriteCallback)
 //----------------------------------------------------------------------
 	TJS_END_NATIVE_MEMBERS
 }
@@ -11,6 +11,8 @@
 #include "tjsCommHead.h"
 
 #include "tjsMessage.h"
+#include "tjsDictionary.h"
+#include "tjsCycleCollector.h"
 #include "SystemIntf.h"
 #include "SysInitIntf.h"
 #include "SysInitImpl.h"
@@ -309,6 +311,144 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/doCompact)
 }
 TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/doCompact)
 //----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/startProfile)
+{
+	// start sampling profiler of the scripts
+
+	tjs_int interval = 0; // default interval
+
+	if(numparams >= 1 && param[0]->Type() != tvtVoid)
+		interval = (tjs_int)*param[0];
+
+	TVPStartScriptProfile(interval);
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/startProfile)
+//----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/stopProfile)
+{
+	// stop the profiler and write the samples to the storage
+
+	ttstr storage;
+
+	if(numparams >= 1 && param[0]->Type() != tvtVoid)
+		storage = *param[0];
+
+	tjs_uint count = TVPStopScriptProfile(storage);
+
+	if(result) *result = (tjs_int)count;
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/stopProfile)
+//----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/getEventQueueStatistics)
+{
+	// get the counters of the script event queue as a dictionary
+	if(!result) return TJS_S_OK;
+
+	tTVPEventQueueStatistics stat;
+	TVPGetEventQueueStatistics(stat);
+
+	iTJSDispatch2 * dic = TJSCreateDictionaryObject();
+	try
+	{
+		tTJSVariant val;
+		val = (tjs_int64)stat.Count;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("count"), NULL, &val, dic);
+		val = (tjs_int64)stat.PeakCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("peakCount"), NULL, &val, dic);
+		val = (tjs_int64)stat.PostCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("posts"), NULL, &val, dic);
+		val = (tjs_int64)stat.DeliverCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("deliveries"), NULL, &val, dic);
+		val = (tjs_int64)stat.CoalescedCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("coalesced"), NULL, &val, dic);
+		val = (tjs_int64)stat.CancelCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("cancels"), NULL, &val, dic);
+		val = (tjs_int64)stat.DiscardCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("discards"), NULL, &val, dic);
+		val = (tjs_int64)TVPGetInputEventCount();
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("inputCount"), NULL, &val, dic);
+		*result = tTJSVariant(dic, dic);
+	}
+	catch(...)
+	{
+		dic->Release();
+		throw;
+	}
+	dic->Release();
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/getEventQueueStatistics)
+//----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/collectCycles)
+{
+	// collect unreachable reference cycles; the collector must be enabled
+	// with "-cyclegc=yes"
+
+	tjs_uint budget = 0; // in ms, 0 processes all candidates
+
+	if(numparams >= 1 && param[0]->Type() != tvtVoid)
+		budget = (tjs_int)*param[0];
+
+	bool done = TJSCollectCycles(budget);
+
+	if(result) *result = (tjs_int)done;
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/collectCycles)
+//----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/getCycleCollectorStatistics)
+{
+	// get the counters of the cycle collector as a dictionary
+	if(!result) return TJS_S_OK;
+
+	tTJSCycleCollectorStatistics stat;
+	TJSGetCycleCollectorStatistics(stat);
+
+	iTJSDispatch2 * dic = TJSCreateDictionaryObject();
+	try
+	{
+		tTJSVariant val;
+		val = (tjs_int)TJSGetCycleCollectorEnabled();
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("enabled"), NULL, &val, dic);
+		val = (tjs_int64)stat.Candidates;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("candidates"), NULL, &val, dic);
+		val = (tjs_int64)stat.Runs;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("runs"), NULL, &val, dic);
+		val = (tjs_int64)stat.ScannedObjects;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("scanned"), NULL, &val, dic);
+		val = (tjs_int64)stat.CollectedCycles;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("cycles"), NULL, &val, dic);
+		val = (tjs_int64)stat.CollectedObjects;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("objects"), NULL, &val, dic);
+		*result = tTJSVariant(dic, dic);
+	}
+	catch(...)
+	{
+		dic->Release();
+		throw;
+	}
+	dic->Release();
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/getCycleCollectorStatistics)
+//----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/reportCycleGarbage)
+{
+	// write the types of the objects collected by the cycle collector to
+	// the console; these are the objects the scripts forgot to invalidate
+	TJSReportCycleGarbage(TVPGetTJS2ConsoleOutputGateway());
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/reportCycleGarbage)
+//----------------------------------------------------------------------
 
 //--properties
 
@@ -16,6 +16,7 @@
 #include "DebugIntf.h"
 #include "EventIntf.h"
 #include "UtilStreams.h"
+#include "FileWriteThread.h"
 #include "tjsError.h"
 #include "CharacterSet.h"
 
@@ -441,6 +442,7 @@ public:
 		// cN: write in cipher at mode N ( currently n is ignored )
 		// zN: write with compress at mode N ( N is compression level )
 		// oN: write from binary offset N (in bytes)
+		// a: write atomically on the file writing thread
 		Stream = NULL;
 		CryptMode = -1;
 		CompressionLevel = Z_DEFAULT_COMPRESSION;
@@ -491,7 +493,9 @@ public:
 		}
 		else
 		{
-			Stream = TVPCreateStream(name, TJS_BS_WRITE);
+			if(TJS_strchr(modestr.c_str(), TJS_W('a')) != NULL)
+				Stream = TVPCreateAsyncWriteStream(name, TVPGetAsyncWriteCallback());
+			if(!Stream) Stream = TVPCreateStream(name, TJS_BS_WRITE);
 		}
 
 
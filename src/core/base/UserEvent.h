@@ -14,6 +14,9 @@
 #define TVP_EV_KEEP_ALIVE			(TVP_EV_DELIVER_EVENTS_DUMMY + 1)
 #define TVP_EV_IMAGE_LOAD_THREAD	(TVP_EV_KEEP_ALIVE + 1)
 #define TVP_EV_WINDOW_RELEASE		(TVP_EV_IMAGE_LOAD_THREAD + 1)
+#define TVP_EV_SCRIPT_LOAD_THREAD	(TVP_EV_WINDOW_RELEASE + 1)
+#define TVP_EV_FILE_WRITE_THREAD	(TVP_EV_SCRIPT_LOAD_THREAD + 1)
+#define TVP_EV_LAYER_RENDER_THREAD	(TVP_EV_FILE_WRITE_THREAD + 1)
 
 #endif // __USER_EVENT_H__
 
@@ -32,6 +32,7 @@
 #include "StringUtil.h"
 #include "FilePathUtil.h"
 #include "Platform.h"
+#include "FileWriteThread.h"
 #include "platform/CCPlatformConfig.h"
 #include "dirent.h"
 #include "TickCount.h"
@@ -106,6 +107,7 @@ bool TJS_INTF_METHOD tTVPFileMedia::CheckExistentStorage(const ttstr &name)
 	ttstr _name(name);
 	GetLocalName(_name);
 
+	TVPFlushAsyncFileWrite(_name);
 	return TVPCheckExistentLocalFile(_name);
 }
 //---------------------------------------------------------------------------
@@ -120,6 +122,8 @@ tTJSBinaryStream * TJS_INTF_METHOD tTVPFileMedia::Open(const ttstr & name, tjs_u
 	ttstr _name(name);
 	GetLocalName(_name);
 
+	// the file may be being written asynchronously
+	TVPFlushAsyncFileWrite(_name);
 	return new tTVPLocalFileStream(origname, _name, flags);
 }
 void TVPListDir(const std::string &folder, std::function<void(const std::string&, int)> cb) {
@@ -474,6 +478,7 @@ ttstr TVPGetTemporaryName()
 //---------------------------------------------------------------------------
 bool TVPRemoveFile(const ttstr &name)
 {
+    TVPFlushAsyncFileWrite(name);
     tTJSNarrowStringHolder holder(name.c_str());
     return !remove(holder);
 }
@@ -26,6 +26,7 @@
 #include "DebugIntf.h"
 #include "tjsLex.h"
 #include "LayerIntf.h"
+#include "LayerRenderThread.h"
 #include "Random.h"
 #include "DetectCPU.h"
 #include "XP3Archive.h"
@@ -1357,6 +1358,18 @@ void TVPAfterSystemInit()
 				TVPGraphicSplitOperationType = gsotBiDirection;
 
 		}
+		// check TVPLayerRenderThreadEnabled option
+		if (TVPGetCommandLine(TJS_W("-renderthread"), &opt))
+		{
+			ttstr str(opt);
+			TVPLayerRenderThreadEnabled = str == TJS_W("yes");
+		}
+		// check TVPPremultipliedAlphaLayers option
+		if (TVPGetCommandLine(TJS_W("-premulalpha"), &opt))
+		{
+			ttstr str(opt);
+			TVPPremultipliedAlphaLayers = str == TJS_W("yes");
+		}
 	}
 
 	// check TVPDefaultHoldAlpha option
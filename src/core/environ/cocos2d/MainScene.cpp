@@ -1794,6 +1794,12 @@ void TVPMainScene::update(float delta) {
 			vmemsize >>= 10;
 			sprintf(buffer, "%d MB(%.2f MB) %d MB\n", TVPGetSelfUsedMemory(), (float)vmemsize / 1024.f, TVPGetSystemFreeMemory());
 			msg += buffer;
+			tjs_uint lines; tjs_uint64 stored, referenced;
+			TVPGetScanLineStoreStat(lines, stored, referenced);
+			if (referenced > stored) {
+				snprintf(buffer, sizeof(buffer), "%u lines(-%.2f MB)\n", lines, (float)((referenced - stored) >> 10) / 1024.f);
+				msg += buffer;
+			}
 			_fpsLabel->setString(msg);
 //#endif
 			_accumDt = 0;
@@ -30,6 +30,7 @@
 #include "tjsByteCodeLoader.h"
 #include "tjsBinarySerializer.h"
 #include "tjsRegExp.h"
+#include "tjsObjectPool.h"
 
 namespace TJS
 {
@@ -80,6 +81,9 @@ bool TJSUnaryAsteriskIgnoresPropAccess = false;
 	// normal property access, if this options is set true.
 	// This is replaced with '&' operator since TJS2 2.4.15. Turn true for
 	// gaining old compatibility.
+bool TJSEnableCodeOptimization = true;
+	// Optimize the generated VM code (see tjsCodeOptimizer.cpp).
+	// The optimization is not done while the debug mode is enabled.
 //---------------------------------------------------------------------------
 
 
@@ -211,6 +215,8 @@ tTJS::~tTJS()
 //---------------------------------------------------------------------------
 void tTJS::Cleanup()
 {
+	TJSStopProfiler(ttstr()); // discard samples if still running
+
 	TJSVariantArrayStackCompactNow();
 //	TJSVariantArrayStackRelease();
 	delete VariantArrayStack; VariantArrayStack = nullptr;
@@ -520,15 +526,16 @@ void tTJS::DoGarbageCollection()
 	// do garbage collection
 	TJSVariantArrayStackCompactNow();
 	TJSCompactStringHeap();
+	TJSCompactObjectPool();
 }
 //---------------------------------------------------------------------------
 // for Bytecode
 void tTJS::LoadByteCode( const tjs_uint8* buff, size_t len, tTJSVariant *result,
-	iTJSDispatch2 *context, const tjs_char *name )
+	iTJSDispatch2 *context, const tjs_char *name, const tjs_char *script )
 {
 	TJS_F_TRACE("tTJS::LoadByteCode");
 	TJSSetFPUE();
-	if(Cache) Cache->LoadByteCode(buff, len, result, context, name);
+	if(Cache) Cache->LoadByteCode(buff, len, result, context, name, script);
 }
 //---------------------------------------------------------------------------
 bool tTJS::LoadByteCode( class tTJSBinaryStream* stream, tTJSVariant *result,
@@ -550,7 +557,7 @@ bool tTJS::LoadByteCode( class tTJSBinaryStream* stream, tTJSVariant *result,
 				assert( tTJSScriptBlock::BYTECODE_FILE_TAG_SIZE == tTJSBinarySerializer::HEADER_LENGTH );
 				if( result != NULL && tTJSBinarySerializer::IsBinary( header ) ) {
 					tTJSBinarySerializer binload;
-					tTJSVariant* var = binload.Read( stream );;
+					tTJSVariant* var = binload.Read( stream, header );;
 					if( var ) {
 					*result = *var;
 					delete var;
@@ -579,7 +586,7 @@ bool tTJS::LoadBinaryDictionayArray( class tTJSBinaryStream* stream, tTJSVariant
 			stream->Read( header, tTJSBinarySerializer::HEADER_LENGTH );
 			if( tTJSBinarySerializer::IsBinary( header ) ) {
 				tTJSBinarySerializer binload;
-				tTJSVariant* var = binload.Read( stream );
+				tTJSVariant* var = binload.Read( stream, header );
 				if( var ) {
 					*result = *var;
 					delete var;
@@ -79,6 +79,10 @@ extern bool TJSUnaryAsteriskIgnoresPropAccess;
 	// normal property access, if this options is set true.
 	// This is replaced with '&' operator since TJS2 2.4.15. Turn true for
 	// gaining old compatibility.
+extern bool TJSEnableCodeOptimization;
+	// Optimize the generated VM code; removes redundant copies and jumps and
+	// uses fused compare-and-jump instructions.
+	// The optimization is not done while the debug mode is enabled.
 
 
 //---------------------------------------------------------------------------
@@ -163,7 +167,10 @@ public:
 
 	// for Bytecode
 	void LoadByteCode( const tjs_uint8* buff, size_t len, tTJSVariant *result = NULL,
-		iTJSDispatch2 *context = NULL, const tjs_char *name = NULL);
+		iTJSDispatch2 *context = NULL, const tjs_char *name = NULL,
+		const tjs_char *script = NULL);
+		// script is the source text of the bytecode; the bytecode compiled
+		// with outputdebug reports the line numbers in this text.
 
 	bool LoadByteCode( class tTJSBinaryStream* stream, tTJSVariant *result = NULL,
 		iTJSDispatch2 *context = NULL, const tjs_char *name = NULL);
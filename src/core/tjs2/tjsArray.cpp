@@ -14,11 +14,13 @@
 
 #include <algorithm>
 #include <functional>
+#include <thread>
 #include "tjsArray.h"
 #include "tjsDictionary.h"
 #include "tjsUtils.h"
 #include "tjsBinarySerializer.h"
 #include "tjsOctPack.h"
+#include "tjsHashSearch.h"
 
 #ifndef TJS_NO_REGEXP
 #include "tjsRegExp.h"
@@ -30,6 +32,14 @@
 #define TJS_ARRAY_BASE_HASH_BITS 3
 	/* hash bits for base "Object" hash */
 
+#define TJS_ARRAY_TYPED_SORT_MIN 16
+	/* minimum item count to sort the packed keys of the items */
+#define TJS_ARRAY_PARALLEL_SORT_MIN 32768
+	/* minimum item count to sort the packed keys in parallel */
+#define TJS_ARRAY_PARALLEL_SORT_MAX_THREADS 8
+#define TJS_ARRAY_FIND_INDEX_MIN 32
+	/* minimum item count to build the hash index for find */
+
 
 
 namespace TJS
@@ -233,6 +243,269 @@ public:
 
 
 
+//---------------------------------------------------------------------------
+// typed sort
+//---------------------------------------------------------------------------
+/*
+	when all items of the array are integers, all are reals or all are
+	strings, the built-in sort orders compare the items in the same way as
+	plain values of the type. the values are packed into an array of keys
+	with their item indices, which is sorted by a merge sort ( in parallel
+	for large arrays ), and the items are rearranged by the sorted indices;
+	integers are sorted without the indices. arrays of other items are
+	sorted as variants.
+*/
+//---------------------------------------------------------------------------
+enum tTJSArrayItemKind { aikMixed, aikInteger, aikReal, aikString };
+//---------------------------------------------------------------------------
+static tTJSArrayItemKind TJSGetArrayItemKind(const std::vector<tTJSVariant> &items)
+{
+	if(items.empty()) return aikMixed;
+	tTJSVariantType type = items[0].Type();
+	for(std::vector<tTJSVariant>::const_iterator i = items.begin() + 1;
+		i != items.end(); i++)
+	{
+		if(i->Type() != type) return aikMixed;
+	}
+	switch(type)
+	{
+	case tvtInteger:	return aikInteger;
+	case tvtReal:		return aikReal;
+	case tvtString:		return aikString;
+	default:			return aikMixed;
+	}
+}
+//---------------------------------------------------------------------------
+static inline const tjs_char * TJSGetArrayStringKey(const tTJSVariant &val)
+{
+	// the string must be flattened here, not in the sorting threads
+	tTJSVariantString *str = val.AsStringNoAddRef();
+	const tjs_char *p = str ? (const tjs_char *)*str : NULL;
+	return p ? p : TJS_W("");
+}
+//---------------------------------------------------------------------------
+struct tTJSArrayRealKeyTraits
+{
+	typedef tTVReal tKey;
+	static tKey Get(const tTJSVariant &val) { return val.AsReal(); }
+	static bool Less(tKey lhs, tKey rhs) { return lhs < rhs; }
+};
+struct tTJSArrayStringKeyTraits
+{
+	typedef const tjs_char * tKey;
+	static tKey Get(const tTJSVariant &val) { return TJSGetArrayStringKey(val); }
+	static bool Less(tKey lhs, tKey rhs) { return TJS_strcmp(lhs, rhs) < 0; }
+};
+//---------------------------------------------------------------------------
+template <typename TraitsT>
+struct tTJSArraySortKey
+{
+	typename TraitsT::tKey Key;
+	tjs_int Index; // index of the item
+};
+template <typename TraitsT>
+class tTJSArraySortKeyAscending
+{
+public:
+	bool operator () (const tTJSArraySortKey<TraitsT> &lhs,
+		const tTJSArraySortKey<TraitsT> &rhs) const
+	{
+		return TraitsT::Less(lhs.Key, rhs.Key);
+	}
+};
+template <typename TraitsT>
+class tTJSArraySortKeyDescending
+{
+public:
+	bool operator () (const tTJSArraySortKey<TraitsT> &lhs,
+		const tTJSArraySortKey<TraitsT> &rhs) const
+	{
+		return TraitsT::Less(rhs.Key, lhs.Key);
+	}
+};
+//---------------------------------------------------------------------------
+template <typename TaskT>
+static void TJSArrayRunParallel(TaskT &task, tjs_int count)
+{
+	// calls task(0) .. task(count-1) on separate threads
+	std::vector<std::thread> threads;
+	tjs_int i = 1;
+	try
+	{
+		for(; i < count; i++)
+			threads.push_back(std::thread(std::ref(task), i));
+	}
+	catch(...)
+	{
+		// could not create a thread; the rest is done in this thread
+	}
+	for(tjs_int j = i; j < count; j++) task(j);
+	task(0);
+	for(std::vector<std::thread>::iterator t = threads.begin();
+		t != threads.end(); t++)
+		t->join();
+}
+//---------------------------------------------------------------------------
+template <typename KeyT, typename CompT>
+class tTJSArraySortRunTask
+{
+	KeyT *Keys;
+	const size_t *Bounds;
+	CompT Comp;
+public:
+	tTJSArraySortRunTask(KeyT *keys, const size_t *bounds, CompT comp) :
+		Keys(keys), Bounds(bounds), Comp(comp) {}
+	void operator () (tjs_int run)
+	{
+		std::stable_sort(Keys + Bounds[run], Keys + Bounds[run + 1], Comp);
+	}
+};
+//---------------------------------------------------------------------------
+template <typename KeyT, typename CompT>
+class tTJSArrayMergeRunTask
+{
+	const KeyT *Src;
+	KeyT *Dest;
+	const size_t *Bounds;
+	tjs_int Step; // number of runs in each of the merged sequences
+	CompT Comp;
+public:
+	tTJSArrayMergeRunTask(const KeyT *src, KeyT *dest, const size_t *bounds,
+		tjs_int step, CompT comp) :
+		Src(src), Dest(dest), Bounds(bounds), Step(step), Comp(comp) {}
+	void operator () (tjs_int merge)
+	{
+		size_t lo = Bounds[merge * Step * 2];
+		size_t mid = Bounds[merge * Step * 2 + Step];
+		size_t hi = Bounds[(merge + 1) * Step * 2];
+		std::merge(Src + lo, Src + mid, Src + mid, Src + hi, Dest + lo, Comp);
+	}
+};
+//---------------------------------------------------------------------------
+template <typename KeyT, typename CompT>
+static void TJSArrayMergeSort(std::vector<KeyT> &keys, CompT comp)
+{
+	// stable merge sort; large arrays are split into runs which are sorted
+	// and merged in parallel
+	size_t count = keys.size();
+	tjs_int threads = (tjs_int)std::thread::hardware_concurrency();
+	if(threads > TJS_ARRAY_PARALLEL_SORT_MAX_THREADS)
+		threads = TJS_ARRAY_PARALLEL_SORT_MAX_THREADS;
+	if(count < TJS_ARRAY_PARALLEL_SORT_MIN || threads < 2)
+	{
+		std::stable_sort(keys.begin(), keys.end(), comp);
+		return;
+	}
+
+	tjs_int runs = 1; // power of two
+	while(runs * 2 <= threads) runs *= 2;
+	std::vector<size_t> bounds(runs + 1);
+	for(tjs_int i = 0; i <= runs; i++) bounds[i] = count * i / runs;
+
+	std::vector<KeyT> work(count);
+	KeyT *src = &keys[0];
+	KeyT *dest = &work[0];
+
+	tTJSArraySortRunTask<KeyT, CompT> sorttask(src, &bounds[0], comp);
+	TJSArrayRunParallel(sorttask, runs);
+
+	for(tjs_int step = 1; step < runs; step *= 2)
+	{
+		tTJSArrayMergeRunTask<KeyT, CompT> mergetask(src, dest, &bounds[0],
+			step, comp);
+		TJSArrayRunParallel(mergetask, runs / (step * 2));
+		std::swap(src, dest);
+	}
+
+	if(src != &keys[0]) keys.swap(work);
+}
+//---------------------------------------------------------------------------
+template <typename TraitsT>
+static void TJSSortArrayItemsByKey(std::vector<tTJSVariant> &items,
+	bool descending)
+{
+	typedef tTJSArraySortKey<TraitsT> tKey;
+	std::vector<tKey> keys(items.size());
+	for(tjs_uint i = 0; i < items.size(); i++)
+	{
+		keys[i].Key = TraitsT::Get(items[i]);
+		keys[i].Index = (tjs_int)i;
+	}
+
+	if(descending)
+		TJSArrayMergeSort(keys, tTJSArraySortKeyDescending<TraitsT>());
+	else
+		TJSArrayMergeSort(keys, tTJSArraySortKeyAscending<TraitsT>());
+
+	std::vector<tTJSVariant> sorted;
+	sorted.reserve(items.size());
+	for(typename std::vector<tKey>::iterator i = keys.begin(); i != keys.end(); i++)
+		sorted.push_back(items[i->Index]);
+	items.swap(sorted);
+}
+//---------------------------------------------------------------------------
+static void TJSSortArrayIntegers(std::vector<tTJSVariant> &items,
+	bool descending)
+{
+	// integer items are identified by their values, so the values can be
+	// sorted alone and stored back
+	std::vector<tTVInteger> keys(items.size());
+	for(tjs_uint i = 0; i < items.size(); i++)
+		keys[i] = items[i].AsInteger();
+
+	if(descending)
+		TJSArrayMergeSort(keys, std::greater<tTVInteger>());
+	else
+		TJSArrayMergeSort(keys, std::less<tTVInteger>());
+
+	for(tjs_uint i = 0; i < items.size(); i++)
+		items[i] = keys[i];
+}
+//---------------------------------------------------------------------------
+static bool TJSSortArrayItemsTyped(std::vector<tTJSVariant> &items,
+	tjs_nchar method)
+{
+	// sort the items by the packed keys. returns false if the items can not
+	// be sorted in this way.
+	if(items.size() < TJS_ARRAY_TYPED_SORT_MIN) return false;
+
+	bool descending;
+	bool asstring; // the method compares items as strings
+	switch(method)
+	{
+	case TJS_N('+'): descending = false; asstring = false; break;
+	case TJS_N('-'): descending = true;  asstring = false; break;
+	case TJS_N('0'): descending = false; asstring = false; break;
+	case TJS_N('9'): descending = true;  asstring = false; break;
+	case TJS_N('a'): descending = false; asstring = true;  break;
+	case TJS_N('z'): descending = true;  asstring = true;  break;
+	default: return false;
+	}
+
+	switch(TJSGetArrayItemKind(items))
+	{
+	case aikInteger:
+		if(asstring) return false; // digits are compared as characters
+		TJSSortArrayIntegers(items, descending);
+		return true;
+	case aikReal:
+		if(asstring) return false;
+		TJSSetFPUE();
+		TJSSortArrayItemsByKey<tTJSArrayRealKeyTraits>(items, descending);
+		return true;
+	case aikString:
+		if(method == TJS_N('0') || method == TJS_N('9'))
+			return false; // strings are converted to numbers
+		TJSSortArrayItemsByKey<tTJSArrayStringKeyTraits>(items, descending);
+		return true;
+	default:
+		return false;
+	}
+}
+//---------------------------------------------------------------------------
+
+
+
 
 
 //---------------------------------------------------------------------------
@@ -270,6 +543,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/* func. name */load)
 	iTJSTextReadStream * stream = TJSCreateTextStreamForRead(name, mode);
 	try
 	{
+		ni->ItemsModified();
 		ni->Items.clear();
 		ttstr content;
 		stream->Read(content, 0);
@@ -371,6 +645,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/loadStruct)
 	ttstr mode;
 	if(numparams >= 2 && param[1]->Type() != tvtVoid) mode =*param[1];
 
+	ni->ItemsModified();
 	ni->Items.clear();
 
 	tTJSBinaryStream* stream = TJSCreateBinaryStreamForRead(name, mode);
@@ -384,7 +659,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/loadStruct)
 			stream->Read( header, tTJSBinarySerializer::HEADER_LENGTH );
 			if( tTJSBinarySerializer::IsBinary( header ) ) {
 				tTJSBinarySerializer binload((tTJSArrayObject*)objthis);
-				tTJSVariant* var = binload.Read( stream );
+				tTJSVariant* var = binload.Read( stream, header );
 				if( var ) {
 					if( result ) *result = *var;
 					delete var;
@@ -463,10 +738,16 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/* func. name */saveStruct)
 	if( TJS_strchr(mode.c_str(), TJS_W('b')) != NULL ) {
 		tTJSBinaryStream* stream = TJSCreateBinaryStreamForWrite(name, mode);
 		try {
-			stream->Write( tTJSBinarySerializer::HEADER, tTJSBinarySerializer::HEADER_LENGTH );
-			std::vector<iTJSDispatch2 *> stack;
-			stack.push_back(objthis);
-			ni->SaveStructuredBinary(stack, *stream);
+			if( tTJSBinaryStructWriter::IsSharedMode(mode.c_str()) ) {
+				// strings and objects are stored once, optionally compressed
+				tTJSBinaryStructWriter writer(mode.c_str());
+				writer.Write(stream, objthis);
+			} else {
+				stream->Write( tTJSBinarySerializer::HEADER, tTJSBinarySerializer::HEADER_LENGTH );
+				std::vector<iTJSDispatch2 *> stack;
+				stack.push_back(objthis);
+				ni->SaveStructuredBinary(stack, *stream);
+			}
 		} catch(...) {
 			delete stream;
 			throw;
@@ -505,6 +786,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/* func.name */split)
 
 	if(numparams < 2) return TJS_E_BADPARAMCOUNT;
 
+	ni->ItemsModified();
 	ni->Items.resize(0);
 	tTJSString string = *param[1];
 	bool purgeempty = false;
@@ -667,6 +949,9 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/* func.name */sort)
 
 
 	// sort
+	ni->ItemsModified();
+	if(TJSSortArrayItemsTyped(ni->Items, method)) return TJS_S_OK;
+
 	switch(method)
 	{
 	case TJS_N('+'):
@@ -718,12 +1003,22 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/* func.name */sort)
 				tTJSArraySortCompare_StringDescending());
 		break;
 	case 0:
-		if(do_stable_sort)
-			std::stable_sort(ni->Items.begin(), ni->Items.end(),
-				tTJSArraySortCompare_Functional(closure));
-		else
-			std::sort(ni->Items.begin(), ni->Items.end(),
-				tTJSArraySortCompare_Functional(closure));
+		try
+		{
+			if(do_stable_sort)
+				std::stable_sort(ni->Items.begin(), ni->Items.end(),
+					tTJSArraySortCompare_Functional(closure));
+			else
+				std::sort(ni->Items.begin(), ni->Items.end(),
+					tTJSArraySortCompare_Functional(closure));
+		}
+		catch(...)
+		{
+			// the function may have searched the array while sorting
+			ni->ItemsModified();
+			throw;
+		}
+		ni->ItemsModified();
 		break;
 	}
 
@@ -736,6 +1031,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/* func.name */reverse)
 	TJS_GET_NATIVE_INSTANCE(/* var. name */ni, /* var. type */tTJSArrayNI);
 
 	// reverse array
+	ni->ItemsModified();
 	std::reverse(ni->Items.begin(), ni->Items.end());
 
 	return TJS_S_OK;
@@ -946,17 +1242,8 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/* func.name */find)
 		if(numparams >= 2) start = *param[1];
 		if(start < 0) start += (tjs_int)ni->Items.size();
 		if(start < 0) start = 0;
-		if(start >= (tjs_int)ni->Items.size()) { *result = -1; return TJS_S_OK; }
 
-		tTJSArrayNI::tArrayItemIterator i;
-		for(i = ni->Items.begin() + start; i != ni->Items.end(); i++)
-		{
-			if(val.DiscernCompare(*i)) break;
-		}
-		if(i == ni->Items.end())
-			*result = -1;
-		else
-			result->operator=((tjs_int)(i - ni->Items.begin()));
+		*result = ni->Find(val, start);
 	}
 
 	return TJS_S_OK;
@@ -990,6 +1277,7 @@ TJS_BEGIN_NATIVE_PROP_DECL(count)
 	TJS_BEGIN_NATIVE_PROP_SETTER
 	{
 		TJS_GET_NATIVE_INSTANCE(/* var. name */ni, /* var. type */tTJSArrayNI);
+		ni->ItemsModified();
 		ni->Items.resize((tjs_uint)(tTVInteger)*param);
 		return TJS_S_OK;
 	}
@@ -1011,6 +1299,7 @@ TJS_BEGIN_NATIVE_PROP_DECL(length)
 	TJS_BEGIN_NATIVE_PROP_SETTER
 	{
 		TJS_GET_NATIVE_INSTANCE(/* var. name */ni, /* var. type */tTJSArrayNI);
+		ni->ItemsModified();
 		ni->Items.resize((tjs_uint)(tTVInteger)*param);
 		return TJS_S_OK;
 	}
@@ -1047,6 +1336,14 @@ iTJSDispatch2 *tTJSArrayClass::CreateBaseTJSObject()
 tTJSArrayNI::tTJSArrayNI()
 {
 	// constructor
+	FindIndex = NULL;
+	FindCount = 0;
+}
+//---------------------------------------------------------------------------
+tTJSArrayNI::~tTJSArrayNI()
+{
+	// destructor
+	if(FindIndex) DeleteFindIndex();
 }
 //---------------------------------------------------------------------------
 tjs_error TJS_INTF_METHOD tTJSArrayNI::Construct(tjs_int numparams, tTJSVariant **params,
@@ -1060,6 +1357,7 @@ tjs_error TJS_INTF_METHOD tTJSArrayNI::Construct(tjs_int numparams, tTJSVariant
 void tTJSArrayNI::Assign(iTJSDispatch2 * dsp)
 {
 	// copy members from "dsp" to "Owner"
+	ItemsModified();
 
 	// determin dsp's object type
 	tTJSArrayNI *arrayni = NULL;
@@ -1083,6 +1381,95 @@ void tTJSArrayNI::Assign(iTJSDispatch2 * dsp)
 	}
 }
 //---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+struct tTJSArrayNI::tFindIndex
+{
+	// string items chained by the buckets of their hash values, in the
+	// order of the item index
+	std::vector<tjs_int> Buckets; // first item of each bucket, or -1
+	std::vector<tjs_int> Next; // next item in the same bucket, or -1
+	std::vector<tjs_uint32> Hashes; // hash value of each string item
+	tjs_uint32 Mask;
+};
+//---------------------------------------------------------------------------
+void tTJSArrayNI::BuildFindIndex()
+{
+	tjs_int count = (tjs_int)Items.size();
+	tjs_int strings = 0;
+	for(tjs_int i = 0; i < count; i++)
+		if(Items[i].Type() == tvtString) strings++;
+
+	tjs_uint32 size = 16;
+	while(size < (tjs_uint32)strings * 2) size <<= 1;
+
+	FindIndex = new tFindIndex();
+	try
+	{
+		FindIndex->Mask = size - 1;
+		FindIndex->Buckets.assign(size, -1);
+		FindIndex->Next.assign(count, -1);
+		FindIndex->Hashes.assign(count, 0);
+
+		// link from the last item, so that the chains are in the index order
+		for(tjs_int i = count - 1; i >= 0; i--)
+		{
+			if(Items[i].Type() != tvtString) continue;
+			tjs_uint32 hash = tTJSHashFunc<tjs_char *>::Make(
+				TJSGetArrayStringKey(Items[i]));
+			tjs_int &first = FindIndex->Buckets[hash & FindIndex->Mask];
+			FindIndex->Hashes[i] = hash;
+			FindIndex->Next[i] = first;
+			first = i;
+		}
+	}
+	catch(...)
+	{
+		DeleteFindIndex();
+		throw;
+	}
+}
+//---------------------------------------------------------------------------
+void tTJSArrayNI::DeleteFindIndex()
+{
+	delete FindIndex;
+	FindIndex = NULL;
+}
+//---------------------------------------------------------------------------
+tjs_int tTJSArrayNI::Find(const tTJSVariant &val, tjs_int start)
+{
+	tjs_int count = (tjs_int)Items.size();
+	if(start >= count) return -1;
+
+	if(val.Type() == tvtString && count >= TJS_ARRAY_FIND_INDEX_MIN)
+	{
+		// the index is built at the second find on the unmodified array,
+		// because a single find is faster without it
+		if(FindIndex && FindIndex->Next.size() != (tjs_uint)count)
+			DeleteFindIndex(); // the items were modified without notice
+		if(!FindIndex && FindCount >= 1) BuildFindIndex();
+		FindCount++;
+
+		if(FindIndex)
+		{
+			tjs_uint32 hash = tTJSHashFunc<tjs_char *>::Make(
+				TJSGetArrayStringKey(val));
+			tjs_int i = FindIndex->Buckets[hash & FindIndex->Mask];
+			for(; i != -1; i = FindIndex->Next[i])
+			{
+				if(i >= start && FindIndex->Hashes[i] == hash &&
+					val.DiscernCompare(Items[i])) return i;
+			}
+			return -1;
+		}
+	}
+
+	for(tjs_int i = start; i < count; i++)
+	{
+		if(val.DiscernCompare(Items[i])) return i;
+	}
+	return -1;
+}
+//---------------------------------------------------------------------------
 tjs_error TJS_INTF_METHOD tTJSArrayNI::tDictionaryEnumCallback::FuncCall(
 	tjs_uint32 flag, const tjs_char * membername, tjs_uint32 *hint,
 	tTJSVariant *result, tjs_int numparams, tTJSVariant **param,
@@ -1265,6 +1652,7 @@ void tTJSArrayNI::AssignStructure(iTJSDispatch2 * dsp,
 	std::vector<iTJSDispatch2 *> &stack)
 {
 	// assign structured data from dsp
+	ItemsModified();
 	tTJSArrayNI *arrayni = NULL;
 	if(TJS_SUCCEEDED(dsp->NativeInstanceSupport(TJS_NIS_GETINSTANCE,
 		ClassID_Array, (iTJSNativeInstance**)&arrayni)) )
@@ -1425,6 +1813,7 @@ void tTJSArrayObject::Finalize()
 void tTJSArrayObject::Clear(tTJSArrayNI * ni)
 {
 	// clear members
+	ni->ItemsModified();
 
 	std::vector<iTJSDispatch2*> vector;
 	try
@@ -1467,6 +1856,7 @@ void tTJSArrayObject::Clear(tTJSArrayNI * ni)
 //---------------------------------------------------------------------------
 void tTJSArrayObject::Add(tTJSArrayNI * ni, const tTJSVariant &val)
 {
+	ni->ItemsModified();
 	ni->Items.push_back(val);
 	CheckObjectClosureAdd(ni->Items[ni->Items.size() -1]);
 }
@@ -1476,6 +1866,7 @@ tjs_int tTJSArrayObject::Remove(tTJSArrayNI * ni, const tTJSVariant &ref, bool r
 	tjs_int count = 0;
 	std::vector<tjs_int> todelete;
 	tjs_int num = 0;
+	ni->ItemsModified();
 	for(tTJSArrayNI::tArrayItemIterator i = ni->Items.begin();
 		i != ni->Items.end(); i++)
 	{
@@ -1540,6 +1931,7 @@ void tTJSArrayObject::Erase(tTJSArrayNI * ni, tjs_int num)
 	if(num < 0) TJS_eTJSError(TJSRangeError);
 	if((unsigned)num >= ni->Items.size()) TJS_eTJSError(TJSRangeError);
 
+	ni->ItemsModified();
 	CheckObjectClosureRemove(ni->Items[num]);
 	ni->Items.erase(ni->Items.begin() + num);
 }
@@ -1551,6 +1943,7 @@ void tTJSArrayObject::Insert(tTJSArrayNI *ni, const tTJSVariant &val, tjs_int nu
 	tjs_int count = (tjs_int)ni->Items.size();
 	if(num > count) TJS_eTJSError(TJSRangeError);
 
+	ni->ItemsModified();
 	ni->Items.insert(ni->Items.begin() + num, val);
 	CheckObjectClosureAdd(val);
 }
@@ -1564,6 +1957,7 @@ void tTJSArrayObject::Insert(tTJSArrayNI *ni, tTJSVariant *const *val, tjs_int n
 
 	// first initialize specified position as void, then
 	// overwrite items.
+	ni->ItemsModified();
 	ni->Items.insert(ni->Items.begin() + num, numvals, tTJSVariant());
 	for(tjs_int i = 0; i < numvals; i++)
 	{
@@ -1642,6 +2036,7 @@ tjs_error TJS_INTF_METHOD
 	if(num >= (tjs_int)ni->Items.size())
 	{
 		if(flag & TJS_MEMBERMUSTEXIST) return TJS_E_MEMBERNOTFOUND;
+		ni->ItemsModified();
 		ni->Items.resize(num+1);
 	}
 	if(num < 0) return TJS_E_MEMBERNOTFOUND;
@@ -1658,6 +2053,7 @@ tjs_error TJS_INTF_METHOD
 		throw;
 	}
 	CheckObjectClosureAdd(val);
+	ni->ItemsModified(); // after the setter which may search the array
 	return hr;
 }
 //---------------------------------------------------------------------------
@@ -1692,6 +2088,7 @@ tjs_error TJS_INTF_METHOD
 	ARRAY_GET_NI;
 	if(num < 0) num += (tjs_int)ni->Items.size();
 	if(num < 0 || (tjs_uint)num>=ni->Items.size()) return TJS_E_MEMBERNOTFOUND;
+	ni->ItemsModified();
 	CheckObjectClosureRemove(ni->Items[num]);
 	std::deque<tTJSVariant>::iterator i;
 	ni->Items.erase(ni->Items.begin() + num);
@@ -1814,6 +2211,7 @@ tjs_error TJS_INTF_METHOD
 	if(num >= (tjs_int)ni->Items.size())
 	{
 		if(flag & TJS_MEMBERMUSTEXIST) return TJS_E_MEMBERNOTFOUND;
+		ni->ItemsModified();
 		ni->Items.resize(num+1);
 	}
 	if(num < 0) return TJS_E_MEMBERNOTFOUND;
@@ -1830,6 +2228,7 @@ tjs_error TJS_INTF_METHOD
 		throw;
 	}
 	CheckObjectClosureAdd(val);
+	ni->ItemsModified(); // after the operation which may search the array
 	return hr;
 }
 //---------------------------------------------------------------------------
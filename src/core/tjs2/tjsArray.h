@@ -88,14 +88,37 @@ class tTJSArrayNI : public tTJSNativeInstance,
 public:
 	typedef std::vector<tTJSVariant>::iterator tArrayItemIterator;
 	std::vector<tTJSVariant> Items;
+		// call ItemsModified() after modifying the items of an existing array
 	tTJSArrayNI();
+	~tTJSArrayNI();
+
+	TJS_DECLARE_POOLED_NEW
 
 	tjs_error TJS_INTF_METHOD Construct(tjs_int numparams, tTJSVariant **params,
 		iTJSDispatch2 *tjsobj);
 
 	void Assign(iTJSDispatch2 *dsp);
 
+	void ItemsModified()
+	{
+		// discard the information derived from the items
+		if(FindIndex) DeleteFindIndex();
+		FindCount = 0;
+	}
+	tjs_int Find(const tTJSVariant &val, tjs_int start);
+		// returns the index of the first item at or after "start" which
+		// equals to val in DiscernCompare, or -1
+
 private:
+	struct tFindIndex;
+	tFindIndex * FindIndex;
+		// hash index of the string items, built by repeated finds of a string
+		// on a large array
+	tjs_uint FindCount; // number of finds since the last modification
+
+	void BuildFindIndex();
+	void DeleteFindIndex();
+
 	struct tDictionaryEnumCallback : public tTJSDispatch
 	{
 		std::vector<tTJSVariant> * Items;
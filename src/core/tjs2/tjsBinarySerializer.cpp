@@ -12,6 +12,7 @@
 #include "tjsBinarySerializer.h"
 #include "tjsDictionary.h"
 #include "tjsArray.h"
+#include <zlib.h>
 
 namespace TJS
 {
@@ -19,8 +20,17 @@ namespace TJS
 const tjs_uint8 tTJSBinarySerializer::HEADER[tTJSBinarySerializer::HEADER_LENGTH] = {
 	'K','B','A','D', '1','0','0', 0
 };
+const tjs_uint8 tTJSBinarySerializer::SHARED_HEADER[tTJSBinarySerializer::HEADER_LENGTH] = {
+	'K','B','A','D', '2','0','0', 0
+};
+// followed by the uncompressed size (32bit) and the zlib stream
+const tjs_uint8 tTJSBinarySerializer::COMPRESSED_HEADER[tTJSBinarySerializer::HEADER_LENGTH] = {
+	'K','B','A','D', '2','0','Z', 0
+};
 bool tTJSBinarySerializer::IsBinary( const tjs_uint8 header[tTJSBinarySerializer::HEADER_LENGTH] ) {
-	return memcmp( HEADER, header, tTJSBinarySerializer::HEADER_LENGTH) == 0;
+	return memcmp( HEADER, header, tTJSBinarySerializer::HEADER_LENGTH) == 0 ||
+		memcmp( SHARED_HEADER, header, tTJSBinarySerializer::HEADER_LENGTH) == 0 ||
+		memcmp( COMPRESSED_HEADER, header, tTJSBinarySerializer::HEADER_LENGTH) == 0;
 }
 /**
  * oCAgli[
@@ -66,11 +76,11 @@ void tTJSBinarySerializer::PutVariant( tTJSBinaryStream* stream, tTJSVariant& v
 	}
 }
 
-tTJSBinarySerializer::tTJSBinarySerializer() : DicClass(NULL), RootDictionary(NULL), RootArray(NULL) {
+tTJSBinarySerializer::tTJSBinarySerializer() : DicClass(NULL), RootDictionary(NULL), RootArray(NULL), Shared(false) {
 }
-tTJSBinarySerializer::tTJSBinarySerializer( class tTJSDictionaryObject* root ) : DicClass(NULL), RootDictionary(root), RootArray(NULL) {
+tTJSBinarySerializer::tTJSBinarySerializer( class tTJSDictionaryObject* root ) : DicClass(NULL), RootDictionary(root), RootArray(NULL), Shared(false) {
 }
-tTJSBinarySerializer::tTJSBinarySerializer( class tTJSArrayObject* root ) : DicClass(NULL), RootDictionary(NULL), RootArray(root) {
+tTJSBinarySerializer::tTJSBinarySerializer( class tTJSArrayObject* root ) : DicClass(NULL), RootDictionary(NULL), RootArray(root), Shared(false) {
 }
 tTJSBinarySerializer::~tTJSBinarySerializer() {
 	if( DicClass ) DicClass->Release();
@@ -141,19 +151,25 @@ tTJSVariant* tTJSBinarySerializer::ReadBasicType( const tjs_uint8* buff, const t
 		if( (index+sizeof(tjs_uint8)) > size ) TJS_eTJSError( TJSReadError );
 		tjs_uint8 len = buff[index]; index++;
 		if( (index+(len*sizeof(tjs_char))) > size ) TJS_eTJSError( TJSReadError );
-		return ReadStringVarint( buff, len, index );
+		tTJSVariant* ret = ReadStringVarint( buff, len, index );
+		if( Shared && len ) SharedStrings.push_back( *ret );
+		return ret;
 	}
 	case TYPE_STRING16: {
 		if( (index+sizeof(tjs_uint16)) > size ) TJS_eTJSError( TJSReadError );
 		tjs_uint16 len = Read16( buff, index );
 		if( (index+(len*sizeof(tjs_char))) > size ) TJS_eTJSError( TJSReadError );
-		return ReadStringVarint( buff, len, index );
+		tTJSVariant* ret = ReadStringVarint( buff, len, index );
+		if( Shared && len ) SharedStrings.push_back( *ret );
+		return ret;
 	}
 	case TYPE_STRING32: {
 		if( (index+sizeof(tjs_uint32)) > size ) TJS_eTJSError( TJSReadError );
 		tjs_uint32 len = Read32( buff, index );
 		if( (index+(len*sizeof(tjs_char))) > size ) TJS_eTJSError( TJSReadError );
-		return ReadStringVarint( buff, len, index );
+		tTJSVariant* ret = ReadStringVarint( buff, len, index );
+		if( Shared && len ) SharedStrings.push_back( *ret );
+		return ret;
 	}
 	case TYPE_FLOAT: {
 			if( (index+sizeof(float)) > size ) TJS_eTJSError( TJSReadError );
@@ -237,6 +253,16 @@ tTJSVariant* tTJSBinarySerializer::ReadBasicType( const tjs_uint8* buff, const t
 		tjs_uint32 count = Read32( buff, index );
 		return ReadDictionary( buff, size, count, index );
 	}
+	case TYPE_STRING_REF: {
+		if( !Shared ) TJS_eTJSError( TJSReadError );
+		tjs_uint i = ReadIndex( buff, size, index, (tjs_uint)SharedStrings.size() );
+		return new tTJSVariant( SharedStrings[i] );
+	}
+	case TYPE_OBJECT_REF: {
+		if( !Shared ) TJS_eTJSError( TJSReadError );
+		tjs_uint i = ReadIndex( buff, size, index, (tjs_uint)SharedObjects.size() );
+		return new tTJSVariant( SharedObjects[i], SharedObjects[i] );
+	}
 	default: {
 		if( type >= TYPE_POSITIVE_FIX_NUM_MIN && type <= TYPE_POSITIVE_FIX_NUM_MAX ) {
 			tjs_int value = type;
@@ -251,7 +277,9 @@ tTJSVariant* tTJSBinarySerializer::ReadBasicType( const tjs_uint8* buff, const t
 		} else if( type >= TYPE_FIX_STRING_MIN && type <= TYPE_FIX_STRING_MAX ) {
 			tjs_int len = type - TYPE_FIX_STRING_MIN;
 			if( (len*sizeof(tjs_char)+index) > size ) TJS_eTJSError( TJSReadError );
-			return ReadStringVarint( buff, len, index );
+			tTJSVariant* ret = ReadStringVarint( buff, len, index );
+			if( Shared && len ) SharedStrings.push_back( *ret );
+			return ret;
 		} else if( type >= TYPE_FIX_ARRAY_MIN && type <= TYPE_FIX_ARRAY_MAX ) {
 			tjs_int count = type - TYPE_FIX_ARRAY_MIN;
 			return ReadArray( buff, size, count, index );
@@ -269,6 +297,7 @@ tTJSVariant* tTJSBinarySerializer::ReadArray( const tjs_uint8* buff, const tjs_u
 	if( index > size ) return NULL;
 
 	tTJSArrayObject* array = CreateArray( count );
+	if( Shared ) SharedObjects.push_back( array );
 	for( tjs_uint i = 0; i < count; i++ ) {
 		tTJSVariant* value = ReadBasicType( buff, size, index );
 		InsertArray( array, i, value );
@@ -282,6 +311,7 @@ tTJSVariant* tTJSBinarySerializer::ReadDictionary( const tjs_uint8* buff, const
 	if( index > size ) return NULL;
 
 	tTJSDictionaryObject* dic = CreateDictionary( count );
+	if( Shared ) SharedObjects.push_back( dic );
 	for( tjs_uint i = 0; i < count; i++ ) {
 		tjs_uint8 type = buff[index];
 		index++;
@@ -309,6 +339,12 @@ tTJSVariant* tTJSBinarySerializer::ReadDictionary( const tjs_uint8* buff, const
 			name = ReadString( buff, len, index );
 			break;
 		}
+		case TYPE_STRING_REF: {
+			if( !Shared ) TJS_eTJSError( TJSReadError );
+			tjs_uint i = ReadIndex( buff, size, index, (tjs_uint)SharedStrings.size() );
+			name = SharedStrings[i].AsString();
+			break;
+		}
 		default:
 			if( type >= TYPE_FIX_STRING_MIN && type <= TYPE_FIX_STRING_MAX ) {
 				tjs_int len = type - TYPE_FIX_STRING_MIN;
@@ -319,6 +355,7 @@ tTJSVariant* tTJSBinarySerializer::ReadDictionary( const tjs_uint8* buff, const
 			}
 			break;
 		}
+		if( Shared && name && type != TYPE_STRING_REF ) SharedStrings.push_back( tTJSVariant( ttstr(name) ) );
 		// ɗvfǂ
 		tTJSVariant* value = ReadBasicType( buff, size, index );
 		AddDictionary( dic, name, value );
@@ -329,19 +366,246 @@ tTJSVariant* tTJSBinarySerializer::ReadDictionary( const tjs_uint8* buff, const
 	dic->Release();
 	return ret;
 }
-tTJSVariant* tTJSBinarySerializer::Read( tTJSBinaryStream* stream )
+tjs_uint tTJSBinarySerializer::ReadIndex( const tjs_uint8* buff, const tjs_uint size, tjs_uint& index, tjs_uint limit ) {
+	tTJSVariant* value = ReadBasicType( buff, size, index );
+	if( value == NULL || value->Type() != tvtInteger ) {
+		delete value;
+		TJS_eTJSError( TJSReadError );
+	}
+	tjs_int64 i = value->AsInteger();
+	delete value;
+	if( i < 0 || i >= (tjs_int64)limit ) TJS_eTJSError( TJSReadError );
+	return (tjs_uint)i;
+}
+/**
+ * header is the one already read from the stream
+ */
+tTJSVariant* tTJSBinarySerializer::Read( tTJSBinaryStream* stream, const tjs_uint8 header[tTJSBinarySerializer::HEADER_LENGTH] )
 {
 	tjs_uint64 pos = stream->GetPosition();
 	tjs_uint size = (tjs_uint)( stream->GetSize() - pos );
 	tjs_uint8* buffstart = new tjs_uint8[size];
 	if( size != stream->Read( buffstart, size ) ) {
+		delete[] buffstart;
 		TJS_eTJSError( TJSReadError );
 	}
+	Shared = memcmp( HEADER, header, HEADER_LENGTH ) != 0;
+	SharedStrings.clear();
+	SharedObjects.clear();
+	if( memcmp( COMPRESSED_HEADER, header, HEADER_LENGTH ) == 0 ) {
+		tjs_uint index = 0;
+		if( size < sizeof(tjs_uint32) ) {
+			delete[] buffstart;
+			TJS_eTJSError( TJSReadError );
+		}
+		uLongf destsize = Read32( buffstart, index );
+		// deflate can not compress more than about 1:1032; a larger size is
+		// a broken or forged header, which must not be allocated
+		if( destsize == 0 ||
+			destsize > (tjs_uint64)(size - index) * MAX_COMPRESSION_RATIO ) {
+			delete[] buffstart;
+			TJS_eTJSError( TJSReadError );
+		}
+		tjs_uint8* dest = new tjs_uint8[destsize];
+		int result = uncompress( dest, &destsize, buffstart + index, size - index );
+		delete[] buffstart;
+		buffstart = dest;
+		if( result != Z_OK ) {
+			delete[] buffstart;
+			TJS_eTJSError( TJSReadError );
+		}
+		size = (tjs_uint)destsize;
+	}
 	tjs_uint index = 0;
-	tTJSVariant* ret = ReadBasicType( buffstart, size, index );
+	tTJSVariant* ret = NULL;
+	try {
+		ret = ReadBasicType( buffstart, size, index );
+	} catch(...) {
+		delete[] buffstart;
+		SharedStrings.clear();
+		SharedObjects.clear();
+		throw;
+	}
 	delete[] buffstart;
+	SharedStrings.clear();
+	SharedObjects.clear();
 	return ret;
 }
+//---------------------------------------------------------------------------
+// tTJSBinaryMemoryStream : memory stream the shared image is built in
+//---------------------------------------------------------------------------
+class tTJSBinaryMemoryStream : public tTJSBinaryStream {
+public:
+	std::vector<tjs_uint8> Data;
+	tjs_uint Position;
+
+	tTJSBinaryMemoryStream() : Position(0) {}
+
+	tjs_uint64 TJS_INTF_METHOD Seek( tjs_int64 offset, tjs_int whence ) {
+		tjs_int64 pos;
+		switch( whence ) {
+		case TJS_BS_SEEK_SET: pos = offset; break;
+		case TJS_BS_SEEK_CUR: pos = (tjs_int64)Position + offset; break;
+		case TJS_BS_SEEK_END: pos = (tjs_int64)Data.size() + offset; break;
+		default: return Position;
+		}
+		if( pos >= 0 && pos <= (tjs_int64)Data.size() ) Position = (tjs_uint)pos;
+		return Position;
+	}
+	tjs_uint TJS_INTF_METHOD Read( void *buffer, tjs_uint read_size ) {
+		tjs_uint rest = (tjs_uint)Data.size() - Position;
+		if( read_size > rest ) read_size = rest;
+		if( read_size ) memcpy( buffer, &Data[Position], read_size );
+		Position += read_size;
+		return read_size;
+	}
+	tjs_uint TJS_INTF_METHOD Write( const void *buffer, tjs_uint write_size ) {
+		if( write_size == 0 ) return 0;
+		if( Position + write_size > Data.size() ) Data.resize( Position + write_size );
+		memcpy( &Data[Position], buffer, write_size );
+		Position += write_size;
+		return write_size;
+	}
+	tjs_uint64 TJS_INTF_METHOD GetSize() { return Data.size(); }
+};
+//---------------------------------------------------------------------------
+// tTJSBinaryStructMembers : collects the members of a dictionary
+//---------------------------------------------------------------------------
+struct tTJSBinaryStructMembers : public tTJSDispatch {
+	std::vector<tTJSVariant> Names;
+	std::vector<tTJSVariant> Values;
+
+	tjs_error TJS_INTF_METHOD FuncCall( tjs_uint32 flag, const tjs_char * membername,
+		tjs_uint32 *hint, tTJSVariant *result, tjs_int numparams,
+		tTJSVariant **param, iTJSDispatch2 *objthis ) {
+		if( numparams < 3 ) return TJS_E_BADPARAMCOUNT;
+		// hidden members are not processed
+		tjs_uint32 flags = (tjs_int)*param[1];
+		if( !(flags & TJS_HIDDENMEMBER) ) {
+			Names.push_back( *param[0] );
+			Values.push_back( *param[2] );
+		}
+		if( result ) *result = (tjs_int)1;
+		return TJS_S_OK;
+	}
+};
+//---------------------------------------------------------------------------
+// tTJSBinaryStructWriter
+//---------------------------------------------------------------------------
+bool tTJSBinaryStructWriter::IsSharedMode( const tjs_char* mode ) {
+	return TJS_strchr( mode, TJS_W('s') ) != NULL || TJS_strchr( mode, TJS_W('z') ) != NULL;
+}
+tTJSBinaryStructWriter::tTJSBinaryStructWriter( const tjs_char* mode )
+ : CompressionLevel(-2), Body(NULL), StringCount(0), ObjectCount(0) {
+	// zN: compress at level N ( same as the text stream )
+	const tjs_char* p = TJS_strchr( mode, TJS_W('z') );
+	if( p ) {
+		CompressionLevel = Z_DEFAULT_COMPRESSION;
+		if( p[1] >= TJS_W('0') && p[1] <= TJS_W('9') )
+			CompressionLevel = p[1] - TJS_W('0');
+	}
+	Body = new tTJSBinaryMemoryStream();
+}
+tTJSBinaryStructWriter::~tTJSBinaryStructWriter() {
+	delete Body;
+}
+void tTJSBinaryStructWriter::Write( tTJSBinaryStream* stream, iTJSDispatch2* root ) {
+	PutObject( root );
+
+	std::vector<tjs_uint8>& data = Body->Data;
+	if( CompressionLevel == -2 ) {
+		stream->WriteBuffer( tTJSBinarySerializer::SHARED_HEADER, tTJSBinarySerializer::HEADER_LENGTH );
+		stream->WriteBuffer( &data[0], (tjs_uint)data.size() );
+	} else {
+		uLongf destsize = compressBound( (uLong)data.size() );
+		std::vector<tjs_uint8> dest( destsize );
+		if( compress2( &dest[0], &destsize, &data[0], (uLong)data.size(), CompressionLevel ) != Z_OK )
+			TJS_eTJSError( TJSWriteError );
+		tjs_uint32 rawsize = (tjs_uint32)data.size();
+		tjs_uint8 tmp[4];
+		tmp[0] = rawsize&0xff;
+		tmp[1] = (rawsize>>8)&0xff;
+		tmp[2] = (rawsize>>16)&0xff;
+		tmp[3] = (rawsize>>24)&0xff;
+		stream->WriteBuffer( tTJSBinarySerializer::COMPRESSED_HEADER, tTJSBinarySerializer::HEADER_LENGTH );
+		stream->WriteBuffer( tmp, sizeof(tmp) );
+		stream->WriteBuffer( &dest[0], (tjs_uint)destsize );
+	}
+}
+void tTJSBinaryStructWriter::PutRef( tjs_uint8 type, tjs_uint index ) {
+	tjs_uint8 tmp[1];
+	tmp[0] = type;
+	Body->Write( tmp, sizeof(tmp) );
+	tTJSBinarySerializer::PutInteger( Body, index );
+}
+void tTJSBinaryStructWriter::PutString( tTJSVariantString* str ) {
+	if( str == NULL || str->GetLength() == 0 ) {
+		tTJSBinarySerializer::PutString( Body, (const tTJSVariantString*)NULL );
+		return;
+	}
+	ttstr key(str);
+	tjs_uint32 hash = tTJSHashFunc<ttstr>::Make( key );
+	tjs_uint* index = Strings.FindWithHash( key, hash );
+	if( index ) {
+		PutRef( tTJSBinarySerializer::TYPE_STRING_REF, *index );
+		return;
+	}
+	Strings.AddWithHash( key, hash, StringCount++ );
+	tTJSBinarySerializer::PutString( Body, str );
+}
+void tTJSBinaryStructWriter::PutValue( tTJSVariant& v ) {
+	switch( v.Type() ) {
+	case tvtObject:
+		PutObject( v.AsObjectClosureNoAddRef().SelectObjectNoAddRef() );
+		break;
+	case tvtString:
+		PutString( v.AsStringNoAddRef() );
+		break;
+	default:
+		tTJSBinarySerializer::PutVariant( Body, v );
+		break;
+	}
+}
+void tTJSBinaryStructWriter::PutObject( iTJSDispatch2* dsp ) {
+	if( dsp == NULL ) {
+		tTJSBinarySerializer::PutNull( Body );
+		return;
+	}
+	tjs_uint* index = Objects.Find( dsp );
+	if( index ) {
+		PutRef( tTJSBinarySerializer::TYPE_OBJECT_REF, *index );
+		return;
+	}
+
+	tTJSDictionaryNI *dicni = NULL;
+	tTJSArrayNI *arrayni = NULL;
+	if( TJS_SUCCEEDED(dsp->NativeInstanceSupport(TJS_NIS_GETINSTANCE,
+		TJSGetDictionaryClassID(), (iTJSNativeInstance**)&dicni)) ) {
+		// dictionary; members are collected first to know the count
+		Objects.Add( dsp, ObjectCount++ );
+		tTJSBinaryStructMembers members;
+		tTJSVariantClosure clo(&members, NULL);
+		dsp->EnumMembers( TJS_IGNOREPROP, &clo, dsp );
+		tjs_uint count = (tjs_uint)members.Names.size();
+		tTJSBinarySerializer::PutStartMap( Body, count );
+		for( tjs_uint i = 0; i < count; i++ ) {
+			PutString( members.Names[i].AsStringNoAddRef() );
+			PutValue( members.Values[i] );
+		}
+	} else if( TJS_SUCCEEDED(dsp->NativeInstanceSupport(TJS_NIS_GETINSTANCE,
+		TJSGetArrayClassID(), (iTJSNativeInstance**)&arrayni)) ) {
+		// array
+		Objects.Add( dsp, ObjectCount++ );
+		tjs_uint count = (tjs_uint)arrayni->Items.size();
+		tTJSBinarySerializer::PutStartArray( Body, count );
+		for( tjs_uint i = 0; i < count; i++ ) {
+			PutValue( arrayni->Items[i] );
+		}
+	} else {
+		// other objects
+		tTJSBinarySerializer::PutNull( Body );
+	}
+}
 
 } // namespace
 
@@ -14,6 +14,7 @@
 #include "tjsVariant.h"
 #include "tjsError.h"
 #include "tjsGlobalStringMap.h"
+#include "tjsHashSearch.h"
 #include <vector>
 #include <limits.h>
 
@@ -42,6 +43,10 @@ public:
 		TYPE_STRING16 = 0xC5,
 		TYPE_STRING32 = 0xC6,
 
+		// shared format only; followed by the index as an integer
+		TYPE_STRING_REF = 0xC7,	// string already stored
+		TYPE_OBJECT_REF = 0xC8,	// dictionary or array already stored
+
 		TYPE_FLOAT = 0xCA,
 		TYPE_DOUBLE = 0xCB,
 
@@ -77,6 +82,9 @@ public:
 	};
 	static const tjs_int HEADER_LENGTH = 8;
 	static const tjs_uint8 HEADER[HEADER_LENGTH];
+	static const tjs_uint8 SHARED_HEADER[HEADER_LENGTH];
+	static const tjs_uint8 COMPRESSED_HEADER[HEADER_LENGTH];
+	static const tjs_uint MAX_COMPRESSION_RATIO = 1032; // of zlib
 	static bool IsBinary( const tjs_uint8 header[HEADER_LENGTH] );
 
 	/*
@@ -132,7 +140,7 @@ public:
 				tmp[1] = (tjs_uint8)( v&0xff );
 				tmp[2] = (tjs_uint8)( (v>>8)&0xff );
 				stream->Write( tmp, sizeof(tmp) );
-			} else if( b >= LONG_MIN ) {
+			} else if( b >= INT_MIN ) {
 				tjs_int32 v = (tjs_int32)b;
 				tjs_uint8 tmp[5];
 				tmp[0] = TYPE_INT32;
@@ -307,11 +315,7 @@ public:
 		tjs_int len = 0;
 		if( val ) {
 			len = val->GetLength();
-			if( val->LongString ) {
-				data = val->LongString;
-			} else {
-				data = val->ShortString;
-			}
+			data = val->operator const tjs_char *();
 		}
 		PutString( stream, data, len );
 	}
@@ -407,13 +411,14 @@ public:
 	static inline tTJSVariantString* ReadString( const tjs_uint8* buff, tjs_uint len, tjs_uint& index ) {
 		tTJSVariantString* ret = NULL;
 		if( len > 0 ) {
-			tjs_char* str = new tjs_char[len];
+			tjs_char* str = new tjs_char[len+1];
 			for( tjs_uint i = 0; i < len; i++ ) {
 				str[i] = buff[index];
 				index++;
 				str[i] |= buff[index] << 8;
 				index++;
 			}
+			str[len] = 0; // TJSAllocVariantString looks for the terminator
 			ret = TJSAllocVariantString( str, len );
 			delete []str;
 		}
@@ -450,13 +455,20 @@ public:
 	tTJSBinarySerializer( class tTJSDictionaryObject* root );
 	tTJSBinarySerializer( class tTJSArrayObject* root );
 	~tTJSBinarySerializer();
-	tTJSVariant* Read( tTJSBinaryStream* stream );
+	tTJSVariant* Read( tTJSBinaryStream* stream, const tjs_uint8 header[HEADER_LENGTH] );
 
 private:
 	iTJSDispatch2* DicClass;
 	class tTJSDictionaryObject* RootDictionary;
 	class tTJSArrayObject* RootArray;
 
+	// shared format
+	bool Shared;
+	std::vector<tTJSVariant> SharedStrings;
+	std::vector<iTJSDispatch2*> SharedObjects;
+
+	tjs_uint ReadIndex( const tjs_uint8* buff, const tjs_uint size, tjs_uint& index, tjs_uint limit );
+
 	class tTJSDictionaryObject* CreateDictionary( tjs_uint count );
 	class tTJSArrayObject* CreateArray( tjs_uint count );
 	void AddDictionary( class tTJSDictionaryObject* dic, tTJSVariantString* name, tTJSVariant* value );
@@ -466,6 +478,41 @@ private:
 	tTJSVariant* ReadDictionary( const tjs_uint8* buff, const tjs_uint size, const tjs_uint count, tjs_uint& index );
 };
 
+/**
+ * writes dictionaries and arrays in the shared format.
+ * each string and each dictionary/array is stored only once and later
+ * occurrences refer to the first one, so shared references and cycles
+ * survive a save/load round trip. the whole image is built in memory and
+ * optionally compressed with zlib before it is written to the stream.
+ * only these two formats exist: KBAD200 (shared tables) and KBAD20Z (the
+ * same, zlib-compressed). there is no delta format against a previous
+ * save, and no LZ4 or other compressor.
+ */
+class tTJSBinaryStructWriter {
+public:
+	/** 's' or 'z' in the mode string of saveStruct selects the shared format */
+	static bool IsSharedMode( const tjs_char* mode );
+
+	tTJSBinaryStructWriter( const tjs_char* mode );
+	~tTJSBinaryStructWriter();
+
+	void Write( tTJSBinaryStream* stream, iTJSDispatch2* root );
+
+private:
+	tjs_int CompressionLevel;	// -2 : not compressed
+	class tTJSBinaryMemoryStream* Body;
+
+	tTJSHashTable<ttstr, tjs_uint, tTJSHashFunc<ttstr>, 1024> Strings;
+	tTJSHashTable<iTJSDispatch2*, tjs_uint, tTJSHashFunc<iTJSDispatch2*>, 256> Objects;
+	tjs_uint StringCount;
+	tjs_uint ObjectCount;
+
+	void PutRef( tjs_uint8 type, tjs_uint index );
+	void PutString( tTJSVariantString* str );
+	void PutValue( tTJSVariant& v );
+	void PutObject( iTJSDispatch2* dsp );
+};
+
 } // namespace
 #endif // tjsBinarySerializerH
 
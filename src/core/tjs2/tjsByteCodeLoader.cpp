@@ -200,7 +200,9 @@ void tTJSByteCodeLoader::ReadObjects( tTJSScriptBlock* block, const tjs_uint8* b
 		tTJSInterCodeContext::tSourcePos* srcPos = NULL;
 		tjs_int srcPosArraySize = 0;
 		if( count > 0 ) {
-			srcPos = new tTJSInterCodeContext::tSourcePos[count];
+			srcPos = (tTJSInterCodeContext::tSourcePos*)TJS_malloc(
+				sizeof(tTJSInterCodeContext::tSourcePos) * count );
+			if( !srcPos ) TJS_eTJSError( TJSInsufficientMem );
 			srcPosArraySize = count;
 			for( int i = 0; i < count; i++ ) {
 				srcPos[i].CodePos = read4byte( &(buff[offset]) );
@@ -217,7 +219,8 @@ void tTJSByteCodeLoader::ReadObjects( tTJSScriptBlock* block, const tjs_uint8* b
 		count = read4byte( &(buff[offset]) );
 		const tjs_int codeSize = count;
 		offset += 4;
-		tjs_int32* code = new tjs_int32[count];
+		tjs_int32* code = (tjs_int32*)TJS_malloc( sizeof(tjs_int32) * (count ? count : 1) );
+		if( !code ) TJS_eTJSError( TJSInsufficientMem );
 		for( int i = 0; i < count; i++ ) {
 			tjs_int16 c = (tjs_int16)read2byte( &(buff[offset]) );
 			code[i] = c;
@@ -617,6 +620,22 @@ void tTJSByteCodeLoader::TranslateCodeAddress( tTJSScriptBlock* block, tjs_int32
 
 		case VM_EXTRY: size = 1; break;
 
+		case VM_CEQJF:
+		case VM_CEQJNF:
+		case VM_CDEQJF:
+		case VM_CDEQJNF:
+		case VM_CLTJF:
+		case VM_CLTJNF:
+		case VM_CGTJF:
+		case VM_CGTJNF:
+		case VM_INCLTJF:
+		case VM_DECGTJF:
+			TJS_OFFSET_VM_CODE_ADDR(code[i+1]);
+			TJS_OFFSET_VM_REG_ADDR(code[i+2]);
+			TJS_OFFSET_VM_REG_ADDR(code[i+3]);
+			size = 4;
+			break;
+
 		case VM_THROW:
 			TJS_OFFSET_VM_REG_ADDR(code[i+1]);
 			size = 2;
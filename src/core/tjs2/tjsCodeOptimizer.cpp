@@ -0,0 +1,884 @@
+//---------------------------------------------------------------------------
+/*
+	TJS2 Script Engine
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// VM code optimizer
+//---------------------------------------------------------------------------
+#include "tjsCommHead.h"
+
+#include "tjsInterCodeGen.h"
+#include "tjsScriptBlock.h"
+#include "tjsError.h"
+
+/*
+	The optimizer rewrites the code of a context after the code generation,
+	before FixCode. The jump addresses are still relative word counts at
+	this point, and every jump code is listed in JumpList.
+
+	- dead code elimination:
+		"const" and "cp" into a frame register whose value is never read
+		are removed.
+	- copy propagation:
+		"op %t, ...; cp %v, %t" is rewritten to "op %v, ..." when %t is not
+		read afterwards. instructions between the definition of %t and the
+		"cp" which modify %t ( like "add %t, %x" ) are rewritten too.
+	- compare-and-jump:
+		"ceq", "cdeq", "clt" or "cgt" followed by "jf" or "jnf" is fused
+		into one instruction ( ceqjf, ceqjnf ... ).
+	- loop rotation ( jump threading ):
+		"jmp" to a loop condition which jumps out of the loop to just after
+		the "jmp", is replaced with a copy of the condition which jumps back
+		into the loop body.
+	- increment-and-test:
+		"inc %r; clt(jf) %r, %x" is fused into "incltjf", and
+		"dec %r; cgt(jf) %r, %x" into "decgtjf".
+	- jumps to the next instruction are removed.
+
+	Only frame registers ( positive register numbers ), which hold the
+	temporary values of expressions, are the subject of the liveness
+	analysis. Local variables are never removed nor be written earlier than
+	the original code does, unless no exception can be caught in the
+	function at that point.
+
+	The superinstructions are ordinary VM codes; they are executed by
+	tjsInterCodeExec.cpp and are written in / read from the bytecode as
+	other codes are.
+*/
+
+//---------------------------------------------------------------------------
+namespace TJS  // following is in the namespace
+{
+//---------------------------------------------------------------------------
+// tTJSCodeOptimizer
+//---------------------------------------------------------------------------
+class tTJSCodeOptimizer
+{
+	enum tOperandRole
+	{
+		orNone,			// not a register; operation code, data address, count ...
+		orRead,			// register which is read
+		orWrite,		// register which is overwritten
+		orReadWrite,	// register which is read and then modified
+		orJump			// relative jump address
+	};
+
+	struct tCode
+	{
+		tjs_int Start;	// start of the instruction in Words
+		tjs_int Size;	// instruction size in words
+		tjs_int Orig;	// index of the original instruction this comes from
+		tjs_int Target;	// original index of the jump target, -1 for no jump
+		bool Label;		// can be reached from other than the previous code
+		bool Deleted;
+	};
+
+	struct tTry
+	{
+		tjs_int Entry;	// index of the "entry" instruction
+		tjs_int Catch;	// index of the catch clause
+		tjs_int ExReg;	// register which receives the exception object
+	};
+
+	std::vector<tjs_int32> Words;
+	std::vector<tjs_uint8> Roles;
+	std::vector<tCode> Codes;
+	std::vector<tjs_int> OrigFirst; // original index -> first index in Codes
+	std::vector<tjs_int> PosIndex; // original code position -> original index
+	std::vector<tjs_int> Entries; // original indices of additional entry points
+	std::vector<tTry> Tries;
+	tjs_int OrigCount;
+	tjs_int OrigSize;
+	tjs_int MaxReg;
+
+	// liveness of frame registers after each instruction
+	std::vector<tjs_uint32> LiveOut;
+	tjs_int LiveWords;
+
+	// results
+	std::vector<tjs_int32> NewCode;
+	std::vector<tjs_int> NewJumps;
+	std::vector<tjs_int> NewOrigPos; // original index -> new code position
+
+public:
+	tTJSCodeOptimizer() : OrigCount(0), OrigSize(0), MaxReg(0), LiveWords(0) {}
+
+	bool Optimize(const tjs_int32 *code, tjs_int size,
+		const std::list<tjs_int> &jumps, const std::vector<tjs_int> &entries);
+
+	const std::vector<tjs_int32> & GetCode() const { return NewCode; }
+	const std::vector<tjs_int> & GetJumps() const { return NewJumps; }
+	tjs_int MapPosition(tjs_int pos) const
+		{ return NewOrigPos[pos >= OrigSize ? OrigCount : PosIndex[pos]]; }
+
+private:
+	static tjs_int GetOperandRoles(const tjs_int32 *code, tjs_uint8 *roles);
+	static bool IsCompareJump(tjs_int32 op)
+		{ return op >= VM_CEQJF && op <= VM_CGTJNF; }
+	static tjs_int Reg(tjs_int32 word) { return TJS_FROM_VM_REG_ADDR(word); }
+	static bool IsRegRole(tjs_uint8 role)
+		{ return role == orRead || role == orWrite || role == orReadWrite; }
+
+	tjs_int32 Op(tjs_int i) const { return Words[Codes[i].Start]; }
+	tjs_int32 & Operand(tjs_int i, tjs_int n) { return Words[Codes[i].Start + n]; }
+	tjs_int NextLive(tjs_int i) const;
+	bool HasLabel(tjs_int from, tjs_int to) const;
+	tjs_int Resolve(tjs_int orig) const { return NextLive(OrigFirst[orig]); }
+	tjs_int Synthesize(tjs_int32 op, tjs_int a, tjs_int b, bool modifya);
+	void RebuildOrigFirst();
+	void MarkLabels();
+
+	bool Decode(const tjs_int32 *code, tjs_int size,
+		const std::list<tjs_int> &jumps, const std::vector<tjs_int> &entries);
+	bool IsLive(tjs_int i, tjs_int reg) const
+		{ return 0 != (LiveOut[i * LiveWords + (reg >> 5)] & (1u << (reg & 31))); }
+	void ComputeLiveness();
+	void EliminateDeadCode();
+	void PropagateCopies();
+	void FuseCompareJumps();
+	void RotateLoops();
+	void FuseIncrements();
+	void RemoveNullJumps();
+	void Emit();
+};
+//---------------------------------------------------------------------------
+tjs_int tTJSCodeOptimizer::GetOperandRoles(const tjs_int32 *code, tjs_uint8 *roles)
+{
+	// fill "roles" with the role of each word of the instruction at "code"
+	// and return the size of the instruction.
+	// 0 is returned for codes which are not known by the optimizer.
+	roles[0] = orNone;
+	tjs_int32 op = code[0];
+	switch(op)
+	{
+	case VM_NOP: case VM_NF: case VM_RET: case VM_EXTRY: case VM_REGMEMBER:
+	case VM_DEBUGGER:
+		return 1;
+
+	case VM_CONST:
+		roles[1] = orWrite; roles[2] = orNone;
+		return 3;
+
+	case VM_CP: case VM_GETP:
+		roles[1] = orWrite; roles[2] = orRead;
+		return 3;
+
+	case VM_CL: case VM_SETF: case VM_SETNF: case VM_GLOBAL:
+		roles[1] = orWrite;
+		return 2;
+
+	case VM_CCL:
+		// clears code[2] registers from code[1]; the range is handled by
+		// ComputeLiveness and PropagateCopies themselves
+		roles[1] = orNone; roles[2] = orNone;
+		return 3;
+
+	case VM_TT: case VM_TF: case VM_SRV: case VM_THROW:
+		roles[1] = orRead;
+		return 2;
+
+	case VM_CEQ: case VM_CDEQ: case VM_CLT: case VM_CGT: case VM_SETP:
+	case VM_ADDCI:
+		roles[1] = orRead; roles[2] = orRead;
+		return 3;
+
+	case VM_LNOT: case VM_BNOT: case VM_TYPEOF: case VM_EVAL: case VM_EEXP:
+	case VM_ASC: case VM_CHR: case VM_NUM: case VM_CHS: case VM_INV:
+	case VM_CHKINV: case VM_INT: case VM_REAL: case VM_STR: case VM_OCTET:
+		roles[1] = orReadWrite;
+		return 2;
+
+	case VM_CHKINS: case VM_CHGTHIS:
+		roles[1] = orReadWrite; roles[2] = orRead;
+		return 3;
+
+	case VM_JF: case VM_JNF: case VM_JMP:
+		roles[1] = orJump;
+		return 2;
+
+	case VM_ENTRY:
+		roles[1] = orJump;
+		roles[2] = orNone; // written when an exception is caught
+		return 3;
+
+	case VM_GPD: case VM_GPDS: case VM_DELD: case VM_TYPEOFD:
+		roles[1] = orWrite; roles[2] = orRead; roles[3] = orNone;
+		return 4;
+
+	case VM_GPI: case VM_GPIS: case VM_DELI: case VM_TYPEOFI:
+		roles[1] = orWrite; roles[2] = orRead; roles[3] = orRead;
+		return 4;
+
+	case VM_SPD: case VM_SPDE: case VM_SPDEH: case VM_SPDS:
+		roles[1] = orRead; roles[2] = orNone; roles[3] = orRead;
+		return 4;
+
+	case VM_SPI: case VM_SPIE: case VM_SPIS:
+		roles[1] = orRead; roles[2] = orRead; roles[3] = orRead;
+		return 4;
+
+	case VM_CEQJF: case VM_CEQJNF: case VM_CDEQJF: case VM_CDEQJNF:
+	case VM_CLTJF: case VM_CLTJNF: case VM_CGTJF: case VM_CGTJNF:
+		roles[1] = orJump; roles[2] = orRead; roles[3] = orRead;
+		return 4;
+
+	case VM_INCLTJF: case VM_DECGTJF:
+		roles[1] = orJump; roles[2] = orReadWrite; roles[3] = orRead;
+		return 4;
+
+	case VM_CALL: case VM_CALLD: case VM_CALLI: case VM_NEW:
+	  {
+		roles[1] = orWrite;
+		roles[2] = orRead;
+		tjs_int st; // start of arguments
+		if(op == VM_CALLD || op == VM_CALLI)
+		{
+			roles[3] = op == VM_CALLI ? orRead : orNone;
+			st = 5;
+		}
+		else
+		{
+			st = 4;
+		}
+		tjs_int num = code[st-1]; // st-1 = argument count
+		roles[st-1] = orNone;
+		if(num == -1) return st; // omitted arguments
+		if(num == -2)
+		{
+			// arguments with expanding
+			num = code[st];
+			roles[st] = orNone;
+			st++;
+			for(tjs_int i = 0; i < num; i++)
+			{
+				roles[st + i*2] = orNone;
+				roles[st + i*2 + 1] =
+					code[st + i*2] == fatUnnamedExpand ? orNone : orRead;
+			}
+			return st + num * 2;
+		}
+		for(tjs_int i = 0; i < num; i++) roles[st + i] = orRead;
+		return st + num;
+	  }
+	}
+
+	if(op >= VM_INC && op <= VM_MULP)
+	{
+		// instructions which have property access variants
+		bool unary = op <= VM_DECP; // inc and dec
+		switch((op - VM_INC) % 4)
+		{
+		case 0: // normal
+			roles[1] = orReadWrite;
+			if(unary) return 2;
+			roles[2] = orRead;
+			return 3;
+		case 1: // pd
+			roles[1] = orWrite; roles[2] = orRead; roles[3] = orNone;
+			if(unary) return 4;
+			roles[4] = orRead;
+			return 5;
+		case 2: // pi
+			roles[1] = orWrite; roles[2] = orRead; roles[3] = orRead;
+			if(unary) return 4;
+			roles[4] = orRead;
+			return 5;
+		case 3: // p
+			roles[1] = orWrite; roles[2] = orRead;
+			if(unary) return 3;
+			roles[3] = orRead;
+			return 4;
+		}
+	}
+
+	return 0;
+}
+//---------------------------------------------------------------------------
+tjs_int tTJSCodeOptimizer::NextLive(tjs_int i) const
+{
+	// returns the first index of living code at or after "i"
+	tjs_int count = (tjs_int)Codes.size();
+	while(i < count && Codes[i].Deleted) i++;
+	return i;
+}
+//---------------------------------------------------------------------------
+bool tTJSCodeOptimizer::HasLabel(tjs_int from, tjs_int to) const
+{
+	// returns whether any code in from+1 .. to can be jumped to.
+	// deleted codes are examined too, as the jumps to them reach the next
+	// living code.
+	for(tjs_int i = from + 1; i <= to; i++)
+		if(Codes[i].Label) return true;
+	return false;
+}
+//---------------------------------------------------------------------------
+tjs_int tTJSCodeOptimizer::Synthesize(tjs_int32 op, tjs_int a, tjs_int b,
+	bool modifya)
+{
+	// append a superinstruction of ( jump, register, register ) to Words and
+	// return its start
+	tjs_int start = (tjs_int)Words.size();
+	Words.push_back(op);
+	Words.push_back(0);
+	Words.push_back(a);
+	Words.push_back(b);
+	Roles.push_back(orNone);
+	Roles.push_back(orJump);
+	Roles.push_back(modifya ? orReadWrite : orRead);
+	Roles.push_back(orRead);
+	return start;
+}
+//---------------------------------------------------------------------------
+void tTJSCodeOptimizer::RebuildOrigFirst()
+{
+	OrigFirst.assign(OrigCount + 1, (tjs_int)Codes.size());
+	for(tjs_int i = (tjs_int)Codes.size() - 1; i >= 0; i--)
+		OrigFirst[Codes[i].Orig] = i;
+}
+//---------------------------------------------------------------------------
+void tTJSCodeOptimizer::MarkLabels()
+{
+	tjs_int count = (tjs_int)Codes.size();
+	for(tjs_int i = 0; i < count; i++) Codes[i].Label = false;
+
+	for(tjs_int i = 0; i < count; i++)
+	{
+		if(Codes[i].Deleted || Codes[i].Target == -1) continue;
+		tjs_int t = Resolve(Codes[i].Target);
+		if(t < count) Codes[t].Label = true;
+	}
+
+	for(std::vector<tjs_int>::const_iterator i = Entries.begin();
+		i != Entries.end(); i++)
+	{
+		tjs_int t = Resolve(*i);
+		if(t < count) Codes[t].Label = true;
+	}
+}
+//---------------------------------------------------------------------------
+bool tTJSCodeOptimizer::Decode(const tjs_int32 *code, tjs_int size,
+	const std::list<tjs_int> &jumps, const std::vector<tjs_int> &entries)
+{
+	Words.assign(code, code + size);
+	Roles.resize(size);
+	PosIndex.assign(size, -1);
+	OrigSize = size;
+	MaxReg = 0;
+
+	for(tjs_int pos = 0; pos < size; )
+	{
+		tCode c;
+		c.Size = GetOperandRoles(code + pos, &Roles[pos]);
+		if(c.Size == 0 || pos + c.Size > size) return false;
+		c.Start = pos;
+		c.Orig = (tjs_int)Codes.size();
+		c.Target = -1;
+		c.Label = false;
+		c.Deleted = false;
+		for(tjs_int i = 0; i < c.Size; i++)
+		{
+			PosIndex[pos + i] = c.Orig;
+			if(IsRegRole(Roles[pos + i]) && Reg(code[pos + i]) > MaxReg)
+				MaxReg = Reg(code[pos + i]);
+		}
+		if(code[pos] == VM_CCL && code[pos + 2] > 0 &&
+			Reg(code[pos + 1]) + code[pos + 2] - 1 > MaxReg)
+			MaxReg = Reg(code[pos + 1]) + code[pos + 2] - 1;
+		Codes.push_back(c);
+		pos += c.Size;
+	}
+
+	OrigCount = (tjs_int)Codes.size();
+	RebuildOrigFirst();
+
+	// resolve jump targets; every jump code must be in the jump list
+	tjs_int jumpcount = 0;
+	for(tjs_int i = 0; i < OrigCount; i++)
+	{
+		tCode &c = Codes[i];
+		if(c.Size < 2 || Roles[c.Start + 1] != orJump) continue;
+		tjs_int target = c.Start + Words[c.Start + 1];
+		if(target < 0 || target > size) return false;
+		if(target == size)
+			c.Target = OrigCount;
+		else if(PosIndex[target] != -1 && Codes[PosIndex[target]].Start == target)
+			c.Target = PosIndex[target];
+		else
+			return false;
+		jumpcount++;
+	}
+	if(jumpcount != (tjs_int)jumps.size()) return false;
+	for(std::list<tjs_int>::const_iterator i = jumps.begin(); i != jumps.end(); i++)
+	{
+		if(*i < 0 || *i >= size) return false;
+		tjs_int idx = PosIndex[*i];
+		if(Codes[idx].Start != *i || Codes[idx].Target == -1) return false;
+	}
+
+	// entry points other than the top
+	for(std::vector<tjs_int>::const_iterator i = entries.begin();
+		i != entries.end(); i++)
+	{
+		if(*i < 0 || *i >= size) continue;
+		if(Codes[PosIndex[*i]].Start != *i) return false;
+		Entries.push_back(PosIndex[*i]);
+	}
+
+	// try blocks
+	for(tjs_int i = 0; i < OrigCount; i++)
+	{
+		if(Op(i) != VM_ENTRY) continue;
+		tTry t;
+		t.Entry = i;
+		t.Catch = Codes[i].Target;
+		t.ExReg = Reg(Operand(i, 2));
+		if(t.Catch <= i) return false;
+		Tries.push_back(t);
+	}
+
+	MarkLabels();
+	return true;
+}
+//---------------------------------------------------------------------------
+void tTJSCodeOptimizer::ComputeLiveness()
+{
+	// backward data flow analysis of frame registers.
+	// "live out" of an instruction is the set of the registers which may be
+	// read after the instruction before they are overwritten.
+	tjs_int count = OrigCount;
+	LiveWords = MaxReg / 32 + 1;
+	LiveOut.assign(count * LiveWords, 0);
+	std::vector<tjs_uint32> livein(count * LiveWords, 0);
+	std::vector<tjs_uint32> out(LiveWords);
+	std::vector<tjs_uint32> in(LiveWords);
+
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(tjs_int i = count - 1; i >= 0; i--)
+		{
+			const tCode &c = Codes[i];
+			tjs_int32 op = Words[c.Start];
+
+			// union of successors' live-in
+			std::fill(out.begin(), out.end(), 0);
+			if(op != VM_JMP && op != VM_RET && op != VM_THROW && i + 1 < count)
+			{
+				const tjs_uint32 *s = &livein[(i + 1) * LiveWords];
+				for(tjs_int w = 0; w < LiveWords; w++) out[w] |= s[w];
+			}
+			if(c.Target != -1 && op != VM_ENTRY && c.Target < count)
+			{
+				const tjs_uint32 *s = &livein[c.Target * LiveWords];
+				for(tjs_int w = 0; w < LiveWords; w++) out[w] |= s[w];
+			}
+			for(std::vector<tTry>::const_iterator t = Tries.begin();
+				t != Tries.end(); t++)
+			{
+				// any code in a try block may reach the catch clause;
+				// the exception object register is written at that time.
+				if(i <= t->Entry || i >= t->Catch) continue;
+				const tjs_uint32 *s = &livein[t->Catch * LiveWords];
+				for(tjs_int w = 0; w < LiveWords; w++)
+				{
+					tjs_uint32 bits = s[w];
+					if(t->ExReg > 0 && (t->ExReg >> 5) == w)
+						bits &= ~(1u << (t->ExReg & 31));
+					out[w] |= bits;
+				}
+			}
+
+			// live-in = reads + ( live-out - writes )
+			in = out;
+			for(tjs_int k = 1; k < c.Size; k++)
+			{
+				tjs_int r = Reg(Words[c.Start + k]);
+				if(Roles[c.Start + k] == orWrite && r > 0)
+					in[r >> 5] &= ~(1u << (r & 31));
+			}
+			if(op == VM_CCL)
+			{
+				tjs_int r = Reg(Words[c.Start + 1]);
+				tjs_int end = r + Words[c.Start + 2];
+				if(r < 1) r = 1;
+				for(; r < end; r++) in[r >> 5] &= ~(1u << (r & 31));
+			}
+			for(tjs_int k = 1; k < c.Size; k++)
+			{
+				tjs_int r = Reg(Words[c.Start + k]);
+				tjs_uint8 role = Roles[c.Start + k];
+				if((role == orRead || role == orReadWrite) && r > 0)
+					in[r >> 5] |= 1u << (r & 31);
+			}
+
+			tjs_uint32 *lo = &LiveOut[i * LiveWords];
+			tjs_uint32 *li = &livein[i * LiveWords];
+			for(tjs_int w = 0; w < LiveWords; w++)
+			{
+				if(lo[w] != out[w] || li[w] != in[w]) changed = true;
+				lo[w] = out[w];
+				li[w] = in[w];
+			}
+		}
+	}
+}
+//---------------------------------------------------------------------------
+void tTJSCodeOptimizer::EliminateDeadCode()
+{
+	// remove copies to the registers which are never read.
+	// "cl" is kept, as it releases the object held by the register.
+	for(tjs_int i = 0; i < OrigCount; i++)
+	{
+		tCode &c = Codes[i];
+		tjs_int32 op = Words[c.Start];
+		if(op != VM_CONST && op != VM_CP && op != VM_GLOBAL &&
+			op != VM_SETF && op != VM_SETNF) continue;
+		tjs_int r = Reg(Words[c.Start + 1]);
+		if((r > 0 && !IsLive(i, r)) ||
+			(op == VM_CP && r == Reg(Words[c.Start + 2])))
+			c.Deleted = true;
+	}
+}
+//---------------------------------------------------------------------------
+void tTJSCodeOptimizer::PropagateCopies()
+{
+	// in-try flags; locals written earlier than the original code may be
+	// observed by the catch clause
+	std::vector<bool> intry(OrigCount, false);
+	for(std::vector<tTry>::const_iterator t = Tries.begin(); t != Tries.end(); t++)
+		for(tjs_int i = t->Entry + 1; i < t->Catch; i++) intry[i] = true;
+
+	for(tjs_int c = 0; c < OrigCount; c++)
+	{
+		// find "cp %v, %t"
+		tCode &cc = Codes[c];
+		if(cc.Deleted || cc.Label || Op(c) != VM_CP) continue;
+		tjs_int v = Reg(Operand(c, 1));
+		tjs_int t = Reg(Operand(c, 2));
+		if(t <= 0 || v == t || (v >= -2 && v <= 0)) continue;
+			// -1 and -2 are "this" and "this-proxy"
+		if(IsLive(c, t)) continue;
+
+		// find the definition of %t in the same basic block
+		tjs_int p = -1;
+		bool between = false;
+		for(tjs_int j = c - 1; j >= 0; j--)
+		{
+			if(Codes[j + 1].Label) break;
+			const tCode &jc = Codes[j];
+			if(jc.Deleted) continue;
+			tjs_int32 op = Words[jc.Start];
+			if(jc.Target != -1 || op == VM_RET || op == VM_THROW ||
+				op == VM_EXTRY || op == VM_CCL) break;
+
+			bool defines = false;
+			bool refv = false;
+			for(tjs_int k = 1; k < jc.Size; k++)
+			{
+				tjs_uint8 role = Roles[jc.Start + k];
+				if(!IsRegRole(role)) continue;
+				tjs_int r = Reg(Words[jc.Start + k]);
+				if(r == t && role == orWrite) defines = true;
+				if(r == v) refv = true;
+			}
+			if(defines)
+			{
+				p = j;
+				break;
+			}
+			if(refv) break;
+			between = true;
+		}
+		if(p == -1) continue;
+		if(between && intry[c]) continue;
+
+		// %v must not be an operand of the definition, except for
+		// "cp %t, %v" which becomes meaningless
+		bool pself = Op(p) == VM_CP && Reg(Operand(p, 2)) == v;
+		if(!pself)
+		{
+			bool refv = false;
+			const tCode &pc = Codes[p];
+			for(tjs_int k = 1; k < pc.Size; k++)
+			{
+				if(IsRegRole(Roles[pc.Start + k]) && Reg(Words[pc.Start + k]) == v)
+					refv = true;
+			}
+			if(refv) continue;
+		}
+
+		// rename %t to %v
+		const tCode &pc = Codes[p];
+		for(tjs_int k = 1; k < pc.Size; k++)
+		{
+			if(Roles[pc.Start + k] == orWrite && Reg(Words[pc.Start + k]) == t)
+				Words[pc.Start + k] = TJS_TO_VM_REG_ADDR(v);
+		}
+		for(tjs_int j = p + 1; j < c; j++)
+		{
+			const tCode &jc = Codes[j];
+			if(jc.Deleted) continue;
+			for(tjs_int k = 1; k < jc.Size; k++)
+			{
+				if(IsRegRole(Roles[jc.Start + k]) && Reg(Words[jc.Start + k]) == t)
+					Words[jc.Start + k] = TJS_TO_VM_REG_ADDR(v);
+			}
+		}
+		cc.Deleted = true;
+		if(pself) Codes[p].Deleted = true;
+	}
+}
+//---------------------------------------------------------------------------
+void tTJSCodeOptimizer::FuseCompareJumps()
+{
+	tjs_int count = (tjs_int)Codes.size();
+	for(tjs_int i = 0; i < count; i++)
+	{
+		if(Codes[i].Deleted) continue;
+		tjs_int32 op = Op(i);
+		if(op != VM_CEQ && op != VM_CDEQ && op != VM_CLT && op != VM_CGT) continue;
+		tjs_int j = NextLive(i + 1);
+		if(j >= count || HasLabel(i, j)) continue;
+		tjs_int32 jop = Op(j);
+		if(jop != VM_JF && jop != VM_JNF) continue;
+
+		// the flag is still set by the fused code
+		tjs_int32 fused = VM_CEQJF + (op - VM_CEQ) * 2 + (jop == VM_JNF ? 1 : 0);
+		Codes[i].Start = Synthesize(fused, Operand(i, 1), Operand(i, 2), false);
+		Codes[i].Size = 4;
+		Codes[i].Target = Codes[j].Target;
+		Codes[j].Deleted = true;
+	}
+}
+//---------------------------------------------------------------------------
+void tTJSCodeOptimizer::RotateLoops()
+{
+	// "jmp" to a condition ( optionally preceded by a "const" ) which jumps
+	// to just after the "jmp", is replaced with the copy of the condition
+	// with the inverted logic, which jumps to just after the condition.
+	tjs_int count = (tjs_int)Codes.size();
+	std::vector<tjs_int> rotate(count, -1); // jmp index -> condition index
+	bool any = false;
+	for(tjs_int j = 0; j < count; j++)
+	{
+		if(Codes[j].Deleted || Op(j) != VM_JMP) continue;
+		tjs_int t = Resolve(Codes[j].Target);
+		if(t >= count || t == j) continue;
+		tjs_int f = t;
+		if(Op(f) == VM_CONST)
+		{
+			f = NextLive(f + 1);
+			if(f >= count || HasLabel(t, f)) continue;
+		}
+		if(f == j || !IsCompareJump(Op(f))) continue;
+		if(Resolve(Codes[f].Target) != NextLive(j + 1)) continue;
+		tjs_int body = NextLive(f + 1);
+		if(body >= count || OrigFirst[Codes[body].Orig] != body) continue;
+		rotate[j] = t;
+		any = true;
+	}
+	if(!any) return;
+
+	std::vector<tCode> codes;
+	codes.reserve(count + count / 4);
+	for(tjs_int j = 0; j < count; j++)
+	{
+		if(rotate[j] == -1)
+		{
+			codes.push_back(Codes[j]);
+			continue;
+		}
+		tjs_int t = rotate[j];
+		tjs_int f = t;
+		tCode c = Codes[j];
+		if(Op(t) == VM_CONST)
+		{
+			// the copy of "const"
+			c.Start = Codes[t].Start;
+			c.Size = Codes[t].Size;
+			c.Target = -1;
+			codes.push_back(c);
+			c.Label = false;
+			f = NextLive(t + 1);
+		}
+		tjs_int32 op = Op(f);
+		tjs_int32 inverted = VM_CEQJF + ((op - VM_CEQJF) ^ 1);
+		c.Start = Synthesize(inverted, Operand(f, 2), Operand(f, 3), false);
+		c.Size = 4;
+		c.Target = Codes[NextLive(f + 1)].Orig;
+		codes.push_back(c);
+	}
+	Codes.swap(codes);
+	RebuildOrigFirst();
+	MarkLabels();
+}
+//---------------------------------------------------------------------------
+void tTJSCodeOptimizer::FuseIncrements()
+{
+	// "inc %r; [const %k, *n;] cltjf %r, %x" -> "[const %k, *n;] incltjf %r, %x"
+	// "dec %r; [const %k, *n;] cgtjf %r, %x" -> "[const %k, *n;] decgtjf %r, %x"
+	tjs_int count = (tjs_int)Codes.size();
+	for(tjs_int i = 0; i < count; i++)
+	{
+		if(Codes[i].Deleted) continue;
+		tjs_int32 op = Op(i);
+		if(op != VM_INC && op != VM_DEC) continue;
+		tjs_int r = Operand(i, 1);
+		tjs_int n = NextLive(i + 1);
+		if(n >= count || HasLabel(i, n)) continue;
+		tjs_int f = n;
+		bool withconst = false;
+		if(Op(n) == VM_CONST && Operand(n, 1) != r)
+		{
+			f = NextLive(n + 1);
+			if(f >= count || HasLabel(n, f)) continue;
+			withconst = true;
+		}
+		if(Op(f) != (op == VM_INC ? VM_CLTJF : VM_CGTJF)) continue;
+		if(Operand(f, 2) != r || Operand(f, 3) == r) continue;
+
+		tjs_int start = Synthesize(op == VM_INC ? VM_INCLTJF : VM_DECGTJF,
+			r, Operand(f, 3), true);
+		tjs_int target = Codes[f].Target;
+		if(withconst)
+		{
+			// "const" goes first; it does not touch %r
+			Codes[i].Start = Codes[n].Start;
+			Codes[i].Size = Codes[n].Size;
+			Codes[n].Start = start;
+			Codes[n].Size = 4;
+			Codes[n].Target = target;
+		}
+		else
+		{
+			Codes[i].Start = start;
+			Codes[i].Size = 4;
+			Codes[i].Target = target;
+		}
+		Codes[f].Deleted = true;
+	}
+}
+//---------------------------------------------------------------------------
+void tTJSCodeOptimizer::RemoveNullJumps()
+{
+	// backward, to remove successive jumps to the same place
+	tjs_int count = (tjs_int)Codes.size();
+	for(tjs_int i = count - 1; i >= 0; i--)
+	{
+		if(Codes[i].Deleted) continue;
+		tjs_int32 op = Op(i);
+		if(op != VM_JMP && op != VM_JF && op != VM_JNF) continue;
+		if(Resolve(Codes[i].Target) == NextLive(i + 1)) Codes[i].Deleted = true;
+	}
+}
+//---------------------------------------------------------------------------
+void tTJSCodeOptimizer::Emit()
+{
+	tjs_int count = (tjs_int)Codes.size();
+	std::vector<tjs_int> addr(count + 1);
+	tjs_int size = 0;
+	for(tjs_int i = 0; i < count; i++)
+	{
+		addr[i] = size;
+		if(!Codes[i].Deleted) size += Codes[i].Size;
+	}
+	addr[count] = size;
+
+	// original index -> new position
+	NewOrigPos.resize(OrigCount + 1);
+	for(tjs_int i = 0; i <= OrigCount; i++) NewOrigPos[i] = addr[Resolve(i)];
+
+	NewCode.resize(size);
+	NewJumps.clear();
+	for(tjs_int i = 0; i < count; i++)
+	{
+		const tCode &c = Codes[i];
+		if(c.Deleted) continue;
+		std::copy(Words.begin() + c.Start, Words.begin() + c.Start + c.Size,
+			NewCode.begin() + addr[i]);
+		if(c.Target != -1)
+		{
+			NewCode[addr[i] + 1] = NewOrigPos[c.Target] - addr[i];
+			NewJumps.push_back(addr[i]);
+		}
+	}
+}
+//---------------------------------------------------------------------------
+bool tTJSCodeOptimizer::Optimize(const tjs_int32 *code, tjs_int size,
+	const std::list<tjs_int> &jumps, const std::vector<tjs_int> &entries)
+{
+	// returns false when the code is left as is
+	if(!Decode(code, size, jumps, entries)) return false;
+
+	if(MaxReg > 0)
+	{
+		ComputeLiveness();
+		EliminateDeadCode();
+		PropagateCopies();
+	}
+	FuseCompareJumps();
+	RotateLoops();
+	FuseIncrements();
+	RemoveNullJumps();
+
+	Emit();
+	return true;
+}
+//---------------------------------------------------------------------------
+
+
+
+
+//---------------------------------------------------------------------------
+// tTJSInterCodeContext::OptimizeCode
+//---------------------------------------------------------------------------
+void tTJSInterCodeContext::OptimizeCode(void)
+{
+	if(!CodeAreaSize) return;
+
+	std::vector<tjs_int> entries;
+	entries.push_back(FunctionRegisterCodePoint);
+		// FixCode inserts code here
+
+	tTJSCodeOptimizer optimizer;
+	if(!optimizer.Optimize(CodeArea, CodeAreaSize, JumpList, entries)) return;
+
+	// replace the code
+	const std::vector<tjs_int32> &code = optimizer.GetCode();
+	tjs_int newsize = (tjs_int)code.size();
+	tjs_int32 *newcode = (tjs_int32*)TJS_malloc(sizeof(tjs_int32) *
+		(newsize ? newsize : 1));
+	if(!newcode) TJS_eTJSScriptError(TJSInsufficientMem, Block, 0);
+	if(newsize) memcpy(newcode, &code[0], sizeof(tjs_int32) * newsize);
+	TJS_free(CodeArea);
+	CodeArea = newcode;
+	CodeAreaCapa = newsize ? newsize : 1;
+
+	const std::vector<tjs_int> &jumps = optimizer.GetJumps();
+	JumpList.assign(jumps.begin(), jumps.end());
+
+	FunctionRegisterCodePoint = optimizer.MapPosition(FunctionRegisterCodePoint);
+
+	// move the source positions; when the code at a position was removed,
+	// the position of the following code wins.
+	SortSourcePos();
+	tjs_int d = 0;
+	for(tjs_int i = 0; i < SourcePosArraySize; i++)
+	{
+		tjs_int pos = optimizer.MapPosition(SourcePosArray[i].CodePos);
+		if(d && SourcePosArray[d-1].CodePos == pos) d--;
+		SourcePosArray[d].CodePos = pos;
+		SourcePosArray[d].SourcePos = SourcePosArray[i].SourcePos;
+		d++;
+	}
+	SourcePosArraySize = d;
+
+	CodeAreaSize = newsize;
+}
+//---------------------------------------------------------------------------
+} // namespace TJS
+
@@ -100,11 +100,14 @@ int tjsConstArrayData::PutLong( tjs_int64 b ) {
 	}
 }
 int tjsConstArrayData::PutDouble( double b ) {
-	std::map<double,int>::const_iterator index = DoubleHash.find( b );
+	// keyed by the bit pattern; 0.0 and -0.0 compare equal as double
+	tjs_uint64 bits;
+	memcpy( &bits, &b, sizeof(bits) );
+	std::map<tjs_uint64,int>::const_iterator index = DoubleHash.find( bits );
 	if( index == DoubleHash.end() ) {
 		int idx = (int)Double.size();
 		Double.push_back( b );
-		DoubleHash.insert( std::pair<double,int>(b,idx) );
+		DoubleHash.insert( std::pair<tjs_uint64,int>(bits,idx) );
 		return idx;
 	} else {
 		return index->second;
@@ -149,7 +152,7 @@ int tjsConstArrayData::GetType( tTJSVariant& v, tTJSScriptBlock* block ) {
 			return TYPE_BYTE;
 		} else if( val >= SHRT_MIN && val <= SHRT_MAX ) {
 			return TYPE_SHORT;
-		} else if( val >= LONG_MIN && val <= LONG_MAX ) {
+		} else if( val >= INT32_MIN && val <= INT32_MAX ) {
 			return TYPE_INTEGER;
 		} else {
 			return TYPE_LONG;
@@ -0,0 +1,492 @@
+//---------------------------------------------------------------------------
+/*
+	TJS2 Script Engine
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// Reference cycle collector for TJS objects
+//---------------------------------------------------------------------------
+#include "tjsCommHead.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <exception>
+#include "tjsCycleCollector.h"
+#include "tjsArray.h"
+#include "tjsNative.h"
+#include "tjsDebug.h"
+#include "tjsError.h"
+#include "TickCount.h"
+
+namespace TJS
+{
+//---------------------------------------------------------------------------
+bool TJSCycleCollectorEnabled = false;
+tjs_int32 TJSCycleCollectorClassID = -1;
+//---------------------------------------------------------------------------
+static const tjs_uint TJSCycleCollectorBatchSize = 256;
+	// candidate roots processed at once; the objects reachable from them are
+	// scanned together, so a larger batch shares more of the scanning.
+static const tjs_uint TJSCycleCollectorScanQuota = 65536;
+	// objects and references a step scans at most. the objects reached but
+	// not scanned are treated as referred from outside, so a cycle which
+	// reaches further than this is given up instead of scanning the whole heap.
+static const tjs_uint TJSCycleCollectorTickInterval = 256;
+	// objects scanned between the checks of the budget
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTJSCycleCollector
+//---------------------------------------------------------------------------
+class tTJSCycleCollector
+{
+	struct tNode
+	{
+		tTJSCustomObject * Object;
+		tjs_int Refs; // references not held by the scanned objects
+		tjs_uint EdgeStart; // references held by this object are
+		tjs_uint EdgeEnd;   // Edges[EdgeStart] .. Edges[EdgeEnd-1]
+		bool Alive;
+	};
+
+	std::vector<tTJSCustomObject *> Candidates;
+	bool Collecting;
+
+	// work area of a step
+	std::vector<tNode> Nodes;
+	std::vector<tjs_int> Edges;
+	std::unordered_map<iTJSDispatch2 *, tjs_int> NodeMap;
+		// -1 for objects which are not scanned
+
+	// objects kept alive by the steps of the current run; later steps treat
+	// them as objects referred from outside and do not scan them again.
+	// "finalize" of the garbage may release them, which only makes the run
+	// miss some garbage.
+	std::unordered_set<iTJSDispatch2 *> Kept;
+
+	// statistics
+	tjs_uint64 Runs;
+	tjs_uint64 ScannedObjects;
+	tjs_uint64 CollectedCycles;
+	tjs_uint64 CollectedObjects;
+	std::map<ttstr, tjs_uint64> CollectedTypes;
+
+public:
+	tTJSCycleCollector()
+	{
+		Collecting = false;
+		Runs = ScannedObjects = CollectedCycles = CollectedObjects = 0;
+	}
+
+	~tTJSCycleCollector()
+	{
+		// objects freed after this must not touch the candidates
+		ClearCandidates();
+	}
+
+	void AddCandidate(tTJSCustomObject *obj)
+	{
+		obj->CycleCandidateIndex = (tjs_int)Candidates.size();
+		Candidates.push_back(obj);
+	}
+
+	void RemoveCandidate(tTJSCustomObject *obj)
+	{
+		// the last one is moved into the place
+		tjs_int index = obj->CycleCandidateIndex;
+		tTJSCustomObject *last = Candidates.back();
+		Candidates[index] = last;
+		last->CycleCandidateIndex = index;
+		Candidates.pop_back();
+		obj->CycleCandidateIndex = -1;
+	}
+
+	void ClearCandidates()
+	{
+		std::vector<tTJSCustomObject *>::iterator i;
+		for(i = Candidates.begin(); i != Candidates.end(); i++)
+			(*i)->CycleCandidateIndex = -1;
+		std::vector<tTJSCustomObject *>().swap(Candidates);
+	}
+
+	bool Collect(tjs_uint budget);
+	void GetStatistics(tTJSCycleCollectorStatistics &stat);
+	void Report(iTJSConsoleOutput * output);
+
+private:
+	static bool IsScannable(tTJSCustomObject *obj)
+	{
+		// objects being invalidated are left to the invalidation
+		return !obj->IsInvalidated && !obj->IsInvalidating;
+	}
+
+	tjs_int AddNode(tTJSCustomObject *obj)
+	{
+		tjs_int index = -1;
+		if(IsScannable(obj))
+		{
+			index = (tjs_int)Nodes.size();
+			tNode node;
+			node.Object = obj;
+			node.Refs = (tjs_int)obj->GetRefCount();
+			node.EdgeStart = node.EdgeEnd = 0;
+			node.Alive = false;
+			Nodes.push_back(node);
+		}
+		NodeMap[(iTJSDispatch2*)obj] = index;
+		return index;
+	}
+
+	tjs_int GetNode(iTJSDispatch2 *dsp)
+	{
+		std::unordered_map<iTJSDispatch2 *, tjs_int>::iterator i =
+			NodeMap.find(dsp);
+		if(i != NodeMap.end()) return i->second;
+
+		if(Kept.find(dsp) != Kept.end())
+		{
+			NodeMap[dsp] = -1;
+			return -1;
+		}
+
+		// only tTJSCustomObject answers to TJSCycleCollectorClassID
+		iTJSNativeInstance *ptr;
+		if(TJS_FAILED(dsp->NativeInstanceSupport(TJS_NIS_GETINSTANCE,
+			TJSCycleCollectorClassID, &ptr)))
+		{
+			NodeMap[dsp] = -1;
+			return -1;
+		}
+		return AddNode((tTJSCustomObject*)(void*)ptr);
+	}
+
+	void AddEdge(iTJSDispatch2 *dsp)
+	{
+		tjs_int index = GetNode(dsp);
+		if(index < 0) return;
+		Edges.push_back(index);
+		Nodes[index].Refs --;
+	}
+
+	void ScanValue(tTJSCustomObject *owner, const tTJSVariant &val)
+	{
+		if(val.Type() != tvtObject) return;
+		const tTJSVariantClosure &clo = val.AsObjectClosureNoAddRef();
+		if(clo.Object) AddEdge(clo.Object);
+		if(clo.ObjThis && clo.ObjThis != (iTJSDispatch2*)owner)
+			AddEdge(clo.ObjThis);
+			// the owner does not count the closures which point itself
+			// ( see CheckObjectClosureAdd )
+	}
+
+	void ScanObject(tTJSCustomObject *obj);
+	void Step(tjs_uint32 start, tjs_uint budget);
+	void Free(const std::vector<tTJSCustomObject *> &garbage);
+	ttstr GetTypeName(tTJSCustomObject *obj);
+};
+//---------------------------------------------------------------------------
+class tTJSCollectedTypeComparator
+{
+public:
+	bool operator () (const std::pair<tjs_uint64, ttstr> & lhs,
+		const std::pair<tjs_uint64, ttstr> & rhs) const
+	{
+		return lhs.first > rhs.first;
+	}
+};
+//---------------------------------------------------------------------------
+static tTJSCycleCollector TJSCycleCollector;
+//---------------------------------------------------------------------------
+void tTJSCycleCollector::ScanObject(tTJSCustomObject *obj)
+{
+	// members
+	tTJSCustomObject::tTJSSymbolBlock * block;
+	for(block = &obj->Symbols; block; block = block->Next)
+	{
+		tTJSCustomObject::tTJSSymbolData * d = block->Data;
+		tTJSCustomObject::tTJSSymbolData * dlim = d + block->Used;
+		for(; d < dlim; d++)
+		{
+			if(d->SymFlags & TJS_SYMBOL_USING)
+				ScanValue(obj, *(tTJSVariant*)(&(d->Value)));
+		}
+	}
+
+	// array elements; the instance is looked up without NativeInstanceSupport,
+	// which may answer for another object ( tTJSExtendableObject )
+	tjs_int32 arrayid = TJSGetArrayClassID();
+	for(tjs_int i = 0; i < TJS_MAX_NATIVE_CLASS; i++)
+	{
+		if(obj->ClassIDs[i] == arrayid && obj->ClassInstances[i])
+		{
+			tTJSArrayNI *ni = (tTJSArrayNI*)obj->ClassInstances[i];
+			std::vector<tTJSVariant>::const_iterator v;
+			for(v = ni->Items.begin(); v != ni->Items.end(); v++)
+				ScanValue(obj, *v);
+			break;
+		}
+	}
+}
+//---------------------------------------------------------------------------
+void tTJSCycleCollector::Step(tjs_uint32 start, tjs_uint budget)
+{
+	// one trial deletion over the objects reachable from a batch of the
+	// candidates. no script runs until the garbage is decided, so the
+	// reference counters do not change while scanning.
+	Runs ++;
+	Nodes.clear();
+	Edges.clear();
+	NodeMap.clear();
+
+	for(tjs_uint n = 0; n < TJSCycleCollectorBatchSize && Candidates.size(); n++)
+	{
+		tTJSCustomObject *obj = Candidates.back();
+		Candidates.pop_back();
+		obj->CycleCandidateIndex = -1;
+		if(Kept.find((iTJSDispatch2*)obj) == Kept.end()) AddNode(obj);
+	}
+
+	// subtract the references among the reachable objects. the scan stops
+	// when the quota or the budget runs out; the candidates of this batch
+	// are not retried then.
+	tjs_uint scanned;
+	for(scanned = 0; scanned < Nodes.size(); scanned++)
+	{
+		if(scanned + Edges.size() >= TJSCycleCollectorScanQuota) break;
+		if(budget && scanned % TJSCycleCollectorTickInterval ==
+				TJSCycleCollectorTickInterval - 1 &&
+			TVPGetRoughTickCount32() - start >= budget) break;
+		Nodes[scanned].EdgeStart = (tjs_uint)Edges.size();
+		ScanObject(Nodes[scanned].Object);
+		Nodes[scanned].EdgeEnd = (tjs_uint)Edges.size();
+	}
+	ScannedObjects += scanned;
+
+	// objects which still have references are referred from outside;
+	// they keep everything reachable from them alive. a negative count means
+	// the counter is adjusted somewhere the collector does not know, so the
+	// object is kept. the references held by the objects not scanned are
+	// unknown, so they are kept too.
+	std::vector<tjs_int> stack;
+	for(tjs_uint i = 0; i < Nodes.size(); i++)
+	{
+		if(i >= scanned || Nodes[i].Refs != 0)
+		{
+			Nodes[i].Alive = true;
+			stack.push_back((tjs_int)i);
+		}
+	}
+	while(stack.size())
+	{
+		const tNode &node = Nodes[stack.back()];
+		stack.pop_back();
+		for(tjs_uint e = node.EdgeStart; e < node.EdgeEnd; e++)
+		{
+			tNode &to = Nodes[Edges[e]];
+			if(!to.Alive)
+			{
+				to.Alive = true;
+				stack.push_back(Edges[e]);
+			}
+		}
+	}
+
+	// the rest are garbage; count the groups of connected objects
+	std::vector<tjs_int> group(Nodes.size());
+	std::vector<tTJSCustomObject *> garbage;
+	for(tjs_uint i = 0; i < Nodes.size(); i++)
+	{
+		group[i] = (tjs_int)i;
+		if(!Nodes[i].Alive)
+			garbage.push_back(Nodes[i].Object);
+		else
+			Kept.insert((iTJSDispatch2*)Nodes[i].Object);
+	}
+	if(garbage.size() == 0) return;
+
+	for(tjs_uint i = 0; i < Nodes.size(); i++)
+	{
+		if(Nodes[i].Alive) continue;
+		for(tjs_uint e = Nodes[i].EdgeStart; e < Nodes[i].EdgeEnd; e++)
+		{
+			// garbage may refer alive objects, which are not counted
+			if(Nodes[Edges[e]].Alive) continue;
+			tjs_int a = (tjs_int)i, b = Edges[e];
+			while(group[a] != a) a = group[a] = group[group[a]];
+			while(group[b] != b) b = group[b] = group[group[b]];
+			if(a != b) group[a] = b;
+		}
+	}
+	for(tjs_uint i = 0; i < Nodes.size(); i++)
+		if(!Nodes[i].Alive && group[i] == (tjs_int)i) CollectedCycles ++;
+	CollectedObjects += garbage.size();
+
+	Free(garbage);
+}
+//---------------------------------------------------------------------------
+void tTJSCycleCollector::Free(const std::vector<tTJSCustomObject *> &garbage)
+{
+	// keep all garbage alive until every object is invalidated, then release.
+	// "finalize" of the objects may run scripts.
+	std::vector<tTJSCustomObject *>::const_iterator i;
+	for(i = garbage.begin(); i != garbage.end(); i++)
+	{
+		(*i)->AddRef();
+		CollectedTypes[GetTypeName(*i)] ++;
+	}
+
+	std::exception_ptr error;
+	for(i = garbage.begin(); i != garbage.end(); i++)
+	{
+		try
+		{
+			(*i)->Invalidate(0, NULL, NULL, *i);
+		}
+		catch(...)
+		{
+			// the first error is thrown after all objects are freed
+			if(!error) error = std::current_exception();
+		}
+	}
+
+	for(i = garbage.begin(); i != garbage.end(); i++)
+		(*i)->Release();
+
+	if(error) std::rethrow_exception(error);
+}
+//---------------------------------------------------------------------------
+ttstr tTJSCycleCollector::GetTypeName(tTJSCustomObject *obj)
+{
+	ttstr type;
+	if(TJSObjectTypeInfoEnabled()) type = TJSGetObjectTypeInfo(obj);
+	if(type.IsEmpty())
+	{
+		if(obj->ClassNames.size())
+			type = TJS_W("instance of class ") + obj->ClassNames[0];
+				// the first one is the most derived class
+		else
+			type = TJS_W("(unknown)");
+	}
+	return type;
+}
+//---------------------------------------------------------------------------
+bool tTJSCycleCollector::Collect(tjs_uint budget)
+{
+	if(Collecting) return Candidates.size() == 0; // called from "finalize"
+	Collecting = true;
+	Kept.clear(); // may be left by an error
+	try
+	{
+		tjs_uint32 start = TVPGetRoughTickCount32();
+		while(Candidates.size())
+		{
+			Step(start, budget);
+			if(budget && TVPGetRoughTickCount32() - start >= budget) break;
+		}
+	}
+	catch(...)
+	{
+		Collecting = false;
+		throw;
+	}
+	Collecting = false;
+
+	// the work area is not kept between the runs
+	std::vector<tNode>().swap(Nodes);
+	std::vector<tjs_int>().swap(Edges);
+	std::unordered_map<iTJSDispatch2 *, tjs_int>().swap(NodeMap);
+	std::unordered_set<iTJSDispatch2 *>().swap(Kept);
+
+	return Candidates.size() == 0;
+}
+//---------------------------------------------------------------------------
+void tTJSCycleCollector::GetStatistics(tTJSCycleCollectorStatistics &stat)
+{
+	stat.Candidates = (tjs_uint)Candidates.size();
+	stat.Runs = Runs;
+	stat.ScannedObjects = ScannedObjects;
+	stat.CollectedCycles = CollectedCycles;
+	stat.CollectedObjects = CollectedObjects;
+}
+//---------------------------------------------------------------------------
+void tTJSCycleCollector::Report(iTJSConsoleOutput * output)
+{
+	{
+		ttstr msg = (const tjs_char *)TJSCycleCollectorStatistics;
+		msg.Replace(TJS_W("%1"), ttstr((tjs_int64)CollectedCycles));
+		msg.Replace(TJS_W("%2"), ttstr((tjs_int64)CollectedObjects));
+		msg.Replace(TJS_W("%3"), ttstr((tjs_int64)Runs));
+		output->Print(msg.c_str());
+	}
+	if(CollectedTypes.size() == 0) return;
+
+	// types of the collected objects, most frequent first
+	output->Print(TJS_W("---"));
+	output->Print((const tjs_char *)TJSGroupByObjectType);
+	std::vector<std::pair<tjs_uint64, ttstr> > items;
+	std::map<ttstr, tjs_uint64>::iterator i;
+	for(i = CollectedTypes.begin(); i != CollectedTypes.end(); i++)
+		items.push_back(std::pair<tjs_uint64, ttstr>(i->second, i->first));
+	std::stable_sort(items.begin(), items.end(), tTJSCollectedTypeComparator());
+
+	for(tjs_uint n = 0; n < items.size(); n++)
+	{
+		tjs_char tmp[64];
+		TJS_snprintf(tmp, sizeof(tmp)/sizeof(tjs_char), TJS_W("%6d"), (int)items[n].first);
+		ttstr info = (const tjs_char *)TJSObjectCountingMessageTJSGroupByObjectType;
+		info.Replace(TJS_W("%1"), tmp);
+		info.Replace(TJS_W("%2"), items[n].second);
+		output->Print(info.c_str());
+	}
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+void TJSAddCycleCandidate(tTJSCustomObject *obj)
+{
+	TJSCycleCollector.AddCandidate(obj);
+}
+//---------------------------------------------------------------------------
+void TJSRemoveCycleCandidate(tTJSCustomObject *obj)
+{
+	TJSCycleCollector.RemoveCandidate(obj);
+}
+//---------------------------------------------------------------------------
+void TJSSetCycleCollectorEnabled(bool b)
+{
+	if(b && TJSCycleCollectorClassID == -1)
+		TJSCycleCollectorClassID = TJSRegisterNativeClass(TJS_W("(cycle collector)"));
+	TJSCycleCollectorEnabled = b;
+	if(!b) TJSCycleCollector.ClearCandidates();
+}
+//---------------------------------------------------------------------------
+bool TJSGetCycleCollectorEnabled()
+{
+	return TJSCycleCollectorEnabled;
+}
+//---------------------------------------------------------------------------
+bool TJSCollectCycles(tjs_uint budget)
+{
+	if(!TJSCycleCollectorEnabled) return true;
+	return TJSCycleCollector.Collect(budget);
+}
+//---------------------------------------------------------------------------
+void TJSGetCycleCollectorStatistics(tTJSCycleCollectorStatistics &stat)
+{
+	TJSCycleCollector.GetStatistics(stat);
+}
+//---------------------------------------------------------------------------
+void TJSReportCycleGarbage(iTJSConsoleOutput * output)
+{
+	TJSCycleCollector.Report(output);
+}
+//---------------------------------------------------------------------------
+} // namespace TJS
@@ -0,0 +1,61 @@
+//---------------------------------------------------------------------------
+/*
+	TJS2 Script Engine
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// Reference cycle collector for TJS objects
+//---------------------------------------------------------------------------
+#ifndef tjsCycleCollectorH
+#define tjsCycleCollectorH
+
+#include "tjsObject.h"
+
+namespace TJS
+{
+//---------------------------------------------------------------------------
+/*
+	objects are reference counted, so objects which refer each other are never
+	freed unless one of them is invalidated. the collector finds such cycles
+	by trial deletion ( Bacon and Rajan ):
+
+	- a tTJSCustomObject whose reference is released while other references
+	  remain is remembered as a candidate root.
+	- starting from the candidates, the references held by the members of the
+	  objects ( and by the elements of arrays ) are subtracted from the
+	  reference counters of the reached objects.
+	- objects left with references are referred from outside ( native code,
+	  the VM registers, objects the collector does not know ), so they and
+	  all objects reachable from them are alive.
+	- the rest are unreachable cycles; they are invalidated, which calls
+	  their "finalize" and clears their members, and then freed.
+
+	references the collector cannot see are always treated as references from
+	outside, so a cycle through them is never collected.
+*/
+//---------------------------------------------------------------------------
+struct tTJSCycleCollectorStatistics
+{
+	tjs_uint Candidates; // candidate roots waiting for the next run
+	tjs_uint64 Runs; // number of collection steps
+	tjs_uint64 ScannedObjects; // objects visited by the trial deletion
+	tjs_uint64 CollectedCycles; // groups of unreachable objects collected
+	tjs_uint64 CollectedObjects; // unreachable objects collected
+};
+//---------------------------------------------------------------------------
+extern void TJSSetCycleCollectorEnabled(bool b);
+	// disabling forgets all the candidates
+extern bool TJSGetCycleCollectorEnabled();
+extern bool TJSCollectCycles(tjs_uint budget);
+	// processes the candidates; returns true if no candidate is left.
+	// budget is in milliseconds, 0 processes all candidates.
+extern void TJSGetCycleCollectorStatistics(tTJSCycleCollectorStatistics &stat);
+extern void TJSReportCycleGarbage(iTJSConsoleOutput * output);
+	// reports the statistics and the types of the collected objects, which
+	// are the objects the scripts leaked
+//---------------------------------------------------------------------------
+} // namespace TJS
+
+#endif
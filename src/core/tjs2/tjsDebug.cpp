@@ -11,9 +11,16 @@
 #include "tjsCommHead.h"
 
 #include <algorithm>
+#include <map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include "tjsDebug.h"
 #include "tjsHashSearch.h"
 #include "tjsInterCodeGen.h"
+#include "tjsScriptBlock.h"
 #include "tjsGlobalStringMap.h"
 
 #ifdef ENABLE_DEBUGGER
@@ -704,6 +711,265 @@ public:
 		return ret;
 	}
 };
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// Profiler : sampling profiler for script execution
+//---------------------------------------------------------------------------
+/*
+	the main thread keeps a light-weight copy of the call stack through the
+	stack tracer hooks, and the sampling thread copies it periodically.
+	the sampling thread records only context pointers and code positions,
+	and they are resolved into names on the main thread when the profile is
+	written; so contexts which appeared on the stack are retained until the
+	profiler stops. frames entered before the profiler started are not
+	recorded.
+	samples are written in collapsed stack format
+	( "function;function;...;line count" ) for flame graph tools.
+*/
+tTJSProfiler * TJSProfiler = NULL;
+//---------------------------------------------------------------------------
+class tTJSProfiler
+{
+	struct tFrame
+	{
+		tTJSInterCodeContext * Context;
+		const tjs_int32 * CodeBase;
+		tjs_int32 * const * CodePtr;
+		bool InTry;
+	};
+
+	struct tSampleFrame
+	{
+		tTJSInterCodeContext * Context;
+		tjs_int CodePos; // -1 for callers
+
+		bool operator < (const tSampleFrame & rhs) const
+		{
+			if(Context != rhs.Context) return Context < rhs.Context;
+			return CodePos < rhs.CodePos;
+		}
+	};
+	typedef std::vector<tSampleFrame> tSample; // from the top of the stack
+
+	// shared with the sampling thread
+	tTJSSpinLock StackLock;
+	std::vector<tFrame> Stack;
+
+	// main thread only
+	std::unordered_set<tTJSInterCodeContext *> Retained;
+
+	// sampling thread only while the thread is running
+	std::map<tSample, tjs_uint> Samples;
+	tjs_uint SampleCount;
+
+	tjs_int Interval; // in ms
+	bool Terminated;
+	std::mutex ThreadMutex;
+	std::condition_variable ThreadCond;
+	std::thread Thread;
+
+public:
+	tTJSProfiler(tjs_int interval)
+	{
+		SampleCount = 0;
+		Interval = interval < 1 ? 1 : interval;
+		Terminated = false;
+		Stack.reserve(256);
+		Thread = std::thread(&tTJSProfiler::SamplingThread, this);
+	}
+
+	~tTJSProfiler()
+	{
+		Terminate();
+		std::unordered_set<tTJSInterCodeContext *>::iterator i;
+		for(i = Retained.begin(); i != Retained.end(); i++) (*i)->Release();
+	}
+
+	void Terminate()
+	{
+		if(!Thread.joinable()) return;
+		{
+			std::lock_guard<std::mutex> lock(ThreadMutex);
+			Terminated = true;
+		}
+		ThreadCond.notify_one();
+		Thread.join();
+	}
+
+	tjs_uint GetSampleCount() const { return SampleCount; }
+
+	void Push(tTJSInterCodeContext *context, bool in_try)
+	{
+		if(Retained.insert(context).second) context->AddRef();
+		tFrame frame = { context, NULL, NULL, in_try };
+		StackLock.lock();
+		Stack.push_back(frame);
+		StackLock.unlock();
+	}
+
+	void Pop()
+	{
+		StackLock.lock();
+		if(Stack.size()) Stack.pop_back(); // may be entered before starting
+		StackLock.unlock();
+	}
+
+	void SetCodePointer(const tjs_int32 * codebase, tjs_int32 * const * codeptr)
+	{
+		StackLock.lock();
+		if(Stack.size())
+		{
+			tFrame & top = Stack.back();
+			top.CodeBase = codebase;
+			top.CodePtr = codeptr;
+		}
+		StackLock.unlock();
+	}
+
+private:
+	void SamplingThread()
+	{
+		std::unique_lock<std::mutex> lock(ThreadMutex);
+		while(!Terminated)
+		{
+			ThreadCond.wait_for(lock, std::chrono::milliseconds(Interval));
+			if(Terminated) break;
+			TakeSample();
+		}
+	}
+
+	void TakeSample()
+	{
+		// sampling thread
+		tSample sample;
+		StackLock.lock();
+		tjs_int top = (tjs_int)Stack.size() - 1;
+		while(top >= 0)
+		{
+			const tFrame & frame = Stack[top];
+			tSampleFrame sf;
+			sf.Context = frame.Context;
+			sf.CodePos = -1;
+			if(sample.empty())
+			{
+				// the code pointer is a local variable of the executing
+				// function, which is read without synchronization; it may be
+				// slightly old, and is checked when it is resolved.
+				sf.CodePos = (frame.CodeBase && frame.CodePtr) ?
+					(tjs_int)(*frame.CodePtr - frame.CodeBase) : 0;
+			}
+			sample.push_back(sf);
+
+			// skip try block stack; see tTJSStackTracer::GetTraceString
+			while(top >= 0 && Stack[top].InTry) top--;
+			top --;
+		}
+		StackLock.unlock();
+
+		if(sample.empty()) return; // not in script
+		Samples[sample] ++;
+		SampleCount ++;
+	}
+
+	static ttstr GetFrameName(const tTJSInterCodeContext *context)
+	{
+		ttstr name = context->GetShortDescriptionWithClassName();
+		// ';' is the frame delimiter of the collapsed stack format
+		tjs_char *p = name.Independ();
+		for(; *p; p++) if(*p == TJS_W(';')) *p = TJS_W(':');
+		return name;
+	}
+
+public:
+	void WriteCollapsedStacks(const ttstr & name)
+	{
+		// main thread; the sampling thread must be terminated
+		std::map<tTJSInterCodeContext *, ttstr> names;
+		std::map<ttstr, tjs_uint> stacks;
+		std::map<tSample, tjs_uint>::iterator i;
+		for(i = Samples.begin(); i != Samples.end(); i++)
+		{
+			const tSample & sample = i->first;
+			ttstr line;
+			for(tjs_int n = (tjs_int)sample.size() - 1; n >= 0; n--)
+			{
+				tTJSInterCodeContext * context = sample[n].Context;
+				std::map<tTJSInterCodeContext *, ttstr>::iterator f =
+					names.find(context);
+				if(f == names.end())
+					f = names.insert(std::make_pair(context, GetFrameName(context))).first;
+				if(!line.IsEmpty()) line += TJS_W(";");
+				line += f->second;
+			}
+
+			tTJSInterCodeContext * context = sample[0].Context;
+			tjs_int codepos = sample[0].CodePos;
+			if(codepos < 0 || codepos >= (tjs_int)context->GetCodeSize()) codepos = 0;
+			line += TJS_W(";");
+			line += context->GetBlock()->GetLineDescriptionString(
+				context->CodePosToSrcPos(codepos));
+
+			stacks[line] += i->second;
+		}
+
+		tTJSBinaryStream * stream = TJSCreateBinaryStreamForWrite(name, TJS_W(""));
+		try
+		{
+			std::map<ttstr, tjs_uint>::iterator s;
+			for(s = stacks.begin(); s != stacks.end(); s++)
+			{
+				tjs_char count[32];
+				TJS_snprintf(count, sizeof(count)/sizeof(tjs_char), TJS_W(" %u\n"),
+					(unsigned int)s->second);
+				std::string line = (s->first + count).AsNarrowStdString();
+				stream->WriteBuffer(line.c_str(), (tjs_uint)line.length());
+			}
+		}
+		catch(...)
+		{
+			delete stream;
+			throw;
+		}
+		delete stream;
+	}
+};
+//---------------------------------------------------------------------------
+void TJSStartProfiler(tjs_int interval)
+{
+	if(TJSProfiler) return;
+	TJSProfiler = new tTJSProfiler(interval);
+}
+//---------------------------------------------------------------------------
+tjs_uint TJSStopProfiler(const ttstr & name)
+{
+	// stops the profiler and writes the samples to the storage when name is
+	// not empty. returns the count of the samples.
+	if(!TJSProfiler) return 0;
+	tTJSProfiler * profiler = TJSProfiler;
+	TJSProfiler = NULL;
+
+	tjs_uint count;
+	try
+	{
+		profiler->Terminate();
+		count = profiler->GetSampleCount();
+		if(!name.IsEmpty()) profiler->WriteCollapsedStacks(name);
+	}
+	catch(...)
+	{
+		delete profiler;
+		throw;
+	}
+	delete profiler;
+	return count;
+}
+//---------------------------------------------------------------------------
+
+
+
 //---------------------------------------------------------------------------
 void TJSAddRefStackTracer()
 {
@@ -719,6 +985,8 @@ void TJSStackTracerPush(tTJSInterCodeContext *context, bool in_try)
 {
 	if(TJSStackTracer)
 		TJSStackTracer->Push(context, in_try);
+	if(TJSProfiler)
+		TJSProfiler->Push(context, in_try);
 }
 //---------------------------------------------------------------------------
 void TJSStackTracerSetCodePointer(const tjs_int32 * codebase,
@@ -726,12 +994,16 @@ void TJSStackTracerSetCodePointer(const tjs_int32 * codebase,
 {
 	if(TJSStackTracer)
 		TJSStackTracer->SetCodePointer(codebase, codeptr);
+	if(TJSProfiler)
+		TJSProfiler->SetCodePointer(codebase, codeptr);
 }
 //---------------------------------------------------------------------------
 void TJSStackTracerPop()
 {
 	if(TJSStackTracer)
 		TJSStackTracer->Pop();
+	if(TJSProfiler)
+		TJSProfiler->Pop();
 }
 //---------------------------------------------------------------------------
 ttstr TJSGetStackTraceString(tjs_int limit, const tjs_char *delimiter)
@@ -113,7 +113,19 @@ extern void TJSStackTracerPush(tTJSInterCodeContext *context, bool in_try);
 extern void TJSStackTracerSetCodePointer(const tjs_int32 * codebase, tjs_int32 * const * codeptr);
 extern void TJSStackTracerPop();
 extern ttstr TJSGetStackTraceString(tjs_int limit = 0, const tjs_char *delimiter = NULL);
-static inline bool TJSStackTracerEnabled() { return 0!=TJSStackTracer; }
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// Profiler : sampling profiler for script execution
+//---------------------------------------------------------------------------
+class tTJSProfiler;
+extern tTJSProfiler * TJSProfiler;
+extern void TJSStartProfiler(tjs_int interval);
+extern tjs_uint TJSStopProfiler(const ttstr & name);
+static inline bool TJSProfilerEnabled() { return 0!=TJSProfiler; }
+//---------------------------------------------------------------------------
+// the stack tracer hooks also feed the profiler
+static inline bool TJSStackTracerEnabled() { return 0!=TJSStackTracer || 0!=TJSProfiler; }
 //---------------------------------------------------------------------------
 
 #ifdef ENABLE_DEBUGGER
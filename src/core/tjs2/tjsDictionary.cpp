@@ -81,7 +81,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/loadStruct)
 			if( tTJSBinarySerializer::IsBinary( header ) ) {
 				if( !dic ) dic = (tTJSDictionaryObject*)TJSCreateDictionaryObject();
 				tTJSBinarySerializer binload(dic);
-				tTJSVariant* var = binload.Read( stream );
+				tTJSVariant* var = binload.Read( stream, header );
 				if( var ) {
 					if( result ) *result = *var;
 					delete var;
@@ -134,10 +134,16 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func.name*/saveStruct)
 	if( TJS_strchr(mode.c_str(), TJS_W('b')) != NULL ) {
 		tTJSBinaryStream* stream = TJSCreateBinaryStreamForWrite(name, mode);
 		try {
-			stream->Write( tTJSBinarySerializer::HEADER, tTJSBinarySerializer::HEADER_LENGTH );
-			std::vector<iTJSDispatch2 *> stack;
-			stack.push_back(objthis);
-			ni->SaveStructuredBinary(stack, *stream);
+			if( tTJSBinaryStructWriter::IsSharedMode(mode.c_str()) ) {
+				// strings and objects are stored once, optionally compressed
+				tTJSBinaryStructWriter writer(mode.c_str());
+				writer.Write(stream, objthis);
+			} else {
+				stream->Write( tTJSBinarySerializer::HEADER, tTJSBinarySerializer::HEADER_LENGTH );
+				std::vector<iTJSDispatch2 *> stack;
+				stack.push_back(objthis);
+				ni->SaveStructuredBinary(stack, *stream);
+			}
 		} catch(...) {
 			delete stream;
 			throw;
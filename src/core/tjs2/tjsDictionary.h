@@ -58,6 +58,8 @@ public:
 	tTJSDictionaryNI();
 	~tTJSDictionaryNI();
 
+	TJS_DECLARE_POOLED_NEW
+
 	tjs_error TJS_INTF_METHOD Construct(tjs_int numparams, tTJSVariant **param,
 		iTJSDispatch2 *obj);
 
@@ -282,6 +282,27 @@ void tTJSInterCodeContext::Disassemble(
 		case VM_JMP:	OP1A_DISASM("jmp");		break;
 #undef OP1A_DISASM
 
+
+
+#define OP2A_DISASM(x) \
+	msg.printf(TJS_W(x) TJS_W(" %%%d, %%%d, %09d"), \
+		TJS_FROM_VM_REG_ADDR(CodeArea[i+2]), \
+		TJS_FROM_VM_REG_ADDR(CodeArea[i+3]), \
+		TJS_FROM_VM_CODE_ADDR(CodeArea[i+1]) + i); \
+	size = 4
+		// compare ( and modify ) two registers and jump
+		case VM_CEQJF:		OP2A_DISASM("ceqjf");		break;
+		case VM_CEQJNF:		OP2A_DISASM("ceqjnf");		break;
+		case VM_CDEQJF:		OP2A_DISASM("cdeqjf");		break;
+		case VM_CDEQJNF:	OP2A_DISASM("cdeqjnf");		break;
+		case VM_CLTJF:		OP2A_DISASM("cltjf");		break;
+		case VM_CLTJNF:		OP2A_DISASM("cltjnf");		break;
+		case VM_CGTJF:		OP2A_DISASM("cgtjf");		break;
+		case VM_CGTJNF:		OP2A_DISASM("cgtjnf");		break;
+		case VM_INCLTJF:	OP2A_DISASM("incltjf");		break;
+		case VM_DECGTJF:	OP2A_DISASM("decgtjf");		break;
+#undef OP2A_DISASM
+
 		case VM_CALL:
 		case VM_CALLD:
 		case VM_CALLI:
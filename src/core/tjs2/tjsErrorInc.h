@@ -56,6 +56,7 @@ TJS_MSG_DECL(TJSGroupByObjectTypeAndHistory, TJS_W("Group by object type and loc
 TJS_MSG_DECL(TJSGroupByObjectType, TJS_W("Group by object type"))
 TJS_MSG_DECL(TJSObjectCountingMessageGroupByObjectTypeAndHistory, TJS_W("%1 time(s) : [%2] %3"))
 TJS_MSG_DECL(TJSObjectCountingMessageTJSGroupByObjectType, TJS_W("%1 time(s) : [%2]"))
+TJS_MSG_DECL(TJSCycleCollectorStatistics, TJS_W("Cycle collector: %1 cycle(s) of %2 object(s) were collected in %3 run(s)"))
 TJS_MSG_DECL(TJSWarnRunningCodeOnDeletingObject, TJS_W("%4: Running code on deleting-in-progress object %1[%2] / The object was created at : %3"))
 TJS_MSG_DECL(TJSWriteError, TJS_W("Write error"))
 TJS_MSG_DECL(TJSReadError, TJS_W("Read error"))
@@ -19,10 +19,12 @@
 #include "tjsUtils.h"
 #include "tjsNative.h"
 #include "tjsArray.h"
+#include "tjsObjectPool.h"
 #include "tjsDebug.h"
 #include "tjsOctPack.h"
 #include <set>
 #include <mutex>
+#include <typeinfo>
 
 #ifdef ENABLE_DEBUGGER
 #include "debugger.h"
@@ -236,6 +238,8 @@ public:
 		if(dsp2) dsp2->AddRef();
 	}
 
+	iTJSDispatch2 * GetDispatch1() const { return Dispatch1; }
+
 private:
 	iTJSDispatch2 *Dispatch1;
 	iTJSDispatch2 *Dispatch2;
@@ -978,6 +982,30 @@ void tTJSInterCodeContext::ThrowScriptException(tTJSVariant &val,
 	TJS_eTJSScriptException(msg, this, srcpos, val);
 }
 //---------------------------------------------------------------------------
+// VM instruction dispatch
+//---------------------------------------------------------------------------
+// with GCC or clang, each instruction handler jumps directly to the handler
+// of the next instruction through a table of label addresses (threaded code),
+// so that each handler has its own indirect branch to be predicted, instead
+// of sharing the one of the switch statement.
+// the switch is still used to enter the loop; it is the only dispatcher on
+// other compilers, or when the debugger must hook every instruction.
+#if defined(__GNUC__) && !defined(ENABLE_DEBUGGER) && !defined(TJS_NO_THREADED_DISPATCH)
+	#define TJS_VM_THREADED_DISPATCH
+#endif
+
+#ifdef TJS_VM_THREADED_DISPATCH
+	#define TJS_VM_CASE(op) case op: vm_label_##op
+	#define TJS_VM_DEFAULT default: vm_label_default
+	#define TJS_VM_NEXT \
+		do { codesave = code; goto *dispatch[(tjs_uint32)*code < (tjs_uint32)__VM_LAST ? \
+			*code : (tjs_int32)__VM_LAST]; } while(0)
+#else
+	#define TJS_VM_CASE(op) case op
+	#define TJS_VM_DEFAULT default
+	#define TJS_VM_NEXT break
+#endif
+//---------------------------------------------------------------------------
 tjs_int tTJSInterCodeContext::ExecuteCode(tTJSVariant *ra_org, tjs_int startip,
 	tTJSVariant **args, tjs_int numargs, tTJSVariant *result)
 {
@@ -1003,6 +1031,64 @@ tjs_int tTJSInterCodeContext::ExecuteCode(tTJSVariant *ra_org, tjs_int startip,
 #ifdef ENABLE_DEBUGGER
 		tjs_int cur_line_no = -1;
 #endif	// ENABLE_DEBUGGER
+#ifdef TJS_VM_THREADED_DISPATCH
+		// the table holds one label per operation code in the order of
+		// tTJSVMCodes, followed by the entry which catches invalid codes.
+		// it is constant-initialized, so concurrent first calls from
+		// several threads never see it half-filled.
+#define TJS_VM_LABEL(op) &&vm_label_##op
+		static void * const dispatch[] = {
+			TJS_VM_LABEL(VM_NOP), TJS_VM_LABEL(VM_CONST), TJS_VM_LABEL(VM_CP),
+			TJS_VM_LABEL(VM_CL), TJS_VM_LABEL(VM_CCL), TJS_VM_LABEL(VM_TT), TJS_VM_LABEL(VM_TF),
+			TJS_VM_LABEL(VM_CEQ), TJS_VM_LABEL(VM_CDEQ), TJS_VM_LABEL(VM_CLT),
+			TJS_VM_LABEL(VM_CGT), TJS_VM_LABEL(VM_SETF), TJS_VM_LABEL(VM_SETNF),
+			TJS_VM_LABEL(VM_LNOT), TJS_VM_LABEL(VM_NF), TJS_VM_LABEL(VM_JF),
+			TJS_VM_LABEL(VM_JNF), TJS_VM_LABEL(VM_JMP), TJS_VM_LABEL(VM_INC),
+			TJS_VM_LABEL(VM_INCPD), TJS_VM_LABEL(VM_INCPI), TJS_VM_LABEL(VM_INCP),
+			TJS_VM_LABEL(VM_DEC), TJS_VM_LABEL(VM_DECPD), TJS_VM_LABEL(VM_DECPI),
+			TJS_VM_LABEL(VM_DECP), TJS_VM_LABEL(VM_LOR), TJS_VM_LABEL(VM_LORPD),
+			TJS_VM_LABEL(VM_LORPI), TJS_VM_LABEL(VM_LORP), TJS_VM_LABEL(VM_LAND),
+			TJS_VM_LABEL(VM_LANDPD), TJS_VM_LABEL(VM_LANDPI), TJS_VM_LABEL(VM_LANDP),
+			TJS_VM_LABEL(VM_BOR), TJS_VM_LABEL(VM_BORPD), TJS_VM_LABEL(VM_BORPI),
+			TJS_VM_LABEL(VM_BORP), TJS_VM_LABEL(VM_BXOR), TJS_VM_LABEL(VM_BXORPD),
+			TJS_VM_LABEL(VM_BXORPI), TJS_VM_LABEL(VM_BXORP), TJS_VM_LABEL(VM_BAND),
+			TJS_VM_LABEL(VM_BANDPD), TJS_VM_LABEL(VM_BANDPI), TJS_VM_LABEL(VM_BANDP),
+			TJS_VM_LABEL(VM_SAR), TJS_VM_LABEL(VM_SARPD), TJS_VM_LABEL(VM_SARPI),
+			TJS_VM_LABEL(VM_SARP), TJS_VM_LABEL(VM_SAL), TJS_VM_LABEL(VM_SALPD),
+			TJS_VM_LABEL(VM_SALPI), TJS_VM_LABEL(VM_SALP), TJS_VM_LABEL(VM_SR),
+			TJS_VM_LABEL(VM_SRPD), TJS_VM_LABEL(VM_SRPI), TJS_VM_LABEL(VM_SRP),
+			TJS_VM_LABEL(VM_ADD), TJS_VM_LABEL(VM_ADDPD), TJS_VM_LABEL(VM_ADDPI),
+			TJS_VM_LABEL(VM_ADDP), TJS_VM_LABEL(VM_SUB), TJS_VM_LABEL(VM_SUBPD),
+			TJS_VM_LABEL(VM_SUBPI), TJS_VM_LABEL(VM_SUBP), TJS_VM_LABEL(VM_MOD),
+			TJS_VM_LABEL(VM_MODPD), TJS_VM_LABEL(VM_MODPI), TJS_VM_LABEL(VM_MODP),
+			TJS_VM_LABEL(VM_DIV), TJS_VM_LABEL(VM_DIVPD), TJS_VM_LABEL(VM_DIVPI),
+			TJS_VM_LABEL(VM_DIVP), TJS_VM_LABEL(VM_IDIV), TJS_VM_LABEL(VM_IDIVPD),
+			TJS_VM_LABEL(VM_IDIVPI), TJS_VM_LABEL(VM_IDIVP), TJS_VM_LABEL(VM_MUL),
+			TJS_VM_LABEL(VM_MULPD), TJS_VM_LABEL(VM_MULPI), TJS_VM_LABEL(VM_MULP),
+			TJS_VM_LABEL(VM_BNOT), TJS_VM_LABEL(VM_TYPEOF), TJS_VM_LABEL(VM_TYPEOFD),
+			TJS_VM_LABEL(VM_TYPEOFI), TJS_VM_LABEL(VM_EVAL), TJS_VM_LABEL(VM_EEXP),
+			TJS_VM_LABEL(VM_CHKINS), TJS_VM_LABEL(VM_ASC), TJS_VM_LABEL(VM_CHR),
+			TJS_VM_LABEL(VM_NUM), TJS_VM_LABEL(VM_CHS), TJS_VM_LABEL(VM_INV),
+			TJS_VM_LABEL(VM_CHKINV), TJS_VM_LABEL(VM_INT), TJS_VM_LABEL(VM_REAL),
+			TJS_VM_LABEL(VM_STR), TJS_VM_LABEL(VM_OCTET), TJS_VM_LABEL(VM_CALL),
+			TJS_VM_LABEL(VM_CALLD), TJS_VM_LABEL(VM_CALLI), TJS_VM_LABEL(VM_NEW),
+			TJS_VM_LABEL(VM_GPD), TJS_VM_LABEL(VM_SPD), TJS_VM_LABEL(VM_SPDE),
+			TJS_VM_LABEL(VM_SPDEH), TJS_VM_LABEL(VM_GPI), TJS_VM_LABEL(VM_SPI),
+			TJS_VM_LABEL(VM_SPIE), TJS_VM_LABEL(VM_GPDS), TJS_VM_LABEL(VM_SPDS),
+			TJS_VM_LABEL(VM_GPIS), TJS_VM_LABEL(VM_SPIS), TJS_VM_LABEL(VM_SETP),
+			TJS_VM_LABEL(VM_GETP), TJS_VM_LABEL(VM_DELD), TJS_VM_LABEL(VM_DELI),
+			TJS_VM_LABEL(VM_SRV), TJS_VM_LABEL(VM_RET), TJS_VM_LABEL(VM_ENTRY),
+			TJS_VM_LABEL(VM_EXTRY), TJS_VM_LABEL(VM_THROW), TJS_VM_LABEL(VM_CHGTHIS),
+			TJS_VM_LABEL(VM_GLOBAL), TJS_VM_LABEL(VM_ADDCI), TJS_VM_LABEL(VM_REGMEMBER),
+			TJS_VM_LABEL(VM_DEBUGGER), TJS_VM_LABEL(VM_CEQJF), TJS_VM_LABEL(VM_CEQJNF),
+			TJS_VM_LABEL(VM_CDEQJF), TJS_VM_LABEL(VM_CDEQJNF), TJS_VM_LABEL(VM_CLTJF),
+			TJS_VM_LABEL(VM_CLTJNF), TJS_VM_LABEL(VM_CGTJF), TJS_VM_LABEL(VM_CGTJNF),
+			TJS_VM_LABEL(VM_INCLTJF), TJS_VM_LABEL(VM_DECGTJF), &&vm_label_default
+		};
+#undef TJS_VM_LABEL
+		static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == __VM_LAST + 1,
+			"the dispatch table does not match tTJSVMCodes");
+#endif
 		while(true)
 		{
 #ifdef ENABLE_DEBUGGER
@@ -1017,159 +1103,204 @@ tjs_int tTJSInterCodeContext::ExecuteCode(tTJSVariant *ra_org, tjs_int startip,
 			codesave = code;
 			switch(*code)
 			{
-			case VM_NOP:
+			TJS_VM_CASE(VM_NOP):
 				code ++;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CONST:
+			TJS_VM_CASE(VM_CONST):
 				TJS_GET_VM_REG(ra, code[1]).CopyRef(TJS_GET_VM_REG(da, code[2]));
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CP:
+			TJS_VM_CASE(VM_CP):
 				TJS_GET_VM_REG(ra, code[1]).CopyRef(TJS_GET_VM_REG(ra, code[2]));
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CL:
+			TJS_VM_CASE(VM_CL):
 				TJS_GET_VM_REG(ra, code[1]).Clear();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CCL:
+			TJS_VM_CASE(VM_CCL):
 				ContinuousClear(ra, code);
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_TT:
+			TJS_VM_CASE(VM_TT):
 				flag = TJS_GET_VM_REG(ra, code[1]).operator bool();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_TF:
+			TJS_VM_CASE(VM_TF):
 				flag = !(TJS_GET_VM_REG(ra, code[1]).operator bool());
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CEQ:
+			TJS_VM_CASE(VM_CEQ):
 				flag = TJS_GET_VM_REG(ra, code[1]).NormalCompare(
 					TJS_GET_VM_REG(ra, code[2]));
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CDEQ:
+			TJS_VM_CASE(VM_CDEQ):
 				flag = TJS_GET_VM_REG(ra, code[1]).DiscernCompare(
 					TJS_GET_VM_REG(ra, code[2]));
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CLT:
+			TJS_VM_CASE(VM_CLT):
 				flag = TJS_GET_VM_REG(ra, code[1]).GreaterThan(
 					TJS_GET_VM_REG(ra, code[2]));
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CGT:
+			TJS_VM_CASE(VM_CGT):
 				flag = TJS_GET_VM_REG(ra, code[1]).LittlerThan(
 					TJS_GET_VM_REG(ra, code[2]));
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SETF:
+			TJS_VM_CASE(VM_SETF):
 				TJS_GET_VM_REG(ra, code[1]) = flag;
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SETNF:
+			TJS_VM_CASE(VM_SETNF):
 				TJS_GET_VM_REG(ra, code[1]) = !flag;
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_LNOT:
+			TJS_VM_CASE(VM_LNOT):
 				TJS_GET_VM_REG(ra, code[1]).logicalnot();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_NF:
+			TJS_VM_CASE(VM_NF):
 				flag = !flag;
 				code ++;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_JF:
+			TJS_VM_CASE(VM_JF):
 				if(flag)
 					TJS_ADD_VM_CODE_ADDR(code, code[1]);
 				else
 					code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_JNF:
+			TJS_VM_CASE(VM_JNF):
 				if(!flag)
 					TJS_ADD_VM_CODE_ADDR(code, code[1]);
 				else
 					code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_JMP:
+			TJS_VM_CASE(VM_JMP):
 				TJS_ADD_VM_CODE_ADDR(code, code[1]);
-				break;
+				TJS_VM_NEXT;
+
+#define TJS_DEF_VM_CJ(vmcode, comp) \
+			TJS_VM_CASE(VM_##vmcode##JF): \
+				flag = TJS_GET_VM_REG(ra, code[2]).comp( \
+					TJS_GET_VM_REG(ra, code[3])); \
+				if(flag) \
+					TJS_ADD_VM_CODE_ADDR(code, code[1]); \
+				else \
+					code += 4; \
+				TJS_VM_NEXT; \
+			TJS_VM_CASE(VM_##vmcode##JNF): \
+				flag = TJS_GET_VM_REG(ra, code[2]).comp( \
+					TJS_GET_VM_REG(ra, code[3])); \
+				if(!flag) \
+					TJS_ADD_VM_CODE_ADDR(code, code[1]); \
+				else \
+					code += 4; \
+				TJS_VM_NEXT;
+
+			TJS_DEF_VM_CJ(CEQ, NormalCompare)
+			TJS_DEF_VM_CJ(CDEQ, DiscernCompare)
+			TJS_DEF_VM_CJ(CLT, GreaterThan)
+			TJS_DEF_VM_CJ(CGT, LittlerThan)
+
+#undef TJS_DEF_VM_CJ
+
+			TJS_VM_CASE(VM_INCLTJF):
+				TJS_GET_VM_REG(ra, code[2]).increment();
+				flag = TJS_GET_VM_REG(ra, code[2]).GreaterThan(
+					TJS_GET_VM_REG(ra, code[3]));
+				if(flag)
+					TJS_ADD_VM_CODE_ADDR(code, code[1]);
+				else
+					code += 4;
+				TJS_VM_NEXT;
+
+			TJS_VM_CASE(VM_DECGTJF):
+				TJS_GET_VM_REG(ra, code[2]).decrement();
+				flag = TJS_GET_VM_REG(ra, code[2]).LittlerThan(
+					TJS_GET_VM_REG(ra, code[3]));
+				if(flag)
+					TJS_ADD_VM_CODE_ADDR(code, code[1]);
+				else
+					code += 4;
+				TJS_VM_NEXT;
 
-			case VM_INC:
+			TJS_VM_CASE(VM_INC):
 				TJS_GET_VM_REG(ra, code[1]).increment();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_INCPD:
+			TJS_VM_CASE(VM_INCPD):
 				OperatePropertyDirect0(ra, code, TJS_OP_INC);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_INCPI:
+			TJS_VM_CASE(VM_INCPI):
 				OperatePropertyIndirect0(ra, code, TJS_OP_INC);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_INCP:
+			TJS_VM_CASE(VM_INCP):
 				OperateProperty0(ra, code, TJS_OP_INC);
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_DEC:
+			TJS_VM_CASE(VM_DEC):
 				TJS_GET_VM_REG(ra, code[1]).decrement();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_DECPD:
+			TJS_VM_CASE(VM_DECPD):
 				OperatePropertyDirect0(ra, code, TJS_OP_DEC);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_DECPI:
+			TJS_VM_CASE(VM_DECPI):
 				OperatePropertyIndirect0(ra, code, TJS_OP_DEC);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_DECP:
+			TJS_VM_CASE(VM_DECP):
 				OperateProperty0(ra, code, TJS_OP_DEC);
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
 #define TJS_DEF_VM_P(vmcode, rope) \
-			case VM_##vmcode: \
+			TJS_VM_CASE(VM_##vmcode): \
 				TJS_GET_VM_REG(ra, code[1]).rope(TJS_GET_VM_REG(ra, code[2])); \
 				code += 3; \
-				break; \
-			case VM_##vmcode##PD: \
+				TJS_VM_NEXT; \
+			TJS_VM_CASE(VM_##vmcode##PD): \
 				OperatePropertyDirect(ra, code, TJS_OP_##vmcode); \
 				code += 5; \
-				break; \
-			case VM_##vmcode##PI: \
+				TJS_VM_NEXT; \
+			TJS_VM_CASE(VM_##vmcode##PI): \
 				OperatePropertyIndirect(ra, code, TJS_OP_##vmcode); \
 				code += 5; \
-				break; \
-			case VM_##vmcode##P: \
+				TJS_VM_NEXT; \
+			TJS_VM_CASE(VM_##vmcode##P): \
 				OperateProperty(ra, code, TJS_OP_##vmcode); \
 				code += 4; \
-				break
+				TJS_VM_NEXT
 
 				TJS_DEF_VM_P(LOR, logicalorequal);
 				TJS_DEF_VM_P(LAND, logicalandequal);
@@ -1188,196 +1319,196 @@ tjs_int tTJSInterCodeContext::ExecuteCode(tTJSVariant *ra_org, tjs_int startip,
 
 #undef TJS_DEF_VM_P
 
-			case VM_BNOT:
+			TJS_VM_CASE(VM_BNOT):
 				TJS_GET_VM_REG(ra, code[1]).bitnot();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_ASC:
+			TJS_VM_CASE(VM_ASC):
 				CharacterCodeOf(TJS_GET_VM_REG(ra, code[1]));
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CHR:
+			TJS_VM_CASE(VM_CHR):
 				CharacterCodeFrom(TJS_GET_VM_REG(ra, code[1]));
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_NUM:
+			TJS_VM_CASE(VM_NUM):
 				TJS_GET_VM_REG(ra, code[1]).tonumber();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CHS:
+			TJS_VM_CASE(VM_CHS):
 				TJS_GET_VM_REG(ra, code[1]).changesign();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_INV:
+			TJS_VM_CASE(VM_INV):
 				TJS_GET_VM_REG(ra, code[1]) =
 					TJS_GET_VM_REG(ra, code[1]).Type() != tvtObject ? false :
 					(TJS_GET_VM_REG(ra, code[1]).AsObjectClosureNoAddRef().Invalidate(0,
 					NULL, NULL, ra[-1].AsObjectNoAddRef()) == TJS_S_TRUE);
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CHKINV:
+			TJS_VM_CASE(VM_CHKINV):
 				TJS_GET_VM_REG(ra, code[1]) =
 					TJS_GET_VM_REG(ra, code[1]).Type() != tvtObject ? true :
 					TJSIsObjectValid(TJS_GET_VM_REG(ra, code[1]).AsObjectClosureNoAddRef().IsValid(0,
 					NULL, NULL, ra[-1].AsObjectNoAddRef()));
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_INT:
+			TJS_VM_CASE(VM_INT):
 				TJS_GET_VM_REG(ra, code[1]).ToInteger();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_REAL:
+			TJS_VM_CASE(VM_REAL):
 				TJS_GET_VM_REG(ra, code[1]).ToReal();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_STR:
+			TJS_VM_CASE(VM_STR):
 				TJS_GET_VM_REG(ra, code[1]).ToString();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_OCTET:
+			TJS_VM_CASE(VM_OCTET):
 				TJS_GET_VM_REG(ra, code[1]).ToOctet();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_TYPEOF:
+			TJS_VM_CASE(VM_TYPEOF):
 				TypeOf(TJS_GET_VM_REG(ra, code[1]));
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_TYPEOFD:
+			TJS_VM_CASE(VM_TYPEOFD):
 				TypeOfMemberDirect(ra, code, TJS_MEMBERMUSTEXIST);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_TYPEOFI:
+			TJS_VM_CASE(VM_TYPEOFI):
 				TypeOfMemberIndirect(ra, code, TJS_MEMBERMUSTEXIST);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_EVAL:
+			TJS_VM_CASE(VM_EVAL):
 				Eval(TJS_GET_VM_REG(ra, code[1]),
 					TJSEvalOperatorIsOnGlobal ? NULL : ra[-1].AsObjectNoAddRef(),
 					true);
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_EEXP:
+			TJS_VM_CASE(VM_EEXP):
 				Eval(TJS_GET_VM_REG(ra, code[1]),
 					TJSEvalOperatorIsOnGlobal ? NULL : ra[-1].AsObjectNoAddRef(),
 					false);
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CHKINS:
+			TJS_VM_CASE(VM_CHKINS):
 				InstanceOf(TJS_GET_VM_REG(ra, code[2]),
 					TJS_GET_VM_REG(ra, code[1]));
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CALL:
-			case VM_NEW:
+			TJS_VM_CASE(VM_CALL):
+			TJS_VM_CASE(VM_NEW):
 				code += CallFunction(ra, code, args, numargs);
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CALLD:
+			TJS_VM_CASE(VM_CALLD):
 				code += CallFunctionDirect(ra, code, args, numargs);
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CALLI:
+			TJS_VM_CASE(VM_CALLI):
 				code += CallFunctionIndirect(ra, code, args, numargs);
-				break;
+				TJS_VM_NEXT;
 
-			case VM_GPD:
+			TJS_VM_CASE(VM_GPD):
 				GetPropertyDirect(ra, code, 0);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_GPDS:
+			TJS_VM_CASE(VM_GPDS):
 				GetPropertyDirect(ra, code, TJS_IGNOREPROP);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SPD:
+			TJS_VM_CASE(VM_SPD):
 				SetPropertyDirect(ra, code, 0);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SPDE:
+			TJS_VM_CASE(VM_SPDE):
 				SetPropertyDirect(ra, code, TJS_MEMBERENSURE);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SPDEH:
+			TJS_VM_CASE(VM_SPDEH):
 				SetPropertyDirect(ra, code, TJS_MEMBERENSURE|TJS_HIDDENMEMBER);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SPDS:
+			TJS_VM_CASE(VM_SPDS):
 				SetPropertyDirect(ra, code, TJS_MEMBERENSURE|TJS_IGNOREPROP);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_GPI:
+			TJS_VM_CASE(VM_GPI):
 				GetPropertyIndirect(ra, code, 0);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_GPIS:
+			TJS_VM_CASE(VM_GPIS):
 				GetPropertyIndirect(ra, code, TJS_IGNOREPROP);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SPI:
+			TJS_VM_CASE(VM_SPI):
 				SetPropertyIndirect(ra, code, 0);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SPIE:
+			TJS_VM_CASE(VM_SPIE):
 				SetPropertyIndirect(ra, code, TJS_MEMBERENSURE);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SPIS:
+			TJS_VM_CASE(VM_SPIS):
 				SetPropertyIndirect(ra, code, TJS_MEMBERENSURE|TJS_IGNOREPROP);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_GETP:
+			TJS_VM_CASE(VM_GETP):
 				GetProperty(ra, code);
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SETP:
+			TJS_VM_CASE(VM_SETP):
 				SetProperty(ra, code);
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_DELD:
+			TJS_VM_CASE(VM_DELD):
 				DeleteMemberDirect(ra, code);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_DELI:
+			TJS_VM_CASE(VM_DELI):
 				DeleteMemberIndirect(ra, code);
 				code += 4;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_SRV:
+			TJS_VM_CASE(VM_SRV):
 				if(result) result->CopyRef(TJS_GET_VM_REG(ra, code[1]));
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_RET:
+			TJS_VM_CASE(VM_RET):
 #ifdef ENABLE_DEBUGGER
 				if( is_enable_debugger ) {
 					TJSDebuggerHook( DBGHOOK_PREV_RETURN, Block->GetName(), cur_line_no, this );
@@ -1386,16 +1517,16 @@ tjs_int tTJSInterCodeContext::ExecuteCode(tTJSVariant *ra_org, tjs_int startip,
 #endif	// ENABLE_DEBUGGER
 				return (tjs_int)(code+1-CodeArea);
 
-			case VM_ENTRY:
+			TJS_VM_CASE(VM_ENTRY):
 				code = CodeArea + ExecuteCodeInTryBlock(ra, (tjs_int)(code-CodeArea + 3), args,
 					numargs, result, (tjs_int)(TJS_FROM_VM_CODE_ADDR(code[1])+code-CodeArea),
 					TJS_FROM_VM_REG_ADDR(code[2]));
-				break;
+				TJS_VM_NEXT;
 
-			case VM_EXTRY:
+			TJS_VM_CASE(VM_EXTRY):
 				return (tjs_int)(code+1-CodeArea);  // same as ret
 
-			case VM_THROW:
+			TJS_VM_CASE(VM_THROW):
 #ifdef ENABLE_DEBUGGER
 				if( is_enable_debugger ) {
 					TJSDebuggerHook( DBGHOOK_PREV_EXCEPT, Block->GetName(), cur_line_no, this );
@@ -1405,30 +1536,30 @@ tjs_int tTJSInterCodeContext::ExecuteCode(tTJSVariant *ra_org, tjs_int startip,
 				ThrowScriptException(TJS_GET_VM_REG(ra, code[1]),
 					Block, CodePosToSrcPos((tjs_int)(code-CodeArea)));
 				code += 2; // actually here not proceed...
-				break;
+				TJS_VM_NEXT;
 
-			case VM_CHGTHIS:
+			TJS_VM_CASE(VM_CHGTHIS):
 				TJS_GET_VM_REG(ra, code[1]).ChangeClosureObjThis(
 					TJS_GET_VM_REG(ra, code[2]).AsObjectNoAddRef());
 				code += 3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_GLOBAL:
+			TJS_VM_CASE(VM_GLOBAL):
 				TJS_GET_VM_REG(ra, code[1]) = Block->GetTJS()->GetGlobalNoAddRef();
 				code += 2;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_ADDCI:
+			TJS_VM_CASE(VM_ADDCI):
 				AddClassInstanceInfo(ra, code);
 				code+=3;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_REGMEMBER:
+			TJS_VM_CASE(VM_REGMEMBER):
 				RegisterObjectMember(ra[-1].AsObjectNoAddRef());
 				code ++;
-				break;
+				TJS_VM_NEXT;
 
-			case VM_DEBUGGER:
+			TJS_VM_CASE(VM_DEBUGGER):
 #ifdef ENABLE_DEBUGGER
 				if( is_enable_debugger ) {
 					TJSDebuggerHook( DBGHOOK_PREV_BREAK, Block->GetName(), cur_line_no, this );
@@ -1438,9 +1569,9 @@ tjs_int tTJSInterCodeContext::ExecuteCode(tTJSVariant *ra_org, tjs_int startip,
 				TJSNativeDebuggerBreak();
 #endif	// ENABLE_DEBUGGER
 				code ++;
-				break;
+				TJS_VM_NEXT;
 
-			default:
+			TJS_VM_DEFAULT:
 				ThrowInvalidVMCode();
 			}
 		}
@@ -1510,6 +1641,9 @@ tjs_int tTJSInterCodeContext::ExecuteCode(tTJSVariant *ra_org, tjs_int startip,
 
 	return (tjs_int)(codesave-CodeArea);
 }
+#undef TJS_VM_CASE
+#undef TJS_VM_DEFAULT
+#undef TJS_VM_NEXT
 //---------------------------------------------------------------------------
 tjs_int tTJSInterCodeContext::ExecuteCodeInTryBlock(tTJSVariant *ra, tjs_int startip,
 	tTJSVariant **args, tjs_int numargs, tTJSVariant *result, tjs_int catchip,
@@ -1554,6 +1688,40 @@ void tTJSInterCodeContext::ContinuousClear(
 	while(r<rl) (r++)->Clear();
 }
 //---------------------------------------------------------------------------
+static tTJSCustomObject * TJSGetPropertyCacheTarget(iTJSDispatch2 *obj)
+{
+	// return the object whose members may be accessed through the inline
+	// property cache, or NULL. classes derived from tTJSCustomObject override
+	// PropGet/PropSet and are excluded by the exact type match.
+	// type_info addresses are compared to avoid string comparison on a
+	// mismatch; a false mismatch only bypasses the cache.
+	if(!obj) return NULL;
+	const std::type_info *type = &typeid(*obj);
+	if(type == &typeid(tTJSObjectProxy))
+	{
+		// objthis-proxy; members found in the first object never reach
+		// the second one
+		obj = static_cast<tTJSObjectProxy*>(obj)->GetDispatch1();
+		if(!obj) return NULL;
+		type = &typeid(*obj);
+	}
+	if(type == &typeid(tTJSCustomObject))
+		return static_cast<tTJSCustomObject*>(obj);
+	return NULL;
+}
+//---------------------------------------------------------------------------
+tTJSInterCodeContext::tPropertyCache * tTJSInterCodeContext::GetPropertyCache(
+	tjs_int32 dataaddr)
+{
+	// return the inline cache entry for the member name at DataArea + dataaddr
+	if(!PropertyCaches)
+	{
+		PropertyCaches = new tPropertyCache[DataAreaSize];
+		memset(PropertyCaches, 0, sizeof(tPropertyCache) * DataAreaSize);
+	}
+	return PropertyCaches + dataaddr / (tjs_int32)sizeof(tTJSVariant);
+}
+//---------------------------------------------------------------------------
 void tTJSInterCodeContext::GetPropertyDirect(tTJSVariant *ra,
 	const tjs_int32 *code, tjs_uint32 flags)
 {
@@ -1578,6 +1746,35 @@ void tTJSInterCodeContext::GetPropertyDirect(tTJSVariant *ra,
 	tjs_error hr;
 	tTJSVariantClosure clo = ra_code2->AsObjectClosureNoAddRef();
 	tTJSVariant *name = TJS_GET_VM_REG_ADDR(DataArea, code[3]);
+
+	tTJSCustomObject *obj = TJSGetPropertyCacheTarget(clo.Object);
+	if(obj)
+	{
+		// try the inline cache for this site
+		iTJSDispatch2 *objthis = clo.ObjThis?clo.ObjThis:ra[-1].AsObjectNoAddRef();
+		tPropertyCache *cache = GetPropertyCache(code[3]);
+		hr = TJS_E_NOTIMPL;
+		if(cache->Object == obj)
+			hr = obj->PropGetByCache(flags, cache->Shape, cache->Data,
+				TJS_GET_VM_REG_ADDR(ra, code[1]), objthis);
+		if(hr == TJS_E_NOTIMPL)
+		{
+			tTJSCustomObject::tTJSSymbolData *data =
+				obj->FindForCache(name->AsStringNoAddRef(), cache->Shape);
+			cache->Object = data ? obj : NULL;
+			cache->Data = data;
+			if(data)
+				hr = obj->PropGetByCache(flags, cache->Shape, data,
+					TJS_GET_VM_REG_ADDR(ra, code[1]), objthis);
+		}
+		if(hr != TJS_E_NOTIMPL)
+		{
+			if(TJS_FAILED(hr))
+				TJSThrowFrom_tjs_error(hr, name->GetString());
+			return;
+		}
+	}
+
 	hr = clo.PropGet(flags,
 		name->GetString(), name->GetHint(), TJS_GET_VM_REG_ADDR(ra, code[1]),
 			clo.ObjThis?clo.ObjThis:ra[-1].AsObjectNoAddRef());
@@ -1608,6 +1805,36 @@ void tTJSInterCodeContext::SetPropertyDirect(tTJSVariant *ra,
 	tjs_error hr;
 	tTJSVariantClosure clo = ra_code1->AsObjectClosureNoAddRef();
 	tTJSVariant *name = TJS_GET_VM_REG_ADDR(DataArea, code[2]);
+
+	tTJSCustomObject *obj = TJSGetPropertyCacheTarget(clo.Object);
+	if(obj)
+	{
+		// try the inline cache for this site
+		iTJSDispatch2 *objthis = clo.ObjThis?clo.ObjThis:ra[-1].AsObjectNoAddRef();
+		tPropertyCache *cache = GetPropertyCache(code[2]);
+		hr = TJS_E_NOTIMPL;
+		if(cache->Object == obj)
+			hr = obj->PropSetByCache(flags, cache->Shape, cache->Data,
+				name->AsStringNoAddRef(), TJS_GET_VM_REG_ADDR(ra, code[3]), objthis);
+		if(hr == TJS_E_NOTIMPL)
+		{
+			tTJSCustomObject::tTJSSymbolData *data =
+				obj->FindForCache(name->AsStringNoAddRef(), cache->Shape);
+			cache->Object = data ? obj : NULL;
+			cache->Data = data;
+			if(data)
+				hr = obj->PropSetByCache(flags, cache->Shape, data,
+					name->AsStringNoAddRef(), TJS_GET_VM_REG_ADDR(ra, code[3]),
+					objthis);
+		}
+		if(hr != TJS_E_NOTIMPL)
+		{
+			if(TJS_FAILED(hr))
+				TJSThrowFrom_tjs_error(hr, name->GetString());
+			return;
+		}
+	}
+
 	hr = clo.PropSetByVS(flags,
 		name->AsStringNoAddRef(), TJS_GET_VM_REG_ADDR(ra, code[3]),
 			clo.ObjThis?clo.ObjThis:ra[-1].AsObjectNoAddRef());
@@ -2198,14 +2425,18 @@ void tTJSInterCodeContext::TypeOfMemberIndirect(tTJSVariant *ra,
 // code[0] is an argument count;
 // -1 for omitting ('...') argument to passing unmodified args from the caller.
 // -2 for expanding array to argument
+// the expanded elements are placed in the variant array stack, and larger
+// pointer arrays are taken from the object pool, so that calls do not
+// allocate memory from the system.
 #define TJS_PASS_ARGS_PREPARED_ARRAY_COUNT 20
 
 #define TJS_BEGIN_FUNC_CALL_ARGS(_code)                                   \
 	tTJSVariant ** pass_args;                                             \
 	tTJSVariant *pass_args_p[TJS_PASS_ARGS_PREPARED_ARRAY_COUNT];         \
 	tTJSVariant * pass_args_v = NULL;                                     \
+	tjs_int pass_args_v_count = 0;                                        \
 	tjs_int code_size;                                                    \
-	bool alloc_args = false;                                              \
+	tjs_int alloc_args_count = 0;                                         \
 	try                                                                   \
 	{                                                                     \
 		tjs_int pass_args_count = (_code)[0];                             \
@@ -2245,13 +2476,18 @@ void tTJSInterCodeContext::TypeOfMemberIndirect(tTJSVariant *ra,
 			}                                                             \
 			pass_args_count += args_v_count;                              \
 			/* allocate temporary variant array for Array object */       \
-			pass_args_v = new tTJSVariant[args_v_count];                  \
+			if(args_v_count)                                              \
+			{                                                             \
+				pass_args_v =                                             \
+					TJSVariantArrayStack->Allocate(args_v_count);         \
+				pass_args_v_count = args_v_count;                         \
+			}                                                             \
 			/* allocate pointer array */                                  \
 			if(pass_args_count < TJS_PASS_ARGS_PREPARED_ARRAY_COUNT)      \
 				pass_args = pass_args_p;                                  \
 			else                                                          \
-				pass_args = new tTJSVariant * [pass_args_count],          \
-					alloc_args = true;                                    \
+				pass_args = TJSAllocPassArgs(pass_args_count),            \
+					alloc_args_count = pass_args_count;                   \
 			/* create pointer array to pass to callee function */         \
 			args_v_count = 0;                                             \
 			pass_args_count = 0;                                          \
@@ -2300,8 +2536,8 @@ void tTJSInterCodeContext::TypeOfMemberIndirect(tTJSVariant *ra,
 		else                                                              \
 		{                                                                 \
 			code_size = pass_args_count + 1;                              \
-			pass_args = new tTJSVariant * [pass_args_count];              \
-			alloc_args = true;                                            \
+			pass_args = TJSAllocPassArgs(pass_args_count);                \
+			alloc_args_count = pass_args_count;                           \
 			for(tjs_int i = 0; i < pass_args_count; i++)                  \
 				pass_args[i] = TJS_GET_VM_REG_ADDR(ra, (_code)[1+i]);     \
 		}
@@ -2311,12 +2547,35 @@ void tTJSInterCodeContext::TypeOfMemberIndirect(tTJSVariant *ra,
 	}                                                                     \
 	catch(...)                                                            \
 	{                                                                     \
-		if(alloc_args) delete [] pass_args;                               \
-		if(pass_args_v) delete [] pass_args_v;                            \
+		if(alloc_args_count)                                              \
+			TJSFreePassArgs(pass_args, alloc_args_count);                 \
+		if(pass_args_v)                                                   \
+			TJSFreePassArgsV(TJSVariantArrayStack, pass_args_v,           \
+				pass_args_v_count);                                       \
 		throw;                                                            \
 	}                                                                     \
-	if(alloc_args) delete [] pass_args;                                   \
-	if(pass_args_v) delete [] pass_args_v;
+	if(alloc_args_count) TJSFreePassArgs(pass_args, alloc_args_count);    \
+	if(pass_args_v)                                                       \
+		TJSFreePassArgsV(TJSVariantArrayStack, pass_args_v,               \
+			pass_args_v_count);
+//---------------------------------------------------------------------------
+static inline tTJSVariant ** TJSAllocPassArgs(tjs_int count)
+{
+	return (tTJSVariant **)TJSAllocObjectMemory(sizeof(tTJSVariant *) * count);
+}
+//---------------------------------------------------------------------------
+static inline void TJSFreePassArgs(tTJSVariant **args, tjs_int count)
+{
+	TJSFreeObjectMemory(args, sizeof(tTJSVariant *) * count);
+}
+//---------------------------------------------------------------------------
+static inline void TJSFreePassArgsV(tTJSVariantArrayStack *stack,
+	tTJSVariant *args, tjs_int count)
+{
+	// release the elements before returning the area to the stack
+	for(tjs_int i = 0; i < count; i++) args[i].Clear();
+	stack->Deallocate(count, args);
+}
 //---------------------------------------------------------------------------
 tjs_int tTJSInterCodeContext::CallFunction(tTJSVariant *ra,
 	const tjs_int32 *code, tTJSVariant **args, tjs_int numargs)
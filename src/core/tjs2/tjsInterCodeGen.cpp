@@ -211,6 +211,7 @@ tTJSInterCodeContext::tTJSInterCodeContext(tTJSInterCodeContext *parent,
 	_DataAreaSize = 0;
 	DataArea = NULL;
 	DataAreaSize = 0;
+	PropertyCaches = NULL;
 
 	FrameBase = 1;
 
@@ -327,6 +328,7 @@ tTJSInterCodeContext::tTJSInterCodeContext( tTJSScriptBlock *block, const tjs_ch
 	_DataAreaSize = 0;
 	DataArea = data;
 	DataAreaSize = dataSize;
+	PropertyCaches = NULL;
 
 	// copy
 	size_t size = superpointer.size();
@@ -401,6 +403,11 @@ void tTJSInterCodeContext::Finalize(void)
 		delete [] DataArea;
 		DataArea = NULL;
 	}
+	if(PropertyCaches)
+	{
+		delete [] PropertyCaches;
+		PropertyCaches = NULL;
+	}
 
 	Block->Remove(this);
 
@@ -1006,7 +1013,13 @@ void tTJSInterCodeContext::Commit()
 
 	RegisterFunction();
 
-	if(ContextType != ctProperty && ContextType != ctSuperClassGetter) FixCode();
+	if(ContextType != ctProperty && ContextType != ctSuperClassGetter)
+	{
+#ifndef ENABLE_DEBUGGER
+		if(TJSEnableCodeOptimization && !TJSEnableDebugMode) OptimizeCode();
+#endif
+		FixCode();
+	}
 
 	if(!DataArea)
 	{
@@ -3905,6 +3918,7 @@ std::vector<tjs_uint8>* tTJSInterCodeContext::ExportByteCode( bool outputdebug,
 	// 13 * 4 f[^̃TCY
 	int srcpossize = 0;
 	if( outputdebug ) {
+		SortSourcePos();
 		srcpossize = SourcePosArraySize * 8;
 	}
 	int codesize = (CodeAreaSize%2) == 1 ? CodeAreaSize * 2+2 : CodeAreaSize * 2;
@@ -3928,7 +3942,7 @@ std::vector<tjs_uint8>* tTJSInterCodeContext::ExportByteCode( bool outputdebug,
 	Add4ByteToVector( result, propGetter );
 	Add4ByteToVector( result, superClassGetter );
 
-	int count = srcpossize;
+	int count = outputdebug ? SourcePosArraySize : 0;
 	Add4ByteToVector( result, count);
 	if( outputdebug ) {
 		for( int i = 0; i < count ; i++ ) {
@@ -3944,6 +3958,11 @@ std::vector<tjs_uint8>* tTJSInterCodeContext::ExportByteCode( bool outputdebug,
 
 	block->TranslateCodeAddress( CodeArea, CodeAreaSize );
 	for( int i = 0; i < CodeAreaSize; i++ ) {
+		if( CodeArea[i] != (tjs_int16)CodeArea[i] ) {
+			// too large to be stored as 16bit bytecode
+			delete result;
+			TJS_eTJSScriptError( TJSInternalError, block, 0 );
+		}
 		Add2ByteToVector( result, CodeArea[i] );
 	}
 	if( (count%2) == 1 ) { // alignment
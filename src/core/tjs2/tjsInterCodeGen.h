@@ -34,7 +34,7 @@ namespace TJS
 #define TJS_TO_VM_REG_ADDR(x) ((x) * (tjs_int)sizeof(tTJSVariant))
 #define TJS_FROM_VM_CODE_ADDR(x)  ((tjs_int)(x) / (tjs_int)sizeof(tjs_uint32))
 #define TJS_FROM_VM_REG_ADDR(x) ((tjs_int)(x) / (tjs_int)sizeof(tTJSVariant))
-#define TJS_ADD_VM_CODE_ADDR(dest, x)  ((*(char **)&(dest)) += (x))
+#define TJS_ADD_VM_CODE_ADDR(dest, x)  ((dest) += TJS_FROM_VM_CODE_ADDR(x))
 #define TJS_GET_VM_REG_ADDR(base, x) ((tTJSVariant*)((char *)(base) + (tjs_int)(x)))
 #define TJS_GET_VM_REG(base, x) (*(TJS_GET_VM_REG_ADDR(base, x)))
 
@@ -74,6 +74,11 @@ enum tTJSVMCodes{
 	VM_DELD, VM_DELI, VM_SRV, VM_RET, VM_ENTRY, VM_EXTRY, VM_THROW,
 	VM_CHGTHIS, VM_GLOBAL, VM_ADDCI, VM_REGMEMBER, VM_DEBUGGER,
 
+	// superinstructions generated by the code optimizer;
+	// these take operands of ( jump address, register, register ).
+	VM_CEQJF, VM_CEQJNF, VM_CDEQJF, VM_CDEQJNF, VM_CLTJF, VM_CLTJNF,
+	VM_CGTJF, VM_CGTJNF, VM_INCLTJF, VM_DECGTJF,
+
 	__VM_LAST /* = last mark ; this is not a real operation code */} ;
 
 #undef TJS_NORMAL_AND_PROPERTY_ACCESSER
@@ -295,6 +300,16 @@ private:
 	tTJSVariant * DataArea;
 	tjs_int DataAreaSize;
 
+	struct tPropertyCache
+	{
+		iTJSDispatch2 *Object; // object seen last at this site (not referenced)
+		tjs_uint64 Shape; // shape of the object when Data was found
+		tTJSCustomObject::tTJSSymbolData *Data;
+	};
+	tPropertyCache * PropertyCaches;
+		// inline caches for VM_GPD/VM_SPD family, indexed as DataArea;
+		// allocated on first use
+
 	tTJSLocalNamespace Namespace;
 
 	std::vector<tTJSExprNode *> NodeToDeleteVector;
@@ -382,6 +397,9 @@ private:
 	void FixCode(void);
 	void RegisterFunction();
 
+	// implemented in tjsCodeOptimizer.cpp
+	void OptimizeCode(void);
+
 	tjs_int _GenNodeCode(tjs_int & frame, tTJSExprNode *node, tjs_uint32 restype,
 		tjs_int reqresaddr, const tSubParam & param);
 	tjs_int GenNodeCode(tjs_int & frame, tTJSExprNode *node, tjs_uint32 restype,
@@ -524,6 +542,7 @@ private:
 		tjs_int catchip, tjs_int exobjreg);
 
 	static void ContinuousClear(tTJSVariant *ra, const tjs_int32 *code);
+	tPropertyCache * GetPropertyCache(tjs_int32 dataaddr);
 	void GetPropertyDirect(tTJSVariant *ra, const tjs_int32 *code,
 		tjs_uint32 flags);
 	void SetPropertyDirect(tTJSVariant *ra, const tjs_int32 *code,
@@ -364,6 +364,16 @@ void TJSDoRehash() { TJSGlobalRebuildHashMagic ++; }
 
 
 
+//---------------------------------------------------------------------------
+// shape counter for the VM's inline property caches
+//---------------------------------------------------------------------------
+static tjs_uint64 TJSObjectShapeCounter = 0;
+	// every construction and every structural change of a member table takes
+	// a new value from this, so a shape is never shared by two layouts.
+//---------------------------------------------------------------------------
+
+
+
 //---------------------------------------------------------------------------
 // tTJSCustomObject
 //---------------------------------------------------------------------------
@@ -392,11 +402,19 @@ tTJSCustomObject::tTJSCustomObject(tjs_int hashbits)
 	if(TJSObjectHashMapEnabled()) TJSAddObjectHashRecord(this);
 	Count = 0;
 	RebuildHashMagic = TJSGlobalRebuildHashMagic;
+	Shape = ++TJSObjectShapeCounter;
 	if(hashbits > TJSObjectHashBitsLimit) hashbits = TJSObjectHashBitsLimit;
-	HashSize = (1 << hashbits);
-	HashMask = HashSize - 1;
-	Symbols = new tTJSSymbolData[HashSize];
-	memset(Symbols, 0, sizeof(tTJSSymbolData) * HashSize);
+	HashBits = hashbits;
+	HashSize = 0;
+	HashMask = 0;
+	HashUsed = 0;
+	HashSlots = NULL;
+	Symbols.Next = NULL;
+	Symbols.Capacity = TJS_OBJECT_INLINE_SYMBOLS;
+	Symbols.Used = 0;
+		// entries are cleared when they are handed out
+	LastSymbolBlock = &Symbols;
+	FreeSymbols = NULL;
 	IsInvalidated = false;
 	IsInvalidating = false;
 	CallFinalize = true;
@@ -412,10 +430,12 @@ tTJSCustomObject::tTJSCustomObject(tjs_int hashbits)
 	missing_name = MissingName;
 	for(tjs_int i=0; i<TJS_MAX_NATIVE_CLASS; i++)
 		ClassIDs[i] = (tjs_int32)-1;
+	CycleCandidateIndex = -1;
 }
 //---------------------------------------------------------------------------
 tTJSCustomObject::~tTJSCustomObject()
 {
+	if(CycleCandidateIndex >= 0) TJSRemoveCycleCandidate(this);
 	for(tjs_int i=TJS_MAX_NATIVE_CLASS-1; i>=0; i--)
 	{
 		if(ClassIDs[i]!=-1)
@@ -423,10 +443,20 @@ tTJSCustomObject::~tTJSCustomObject()
 			if(ClassInstances[i]) ClassInstances[i]->Destruct();
 		}
 	}
-	delete [] Symbols;
+	FreeSymbolStorage();
 	if(TJSObjectHashMapEnabled()) TJSRemoveObjectHashRecord(this);
 }
 //---------------------------------------------------------------------------
+tjs_uint TJS_INTF_METHOD tTJSCustomObject::Release(void)
+{
+	// a reference released while others remain may have been the last one
+	// from outside of a reference cycle
+	if(TJSCycleCollectorEnabled && CycleCandidateIndex < 0 && GetRefCount() > 1
+		&& !IsInvalidated)
+		TJSAddCycleCandidate(this);
+	return inherited::Release();
+}
+//---------------------------------------------------------------------------
 void tTJSCustomObject::_Finalize(void)
 {
 	if(IsInvalidating) return; // to avoid re-entrance
@@ -567,6 +597,218 @@ bool tTJSCustomObject::CallSetMissing(const tjs_char *name, const tTJSVariant &v
 	return res;
 }
 //---------------------------------------------------------------------------
+static tjs_int TJSGetSymbolHashSize(tjs_int count, tjs_int hashbits)
+{
+	// decide hash table size for "count" members; the table is kept at most
+	// half full after rebuilding.
+	tjs_int size = 1 << (hashbits > 3 ? hashbits : 3);
+	while(size < count * 2) size <<= 1;
+	return size;
+}
+//---------------------------------------------------------------------------
+static tTJSCustomObject::tTJSSymbolSlot * TJSAllocSymbolSlots(tjs_int size)
+{
+	tTJSCustomObject::tTJSSymbolSlot *slots = (tTJSCustomObject::tTJSSymbolSlot*)
+		TJSAllocObjectMemory(sizeof(tTJSCustomObject::tTJSSymbolSlot) * size);
+	memset(slots, 0, sizeof(tTJSCustomObject::tTJSSymbolSlot) * size);
+	return slots;
+}
+//---------------------------------------------------------------------------
+static void TJSFreeSymbolSlots(tTJSCustomObject::tTJSSymbolSlot *slots,
+	tjs_int size)
+{
+	TJSFreeObjectMemory(slots, sizeof(tTJSCustomObject::tTJSSymbolSlot) * size);
+}
+//---------------------------------------------------------------------------
+static size_t TJSGetSymbolBlockSize(tjs_int capacity)
+{
+	return sizeof(tTJSCustomObject::tTJSSymbolBlock) +
+		sizeof(tTJSCustomObject::tTJSSymbolData) *
+			(capacity - TJS_OBJECT_INLINE_SYMBOLS);
+}
+//---------------------------------------------------------------------------
+static tTJSCustomObject::tTJSSymbolBlock * TJSAllocSymbolBlock(tjs_int capacity)
+{
+	if(capacity < TJS_OBJECT_INLINE_SYMBOLS) capacity = TJS_OBJECT_INLINE_SYMBOLS;
+	tTJSCustomObject::tTJSSymbolBlock *block =
+		(tTJSCustomObject::tTJSSymbolBlock*)
+			TJSAllocObjectMemory(TJSGetSymbolBlockSize(capacity));
+	block->Next = NULL;
+	block->Capacity = capacity;
+	block->Used = 0; // entries are cleared when they are handed out
+	return block;
+}
+//---------------------------------------------------------------------------
+static inline tTJSCustomObject::tTJSSymbolData * TJSGetNextFreeSymbol(
+	const tTJSCustomObject::tTJSSymbolData *data)
+{
+	// an unused entry keeps the link to the next one in its value
+	tTJSCustomObject::tTJSSymbolData *next;
+	memcpy(&next, &data->Value, sizeof(next));
+	return next;
+}
+//---------------------------------------------------------------------------
+static inline void TJSSetNextFreeSymbol(tTJSCustomObject::tTJSSymbolData *data,
+	tTJSCustomObject::tTJSSymbolData *next)
+{
+	memcpy(&data->Value, &next, sizeof(next));
+}
+//---------------------------------------------------------------------------
+tTJSCustomObject::tTJSSymbolData * tTJSCustomObject::AllocSymbol()
+{
+	// hand out an entry of a deleted member, or the next entry at the end of
+	// the storage. existing entries never move here.
+	if(FreeSymbols)
+	{
+		tTJSSymbolData *data = FreeSymbols;
+		FreeSymbols = TJSGetNextFreeSymbol(data);
+		return data;
+	}
+
+	tTJSSymbolBlock *block = LastSymbolBlock;
+	if(block->Used == block->Capacity)
+	{
+		if(!block->Next)
+			block->Next = TJSAllocSymbolBlock(block->Capacity * 2);
+		// otherwise use the block reserved by RebuildHash
+		block = LastSymbolBlock = block->Next;
+	}
+	return block->Data + block->Used++;
+}
+//---------------------------------------------------------------------------
+void tTJSCustomObject::PrepareHashSlot()
+{
+	if(!HashSlots)
+	{
+		// members in the inline block are searched linearly;
+		// the hash table is created when they overflow the block.
+		if(FreeSymbols || Symbols.Used < Symbols.Capacity) return;
+	}
+	else
+	{
+		// keep the table at most 3/4 full, counting tombstones
+		if((HashUsed + 1) * 4 <= HashSize * 3) return;
+	}
+
+	tjs_int size = TJSGetSymbolHashSize(Count + 1, HashBits);
+	if(HashSlots)
+		ResizeHashSlots(size);
+	else
+		SetHashSlots(TJSAllocSymbolSlots(size), size);
+}
+//---------------------------------------------------------------------------
+void tTJSCustomObject::SetHashSlots(tTJSSymbolSlot *slots, tjs_int size)
+{
+	if(HashSlots) TJSFreeSymbolSlots(HashSlots, HashSize);
+	HashSlots = slots;
+	HashSize = size;
+	HashMask = size - 1;
+	HashUsed = 0;
+
+	if(!HashSlots) return;
+
+	for(tTJSSymbolBlock *block = &Symbols; block; block = block->Next)
+	{
+		tTJSSymbolData *d = block->Data;
+		tTJSSymbolData *dlim = d + block->Used;
+		for(; d < dlim; d++)
+		{
+			if(d->SymFlags & TJS_SYMBOL_USING) InsertHashSlot(d);
+		}
+	}
+}
+//---------------------------------------------------------------------------
+void tTJSCustomObject::ResizeHashSlots(tjs_int size)
+{
+	// rehash the members from the current table, dropping the tombstones.
+	// unlike SetHashSlots, the member storage ( which may hold many unused
+	// entries ) is not scanned.
+	tTJSSymbolSlot *newslots = TJSAllocSymbolSlots(size);
+	tTJSSymbolSlot *oldslots = HashSlots;
+	tjs_int oldsize = HashSize;
+	HashSlots = newslots;
+	HashSize = size;
+	HashMask = size - 1;
+	HashUsed = 0;
+
+	tTJSSymbolSlot *slot = oldslots;
+	tTJSSymbolSlot *slotlim = oldslots + oldsize;
+	for(; slot < slotlim; slot++)
+	{
+		if(slot->Data) InsertHashSlot(slot->Data);
+	}
+	TJSFreeSymbolSlots(oldslots, oldsize);
+}
+//---------------------------------------------------------------------------
+void tTJSCustomObject::InsertHashSlot(tTJSSymbolData *data)
+{
+	// the member must not be in the table.
+	// the first empty or deleted slot on the probe sequence is used.
+	tjs_uint32 i = data->Hash & HashMask;
+	tTJSSymbolSlot *slot;
+	while((slot = HashSlots + i)->Data) i = (i + 1) & HashMask;
+	if(!slot->Hash) HashUsed++;
+	slot->Hash = data->Hash;
+	slot->Data = data;
+}
+//---------------------------------------------------------------------------
+tTJSCustomObject::tTJSSymbolSlot * tTJSCustomObject::FindHashSlot(
+	const tjs_char * name, tjs_uint32 hash)
+{
+	tjs_uint32 i = hash & HashMask;
+	while(true)
+	{
+		tTJSSymbolSlot *slot = HashSlots + i;
+		if(slot->Data)
+		{
+			if(slot->Hash == hash && slot->Data->NameMatch(name)) return slot;
+		}
+		else if(!slot->Hash)
+		{
+			return NULL; // reached an empty slot
+		}
+		i = (i + 1) & HashMask;
+	}
+}
+//---------------------------------------------------------------------------
+inline tTJSCustomObject::tTJSSymbolData * tTJSCustomObject::FindByHash(
+	const tjs_char * name, tjs_uint32 hash)
+{
+	if(HashSlots)
+	{
+		tTJSSymbolSlot *slot = FindHashSlot(name, hash);
+		return slot ? slot->Data : NULL;
+	}
+
+	// small object; all members are in the inline block
+	tTJSSymbolData *d = Symbols.Data;
+	tTJSSymbolData *dlim = d + Symbols.Used;
+	for(; d < dlim; d++)
+	{
+		if(d->Hash == hash && (d->SymFlags & TJS_SYMBOL_USING))
+		{
+			if(d->NameMatch(name)) return d;
+		}
+	}
+	return NULL;
+}
+//---------------------------------------------------------------------------
+void tTJSCustomObject::FreeSymbolStorage()
+{
+	tTJSSymbolBlock *block = Symbols.Next;
+	while(block)
+	{
+		tTJSSymbolBlock *next = block->Next;
+		TJSFreeObjectMemory(block, TJSGetSymbolBlockSize(block->Capacity));
+		block = next;
+	}
+	Symbols.Next = NULL;
+	LastSymbolBlock = &Symbols;
+	FreeSymbols = NULL;
+
+	SetHashSlots(NULL, 0);
+}
+//---------------------------------------------------------------------------
 tTJSCustomObject::tTJSSymbolData * tTJSCustomObject::Add(const tjs_char * name,
 	tjs_uint32 *hint)
 {
@@ -592,37 +834,14 @@ tTJSCustomObject::tTJSSymbolData * tTJSCustomObject::Add(const tjs_char * name,
 	else
 		hash = tTJSHashFunc<tjs_char *>::Make(name);
 
-	tTJSSymbolData *lv1 = Symbols + (hash & HashMask);
-
-	if((lv1->SymFlags & TJS_SYMBOL_USING))
-	{
-		// lv1 is using
-		// make a chain and insert it after lv1
-
-		data = new tTJSSymbolData;
-
-		data->SelfClear();
-
-		data->Next = lv1->Next;
-		lv1->Next = data;
-
-		data->SetName(name, hash);
-		data->SymFlags |= TJS_SYMBOL_USING;
-	}
-	else
-	{
-		// lv1 is unused
-		if(!(lv1->SymFlags & TJS_SYMBOL_INIT))
-		{
-			lv1->SelfClear();
-		}
-
-		lv1->SetName(name, hash);
-		lv1->SymFlags |= TJS_SYMBOL_USING;
-		data = lv1;
-	}
+	data = NewSymbol();
+	data->SelfClear();
+	data->SetName(name, hash);
+	data->SymFlags |= TJS_SYMBOL_USING;
+	if(HashSlots) InsertHashSlot(data);
 
 	Count++;
+	Shape = ++TJSObjectShapeCounter;
 
 
 	return data;
@@ -652,89 +871,16 @@ tTJSCustomObject::tTJSSymbolData * tTJSCustomObject::Add(tTJSVariantString * nam
 	else
 		hash = tTJSHashFunc<tjs_char *>::Make((const tjs_char *)(*name));
 
-	tTJSSymbolData *lv1 = Symbols + (hash & HashMask);
-
-	if((lv1->SymFlags & TJS_SYMBOL_USING))
-	{
-		// lv1 is using
-		// make a chain and insert it after lv1
-
-		data = new tTJSSymbolData;
-
-		data->SelfClear();
-
-		data->Next = lv1->Next;
-		lv1->Next = data;
-
-		data->SetName(name, hash);
-		data->SymFlags |= TJS_SYMBOL_USING;
-	}
-	else
-	{
-		// lv1 is unused
-		if(!(lv1->SymFlags & TJS_SYMBOL_INIT))
-		{
-			lv1->SelfClear();
-		}
-
-		lv1->SetName(name, hash);
-		lv1->SymFlags |= TJS_SYMBOL_USING;
-		data = lv1;
-	}
+	data = NewSymbol();
+	data->SelfClear();
+	data->SetName(name, hash);
+	data->SymFlags |= TJS_SYMBOL_USING;
+	if(HashSlots) InsertHashSlot(data);
 
 	Count++;
+	Shape = ++TJSObjectShapeCounter;
 
 
-	return data;
-}
-//---------------------------------------------------------------------------
-tTJSCustomObject::tTJSSymbolData * tTJSCustomObject::AddTo(tTJSVariantString *name,
-		tTJSSymbolData *newdata, tjs_int newhashmask)
-{
-	// similar to Add, except for adding member to new hash space.
-	if(name == NULL)
-	{
-		return NULL;
-	}
-
-	// at this point, the member must not exist in destination hash space
-
-	tjs_uint32 hash;
-	hash = tTJSHashFunc<tjs_char *>::Make((const tjs_char *)(*name));
-
-	tTJSSymbolData *lv1 = newdata + (hash & newhashmask);
-	tTJSSymbolData *data;
-
-	if((lv1->SymFlags & TJS_SYMBOL_USING))
-	{
-		// lv1 is using
-		// make a chain and insert it after lv1
-
-		data = new tTJSSymbolData;
-
-		data->SelfClear();
-
-		data->Next = lv1->Next;
-		lv1->Next = data;
-
-		data->SetName(name, hash);
-		data->SymFlags |= TJS_SYMBOL_USING;
-	}
-	else
-	{
-		// lv1 is unused
-		if(!(lv1->SymFlags & TJS_SYMBOL_INIT))
-		{
-			lv1->SelfClear();
-		}
-
-		lv1->SetName(name, hash);
-		lv1->SymFlags |= TJS_SYMBOL_USING;
-		data = lv1;
-	}
-
-	// count is not incremented
-
 	return data;
 }
 //---------------------------------------------------------------------------
@@ -747,104 +893,97 @@ void tTJSCustomObject::RebuildHash()
 //---------------------------------------------------------------------------
 void tTJSCustomObject::RebuildHash( tjs_int requestcount )
 {
-	// rebuild hash table
+	// rebuild hash table, compact the member storage and reserve room for
+	// "requestcount" members.
 	RebuildHashMagic = TJSGlobalRebuildHashMagic;
 
-	// decide new hash table size
+	if(requestcount < Count) requestcount = Count;
 
-	tjs_int r, v = requestcount;
-	if(v & 0xffff0000) r = 16, v >>= 16; else r = 0;
-	if(v & 0xff00) r += 8, v >>= 8;
-	if(v & 0xf0) r += 4, v >>= 4;
-	v<<=1;
-	tjs_int newhashbits = r + ((0xffffaa50 >> v) &0x03) + 2;
-	if(newhashbits > TJSObjectHashBitsLimit) newhashbits = TJSObjectHashBitsLimit;
-	tjs_int newhashsize = (1 << newhashbits);
-
-
-	if(newhashsize == HashSize) return;
+	tjs_int used = 0;
+	tjs_int capacity = 0;
+	for(tTJSSymbolBlock *block = &Symbols; block; block = block->Next)
+	{
+		used += block->Used;
+		capacity += block->Capacity;
+	}
 
-	tjs_int newhashmask = newhashsize - 1;
-	tjs_int orgcount = Count;
+	bool needslots = requestcount > TJS_OBJECT_INLINE_SYMBOLS;
+	tjs_int newhashsize = needslots ? TJSGetSymbolHashSize(requestcount, HashBits) : 0;
 
-	// allocate new hash space
-	tTJSSymbolData *newsymbols = new tTJSSymbolData[newhashsize];
+	if(used == Count && (needslots || !Symbols.Next))
+	{
+		// no deleted entries; members need not to move.
+		if(!needslots)
+		{
+			if(HashSlots) SetHashSlots(NULL, 0);
+			return;
+		}
 
+		if(capacity < requestcount)
+		{
+			// reserve; the block is filled after the current ones
+			tTJSSymbolBlock *last = LastSymbolBlock;
+			while(last->Next) last = last->Next;
+			last->Next = TJSAllocSymbolBlock(requestcount - capacity);
+		}
 
-	// enumerate current symbol and push to new hash space
+		if(!HashSlots || HashSize < newhashsize || HashSize > newhashsize * 4 ||
+			HashUsed - Count > Count)
+			SetHashSlots(TJSAllocSymbolSlots(newhashsize), newhashsize);
+		return;
+	}
 
+	// allocate new space before touching members
+	tTJSSymbolSlot *newslots = NULL;
+	tTJSSymbolBlock *newblock = NULL;
 	try
 	{
-		memset(newsymbols, 0, sizeof(tTJSSymbolData) * newhashsize);
-		//tjs_int i;
-		tTJSSymbolData * lv1 = Symbols;
-		tTJSSymbolData * lv1lim = lv1 + HashSize;
-		for(; lv1 < lv1lim; lv1++)
+		if(needslots)
 		{
-			tTJSSymbolData * d = lv1->Next;
-			while(d)
-			{
-				tTJSSymbolData * nextd = d->Next;
-				if(d->SymFlags & TJS_SYMBOL_USING)
-				{
-//					d->ReShare();
-					tTJSSymbolData *data = AddTo(d->Name, newsymbols, newhashmask);
-					if(data)
-					{
-						GetValue(data).CopyRef(*(tTJSVariant*)(&(d->Value)));
-						data->SymFlags &= ~ (TJS_SYMBOL_HIDDEN | TJS_SYMBOL_STATIC);
-						data->SymFlags |= d->SymFlags & (TJS_SYMBOL_HIDDEN | TJS_SYMBOL_STATIC);
-						CheckObjectClosureAdd(GetValue(data));
-					}
-				}
-				d = nextd;
-			}
-
-			if(lv1->SymFlags & TJS_SYMBOL_USING)
-			{
-//				lv1->ReShare();
-				tTJSSymbolData *data = AddTo(lv1->Name, newsymbols, newhashmask);
-				if(data)
-				{
-					GetValue(data).CopyRef(*(tTJSVariant*)(&(lv1->Value)));
-					data->SymFlags &= ~ (TJS_SYMBOL_HIDDEN | TJS_SYMBOL_STATIC);
-					data->SymFlags |= lv1->SymFlags & (TJS_SYMBOL_HIDDEN | TJS_SYMBOL_STATIC);
-					CheckObjectClosureAdd(GetValue(data));
-				}
-			}
+			newslots = TJSAllocSymbolSlots(newhashsize);
+			newblock = TJSAllocSymbolBlock(requestcount - TJS_OBJECT_INLINE_SYMBOLS);
 		}
 	}
 	catch(...)
 	{
-		// recover
-		tjs_int _HashMask = HashMask;
-		tjs_int _HashSize = HashSize;
-		tTJSSymbolData * _Symbols = Symbols;
+		if(newslots) TJSFreeSymbolSlots(newslots, newhashsize);
+		throw;
+	}
 
-		Symbols = newsymbols;
-		HashSize = newhashsize;
-		HashMask = newhashmask;
+	// move live members to the front, keeping their order.
+	// members only move towards the front, so that no member is overwritten
+	// before it is moved. the values are moved bitwise; no reference
+	// counting is involved.
+	tjs_int n = 0;
+	for(tTJSSymbolBlock *block = &Symbols; block; block = block->Next)
+	{
+		tTJSSymbolData *d = block->Data;
+		tTJSSymbolData *dlim = d + block->Used;
+		for(; d < dlim; d++)
+		{
+			if(!(d->SymFlags & TJS_SYMBOL_USING)) continue;
+			tTJSSymbolData *to = n < TJS_OBJECT_INLINE_SYMBOLS ?
+				Symbols.Data + n : newblock->Data + (n - TJS_OBJECT_INLINE_SYMBOLS);
+			if(to != d) memcpy(to, d, sizeof(*d));
+			n++;
+		}
+	}
 
-		DeleteAllMembers();
-		delete [] Symbols;
+	// the rest of the inline block holds moved or deleted entries
+	tjs_int inlineused = n < TJS_OBJECT_INLINE_SYMBOLS ? n : TJS_OBJECT_INLINE_SYMBOLS;
+	Symbols.Used = inlineused;
 
-		HashMask = _HashMask;
-		HashSize = _HashSize;
-		Symbols = _Symbols;
-		Count = orgcount;
+	FreeSymbolStorage();
 
-		throw;
+	if(newblock)
+	{
+		newblock->Used = n - inlineused;
+		Symbols.Next = newblock;
+		if(newblock->Used) LastSymbolBlock = newblock;
+		SetHashSlots(newslots, newhashsize);
 	}
 
-	// delete all current members
-	DeleteAllMembers();
-	delete [] Symbols;
-
-	// assign new members
-	Symbols = newsymbols;
-	HashSize = newhashsize;
-	HashMask = newhashmask;
-	Count = orgcount;
+	Shape = ++TJSObjectShapeCounter;
 }
 //---------------------------------------------------------------------------
 bool tTJSCustomObject::DeleteByName(const tjs_char * name, tjs_uint32 *hint)
@@ -852,66 +991,65 @@ bool tTJSCustomObject::DeleteByName(const tjs_char * name, tjs_uint32 *hint)
 	// TODO: utilize hint
 	// find an element named "name" and deletes it
 	tjs_uint32 hash = tTJSHashFunc<tjs_char *>::Make(name);
-	tTJSSymbolData * lv1 = Symbols + (hash & HashMask);
-
-	if(!(lv1->SymFlags & TJS_SYMBOL_USING) && lv1->Next== NULL)
-		return false; // not found
 
-	if((lv1->SymFlags & TJS_SYMBOL_USING) && lv1->NameMatch(name))
+	tTJSSymbolData *data;
+	if(HashSlots)
 	{
-		// mark the element place as "unused"
-		CheckObjectClosureRemove(*(tTJSVariant*)(&(lv1->Value)));
-		lv1->PostClear();
-		Count--;
-		return true;
+		tTJSSymbolSlot *slot = FindHashSlot(name, hash);
+		if(!slot) return false; // not found
+		data = slot->Data;
+		slot->Data = NULL; // leave a tombstone
 	}
-
-	// chain processing
-	tTJSSymbolData * d = lv1->Next;
-	tTJSSymbolData * prevd = lv1;
-	while(d)
+	else
 	{
-		if((d->SymFlags & TJS_SYMBOL_USING) && d->Hash == hash)
-		{
-			if(d->NameMatch(name))
-			{
-				// sever from the chain
-				prevd->Next = d->Next;
-				CheckObjectClosureRemove(*(tTJSVariant*)(&(d->Value)));
-				d->Destory();
+		data = FindByHash(name, hash);
+		if(!data) return false; // not found
+	}
 
-				delete d;
+	// mark the element place as "unused"
+	CheckObjectClosureRemove(*(tTJSVariant*)(&(data->Value)));
+	data->PostClear();
 
-				Count--;
-				return true;
-			}
-		}
-		prevd = d;
-		d = d->Next;
+	// the last entry can be handed out again; others are reused through
+	// the free list
+	if(LastSymbolBlock->Used &&
+		data == LastSymbolBlock->Data + LastSymbolBlock->Used - 1)
+	{
+		LastSymbolBlock->Used--;
+	}
+	else
+	{
+		TJSSetNextFreeSymbol(data, FreeSymbols);
+		FreeSymbols = data;
 	}
 
-	return false;
+	Count--;
+	Shape = ++TJSObjectShapeCounter;
+	return true;
 }
 //---------------------------------------------------------------------------
 void tTJSCustomObject::DeleteAllMembers(void)
 {
 	// delete all members
+	Shape = ++TJSObjectShapeCounter;
 	if(Count <= 10) return _DeleteAllMembers();
 
-	std::vector<iTJSDispatch2*> vector;
+	typedef std::vector<iTJSDispatch2*, tTJSPoolAllocator<iTJSDispatch2*> >
+		tObjectVector;
+	tObjectVector vector;
 	try
 	{
-		tTJSSymbolData * lv1, *lv1lim;
+		vector.reserve(Count * 2); // an object and its objthis per member
+
+		tTJSSymbolBlock * block;
 
 		// list all members up that hold object
-		lv1 = Symbols;
-		lv1lim = lv1 + HashSize;
-		for(; lv1 < lv1lim; lv1++)
+		for(block = &Symbols; block; block = block->Next)
 		{
-			tTJSSymbolData * d = lv1->Next;
-			while(d)
+			tTJSSymbolData * d = block->Data;
+			tTJSSymbolData * dlim = d + block->Used;
+			for(; d < dlim; d++)
 			{
-				tTJSSymbolData * nextd = d->Next;
 				if(d->SymFlags & TJS_SYMBOL_USING)
 				{
 					if(((tTJSVariant*)(&(d->Value)))->Type() == tvtObject)
@@ -925,56 +1063,31 @@ void tTJSCustomObject::DeleteAllMembers(void)
 						((tTJSVariant*)(&(d->Value)))->Clear();
 					}
 				}
-				d = nextd;
-			}
-
-			if(lv1->SymFlags & TJS_SYMBOL_USING)
-			{
-				if(((tTJSVariant*)(&(lv1->Value)))->Type() == tvtObject)
-				{
-					CheckObjectClosureRemove(*(tTJSVariant*)(&(lv1->Value)));
-					tTJSVariantClosure clo =
-						((tTJSVariant*)(&(lv1->Value)))->AsObjectClosureNoAddRef();
-					clo.AddRef();
-					if(clo.Object) vector.push_back(clo.Object);
-					if(clo.ObjThis) vector.push_back(clo.ObjThis);
-					((tTJSVariant*)(&(lv1->Value)))->Clear();
-				}
 			}
 		}
 
 		// delete all members
-		lv1 = Symbols;
-		lv1lim = lv1 + HashSize;
-		for(; lv1 < lv1lim; lv1++)
+		for(block = &Symbols; block; block = block->Next)
 		{
-			tTJSSymbolData * d = lv1->Next;
-			while(d)
+			tTJSSymbolData * d = block->Data;
+			tTJSSymbolData * dlim = d + block->Used;
+			for(; d < dlim; d++)
 			{
-				tTJSSymbolData * nextd = d->Next;
 				if(d->SymFlags & TJS_SYMBOL_USING)
 				{
 					d->Destory();
 				}
-
-				delete d;
-
-				d = nextd;
 			}
-
-			if(lv1->SymFlags & TJS_SYMBOL_USING)
-			{
-				lv1->PostClear();
-			}
-
-			lv1->Next = NULL;
 		}
 
+		FreeSymbolStorage();
+		Symbols.Used = 0;
+
 		Count = 0;
 	}
 	catch(...)
 	{
-		std::vector<iTJSDispatch2*>::iterator i;
+		tObjectVector::iterator i;
 		for(i = vector.begin(); i != vector.end(); i++)
 		{
 			(*i)->Release();
@@ -984,7 +1097,7 @@ void tTJSCustomObject::DeleteAllMembers(void)
 	}
 
 	// release all objects
-	std::vector<iTJSDispatch2*>::iterator i;
+	tObjectVector::iterator i;
 	for(i = vector.begin(); i != vector.end(); i++)
 	{
 		(*i)->Release();
@@ -993,22 +1106,21 @@ void tTJSCustomObject::DeleteAllMembers(void)
 //---------------------------------------------------------------------------
 void tTJSCustomObject::_DeleteAllMembers(void)
 {
+	Shape = ++TJSObjectShapeCounter;
 	iTJSDispatch2 * dsps[20];
 	tjs_int num_dsps = 0;
 
 	try
 	{
-		tTJSSymbolData * lv1, *lv1lim;
+		tTJSSymbolBlock * block;
 
 		// list all members up that hold object
-		lv1 = Symbols;
-		lv1lim = lv1 + HashSize;
-		for(; lv1 < lv1lim; lv1++)
+		for(block = &Symbols; block; block = block->Next)
 		{
-			tTJSSymbolData * d = lv1->Next;
-			while(d)
+			tTJSSymbolData * d = block->Data;
+			tTJSSymbolData * dlim = d + block->Used;
+			for(; d < dlim; d++)
 			{
-				tTJSSymbolData * nextd = d->Next;
 				if(d->SymFlags & TJS_SYMBOL_USING)
 				{
 					if(((tTJSVariant*)(&(d->Value)))->Type() == tvtObject)
@@ -1022,51 +1134,26 @@ void tTJSCustomObject::_DeleteAllMembers(void)
 						((tTJSVariant*)(&(d->Value)))->Clear();
 					}
 				}
-				d = nextd;
-			}
-
-			if(lv1->SymFlags & TJS_SYMBOL_USING)
-			{
-				if(((tTJSVariant*)(&(lv1->Value)))->Type() == tvtObject)
-				{
-					CheckObjectClosureRemove(*(tTJSVariant*)(&(lv1->Value)));
-					tTJSVariantClosure clo =
-						((tTJSVariant*)(&(lv1->Value)))->AsObjectClosureNoAddRef();
-					clo.AddRef();
-					if(clo.Object) dsps[num_dsps++] = clo.Object;
-					if(clo.ObjThis) dsps[num_dsps++] = clo.ObjThis;
-					((tTJSVariant*)(&(lv1->Value)))->Clear();
-				}
 			}
 		}
 
 		// delete all members
-		lv1 = Symbols;
-		lv1lim = lv1 + HashSize;
-		for(; lv1 < lv1lim; lv1++)
+		for(block = &Symbols; block; block = block->Next)
 		{
-			tTJSSymbolData * d = lv1->Next;
-			while(d)
+			tTJSSymbolData * d = block->Data;
+			tTJSSymbolData * dlim = d + block->Used;
+			for(; d < dlim; d++)
 			{
-				tTJSSymbolData * nextd = d->Next;
 				if(d->SymFlags & TJS_SYMBOL_USING)
 				{
 					d->Destory();
 				}
-
-				delete d;
-
-				d = nextd;
-			}
-
-			if(lv1->SymFlags & TJS_SYMBOL_USING)
-			{
-				lv1->PostClear();
 			}
-
-			lv1->Next = NULL;
 		}
 
+		FreeSymbolStorage();
+		Symbols.Used = 0;
+
 		Count = 0;
 	}
 	catch(...)
@@ -1097,37 +1184,8 @@ tTJSCustomObject::tTJSSymbolData * tTJSCustomObject::Find(const tjs_char * name,
 	if(hint && *hint)
 	{
 		// try finding via hint
-		// search over the chain
-		tjs_uint32 hash = *hint;
-		tjs_int cnt = 0;
-		tTJSSymbolData * lv1 = Symbols + (hash & HashMask);
-		tTJSSymbolData * prevd = lv1;
-		tTJSSymbolData * d = lv1->Next;
-		for(; d; prevd = d, d=d->Next, cnt++)
-		{
-			if(d->Hash == hash && (d->SymFlags & TJS_SYMBOL_USING))
-			{
-				if(d->NameMatch(name))
-				{
-					if(cnt>2)
-					{
-						// move to first
-						prevd->Next = d->Next;
-						d->Next = lv1->Next;
-						lv1->Next = d;
-					}
-					return d;
-				}
-			}
-		}
-
-		if(lv1->Hash == hash && (lv1->SymFlags & TJS_SYMBOL_USING))
-		{
-			if(lv1->NameMatch(name))
-			{
-				return lv1;
-			}
-		}
+		tTJSSymbolData *data = FindByHash(name, *hint);
+		if(data) return data;
 	}
 
 	tjs_uint32 hash = tTJSHashFunc<tjs_char *>::Make(name);
@@ -1140,43 +1198,7 @@ tTJSCustomObject::tTJSSymbolData * tTJSCustomObject::Find(const tjs_char * name,
 
 	if(hint) *hint = hash;
 
-	tTJSSymbolData * lv1 = Symbols + (hash & HashMask);
-
-	if(!(lv1->SymFlags & TJS_SYMBOL_USING) && lv1->Next == NULL)
-		return NULL; // lv1 is unused and does not have any chains
-
-	// search over the chain
-	tjs_int cnt = 0;
-	tTJSSymbolData * prevd = lv1;
-	tTJSSymbolData * d = lv1->Next;
-	for(; d; prevd = d, d=d->Next, cnt++)
-	{
-		if(d->Hash == hash && (d->SymFlags & TJS_SYMBOL_USING))
-		{
-			if(d->NameMatch(name))
-			{
-				if(cnt>2)
-				{
-					// move to first
-					prevd->Next = d->Next;
-					d->Next = lv1->Next;
-					lv1->Next = d;
-				}
-				return d;
-			}
-		}
-	}
-
-	if(lv1->Hash == hash && (lv1->SymFlags & TJS_SYMBOL_USING))
-	{
-		if(lv1->NameMatch(name))
-		{
-			return lv1;
-		}
-	}
-
-	return NULL;
-
+	return FindByHash(name, hash);
 }
 //---------------------------------------------------------------------------
 bool tTJSCustomObject::CallEnumCallbackForData(
@@ -1208,7 +1230,9 @@ void tTJSCustomObject::InternalEnumMembers(tjs_uint32 flags,
 	tTJSVariantClosure *callback, iTJSDispatch2 *objthis)
 {
 	// enumlate members by calling callback.
-	// note that member changes(delete or insert) through this function is not guaranteed.
+	// members are enumerated in the storage order, which is the order they
+	// were added unless entries of deleted members are reused.
+	// member changes(delete or insert) through this function is not guaranteed.
 	if(!callback) return;
 
 	tTJSVariant name;
@@ -1216,25 +1240,15 @@ void tTJSCustomObject::InternalEnumMembers(tjs_uint32 flags,
 	tTJSVariant value;
 	tTJSVariant * params[3] = { &name, &newflags, &value };
 
-	const tTJSSymbolData * lv1 = Symbols;
-	const tTJSSymbolData * lv1lim = lv1 + HashSize;
-	for(; lv1 < lv1lim; lv1++)
+	for(const tTJSSymbolBlock * block = &Symbols; block; block = block->Next)
 	{
-		const tTJSSymbolData * d = lv1->Next;
-		while(d)
+		for(tjs_int i = 0; i < block->Used; i++)
 		{
-			const tTJSSymbolData * nextd = d->Next;
-
+			const tTJSSymbolData * d = block->Data + i;
 			if(d->SymFlags & TJS_SYMBOL_USING)
 			{
 				if(!CallEnumCallbackForData(flags, params, *callback, objthis, d)) return ;
 			}
-			d = nextd;
-		}
-
-		if(lv1->SymFlags & TJS_SYMBOL_USING)
-		{
-			if(!CallEnumCallbackForData(flags, params, *callback, objthis, lv1)) return ;
 		}
 	}
 }
@@ -1246,6 +1260,92 @@ tjs_int tTJSCustomObject::GetValueInteger(const tjs_char * name, tjs_uint32 *hin
 	return (tjs_int)data->Value.Integer;
 }
 //---------------------------------------------------------------------------
+tTJSCustomObject::tTJSSymbolData * tTJSCustomObject::FindForCache(
+	tTJSVariantString *name, tjs_uint64 &shape)
+{
+	// find the member for the VM's inline property cache.
+	// the returned data is valid as long as Shape does not change.
+	if(RebuildHashMagic != TJSGlobalRebuildHashMagic)
+	{
+		RebuildHash();
+	}
+
+	if(!GetValidity() || !name) return NULL;
+
+	shape = Shape;
+	return Find((const tjs_char *)(*name), name->GetHint());
+}
+//---------------------------------------------------------------------------
+tjs_error tTJSCustomObject::PropGetByCache(tjs_uint32 flag, tjs_uint64 shape,
+	tTJSSymbolData *data, tTJSVariant *result, iTJSDispatch2 *objthis)
+{
+	// same as PropGet with a member found by FindForCache.
+	// returns TJS_E_NOTIMPL if the cached data may be stale.
+	if(shape != Shape || RebuildHashMagic != TJSGlobalRebuildHashMagic ||
+		!GetValidity())
+		return TJS_E_NOTIMPL;
+
+	return TJSDefaultPropGet(flag, GetValue(data), result, objthis);
+}
+//---------------------------------------------------------------------------
+tjs_error tTJSCustomObject::PropSetByCache(tjs_uint32 flag, tjs_uint64 shape,
+	tTJSSymbolData *data, tTJSVariantString *name, const tTJSVariant *param,
+	iTJSDispatch2 *objthis)
+{
+	// same as PropSetByVS with a member found by FindForCache.
+	// returns TJS_E_NOTIMPL if the cached data may be stale.
+	if(shape != Shape || RebuildHashMagic != TJSGlobalRebuildHashMagic ||
+		!GetValidity())
+		return TJS_E_NOTIMPL;
+
+	if(flag & TJS_HIDDENMEMBER)
+		data->SymFlags |= TJS_SYMBOL_HIDDEN;
+	else
+		data->SymFlags &= ~TJS_SYMBOL_HIDDEN;
+
+	if(flag & TJS_STATICMEMBER)
+		data->SymFlags |= TJS_SYMBOL_STATIC;
+	else
+		data->SymFlags &= ~TJS_SYMBOL_STATIC;
+
+	if(!(flag & TJS_IGNOREPROP))
+	{
+		if(GetValue(data).Type() == tvtObject)
+		{
+			tTJSVariantClosure tvclosure =
+				GetValue(data).AsObjectClosureNoAddRef();
+			if(tvclosure.Object)
+			{
+				tjs_error hr = tvclosure.Object->PropSet(0, NULL, NULL, param,
+					TJS_SELECT_OBJTHIS(tvclosure, objthis));
+				if(TJS_SUCCEEDED(hr)) return hr;
+				if(hr != TJS_E_NOTIMPL && hr != TJS_E_INVALIDTYPE &&
+					hr != TJS_E_INVALIDOBJECT)
+					return hr;
+			}
+			// the property handler may have changed the member table
+			data = Find((const tjs_char *)(*name), name->GetHint());
+			if(!data) return TJS_E_MEMBERNOTFOUND;
+		}
+	}
+
+	if(!param) return TJS_E_INVALIDPARAM;
+
+	CheckObjectClosureRemove(GetValue(data));
+	try
+	{
+		GetValue(data).CopyRef(*param);
+	}
+	catch(...)
+	{
+		CheckObjectClosureAdd(GetValue(data));
+		throw;
+	}
+	CheckObjectClosureAdd(GetValue(data));
+
+	return TJS_S_OK;
+}
+//---------------------------------------------------------------------------
 tjs_error TJSTryFuncCallViaPropGet(tTJSVariantClosure tvclosure,
 	tjs_uint32 flag, tTJSVariant *result,
 	tjs_int numparams, tTJSVariant **param, iTJSDispatch2 *objthis)
@@ -2073,6 +2173,12 @@ tTJSCustomObject::NativeInstanceSupport(tjs_uint32 flag, tjs_int32 classid,
 {
 	if(flag == TJS_NIS_GETINSTANCE)
 	{
+		if(classid == TJSCycleCollectorClassID && classid != -1)
+		{
+			*pointer = (iTJSNativeInstance*)(void*)this;
+			return TJS_S_OK;
+		}
+
 		// search "classid"
 		for(tjs_int i=0; i<TJS_MAX_NATIVE_CLASS; i++)
 		{
@@ -16,6 +16,7 @@
 #include "tjsVariant.h"
 #include "tjsUtils.h"
 #include "tjsError.h"
+#include "tjsObjectPool.h"
 
 namespace TJS
 {
@@ -64,6 +65,20 @@ TJS_EXP_FUNC_DEF(void, TJSDoRehash, ());
 
 
 
+//---------------------------------------------------------------------------
+// cycle collector hooks ( see tjsCycleCollector.h )
+//---------------------------------------------------------------------------
+class tTJSCustomObject;
+extern bool TJSCycleCollectorEnabled;
+extern tjs_int32 TJSCycleCollectorClassID;
+	// tTJSCustomObject::NativeInstanceSupport returns the object itself for
+	// this class id, so that the collector can find custom objects
+extern void TJSAddCycleCandidate(tTJSCustomObject *obj);
+extern void TJSRemoveCycleCandidate(tTJSCustomObject *obj);
+//---------------------------------------------------------------------------
+
+
+
 /*[*/
 //---------------------------------------------------------------------------
 // tTJSDispatch
@@ -373,7 +388,11 @@ public:
 #define TJS_NAMESPACE_DEFAULT_HASH_BITS 3
 
 extern tjs_int TJSObjectHashBitsLimit;
-	// this limits hash table size
+	// this limits initial hash table size
+
+#define TJS_OBJECT_INLINE_SYMBOLS 8
+	// number of members stored in the object itself; objects up to this
+	// size do not allocate any member storage nor hash table
 
 
 #define TJS_SYMBOL_USING	0x1
@@ -391,6 +410,7 @@ extern tjs_int TJSObjectHashBitsLimit;
 class tTJSCustomObject : public tTJSDispatch
 {
 	typedef tTJSDispatch inherited;
+	friend class tTJSCycleCollector;
 
 	// tTJSSymbolData -----------------------------------------------------
 public:
@@ -407,8 +427,6 @@ public:
 					all member to zero.
 			*/
 
-		tTJSSymbolData * Next; // next chain
-
 		void SelfClear(void)
 		{
 			memset(this, 0, sizeof(*this));
@@ -472,18 +490,50 @@ public:
 		void ReShare();
 	};
 
+	// tTJSSymbolBlock ----------------------------------------------------
+	// members are stored in a list of blocks. a block never moves once
+	// allocated, so tTJSSymbolData pointers stay valid until RebuildHash
+	// compacts the storage or all members are deleted.
+	// entries of deleted members are linked in FreeSymbols and are reused by
+	// the next members added, so the storage is in insertion order only
+	// until a member is deleted.
+	struct tTJSSymbolBlock
+	{
+		tTJSSymbolBlock * Next; // next block
+		tjs_int Capacity; // number of entries in Data
+		tjs_int Used; // number of entries handed out, including unused ones
+		tTJSSymbolData Data[TJS_OBJECT_INLINE_SYMBOLS];
+			// blocks other than the first one are allocated with
+			// Capacity entries here
+	};
 
+	// tTJSSymbolSlot -----------------------------------------------------
+	// open addressing hash table entry with the full hash cached.
+	// Data == NULL && Hash == 0 : empty
+	// Data == NULL && Hash != 0 : deleted (tombstone)
+	struct tTJSSymbolSlot
+	{
+		tjs_uint32 Hash;
+		tTJSSymbolData * Data;
+	};
 
 	//---------------------------------------------------------------------
 	tjs_int Count;
+	tjs_int HashBits; // initial hash table size hint
 	tjs_int HashMask;
-	tjs_int HashSize;
-	tTJSSymbolData * Symbols;
+	tjs_int HashSize; // 0 while all members fit in the inline block
+	tjs_int HashUsed; // number of non-empty slots, including tombstones
+	tTJSSymbolSlot * HashSlots;
+	tTJSSymbolBlock Symbols; // the first, inline block
+	tTJSSymbolBlock * LastSymbolBlock;
+	tTJSSymbolData * FreeSymbols; // deleted entries, linked through Value
 	tjs_uint RebuildHashMagic;
+	tjs_uint64 Shape; // changes whenever the symbol table layout changes
 	bool IsInvalidated;
 	bool IsInvalidating;
 	iTJSNativeInstance* ClassInstances[TJS_MAX_NATIVE_CLASS];
 	tjs_int32 ClassIDs[TJS_MAX_NATIVE_CLASS];
+	tjs_int CycleCandidateIndex; // index in the cycle collector's candidates, or -1
 
 
 	void _Finalize(void);
@@ -497,7 +547,7 @@ protected:
 	bool ProsessingMissing; // true if 'missing' method is being called
 	ttstr missing_name; // name of the 'missing' method
 	virtual void Finalize(void);
-	std::vector<ttstr > ClassNames;
+	std::vector<ttstr, tTJSPoolAllocator<ttstr> > ClassNames;
 
 	//---------------------------------------------------------------------
 public:
@@ -505,6 +555,11 @@ public:
 	tTJSCustomObject(tjs_int hashbits = TJS_NAMESPACE_DEFAULT_HASH_BITS);
 	virtual ~tTJSCustomObject();
 
+	TJS_DECLARE_POOLED_NEW
+
+	tjs_uint TJS_INTF_METHOD Release(void);
+		// remembers the object as a candidate of the cycle collector
+
 private:
 	void BeforeDestruction(void);
 
@@ -538,9 +593,34 @@ private:
 	tTJSSymbolData * Add(tTJSVariantString * name);
 		// tTJSVariantString version of above.
 
-	tTJSSymbolData * AddTo(tTJSVariantString *name,
-		tTJSSymbolData *newdata, tjs_int newhashmask);
-		// Adds member to the new hash space, used in RebuildHash
+	tTJSSymbolData * NewSymbol()
+	{
+		// Hands out an entry for a new member, making room in the hash table
+		if(!HashSlots && Symbols.Used < Symbols.Capacity)
+			return Symbols.Data + Symbols.Used++; // small object
+		PrepareHashSlot();
+		return AllocSymbol();
+	}
+
+	tTJSSymbolData * AllocSymbol();
+		// Hands out the next entry of the member storage
+
+	void PrepareHashSlot();
+		// Makes room for one more slot in the hash table
+
+	void SetHashSlots(tTJSSymbolSlot *slots, tjs_int size);
+
+	void ResizeHashSlots(tjs_int size);
+		// Replaces the hash table with "slots" and indexes current members
+
+	void InsertHashSlot(tTJSSymbolData *data);
+		// Puts data into the hash table ( does not grow the table )
+
+	tTJSSymbolSlot * FindHashSlot(const tjs_char * name, tjs_uint32 hash);
+		// Finds the slot of Name in the hash table
+
+	void FreeSymbolStorage();
+		// Frees heap blocks and the hash table ( entries must be cleared )
 
 	void RebuildHash(); // rebuild hash table
 
@@ -555,6 +635,9 @@ private:
 	tTJSSymbolData * Find(const tjs_char * name, tjs_uint32 *hint) ;
 		// Finds Name, returns its data; if not found, returns NULL
 
+	tTJSSymbolData * FindByHash(const tjs_char * name, tjs_uint32 hash);
+		// Finds Name with given hash
+
 	static bool CallEnumCallbackForData(tjs_uint32 flags,
 		tTJSVariant ** params,
 		tTJSVariantClosure & callback, iTJSDispatch2 * objthis,
@@ -575,6 +658,18 @@ public:
 		// service function for lexical analyzer
 	//---------------------------------------------------------------------
 public:
+	// inline property cache support for the VM.
+	// a (Shape, tTJSSymbolData*) pair obtained from FindForCache stays usable
+	// until the member layout of this object changes; the ByCache methods
+	// return TJS_E_NOTIMPL when the pair is stale.
+	tTJSSymbolData * FindForCache(tTJSVariantString *name, tjs_uint64 &shape);
+	tjs_error PropGetByCache(tjs_uint32 flag, tjs_uint64 shape,
+		tTJSSymbolData *data, tTJSVariant *result, iTJSDispatch2 *objthis);
+	tjs_error PropSetByCache(tjs_uint32 flag, tjs_uint64 shape,
+		tTJSSymbolData *data, tTJSVariantString *name, const tTJSVariant *param,
+		iTJSDispatch2 *objthis);
+	//---------------------------------------------------------------------
+public:
 
 	tjs_error TJS_INTF_METHOD
 	FuncCall(tjs_uint32 flag, const tjs_char * membername, tjs_uint32 *hint,
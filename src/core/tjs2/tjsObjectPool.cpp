@@ -0,0 +1,184 @@
+//---------------------------------------------------------------------------
+/*
+	TJS2 Script Engine
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// size-class pooled allocator for small script objects
+//---------------------------------------------------------------------------
+#include "tjsCommHead.h"
+
+#include "tjsObjectPool.h"
+#include "tjsError.h"
+#include "tjsUtils.h"
+
+namespace TJS
+{
+//---------------------------------------------------------------------------
+#define TJS_OBJECT_POOL_CLASSES \
+	(TJS_OBJECT_POOL_MAX_SIZE / TJS_OBJECT_POOL_GRANULARITY)
+#define TJS_OBJECT_POOL_CLASS_BYTES 65536
+	// max bytes kept in each thread per size class
+
+#define TJS_OP_CACHE_NONE 0
+#define TJS_OP_CACHE_ACTIVE 1
+#define TJS_OP_CACHE_EXITING 2
+//---------------------------------------------------------------------------
+struct tTJSObjectPoolFreeCell
+{
+	tTJSObjectPoolFreeCell *Next;
+};
+//---------------------------------------------------------------------------
+struct tTJSObjectPoolThreadCache
+{
+	// this must be trivially destructible, because objects may still be
+	// freed after the thread-local objects are destroyed.
+	// see tTJSObjectPoolThreadCacheFlusher.
+	tjs_int State;
+	tTJSObjectPoolFreeCell *FreeCells[TJS_OBJECT_POOL_CLASSES];
+	tjs_uint FreeBytes[TJS_OBJECT_POOL_CLASSES];
+
+	// statistics not yet merged into the global counters
+	tjs_uint64 AllocCount;
+	tjs_uint64 ReuseCount;
+	tjs_uint64 FreeCount;
+};
+static thread_local tTJSObjectPoolThreadCache TJSObjectPoolThreadCache;
+//---------------------------------------------------------------------------
+static tTJSSpinLock TJSObjectPoolStatisticsCS;
+static tjs_uint64 TJSObjectPoolTotalAllocCount = 0;
+static tjs_uint64 TJSObjectPoolTotalReuseCount = 0;
+static tjs_uint64 TJSObjectPoolTotalFreeCount = 0;
+//---------------------------------------------------------------------------
+static void TJSMergeObjectPoolStatistics(tTJSObjectPoolThreadCache &cache)
+{
+	tTJSSpinLockHolder holder(TJSObjectPoolStatisticsCS);
+	TJSObjectPoolTotalAllocCount += cache.AllocCount;
+	TJSObjectPoolTotalReuseCount += cache.ReuseCount;
+	TJSObjectPoolTotalFreeCount += cache.FreeCount;
+	cache.AllocCount = cache.ReuseCount = cache.FreeCount = 0;
+}
+//---------------------------------------------------------------------------
+static void TJSFlushObjectPoolThreadCache(tTJSObjectPoolThreadCache &cache)
+{
+	for(tjs_int cls = 0; cls < TJS_OBJECT_POOL_CLASSES; cls++)
+	{
+		tTJSObjectPoolFreeCell *cell = cache.FreeCells[cls];
+		while(cell)
+		{
+			tTJSObjectPoolFreeCell *next = cell->Next;
+			free(cell);
+			cell = next;
+		}
+		cache.FreeCells[cls] = NULL;
+		cache.FreeBytes[cls] = 0;
+	}
+}
+//---------------------------------------------------------------------------
+struct tTJSObjectPoolThreadCacheFlusher
+{
+	// frees all pooled memory when the thread exits;
+	// the memory freed after this is returned to the system directly.
+	~tTJSObjectPoolThreadCacheFlusher()
+	{
+		tTJSObjectPoolThreadCache &cache = TJSObjectPoolThreadCache;
+		cache.State = TJS_OP_CACHE_EXITING;
+		TJSFlushObjectPoolThreadCache(cache);
+		TJSMergeObjectPoolStatistics(cache);
+	}
+};
+//---------------------------------------------------------------------------
+static void TJSPrepareObjectPoolThreadCache(tTJSObjectPoolThreadCache &cache)
+{
+	// called at the first use of the thread cache
+	static thread_local tTJSObjectPoolThreadCacheFlusher flusher;
+	(void)&flusher; // construct the flusher to register its destructor
+	cache.State = TJS_OP_CACHE_ACTIVE;
+}
+//---------------------------------------------------------------------------
+static inline tjs_int TJSGetObjectPoolClass(size_t size)
+{
+	// returns the size class index for "size" bytes, or -1 if the size is
+	// not pooled
+	if(size == 0 || size > TJS_OBJECT_POOL_MAX_SIZE) return -1;
+	return (tjs_int)((size - 1) / TJS_OBJECT_POOL_GRANULARITY);
+}
+//---------------------------------------------------------------------------
+void * TJSAllocObjectMemory(size_t size)
+{
+	tTJSObjectPoolThreadCache &cache = TJSObjectPoolThreadCache;
+	cache.AllocCount++;
+
+	tjs_int cls = TJSGetObjectPoolClass(size);
+	if(cls >= 0)
+	{
+		tTJSObjectPoolFreeCell *cell = cache.FreeCells[cls];
+		if(cell)
+		{
+			cache.FreeCells[cls] = cell->Next;
+			cache.FreeBytes[cls] -= (cls + 1) * TJS_OBJECT_POOL_GRANULARITY;
+			cache.ReuseCount++;
+			return cell;
+		}
+		// round up to the size class, so that the memory can be reused by
+		// any size of the class
+		size = (cls + 1) * TJS_OBJECT_POOL_GRANULARITY;
+	}
+
+	void *ptr = malloc(size);
+	if(!ptr) TJS_eTJSError(TJSInsufficientMem);
+	return ptr;
+}
+//---------------------------------------------------------------------------
+void TJSFreeObjectMemory(void *ptr, size_t size)
+{
+	if(!ptr) return;
+
+	tTJSObjectPoolThreadCache &cache = TJSObjectPoolThreadCache;
+	cache.FreeCount++;
+
+	tjs_int cls = TJSGetObjectPoolClass(size);
+	if(cls >= 0)
+	{
+		if(cache.State == TJS_OP_CACHE_NONE)
+			TJSPrepareObjectPoolThreadCache(cache);
+		tjs_uint bytes = (cls + 1) * TJS_OBJECT_POOL_GRANULARITY;
+		if(cache.State == TJS_OP_CACHE_ACTIVE &&
+			cache.FreeBytes[cls] + bytes <= TJS_OBJECT_POOL_CLASS_BYTES)
+		{
+			tTJSObjectPoolFreeCell *cell = (tTJSObjectPoolFreeCell*)ptr;
+			cell->Next = cache.FreeCells[cls];
+			cache.FreeCells[cls] = cell;
+			cache.FreeBytes[cls] += bytes;
+			return;
+		}
+	}
+	free(ptr);
+}
+//---------------------------------------------------------------------------
+void TJSCompactObjectPool()
+{
+	tTJSObjectPoolThreadCache &cache = TJSObjectPoolThreadCache;
+	TJSFlushObjectPoolThreadCache(cache);
+	TJSMergeObjectPoolStatistics(cache);
+}
+//---------------------------------------------------------------------------
+void TJSGetObjectPoolStatistics(tTJSObjectPoolStatistics &stat)
+{
+	tTJSObjectPoolThreadCache &cache = TJSObjectPoolThreadCache;
+	TJSMergeObjectPoolStatistics(cache);
+
+	tjs_uint64 bytes = 0;
+	for(tjs_int cls = 0; cls < TJS_OBJECT_POOL_CLASSES; cls++)
+		bytes += cache.FreeBytes[cls];
+
+	tTJSSpinLockHolder holder(TJSObjectPoolStatisticsCS);
+	stat.AllocCount = TJSObjectPoolTotalAllocCount;
+	stat.ReuseCount = TJSObjectPoolTotalReuseCount;
+	stat.FreeCount = TJSObjectPoolTotalFreeCount;
+	stat.PooledBytes = bytes;
+}
+//---------------------------------------------------------------------------
+} // namespace TJS
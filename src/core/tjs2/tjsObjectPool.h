@@ -0,0 +1,76 @@
+//---------------------------------------------------------------------------
+/*
+	TJS2 Script Engine
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// size-class pooled allocator for small script objects
+//---------------------------------------------------------------------------
+#ifndef tjsObjectPoolH
+#define tjsObjectPoolH
+
+#include "tjsConfig.h"
+#include <stddef.h>
+
+namespace TJS
+{
+//---------------------------------------------------------------------------
+/*
+	objects, their native instances and their member storage are created
+	and freed at a high rate by scripts. freed memory of small sizes is kept
+	in per-thread free lists of size classes ( TJS_OBJECT_POOL_GRANULARITY
+	bytes each ) and is reused by the next allocation of the same class.
+	the memory must be freed with the same size as it was allocated.
+	the pools are trimmed by TJSCompactObjectPool, which is called on the
+	garbage collection of the script engine.
+*/
+//---------------------------------------------------------------------------
+#define TJS_OBJECT_POOL_GRANULARITY 16
+#define TJS_OBJECT_POOL_MAX_SIZE 1024
+	// larger memory is allocated from the system directly
+//---------------------------------------------------------------------------
+extern void * TJSAllocObjectMemory(size_t size);
+extern void TJSFreeObjectMemory(void *ptr, size_t size);
+extern void TJSCompactObjectPool();
+	// frees all pooled memory of the current thread
+struct tTJSObjectPoolStatistics
+{
+	tjs_uint64 AllocCount; // total number of allocations
+	tjs_uint64 ReuseCount; // allocations served from the pools
+	tjs_uint64 FreeCount; // total number of frees
+	tjs_uint64 PooledBytes; // memory kept in the pools of the current thread
+};
+extern void TJSGetObjectPoolStatistics(tTJSObjectPoolStatistics &stat);
+//---------------------------------------------------------------------------
+// class-specific operator new/delete using the pool; delete must be called
+// through a virtual destructor for the derived classes to pass their size.
+#define TJS_DECLARE_POOLED_NEW \
+	static void * operator new(size_t size) \
+		{ return TJS::TJSAllocObjectMemory(size); } \
+	static void operator delete(void *ptr, size_t size) \
+		{ TJS::TJSFreeObjectMemory(ptr, size); }
+//---------------------------------------------------------------------------
+// allocator for the standard containers
+template <typename T>
+class tTJSPoolAllocator
+{
+public:
+	typedef T value_type;
+	tTJSPoolAllocator() {}
+	template <typename U> tTJSPoolAllocator(const tTJSPoolAllocator<U> &) {}
+	T * allocate(size_t n)
+		{ return (T*)TJSAllocObjectMemory(n * sizeof(T)); }
+	void deallocate(T *p, size_t n)
+		{ TJSFreeObjectMemory(p, n * sizeof(T)); }
+	template <typename U> struct rebind { typedef tTJSPoolAllocator<U> other; };
+	template <typename U> bool operator == (const tTJSPoolAllocator<U> &) const
+		{ return true; }
+	template <typename U> bool operator != (const tTJSPoolAllocator<U> &) const
+		{ return false; }
+};
+//---------------------------------------------------------------------------
+} // namespace TJS
+
+#endif
@@ -13,6 +13,7 @@
 
 #include "tjsRegExp.h"
 #include "tjsArray.h"
+#include "tjsHashSearch.h"
 
 #include <functional>
 
@@ -65,6 +66,122 @@ static tjs_uint32 TJSGetRegExpFlagsFromString(const tjs_char *string)
 
 	return flag;
 }
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTJSCompiledRegExp : compiled regular expression shared among RegExp objects
+//---------------------------------------------------------------------------
+/*
+	compiling a pattern costs much more than a simple search, and the same
+	patterns are compiled repeatedly; a regular expression literal creates
+	a new RegExp object and compiles its pattern every time it is evaluated.
+	compiled expressions are shared among the RegExp objects which have the
+	same pattern and options, and recently used ones are kept in the cache.
+	regex_t is not modified by searching (matching state is held in
+	OnigRegion), so sharing one among objects/threads is safe.
+*/
+#define TJS_REGEXP_CACHE_MAX_COUNT 256
+//---------------------------------------------------------------------------
+class tTJSCompiledRegExp
+{
+	std::atomic<tjs_int> RefCount;
+	regex_t *RegEx;
+
+	~tTJSCompiledRegExp() { onig_free(RegEx); }
+
+public:
+	tTJSCompiledRegExp(regex_t *regex) : RefCount(1), RegEx(regex) {}
+
+	void AddRef() { RefCount++; }
+	void Release() { if(--RefCount == 0) delete this; }
+
+	regex_t * GetRegEx() const { return RegEx; }
+};
+//---------------------------------------------------------------------------
+struct tTJSRegExpCacheKey
+{
+	ttstr Pattern;
+	tjs_uint32 Options;
+
+	bool operator == (const tTJSRegExpCacheKey &rhs) const
+		{ return Options == rhs.Options && Pattern == rhs.Pattern; }
+};
+//---------------------------------------------------------------------------
+class tTJSRegExpCacheHashFunc
+{
+public:
+	static tjs_uint32 Make(const tTJSRegExpCacheKey &val)
+	{
+		return tTJSHashFunc<ttstr>::Make(val.Pattern) ^ val.Options;
+	}
+};
+//---------------------------------------------------------------------------
+typedef tTJSRefHolder<tTJSCompiledRegExp> tTJSCompiledRegExpHolder;
+typedef tTJSHashCache<tTJSRegExpCacheKey, tTJSCompiledRegExpHolder,
+	tTJSRegExpCacheHashFunc> tTJSRegExpCache;
+static tTJSRegExpCache *TJSRegExpCache = NULL;
+static tTJSStaticCriticalSection TJSRegExpCacheCS;
+static tjs_uint64 TJSRegExpCacheHitCount = 0;
+static tjs_uint64 TJSRegExpCacheMissCount = 0;
+//---------------------------------------------------------------------------
+static tTJSCompiledRegExp * TJSCompileRegExp(const tjs_char *pattern, tjs_int len,
+	tjs_uint32 flags)
+{
+	// returns compiled expression of the pattern ( AddRef'ed ).
+	// throws eTJSError when the pattern has errors.
+	tTJSRegExpCacheKey key;
+	key.Pattern = ttstr(pattern, len);
+	key.Options = flags&((ONIG_OPTION_MAXBIT<<1)-1);
+	tjs_uint32 hash = tTJSRegExpCacheHashFunc::Make(key);
+
+	{
+		tTJSCriticalSectionHolder cs(TJSRegExpCacheCS);
+		if(!TJSRegExpCache)
+			TJSRegExpCache = new tTJSRegExpCache(TJS_REGEXP_CACHE_MAX_COUNT);
+		tTJSCompiledRegExpHolder *holder =
+			TJSRegExpCache->FindAndTouchWithHash(key, hash);
+		if(holder)
+		{
+			TJSRegExpCacheHitCount++;
+			return holder->GetObject();
+		}
+		TJSRegExpCacheMissCount++;
+	}
+
+	// compile outside of the lock
+	regex_t *regex = NULL;
+	OnigErrorInfo einfo;
+	int r = onig_new( &regex, (UChar*)pattern, (UChar*)(pattern+len),
+		key.Options, ONIG_ENCODING_UTF16_LE, ONIG_SYNTAX_PERL, &einfo );
+	if( r ) {
+		char s[ONIG_MAX_ERROR_MESSAGE_LEN];
+		onig_error_code_to_str( (UChar* )s, r, &einfo );
+		TJS_eTJSError( s );
+	}
+
+	tTJSCompiledRegExp *compiled = new tTJSCompiledRegExp(regex);
+	{
+		tTJSCriticalSectionHolder cs(TJSRegExpCacheCS);
+		if(TJSRegExpCache)
+			TJSRegExpCache->AddWithHash(key, hash, tTJSCompiledRegExpHolder(compiled));
+	}
+	return compiled;
+}
+//---------------------------------------------------------------------------
+void TJSGetRegExpCacheStatistics(tTJSRegExpCacheStatistics &stat)
+{
+	tTJSCriticalSectionHolder cs(TJSRegExpCacheCS);
+	stat.HitCount = TJSRegExpCacheHitCount;
+	stat.MissCount = TJSRegExpCacheMissCount;
+	stat.Count = TJSRegExpCache ? TJSRegExpCache->GetCount() : 0;
+	stat.MaxCount = TJS_REGEXP_CACHE_MAX_COUNT;
+}
+//---------------------------------------------------------------------------
+
+
+
 //---------------------------------------------------------------------------
 void replace_regex( tTJSVariant **param, tjs_int numparams, tTJSNI_RegExp *_this, iTJSDispatch2 *objthis, ttstr &res ) {
 	ttstr to;
@@ -158,6 +275,14 @@ iTJSDispatch2* split_regex( const ttstr &target, iTJSDispatch2 * array, tTJSNI_R
 //---------------------------------------------------------------------------
 void TJSReleaseRegex()
 {
+	{
+		tTJSCriticalSectionHolder cs(TJSRegExpCacheCS);
+		if(TJSRegExpCache)
+		{
+			delete TJSRegExpCache;
+			TJSRegExpCache = NULL;
+		}
+	}
 	onig_end();
 }
 //---------------------------------------------------------------------------
@@ -165,7 +290,7 @@ void TJSReleaseRegex()
 //---------------------------------------------------------------------------
 // tTJSNI_RegExp : TJS Native Instance : RegExp
 //---------------------------------------------------------------------------
-tTJSNI_RegExp::tTJSNI_RegExp() : RegEx(NULL)
+tTJSNI_RegExp::tTJSNI_RegExp() : RegEx(NULL), Compiled(NULL)
 {
 	// C++constructor
 	Flags = TJSRegExpFlagToValue(0, 0);
@@ -175,10 +300,15 @@ tTJSNI_RegExp::tTJSNI_RegExp() : RegEx(NULL)
 }
 //---------------------------------------------------------------------------
 tTJSNI_RegExp::~tTJSNI_RegExp() {
-	if( RegEx ) {
-		onig_free(RegEx);
-		RegEx = NULL;
-	}
+	SetCompiled(NULL);
+}
+//---------------------------------------------------------------------------
+void tTJSNI_RegExp::SetCompiled(tTJSCompiledRegExp *compiled)
+{
+	// takes over the reference of compiled
+	if( Compiled ) Compiled->Release();
+	Compiled = compiled;
+	RegEx = compiled ? compiled->GetRegEx() : NULL;
 }
 //---------------------------------------------------------------------------
 void tTJSNI_RegExp::Split(iTJSDispatch2 ** array, const ttstr &target, bool purgeempty)
@@ -272,18 +402,10 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/_compile)
 
 	try
 	{
-		if( _this->RegEx ) {
-			onig_free( _this->RegEx );
-			_this->RegEx = NULL;
-		}
-		OnigErrorInfo einfo;
-		int r = onig_new( &(_this->RegEx), (UChar*)exprstart, (UChar*)(expr.c_str()+expr.length()),
-			flags&((ONIG_OPTION_MAXBIT<<1)-1), ONIG_ENCODING_UTF16_LE, ONIG_SYNTAX_PERL, &einfo );
-		if( r ) {
-			char s[ONIG_MAX_ERROR_MESSAGE_LEN];
-			onig_error_code_to_str( (UChar* )s, r, &einfo );
-			TJS_eTJSError( s );
-		}
+		// literals of the same pattern share the compiled expression
+		_this->SetCompiled(NULL);
+		_this->SetCompiled(TJSCompileRegExp(exprstart,
+			(tjs_int)(expr.c_str()+expr.length()-exprstart), flags));
 	}
 	catch(std::exception &e)
 	{
@@ -624,18 +746,8 @@ void tTJSNC_RegExp::Compile(tjs_int numparams, tTJSVariant **param, tTJSNI_RegEx
 
 	if(expr.IsEmpty()) expr = TJS_W("(?:)"); // generate empty regular expression
 
-	if( _this->RegEx ) {
-		onig_free( _this->RegEx );
-		_this->RegEx = NULL;
-	}
-	OnigErrorInfo einfo;
-	int r = onig_new( &(_this->RegEx), (UChar*)expr.c_str(), (UChar*)(expr.c_str()+expr.length()),
-		flags&((ONIG_OPTION_MAXBIT<<1)-1), ONIG_ENCODING_UTF16_LE, ONIG_SYNTAX_PERL, &einfo );
-	if( r ) {
-		char s[ONIG_MAX_ERROR_MESSAGE_LEN];
-		onig_error_code_to_str( (UChar* )s, r, &einfo );
-		TJS_eTJSError( s );
-	}
+	_this->SetCompiled(NULL);
+	_this->SetCompiled(TJSCompileRegExp(expr.c_str(), expr.length(), flags));
 	_this->Flags = flags;
 }
 //---------------------------------------------------------------------------
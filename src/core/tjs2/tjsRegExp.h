@@ -19,13 +19,14 @@
 namespace TJS
 {
 
+class tTJSCompiledRegExp;
 //---------------------------------------------------------------------------
 // tTJSNI_RegExp
 //---------------------------------------------------------------------------
 class tTJSNI_RegExp : public tTJSNativeInstance
 {
 public:
-	regex_t* RegEx;
+	regex_t* RegEx; // owned by Compiled
 	//OnigRegion* Region;
 	tjs_uint32 Flags;
 	tjs_uint Start;
@@ -38,10 +39,12 @@ public:
 	ttstr LeftContext;
 	ttstr RightContext;
 private:
+	tTJSCompiledRegExp *Compiled;
 
 public:
 	tTJSNI_RegExp();
 	~tTJSNI_RegExp();
+	void SetCompiled(tTJSCompiledRegExp *compiled);
 	void Split(iTJSDispatch2 ** array, const ttstr &target, bool purgeempty);
 };
 //---------------------------------------------------------------------------
@@ -75,6 +78,17 @@ public:
 extern iTJSDispatch2 * TJSCreateRegExpClass();
 extern void TJSReleaseRegex();
 //---------------------------------------------------------------------------
+// compiled regular expression cache
+//---------------------------------------------------------------------------
+struct tTJSRegExpCacheStatistics
+{
+	tjs_uint64 HitCount;
+	tjs_uint64 MissCount;
+	tjs_uint Count; // compiled expressions in the cache
+	tjs_uint MaxCount;
+};
+extern void TJSGetRegExpCacheStatistics(tTJSRegExpCacheStatistics &stat);
+//---------------------------------------------------------------------------
 
 } // namespace TJS
 #endif
@@ -108,6 +108,43 @@ void tTJSScriptBlock::SetName(const tjs_char *name, tjs_int lineofs)
 	}
 }
 //---------------------------------------------------------------------------
+void tTJSScriptBlock::SetScript(const tjs_char *text)
+{
+	// keep the script text and the start of each line, which are used to
+	// convert source positions to line numbers
+	if(Script) delete [] Script;
+	LineVector.clear();
+	LineLengthVector.clear();
+
+	Script = new tjs_char[TJS_strlen(text)+1];
+	TJS_strcpy(Script, text);
+
+	// calculation of line-count
+	tjs_char *ls = Script;
+	tjs_char *p = Script;
+	while(*p)
+	{
+		if(*p == TJS_W('\r') || *p == TJS_W('\n'))
+		{
+			LineVector.push_back(int(ls - Script));
+			LineLengthVector.push_back(int(p - ls));
+			if(*p == TJS_W('\r') && p[1] == TJS_W('\n')) p++;
+			p++;
+			ls = p;
+		}
+		else
+		{
+			p++;
+		}
+	}
+
+	if(p!=ls)
+	{
+		LineVector.push_back(int(ls - Script));
+		LineLengthVector.push_back(int(p - ls));
+	}
+}
+//---------------------------------------------------------------------------
 void tTJSScriptBlock::Add(tTJSInterCodeContext * cntx)
 {
 	InterCodeContextList.push_back(cntx);
@@ -172,6 +209,7 @@ tjs_int tTJSScriptBlock::SrcPosToLine(tjs_int pos) const
 tjs_int tTJSScriptBlock::LineToSrcPos(tjs_int line) const
 {
 	// assumes line is added by LineOffset
+	if( LineVector.empty() ) return 0; // bytecode without the script text
 	line -= LineOffset;
 	return LineVector[line];
 }
@@ -234,33 +272,7 @@ void tTJSScriptBlock::SetText(tTJSVariant *result, const tjs_char *text,
 
 	TJS_D((TJS_W("Counting lines ...\n")))
 
-	Script = new tjs_char[TJS_strlen(text)+1];
-	TJS_strcpy(Script, text);
-
-	// calculation of line-count
-	tjs_char *ls = Script;
-	tjs_char *p = Script;
-	while(*p)
-	{
-		if(*p == TJS_W('\r') || *p == TJS_W('\n'))
-		{
-			LineVector.push_back(int(ls - Script));
-			LineLengthVector.push_back(int(p - ls));
-			if(*p == TJS_W('\r') && p[1] == TJS_W('\n')) p++;
-			p++;
-			ls = p;
-		}
-		else
-		{
-			p++;
-		}
-	}
-
-	if(p!=ls)
-	{
-		LineVector.push_back(int(ls - Script));
-		LineLengthVector.push_back(int(p - ls));
-	}
+	SetScript(text);
 
 	try
 	{
@@ -525,11 +537,17 @@ void tTJSScriptBlock::ExportByteCode( bool outputdebug, tTJSBinaryStream* output
 	objarray.reserve( count * 2 );
 	tjsConstArrayData* constarray = new tjsConstArrayData();
 	int objsize = 0;
-	for( std::list<tTJSInterCodeContext *>::const_iterator i = InterCodeContextList.begin(); i != InterCodeContextList.end(); i++ ) {
-		tTJSInterCodeContext* obj = (*i);
-		std::vector<tjs_uint8>* buf = obj->ExportByteCode( outputdebug, this, *constarray );
-		objarray.push_back( buf );
-		objsize += (int)buf->size() + BYTECODE_TAG_SIZE + BYTECODE_CHUNK_SIZE_LEN; // tag + size
+	try {
+		for( std::list<tTJSInterCodeContext *>::const_iterator i = InterCodeContextList.begin(); i != InterCodeContextList.end(); i++ ) {
+			tTJSInterCodeContext* obj = (*i);
+			std::vector<tjs_uint8>* buf = obj->ExportByteCode( outputdebug, this, *constarray );
+			objarray.push_back( buf );
+			objsize += (int)buf->size() + BYTECODE_TAG_SIZE + BYTECODE_CHUNK_SIZE_LEN; // tag + size
+		}
+	} catch(...) {
+		for( std::vector<std::vector<tjs_uint8>* >::iterator i = objarray.begin(); i != objarray.end(); i++ ) delete *i;
+		delete constarray;
+		throw;
 	}
 
 	objsize += BYTECODE_TAG_SIZE + BYTECODE_CHUNK_SIZE_LEN + 4 + 4; // OBJS tag + size + toplevel + count
@@ -576,27 +594,7 @@ void tTJSScriptBlock::Compile( const tjs_char *text, bool isexpression, bool isr
 
 	tTJSInterCodeContext::IsBytecodeCompile = true;
 	try {
-		Script = new tjs_char[TJS_strlen(text)+1];
-		TJS_strcpy(Script, text);
-
-		// calculation of line-count
-		tjs_char *ls = Script;
-		tjs_char *p = Script;
-		while( *p ) {
-			if(*p == TJS_W('\r') || *p == TJS_W('\n')) {
-				LineVector.push_back(int(ls - Script));
-				LineLengthVector.push_back(int(p - ls));
-				if(*p == TJS_W('\r') && p[1] == TJS_W('\n')) p++;
-				p++;
-				ls = p;
-			} else {
-				p++;
-			}
-		}
-		if( p != ls ) {
-			LineVector.push_back(int(ls - Script));
-			LineLengthVector.push_back(int(p - ls));
-		}
+		SetScript( text );
 
 		Parse( text, isexpression, isresultneeded );
 
@@ -885,6 +883,22 @@ void tTJSScriptBlock::TranslateCodeAddress( tjs_int32* code, const tjs_int32 cod
 
 		case VM_EXTRY: size = 1; break;
 
+		case VM_CEQJF:
+		case VM_CEQJNF:
+		case VM_CDEQJF:
+		case VM_CDEQJNF:
+		case VM_CLTJF:
+		case VM_CLTJNF:
+		case VM_CGTJF:
+		case VM_CGTJNF:
+		case VM_INCLTJF:
+		case VM_DECGTJF:
+			TJS_OFFSET_VM_CODE_ADDR(code[i+1]);
+			TJS_OFFSET_VM_REG_ADDR(code[i+2]);
+			TJS_OFFSET_VM_REG_ADDR(code[i+3]);
+			size = 4;
+			break;
+
 		case VM_THROW:
 			TJS_OFFSET_VM_REG_ADDR(code[i+1]);
 			size = 2;
@@ -83,6 +83,7 @@ public:
 	ttstr GetLineDescriptionString(tjs_int pos) const;
 
 	const tjs_char *GetScript() const { return Script; }
+	void SetScript(const tjs_char *text);
 
 	void PushContextStack(const tjs_char *name, tTJSContextType type);
 	void PopContextStack(void);
@@ -219,13 +219,14 @@ void tTJSScriptCache::EvalExpression(const ttstr &expression, tTJSVariant *resul
 //---------------------------------------------------------------------------
 // for Bytecode
 void tTJSScriptCache::LoadByteCode( const tjs_uint8* buff, size_t len, tTJSVariant *result,
-		iTJSDispatch2 *context, const tjs_char *name )
+		iTJSDispatch2 *context, const tjs_char *name, const tjs_char *script )
 {
 	tTJSByteCodeLoader* loader = new tTJSByteCodeLoader();
 	tTJSScriptBlock* blk = NULL;
 	try {
 		blk = loader->ReadByteCode( Owner, name, buff, len );
 		if( blk != NULL ) {
+			if( script && script[0] ) blk->SetScript( script );
 			// blk->Dump();
 			blk->ExecuteTopLevel( result, context );
 		} else {
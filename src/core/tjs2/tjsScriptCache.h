@@ -88,7 +88,7 @@ public:
 
 	// for Bytecode
 	void LoadByteCode( const tjs_uint8* buff, size_t len, tTJSVariant *result,
-		iTJSDispatch2 *context, const tjs_char *name );
+		iTJSDispatch2 *context, const tjs_char *name, const tjs_char *script );
 };
 //---------------------------------------------------------------------------
 
@@ -1123,6 +1123,16 @@ void tTJSVariant::operator +=(const tTJSVariant &rhs)
 		{
 			// both are string
 
+			// concatenate lazily if the string is long and is shared
+			// (or is already a rope); see TJSConcatVariantString
+			if(String && rhs.String &&
+				(String->GetRefCount() != 0 || String->IsRope()) &&
+				String->GetLength() >= TJS_VS_ROPE_MIN_LEN)
+			{
+				String = TJSConcatVariantString(String, rhs.String);
+				return;
+			}
+
 			// independ string
 			if(String && String->GetRefCount() != 0)
 			{
@@ -1137,6 +1147,18 @@ void tTJSVariant::operator +=(const tTJSVariant &rhs)
 			return;
 		}
 
+		if(vt == tvtString && String &&
+			String->GetLength() >= TJS_VS_ROPE_MIN_LEN)
+		{
+			// long string + non-string; append as a string not to copy
+			// the long string
+			tTJSVariant app;
+			app.vt = tvtString;
+			app.String = rhs.AsString();
+			operator +=(app);
+			return;
+		}
+
 		tTJSVariant val;
 		val.vt = tvtString;
 		tTJSVariantString *s1, *s2;
@@ -58,11 +58,72 @@ tjs_int TJSGetShorterStrLen(const tjs_char *str, tjs_int max)
 	// additional space for long string heap over TJSVS_ALLOC_DOUBLE_LIMIT
 #define TJSVS_ALLOC_DOUBLE_LIMIT 4000000
 	// switching value of double-sizing or incremental-sizing
+#define TJSVS_BUFFER_CLASSES 6
+	// number of size classes of long string buffers
+#define TJSVS_BUFFER_CACHE 16
+	// max number of buffers cached in each thread per size class
+static const tjs_uint TJSVSBufferClassSizes[TJSVS_BUFFER_CLASSES] =
+	{ 48, 64, 96, 128, 192, 256 };
+	// buffer sizes (in characters) which are cached in threads
+//---------------------------------------------------------------------------
+// per-thread cache of string heap cells and long string buffers
+//---------------------------------------------------------------------------
+// each thread allocates and frees cells from its own list without locking.
+// the global free list is not lock-free; it is still guarded by
+// TJSStringHeapCS, which a thread takes only when its list runs dry or
+// overflows, moving TJS_VS_CACHE_BATCH cells at once.
+#define TJS_VS_CACHE_CELLS 64
+	// max number of string heap cells cached in each thread
+#define TJS_VS_CACHE_BATCH 32
+	// number of cells moved between the thread and the global heap at once
+
+#define TJS_VS_CACHE_NONE 0
+#define TJS_VS_CACHE_ACTIVE 1
+#define TJS_VS_CACHE_EXITING 2
+struct tTJSStringHeapThreadCache
+{
+	// this must be trivially destructible, because strings may still be
+	// freed after the thread-local objects are destroyed (e.g. by static
+	// objects at the program exit). see tTJSStringHeapThreadCacheFlusher.
+	tjs_int State;
+	tjs_uint CellCount;
+	tTJSVariantString *Cells[TJS_VS_CACHE_CELLS];
+	tjs_uint BufferCount[TJSVS_BUFFER_CLASSES];
+	tjs_char *Buffers[TJSVS_BUFFER_CLASSES][TJSVS_BUFFER_CACHE];
+
+	// statistics not yet merged into the global counters
+	tjs_uint64 AllocCount;
+	tjs_uint64 FreeCount;
+};
+static thread_local tTJSStringHeapThreadCache TJSStringHeapThreadCache;
+static void TJSPrepareStringHeapThreadCache(tTJSStringHeapThreadCache &cache);
+//---------------------------------------------------------------------------
+static inline tjs_int TJSVS_GetBufferClass(size_t size)
+{
+	// returns the size class index of the buffer which has exactly "size"
+	// characters, or -1
+	if(size > TJSVSBufferClassSizes[TJSVS_BUFFER_CLASSES - 1]) return -1;
+	for(tjs_int i = 0; i < TJSVS_BUFFER_CLASSES; i++)
+		if(TJSVSBufferClassSizes[i] == size) return i;
+	return -1;
+}
 //---------------------------------------------------------------------------
 /*static inline*/ tjs_char *TJSVS_malloc(tjs_uint len)
 {
-	char *ret = (char*)malloc(
-		(len = (len + TJSVS_ALLOC_INC_SIZE_S))*sizeof(tjs_char) + sizeof(size_t));
+	len += TJSVS_ALLOC_INC_SIZE_S;
+	if(len <= TJSVSBufferClassSizes[TJSVS_BUFFER_CLASSES - 1])
+	{
+		// round up to the size class, and reuse the cached buffer if exists
+		tjs_int cls = 0;
+		while(TJSVSBufferClassSizes[cls] < len) cls++;
+		len = TJSVSBufferClassSizes[cls];
+
+		tTJSStringHeapThreadCache &cache = TJSStringHeapThreadCache;
+		if(cache.BufferCount[cls])
+			return cache.Buffers[cls][--cache.BufferCount[cls]];
+	}
+
+	char *ret = (char*)malloc(len*sizeof(tjs_char) + sizeof(size_t));
 	if(!ret) TJSThrowStringAllocError();
 	*(size_t *)ret = len; // embed size
 	return (tjs_char*)(ret + sizeof(size_t));
@@ -92,8 +153,24 @@ tjs_int TJSGetShorterStrLen(const tjs_char *str, tjs_int max)
 //---------------------------------------------------------------------------
 /*static inline*/ void TJSVS_free(tjs_char *buf)
 {
-	// free buffer
-	free((char*)buf - sizeof(size_t));
+	// free buffer; buffers of the size classes are kept in the thread cache.
+	// buffers enlarged by TJSVS_realloc may also hit the size class, this is
+	// no problem since all buffers are allocated by malloc.
+	size_t * ptr = (size_t *)((char*)buf - sizeof(size_t));
+	tjs_int cls = TJSVS_GetBufferClass(*ptr);
+	if(cls >= 0)
+	{
+		tTJSStringHeapThreadCache &cache = TJSStringHeapThreadCache;
+		if(cache.State == TJS_VS_CACHE_NONE)
+			TJSPrepareStringHeapThreadCache(cache);
+		if(cache.State == TJS_VS_CACHE_ACTIVE &&
+			cache.BufferCount[cls] < TJSVS_BUFFER_CACHE)
+		{
+			cache.Buffers[cls][cache.BufferCount[cls]++] = buf;
+			return;
+		}
+	}
+	free(ptr);
 }
 //---------------------------------------------------------------------------
 
@@ -108,6 +185,8 @@ tjs_int TJSGetShorterStrLen(const tjs_char *str, tjs_int max)
 
 #define HEAP_FLAG_USING 0x01
 #define HEAP_FLAG_DELETE 0x02
+#define HEAP_FLAG_CACHED 0x04
+	// the cell is free but is held by a thread cache
 #define HEAP_CAPACITY_INC 4096
 static tTJSSpinLock TJSStringHeapCS;
 static std::vector<tTJSVariantString*> *TJSStringHeapList = NULL;
@@ -115,9 +194,29 @@ static tTJSVariantString ** TJSStringHeapFreeCellList = NULL;
 //static tjs_uint TJSStringHeapFreeCellListCapacity = 0;
 static tjs_uint TJSStringHeapFreeCellListPointer = 0;
 static tjs_uint TJSStringHeapAllocCount = 0;
+	// number of cells out of the global free list (including cached cells)
+
+static tjs_uint64 TJSStringHeapTotalAllocCount = 0;
+static tjs_uint64 TJSStringHeapTotalFreeCount = 0;
+static tjs_uint64 TJSStringHeapContentionCount = 0;
 
 static tjs_uint TJSStringHeapLastCheckedFreeBlock = 0;
 //---------------------------------------------------------------------------
+class tTJSStringHeapLockHolder
+{
+	// lock TJSStringHeapCS, counting the contention
+public:
+	tTJSStringHeapLockHolder()
+	{
+		if(TJSStringHeapCS.atom_lock.test_and_set(std::memory_order_acquire))
+		{
+			TJSStringHeapCS.lock();
+			TJSStringHeapContentionCount ++;
+		}
+	}
+	~tTJSStringHeapLockHolder() { TJSStringHeapCS.unlock(); }
+};
+//---------------------------------------------------------------------------
 
 
 //---------------------------------------------------------------------------
@@ -191,6 +290,93 @@ static void TJSUninitStringHeap(void)
 	}
 }
 //---------------------------------------------------------------------------
+static inline void TJSMergeStringHeapStatistics(tTJSStringHeapThreadCache &cache)
+{
+	// must be called in thread-protected section
+	TJSStringHeapTotalAllocCount += cache.AllocCount;
+	TJSStringHeapTotalFreeCount += cache.FreeCount;
+	cache.AllocCount = cache.FreeCount = 0;
+}
+//---------------------------------------------------------------------------
+static tTJSVariantString * TJSRefillStringHeapThreadCache(
+	tTJSStringHeapThreadCache &cache)
+{
+	// take cells from the global free list, and return one of them.
+	// the thread which is exiting takes only the cell to return.
+	if(cache.State == TJS_VS_CACHE_NONE)
+		TJSPrepareStringHeapThreadCache(cache);
+	tjs_uint count =
+		cache.State == TJS_VS_CACHE_ACTIVE ? TJS_VS_CACHE_BATCH : 1;
+
+	tTJSStringHeapLockHolder csh;
+	TJSMergeStringHeapStatistics(cache);
+
+	if(!TJSStringHeapList) TJSInitStringHeap(); // first string to alloc
+
+	for(tjs_uint i = 0; i < count; i++)
+	{
+		if(TJSStringHeapFreeCellListPointer == 0)
+			TJSAddStringHeapBlock();
+		tTJSVariantString *cell =
+			TJSStringHeapFreeCellList[--TJSStringHeapFreeCellListPointer];
+		cell->HeapFlag = HEAP_FLAG_CACHED;
+		cache.Cells[cache.CellCount++] = cell;
+	}
+	TJSStringHeapAllocCount += count;
+
+	return cache.Cells[--cache.CellCount];
+}
+//---------------------------------------------------------------------------
+static void TJSFlushStringHeapThreadCache(tTJSStringHeapThreadCache &cache,
+	tjs_uint count)
+{
+	// return cells from the thread cache to the global free list
+	if(count > cache.CellCount) count = cache.CellCount;
+
+	tTJSStringHeapLockHolder csh;
+	TJSMergeStringHeapStatistics(cache);
+
+	for(tjs_uint i = 0; i < count; i++)
+	{
+		tTJSVariantString *cell = cache.Cells[--cache.CellCount];
+		cell->HeapFlag = 0;
+		TJSStringHeapFreeCellList[TJSStringHeapFreeCellListPointer++] = cell;
+	}
+	TJSStringHeapAllocCount -= count;
+
+	if(TJSStringHeapAllocCount == 0 && TJSStringHeapList)
+	{
+		// last string was freed
+		TJSUninitStringHeap();
+	}
+}
+//---------------------------------------------------------------------------
+struct tTJSStringHeapThreadCacheFlusher
+{
+	// returns all cached cells and buffers when the thread exits;
+	// the strings freed after this are returned to the global heap directly.
+	~tTJSStringHeapThreadCacheFlusher()
+	{
+		tTJSStringHeapThreadCache &cache = TJSStringHeapThreadCache;
+		cache.State = TJS_VS_CACHE_EXITING;
+		for(tjs_int cls = 0; cls < TJSVS_BUFFER_CLASSES; cls++)
+		{
+			while(cache.BufferCount[cls])
+				free((char*)cache.Buffers[cls][--cache.BufferCount[cls]] -
+					sizeof(size_t));
+		}
+		TJSFlushStringHeapThreadCache(cache, cache.CellCount);
+	}
+};
+//---------------------------------------------------------------------------
+static void TJSPrepareStringHeapThreadCache(tTJSStringHeapThreadCache &cache)
+{
+	// called at the first use of the thread cache
+	static thread_local tTJSStringHeapThreadCacheFlusher flusher;
+	(void)&flusher; // construct the flusher to register its destructor
+	cache.State = TJS_VS_CACHE_ACTIVE;
+}
+//---------------------------------------------------------------------------
 #ifdef TJS_DEBUG_UNRELEASED_STRING
 static void TJSUninitStringHeap(void)
 {
@@ -292,7 +478,7 @@ void TJSCompactStringHeap()
 	if(!TJSStringHeapList) return;
 
 	{	// thread-protected
-		tTJSSpinLockHolder csh(TJSStringHeapCS);
+		tTJSStringHeapLockHolder csh;
 
 #ifndef __CODEGUARD__
 	// may be very slow when used with codeguard
@@ -334,9 +520,12 @@ void TJSCompactStringHeap()
 			{
 				tjs_int freecount = 0;
 				tTJSVariantString * block = (*TJSStringHeapList)[block_ind];
+				// cells owned by threads switch between HEAP_FLAG_USING and
+				// HEAP_FLAG_CACHED without the lock, but never become zero
+				// outside of the lock.
 				for(tjs_int i = 0; i < HEAP_CAPACITY_INC; i++)
 				{
-					if(!(block[i].HeapFlag & HEAP_FLAG_USING))
+					if(!(block[i].HeapFlag & (HEAP_FLAG_USING|HEAP_FLAG_CACHED)))
 						freecount ++;
 				}
 
@@ -404,82 +593,168 @@ void TJSCompactStringHeap()
 	}
 }
 //---------------------------------------------------------------------------
-tTJSVariantString * TJSAllocStringHeap(void)
+struct tTJSVariantStringRope
+{
+	// stored in ShortString of the rope
+	tTJSVariantString *Left;
+	tTJSVariantString *Right;
+};
+static_assert(sizeof(tTJSVariantStringRope) <= sizeof(tjs_char) * (TJS_VS_SHORT_LEN + 1),
+	"tTJSVariantStringRope does not fit in ShortString");
+static inline tTJSVariantStringRope * TJSGetRope(const tTJSVariantString *vs)
+{
+	return (tTJSVariantStringRope *)const_cast<tjs_char *>(vs->ShortString);
+}
+static void TJSFreeStringHeapCell(tTJSVariantString * vs);
+static tTJSStaticCriticalSection TJSRopeFlattenCS;
+	// a shared rope may be read from some threads at once
+//---------------------------------------------------------------------------
+static void TJSReleaseRope(tTJSVariantString *vs)
 {
-	if(TJSStringHeapAllocCount == 0)
+	// free the rope and the strings only held by it; ropes may be nested
+	// very deeply (a string built in a loop), so this does not recurse.
+	std::vector<tTJSVariantString *> pending;
+	pending.push_back(vs);
+	while(!pending.empty())
 	{
-		// first string to alloc
-		// here must be called in main thread...
-		TJSInitStringHeap(); // initial block
+		tTJSVariantString *str = pending.back();
+		pending.pop_back();
+		if(str->IsRope())
+		{
+			tTJSVariantStringRope *rope = TJSGetRope(str);
+			if(rope->Left->RefCount == 0)
+				pending.push_back(rope->Left);
+			else
+				rope->Left->RefCount--;
+			if(rope->Right->RefCount == 0)
+				pending.push_back(rope->Right);
+			else
+				rope->Right->RefCount--;
+		}
+		else if(str->LongString)
+		{
+			TJSVS_free(str->LongString);
+		}
+		TJSFreeStringHeapCell(str);
 	}
-
-	{	// thread-protected
-		tTJSSpinLockHolder csh(TJSStringHeapCS);
-
+}
+//---------------------------------------------------------------------------
+tTJSVariantString * TJSAllocStringHeap(void)
+{
 #ifdef TJS_VS_USE_SYSTEM_NEW
-		tTJSVariantString *ret = new tTJSVariantString();
+	tTJSVariantString *ret = new tTJSVariantString();
+	{	// thread-protected
+		tTJSStringHeapLockHolder csh;
+		TJSStringHeapAllocCount ++;
+		TJSStringHeapTotalAllocCount ++;
+	}	// end-of-thread-protected
 #else
-		if(TJSStringHeapFreeCellListPointer == 0)
-			TJSAddStringHeapBlock();
-
-		tTJSVariantString *ret =
-			TJSStringHeapFreeCellList[--TJSStringHeapFreeCellListPointer];
+	tTJSStringHeapThreadCache &cache = TJSStringHeapThreadCache;
+	tTJSVariantString *ret;
+	if(cache.CellCount)
+		ret = cache.Cells[--cache.CellCount];
+	else
+		ret = TJSRefillStringHeapThreadCache(cache);
+	cache.AllocCount ++;
 #endif
 
-		ret->RefCount = 0;
-		ret->Length = 0;
-		ret->LongString = NULL;
-		ret->HeapFlag = HEAP_FLAG_USING;
-		ret->Hint = 0;
-
-		TJSStringHeapAllocCount ++;
-
-		return ret;
+	ret->RefCount = 0;
+	ret->Length = 0;
+	ret->LongString = NULL;
+	ret->HeapFlag = HEAP_FLAG_USING;
+	ret->Hint = 0;
 
-	}	// end-of-thread-protected
+	return ret;
 }
 //---------------------------------------------------------------------------
 void TJSDeallocStringHeap(tTJSVariantString * vs)
 {
 	// free vs
 
-	{	// thread-pretected
-		tTJSSpinLockHolder csh(TJSStringHeapCS);
-
 #ifdef TJS_DEBUG_CHECK_STRING_HEAP_INTEGRITY
+	{
+		const tjs_char * ptr = vs->operator const tjs_char *();
+		if(ptr[0] == 0)
 		{
-			const tjs_char * ptr = vs->operator const tjs_char *();
-			if(ptr[0] == 0)
-			{
-				OutputDebugString("empty string cell found");
-			}
-			if(TJS_strlen(ptr) != vs->GetLength())
-			{
-				OutputDebugString("invalid string length cell found");
-			}
+			OutputDebugString("empty string cell found");
 		}
+		if(TJS_strlen(ptr) != vs->GetLength())
+		{
+			OutputDebugString("invalid string length cell found");
+		}
+	}
 #endif
 
+	if(vs->IsRope())
+	{
+		TJSReleaseRope(vs);
+		return;
+	}
 
-		if(vs->LongString) TJSVS_free(vs->LongString);
-
-		vs->HeapFlag = 0;
+	if(vs->LongString) TJSVS_free(vs->LongString);
 
+	TJSFreeStringHeapCell(vs);
+}
+//---------------------------------------------------------------------------
+static void TJSFreeStringHeapCell(tTJSVariantString * vs)
+{
+	// return the cell to the thread cache or to the global heap
 #ifdef TJS_VS_USE_SYSTEM_NEW
-		delete vs;
+	vs->HeapFlag = 0;
+	delete vs;
+	{	// thread-protected
+		tTJSStringHeapLockHolder csh;
+		TJSStringHeapTotalFreeCount ++;
+		if(--TJSStringHeapAllocCount == 0)
+		{
+			// last string was freed
+			TJSUninitStringHeap();
+		}
+	}	// end-of-thread-protected
 #else
+	tTJSStringHeapThreadCache &cache = TJSStringHeapThreadCache;
+	if(cache.State == TJS_VS_CACHE_NONE)
+		TJSPrepareStringHeapThreadCache(cache);
+	cache.FreeCount ++;
+
+	if(cache.State == TJS_VS_CACHE_ACTIVE)
+	{
+		// keep the cell in the thread cache
+		vs->HeapFlag = HEAP_FLAG_CACHED;
+		if(cache.CellCount == TJS_VS_CACHE_CELLS)
+			TJSFlushStringHeapThreadCache(cache, TJS_VS_CACHE_BATCH);
+		cache.Cells[cache.CellCount++] = vs;
+		return;
+	}
+
+	{	// thread-protected
+		tTJSStringHeapLockHolder csh;
+		TJSMergeStringHeapStatistics(cache);
+
+		vs->HeapFlag = 0;
 		TJSStringHeapFreeCellList[TJSStringHeapFreeCellListPointer++] = vs;
-#endif
 
-		TJSStringHeapAllocCount--;
+		if(--TJSStringHeapAllocCount == 0)
+		{
+			// last string was freed
+			TJSUninitStringHeap();
+		}
 	}	// end-of-thread-protected
+#endif
+}
+//---------------------------------------------------------------------------
+void TJSGetStringHeapStatistics(tTJSStringHeapStatistics &stat)
+{
+	tTJSStringHeapThreadCache &cache = TJSStringHeapThreadCache;
 
-	if(TJSStringHeapAllocCount == 0)
-	{
-		// last string was freed
-		// here must be called in main thread...
-		TJSUninitStringHeap();
-	}
+	tTJSStringHeapLockHolder csh;
+	TJSMergeStringHeapStatistics(cache);
+
+	stat.AllocCount = TJSStringHeapTotalAllocCount;
+	stat.FreeCount = TJSStringHeapTotalFreeCount;
+	stat.ContentionCount = TJSStringHeapContentionCount;
+	stat.CellCount = TJSStringHeapAllocCount;
+	stat.BlockCount = TJSStringHeapList ? (tjs_uint)TJSStringHeapList->size() : 0;
 }
 //---------------------------------------------------------------------------
 
@@ -538,7 +813,69 @@ void tTJSVariantString::ToNumber(tTJSVariant &dest) const
 //---------------------------------------------------------------------------
 tTJSVariantString::operator const tjs_char *() const
 {
-	return (!this) ? (NULL) : (LongString ? LongString : ShortString);
+	if(!this) return NULL;
+	if(LongString) return LongString;
+	if(Length > TJS_VS_SHORT_LEN) return Flatten(); // rope
+	return ShortString;
+}
+//---------------------------------------------------------------------------
+const tjs_char * tTJSVariantString::Flatten() const
+{
+	// concatenate the strings held by the rope into a new buffer, and
+	// release them. the rope behaves as a normal long string after this.
+	// the rope may be shared between threads; only one of them flattens it
+	// and the others use the buffer made by that one.
+	tTJSVariantString *self = const_cast<tTJSVariantString *>(this);
+	tTJSVariantStringRope rope;
+	tjs_char *buf;
+	{
+		tTJSCriticalSectionHolder holder(TJSRopeFlattenCS);
+		if(LongString) return LongString;
+		rope = *TJSGetRope(this);
+
+		buf = TJSVS_malloc(Length + 1);
+		try
+		{
+			// fill the buffer from the end, without recursion
+			std::vector<const tTJSVariantString *> pending;
+			pending.push_back(rope.Left);
+			pending.push_back(rope.Right);
+			tjs_int pos = Length;
+			while(!pending.empty())
+			{
+				const tTJSVariantString *str = pending.back();
+				pending.pop_back();
+				if(str->IsRope())
+				{
+					const tTJSVariantStringRope *r = TJSGetRope(str);
+					pending.push_back(r->Left);
+					pending.push_back(r->Right);
+				}
+				else
+				{
+					pos -= str->Length;
+					memcpy(buf + pos, str->LongString ? str->LongString : str->ShortString,
+						str->Length * sizeof(tjs_char));
+				}
+			}
+		}
+		catch(...)
+		{
+			TJSVS_free(buf);
+			throw;
+		}
+		buf[Length] = 0;
+
+		// the buffer must be visible before the readers which do not lock
+		// see LongString
+		std::atomic_thread_fence(std::memory_order_release);
+		self->LongString = buf;
+	}
+
+	// the children are no longer reached from the rope
+	rope.Left->Release();
+	rope.Right->Release();
+	return buf;
 }
 //---------------------------------------------------------------------------
 tjs_int tTJSVariantString::GetLength() const
@@ -667,6 +1004,38 @@ tTJSVariantString * TJSAppendVariantString(tTJSVariantString *str,
 	return str;
 }
 //---------------------------------------------------------------------------
+tTJSVariantString * TJSConcatVariantString(tTJSVariantString *str,
+	const tTJSVariantString *app)
+{
+	// returns the string which concatenates str and app; the reference of
+	// str is moved to the result. the result is a rope which holds both
+	// strings and is flattened when its buffer is needed, so building a
+	// long string by repeated concatenation does not copy the whole string
+	// each time.
+	if(!app) return str;
+	if(!str)
+	{
+		const_cast<tTJSVariantString *>(app)->AddRef();
+		return const_cast<tTJSVariantString *>(app);
+	}
+
+	tjs_int len = str->GetLength() + app->GetLength();
+	if(len <= TJS_VS_SHORT_LEN)
+	{
+		tTJSVariantString *ret = TJSAllocVariantString(*str, *app);
+		str->Release();
+		return ret;
+	}
+
+	tTJSVariantString *ret = TJSAllocStringHeap();
+	tTJSVariantStringRope *rope = TJSGetRope(ret);
+	rope->Left = str;
+	rope->Right = const_cast<tTJSVariantString *>(app);
+	rope->Right->AddRef();
+	ret->Length = len;
+	return ret;
+}
+//---------------------------------------------------------------------------
 tTJSVariantString * TJSAppendVariantString(tTJSVariantString *str,
 	const tTJSVariantString *app)
 {
@@ -29,6 +29,9 @@ namespace TJS
 //---------------------------------------------------------------------------
 #define TJS_VS_SHORT_LEN 21
 /*]*/
+#define TJS_VS_ROPE_MIN_LEN 128
+	// minimum length of the string to be concatenated lazily
+
 class tTJSVariantString;
 extern tjs_int TJSGetShorterStrLen(const tjs_char *str, tjs_int max);
 extern tTJSVariantString * TJSAllocStringHeap(void);
@@ -36,6 +39,15 @@ extern void TJSDeallocStringHeap(tTJSVariantString * vs);
 extern void TJSThrowStringAllocError();
 extern void TJSThrowNarrowToWideConversionError();
 extern void TJSCompactStringHeap();
+struct tTJSStringHeapStatistics
+{
+	tjs_uint64 AllocCount; // total number of allocated strings
+	tjs_uint64 FreeCount; // total number of freed strings
+	tjs_uint64 ContentionCount; // number of times the heap lock was contended
+	tjs_uint CellCount; // cells in use or cached by threads
+	tjs_uint BlockCount; // heap blocks
+};
+extern void TJSGetStringHeapStatistics(tTJSStringHeapStatistics &stat);
 #ifdef TJS_DEBUG_DUMP_STRING
 extern void TJSDumpStringHeap(void);
 #endif
@@ -86,8 +98,22 @@ public:
 
 	TJS_METHOD_DEF(void, Release, ());
 
+	/*
+		a concatenated string may be a "rope", which holds references to the
+		two strings to be concatenated instead of the string buffer.
+		(see TJSConcatVariantString)
+		the rope is flattened at the first access to the buffer.
+	*/
+	bool IsRope() const
+	{
+		return !LongString && Length > TJS_VS_SHORT_LEN;
+	}
+
+	const tjs_char * Flatten() const;
+
 	TJS_METHOD_DEF(void, SetString, (const tjs_char *ref, tjs_int maxlen = -1))
 	{
+		if(IsRope()) Flatten();
 		if(LongString) TJSVS_free(LongString), LongString = NULL;
 		tjs_int len;
 		if(maxlen != -1)
@@ -109,6 +135,7 @@ public:
 
 	TJS_METHOD_DEF(void, SetString, (const tjs_nchar *ref))
 	{
+		if(IsRope()) Flatten();
 		if(LongString) TJSVS_free(LongString), LongString = NULL;
 		tjs_int len = (tjs_int)TJS_narrowtowidelen(ref);
 		if(len == -1) TJSThrowNarrowToWideConversionError();
@@ -130,6 +157,7 @@ public:
 		/* note that you must call FixLength if you allocate larger than the
 			actual string size */
 
+		if(IsRope()) Flatten();
 		if(LongString) TJSVS_free(LongString), LongString = NULL;
 
 		Length = len;
@@ -146,6 +174,7 @@ public:
 
 	TJS_METHOD_DEF(void, ResetString, (const tjs_char *ref))
 	{
+		if(IsRope()) Flatten();
 		if(LongString) TJSVS_free(LongString), LongString = NULL;
 		SetString(ref);
 	}
@@ -157,6 +186,7 @@ public:
 			actual string size */
 
 		// assume this != NULL
+		if(IsRope()) Flatten();
 		tjs_int newlen = Length += applen;
 		if(LongString)
 		{
@@ -192,6 +222,7 @@ public:
 	TJS_METHOD_DEF(void, Append, (const tjs_char *str, tjs_int applen))
 	{
 		// assume this != NULL
+		if(IsRope()) Flatten();
 		tjs_int orglen = Length;
 		tjs_int newlen = Length += applen;
 		if(LongString)
@@ -244,7 +275,7 @@ public:
 	void Persist(tjs_uint8 *dest) const
 	{
 		tjs_uint size;
-		const tjs_char *ptr = LongString?LongString:ShortString;
+		const tjs_char *ptr = this->operator const tjs_char *();
 		*(tjs_uint*)dest = size = GetLength();
 		dest += sizeof(tjs_uint);
 		while(size--)
@@ -274,6 +305,8 @@ TJS_EXP_FUNC_DEF(tTJSVariantString *, TJSAppendVariantString, (tTJSVariantString
 	const tjs_char *app));
 TJS_EXP_FUNC_DEF(tTJSVariantString *, TJSAppendVariantString, (tTJSVariantString *str,
 	const tTJSVariantString *app));
+extern tTJSVariantString * TJSConcatVariantString(tTJSVariantString *str,
+	const tTJSVariantString *app);
 TJS_EXP_FUNC_DEF(tTJSVariantString *, TJSFormatString, (const tjs_char *format, tjs_uint numparams,
 	tTJSVariant **params));
 
@@ -11,6 +11,15 @@
 
 #include "KAGParser.h"
 #include "EventIntf.h"
+#include "SysInitIntf.h"
+#include "SysInitImpl.h"
+#include "StorageIntf.h"
+#include "UtilStreams.h"
+#include "Platform.h"
+#include "ThreadIntf.h"
+#include "md5.h"
+#include <deque>
+#include <algorithm>
 namespace TJS { ttstr TJSMapGlobalStringMap(const ttstr & string); }
 
 //---------------------------------------------------------------------------
@@ -46,18 +55,232 @@ const tjs_char* TVPUnknownMacroName = TJS_W("Unknown macro \"%1\"");
 #undef TJS_NATIVE_SET_ClassID
 #define TJS_NATIVE_SET_ClassID ClassID_KAGParser = TJS_NCM_CLASSID;
 static tjs_int32 ClassID_KAGParser = -1;
+//---------------------------------------------------------------------------
+static bool inline TVPIsWS(tjs_char ch)
+{
+	// is white space ?
+	return (ch == TJS_W(' ') || ch == TJS_W('\t'));
+}
+//---------------------------------------------------------------------------
+// compiled scenario cache
+//---------------------------------------------------------------------------
+/*
+	when "-scenariocache=yes" is specified, the scenario file is stored in
+	"scenariocache" folder under the data path in compiled form, and is used
+	instead of parsing the scenario text again at the next time.
+	the compiled scenario holds the split lines, the label index and the
+	tokenized tags. macros are not stored since they are defined while the
+	scenario runs.
+	the file is named after the MD5 digest of the scenario text, so any
+	change of the scenario results in a different file.
+	the file consists of fixed size records and the text which are used in
+	place; the whole file is read into the buffer of the cache item at once.
+*/
+static tjs_int TVPScenarioCacheOptionsGeneration = 0;
+static bool TVPScenarioCacheEnabled = false;
+static const tjs_uint8 TVPScenarioCacheTag[8] =
+	{ 'T', 'V', 'P', 'K', 'S', 'C', '1', '0' };
+struct tTVPCompiledScenarioHeader
+{
+	tjs_uint8 Tag[8];
+	md5_byte_t Digest[16];
+	tjs_uint32 LineCount;
+	tjs_uint32 LabelCount;
+	tjs_uint32 TagCount;
+	tjs_uint32 AttributeCount;
+	tjs_uint32 StringCount;
+	tjs_uint32 TextLength; // in characters, including null terminaters
+	tjs_uint32 StringLength; // in characters
+};
+struct tTVPCompiledScenarioLine
+{
+	tjs_uint32 Start; // offset in the text
+	tjs_uint32 Length;
+};
+struct tTVPCompiledScenarioLabel
+{
+	tjs_uint32 Name; // index of the string table
+	tjs_uint32 Line;
+	tjs_uint32 Count;
+};
+struct tTVPCompiledScenarioTag
+{
+	tjs_uint32 Line;
+	tjs_uint32 Start;
+	tjs_uint32 End;
+	tjs_uint32 Name; // index of the string table
+	tjs_uint32 FirstAttribute;
+	tjs_uint32 AttributeCount;
+};
+struct tTVPCompiledScenarioAttribute
+{
+	tjs_uint32 Name; // index of the string table
+	tjs_uint32 Value; // index of the string table
+	tjs_uint32 Flags;
+};
+struct tTVPCompiledScenarioString
+{
+	tjs_uint32 Offset; // offset in the string pool
+	tjs_uint32 Length;
+};
+//---------------------------------------------------------------------------
+static void TVPInitScenarioCacheOptions()
+{
+	if(TVPScenarioCacheOptionsGeneration == TVPGetCommandLineArgumentGeneration()) return;
+	TVPScenarioCacheOptionsGeneration = TVPGetCommandLineArgumentGeneration();
+
+	tTJSVariant val;
+	TVPScenarioCacheEnabled = false;
+	if(TVPGetCommandLine(TJS_W("-scenariocache"), &val))
+	{
+		ttstr str(val);
+		if(str == TJS_W("yes"))
+			TVPScenarioCacheEnabled = true;
+	}
+}
+//---------------------------------------------------------------------------
+static void TVPMakeScenarioCacheDigest(const ttstr &text, md5_byte_t digest[16])
+{
+	md5_state_t state;
+	md5_init(&state);
+
+	// format version
+	tjs_int32 options[1];
+	options[0] = (tjs_int32)sizeof(tjs_char);
+	md5_append(&state, TVPScenarioCacheTag, sizeof(TVPScenarioCacheTag));
+	md5_append(&state, (const md5_byte_t *)options, sizeof(options));
+
+	// scenario text
+	md5_append(&state, (const md5_byte_t *)text.c_str(),
+		(int)(text.GetLen() * sizeof(tjs_char)));
+
+	md5_finish(&state, digest);
+}
+//---------------------------------------------------------------------------
+static ttstr TVPGetScenarioCacheFileName(const md5_byte_t digest[16])
+{
+	static const tjs_char hex[] = TJS_W("0123456789abcdef");
+	tjs_char name[33];
+	for(tjs_int i = 0; i < 16; i++)
+	{
+		name[i*2  ] = hex[digest[i] >> 4];
+		name[i*2+1] = hex[digest[i] & 0x0f];
+	}
+	name[32] = 0;
+	return ttstr(name) + TJS_W(".ksc");
+}
+//---------------------------------------------------------------------------
+static bool TVPCheckCompiledScenario(const tjs_uint8 *data, tjs_uint64 size,
+	const md5_byte_t digest[16])
+{
+	// check consistency of the compiled scenario
+	const tTVPCompiledScenarioHeader *header =
+		(const tTVPCompiledScenarioHeader *)data;
+	if(size < sizeof(tTVPCompiledScenarioHeader)) return false;
+	if(memcmp(header->Tag, TVPScenarioCacheTag, 8) ||
+		memcmp(header->Digest, digest, 16)) return false;
+	if(header->LineCount == 0 || header->TextLength == 0) return false;
+
+	tjs_uint64 expected = sizeof(tTVPCompiledScenarioHeader) +
+		(tjs_uint64)header->LineCount * sizeof(tTVPCompiledScenarioLine) +
+		(tjs_uint64)header->LabelCount * sizeof(tTVPCompiledScenarioLabel) +
+		(tjs_uint64)header->TagCount * sizeof(tTVPCompiledScenarioTag) +
+		(tjs_uint64)header->AttributeCount * sizeof(tTVPCompiledScenarioAttribute) +
+		(tjs_uint64)header->StringCount * sizeof(tTVPCompiledScenarioString) +
+		((tjs_uint64)header->TextLength + header->StringLength) * sizeof(tjs_char);
+	if(size != expected) return false;
+
+	const tTVPCompiledScenarioLine *lines =
+		(const tTVPCompiledScenarioLine *)(header + 1);
+	const tTVPCompiledScenarioLabel *labels =
+		(const tTVPCompiledScenarioLabel *)(lines + header->LineCount);
+	const tTVPCompiledScenarioTag *tags =
+		(const tTVPCompiledScenarioTag *)(labels + header->LabelCount);
+	const tTVPCompiledScenarioAttribute *attribs =
+		(const tTVPCompiledScenarioAttribute *)(tags + header->TagCount);
+	const tTVPCompiledScenarioString *strings =
+		(const tTVPCompiledScenarioString *)(attribs + header->AttributeCount);
+	const tjs_char *text = (const tjs_char *)(strings + header->StringCount);
+
+	tjs_uint32 i;
+	for(i = 0; i < header->LineCount; i++)
+	{
+		if((tjs_uint64)lines[i].Start + lines[i].Length >= header->TextLength)
+			return false;
+		if(text[lines[i].Start + lines[i].Length] != 0) return false;
+	}
+	for(i = 0; i < header->LabelCount; i++)
+	{
+		if(labels[i].Name >= header->StringCount ||
+			labels[i].Line >= header->LineCount) return false;
+	}
+	for(i = 0; i < header->TagCount; i++)
+	{
+		const tTVPCompiledScenarioTag &tag = tags[i];
+		if(tag.Line >= header->LineCount || tag.Start >= tag.End ||
+			tag.End > (tjs_uint32)lines[tag.Line].Length ||
+			tag.Name >= header->StringCount ||
+			(tjs_uint64)tag.FirstAttribute + tag.AttributeCount >
+				header->AttributeCount) return false;
+		if(i > 0 && (tags[i-1].Line > tag.Line ||
+			(tags[i-1].Line == tag.Line && tags[i-1].Start >= tag.Start)))
+			return false; // must be sorted by the position
+	}
+	for(i = 0; i < header->AttributeCount; i++)
+	{
+		if(attribs[i].Name >= header->StringCount ||
+			attribs[i].Value >= header->StringCount) return false;
+	}
+	for(i = 0; i < header->StringCount; i++)
+	{
+		if((tjs_uint64)strings[i].Offset + strings[i].Length >
+			header->StringLength) return false;
+	}
+	return true;
+}
+//---------------------------------------------------------------------------
+static const ttstr & TVPGetCompiledScenarioName(std::vector<ttstr> &strings,
+	std::vector<bool> &mapped, tjs_uint32 index)
+{
+	// names are mapped to the global string map, like tokenized at runtime
+	if(!mapped[index])
+	{
+		strings[index] = TJSMapGlobalStringMap(strings[index]);
+		mapped[index] = true;
+	}
+	return strings[index];
+}
+//---------------------------------------------------------------------------
+static tjs_uint32 TVPAddCompiledScenarioString(
+	tTJSHashTable<ttstr, tjs_uint32> &hash, std::vector<ttstr> &strings,
+	const ttstr &str)
+{
+	tjs_uint32 *index = hash.Find(str);
+	if(index) return *index;
+	tjs_uint32 newindex = (tjs_uint32)strings.size();
+	strings.push_back(str);
+	hash.Add(str, newindex);
+	return newindex;
+}
+//---------------------------------------------------------------------------
+
+
+
 //---------------------------------------------------------------------------
 // tTVPScenarioCacheItem : Scenario Cache Item
 //---------------------------------------------------------------------------
-tTVPScenarioCacheItem::tTVPScenarioCacheItem(const ttstr & name, bool isstring)
+tTVPScenarioCacheItem::tTVPScenarioCacheItem(const ttstr & name, bool isstring,
+	const ttstr *preloaded)
 {
 	RefCount = 1;
 	Lines = NULL;
 	LineCount = 0;
 	LabelCached = false;
+	LineTags = NULL;
+	StorageTargetsCollected = false;
 	try
 	{
-		LoadScenario(name, isstring);
+		LoadScenario(name, isstring, preloaded);
 	}
 	catch(...)
 	{
@@ -68,6 +291,16 @@ tTVPScenarioCacheItem::tTVPScenarioCacheItem(const ttstr & name, bool isstring)
 //---------------------------------------------------------------------------
 tTVPScenarioCacheItem::~tTVPScenarioCacheItem()
 {
+	if(LineTags)
+	{
+		for(tjs_int i = 0; i < LineCount; i++)
+		{
+			std::vector<tTag *> &tags = LineTags[i];
+			for(std::vector<tTag *>::iterator t = tags.begin(); t != tags.end(); t++)
+				delete *t;
+		}
+		delete [] LineTags;
+	}
 	if(Lines) delete [] Lines;
 }
 //---------------------------------------------------------------------------
@@ -84,10 +317,16 @@ void tTVPScenarioCacheItem::Release()
 		RefCount --;
 }
 //---------------------------------------------------------------------------
-void tTVPScenarioCacheItem::LoadScenario(const ttstr & name, bool isstring)
+void tTVPScenarioCacheItem::LoadScenario(const ttstr & name, bool isstring,
+	const ttstr *preloaded)
 {
 	// load scenario from file or string to buffer
 
+	bool savecompiled = false;
+	md5_byte_t digest[16];
+	ttstr compiledname;
+	tjs_uint textlen = 0;
+
 	if(isstring)
 	{
 		// when onScenarioLoad returns string;
@@ -102,12 +341,36 @@ void tTVPScenarioCacheItem::LoadScenario(const ttstr & name, bool isstring)
 
 		try
 		{
-			stream = TVPCreateTextStreamForRead(name, TJS_W(""));
-//			stream = TVPCreateTextStreamForReadByEncoding(name, TJS_W(""), TJS_W("Shift_JIS"));
 			ttstr tmp;
-			if (stream) {
-				stream->Read(tmp, 0);
+			if(preloaded)
+			{
+				// already read by the scenario preloader
+				tmp = *preloaded;
 			}
+			else
+			{
+				stream = TVPCreateTextStreamForRead(name, TJS_W(""));
+//				stream = TVPCreateTextStreamForReadByEncoding(name, TJS_W(""), TJS_W("Shift_JIS"));
+				if (stream) {
+					stream->Read(tmp, 0);
+				}
+			}
+
+			TVPInitScenarioCacheOptions();
+			if(TVPScenarioCacheEnabled && !tmp.IsEmpty())
+			{
+				// use compiled scenario if exists
+				TVPMakeScenarioCacheDigest(tmp, digest);
+				compiledname = TVPGetScenarioCacheFileName(digest);
+				if(LoadCompiledScenario(compiledname, digest))
+				{
+					if(stream) stream->Destruct();
+					return;
+				}
+				savecompiled = true;
+				textlen = tmp.GetLen() + 1;
+			}
+
 			Buffer = tmp.c_str();
 		}
 		catch(...)
@@ -185,6 +448,336 @@ void tTVPScenarioCacheItem::LoadScenario(const ttstr & name, bool isstring)
 	LineCount = count;
 			// tab-only last line will not be counted in pass2, thus makes
 			// pass2 counted lines are lesser than pass1 lines.
+
+	if(savecompiled) SaveCompiledScenario(compiledname, digest, textlen);
+}
+//---------------------------------------------------------------------------
+bool tTVPScenarioCacheItem::LoadCompiledScenario(const ttstr & filename,
+	const tjs_uint8 digest[16])
+{
+	// read the compiled scenario; returns false if the file does not exist
+	// or is not valid
+	// the whole file is read into Buffer.
+	ttstr storage = TVPDataPath + TJS_W("scenariocache/") + filename;
+	tjs_uint64 size;
+	try
+	{
+		if(!TVPIsExistentStorageNoSearch(storage)) return false;
+
+		tTVPStreamHolder stream(storage);
+		size = stream->GetSize();
+		if(size < sizeof(tTVPCompiledScenarioHeader) || size >= 0x7fffffff)
+			return false;
+		tjs_uint8 *data = (tjs_uint8 *)
+			Buffer.Allocate((size_t)(size / sizeof(tjs_char) + 1));
+		if(stream->Read(data, (tjs_uint)size) != size)
+		{
+			Buffer.Clear();
+			return false;
+		}
+	}
+	catch(...)
+	{
+		Buffer.Clear();
+		return false;
+	}
+
+	const tjs_uint8 *data = (const tjs_uint8 *)(const tjs_char *)Buffer;
+	if(!TVPCheckCompiledScenario(data, size, digest))
+	{
+		Buffer.Clear();
+		return false;
+	}
+
+	const tTVPCompiledScenarioHeader *header =
+		(const tTVPCompiledScenarioHeader *)data;
+	const tTVPCompiledScenarioLine *lines =
+		(const tTVPCompiledScenarioLine *)(header + 1);
+	const tTVPCompiledScenarioLabel *labels =
+		(const tTVPCompiledScenarioLabel *)(lines + header->LineCount);
+	const tTVPCompiledScenarioTag *tags =
+		(const tTVPCompiledScenarioTag *)(labels + header->LabelCount);
+	const tTVPCompiledScenarioAttribute *attribs =
+		(const tTVPCompiledScenarioAttribute *)(tags + header->TagCount);
+	const tTVPCompiledScenarioString *strings =
+		(const tTVPCompiledScenarioString *)(attribs + header->AttributeCount);
+	const tjs_char *text = (const tjs_char *)(strings + header->StringCount);
+	const tjs_char *pool = text + header->TextLength;
+
+	// string table
+	std::vector<ttstr> strs(header->StringCount);
+	std::vector<bool> mapped(header->StringCount);
+	tjs_uint32 i;
+	for(i = 0; i < header->StringCount; i++)
+		strs[i] = ttstr(pool + strings[i].Offset, strings[i].Length);
+
+	// lines; these point the text in the buffer
+	LineCount = header->LineCount;
+	Lines = new tLine[LineCount];
+	for(i = 0; i < header->LineCount; i++)
+	{
+		Lines[i].Start = text + lines[i].Start;
+		Lines[i].Length = lines[i].Length;
+	}
+
+	// labels
+	LabelAliases.resize(LineCount);
+	for(i = 0; i < header->LabelCount; i++)
+	{
+		const ttstr &label = strs[labels[i].Name];
+		LabelCache.Add(label, tLabelCacheData(labels[i].Line, labels[i].Count));
+		LabelAliases[labels[i].Line] = label;
+	}
+	LabelCached = true;
+
+	// tags
+	LineTags = new std::vector<tTag *>[LineCount];
+	for(i = 0; i < header->TagCount; i++)
+	{
+		tTag *tag = new tTag();
+		LineTags[tags[i].Line].push_back(tag);
+		tag->Start = tags[i].Start;
+		tag->End = tags[i].End;
+		tag->Name = TVPGetCompiledScenarioName(strs, mapped, tags[i].Name);
+		tag->Attributes.resize(tags[i].AttributeCount);
+		for(tjs_uint32 j = 0; j < tags[i].AttributeCount; j++)
+		{
+			const tTVPCompiledScenarioAttribute &src =
+				attribs[tags[i].FirstAttribute + j];
+			tTagAttribute &dest = tag->Attributes[j];
+			dest.Name = TVPGetCompiledScenarioName(strs, mapped, src.Name);
+			dest.Value = strs[src.Value];
+			dest.Flags = (tjs_int)src.Flags;
+		}
+	}
+
+	return true;
+}
+//---------------------------------------------------------------------------
+void tTVPScenarioCacheItem::TokenizeAllTags()
+{
+	// tokenize all tags in the scenario.
+	// a tag which can not be tokenized is skipped with the rest of the
+	// line; the error will be reported when the parser reaches it.
+	bool inscript = false;
+	for(tjs_int i = 0; i < LineCount; i++)
+	{
+		const tjs_char *p = Lines[i].Start;
+		if(inscript)
+		{
+			if((p[0] == TJS_W('[') &&
+				(!TJS_strcmp(p, TJS_W("[endscript]")) ||
+				 !TJS_strcmp(p, TJS_W("[endscript]\\")) ))||
+			  (p[0] == TJS_W('@') &&
+				(!TJS_strcmp(p, TJS_W("@endscript")) ) ) )
+				inscript = false;
+			continue;
+		}
+
+		if(p[0] == TJS_W(';') || p[0] == TJS_W('*')) continue; // comment or label
+
+		if((p[0] == TJS_W('[') &&
+			(!TJS_strcmp(p, TJS_W("[iscript]")) ||
+			 !TJS_strcmp(p, TJS_W("[iscript]\\")) ))||
+		   (p[0] == TJS_W('@') &&
+			(!TJS_strcmp(p, TJS_W("@iscript")) ) ) )
+		{
+			inscript = true;
+			continue;
+		}
+
+		try
+		{
+			if(p[0] == TJS_W('@'))
+			{
+				GetTag(i, 0, 0); // line command
+				continue;
+			}
+
+			tjs_int pos = 0;
+			while(p[pos])
+			{
+				if(p[pos] == TJS_W('['))
+				{
+					if(p[pos+1] == TJS_W('['))
+						pos += 2; // escaped '['
+					else
+						pos = GetTag(i, pos, TJS_W(']')).End + 1;
+				}
+				else
+				{
+					pos++;
+				}
+			}
+		}
+		catch(...)
+		{
+			// syntax error; rest of the line is not tokenized
+		}
+	}
+}
+//---------------------------------------------------------------------------
+bool tTVPScenarioCacheItem::CollectStorageTargets(std::vector<ttstr> &storages)
+{
+	// collect storage names of jump/call tags.
+	// storages given by entities or macro arguments are not collected.
+	if(StorageTargetsCollected) return false;
+	StorageTargetsCollected = true;
+
+	TokenizeAllTags();
+	if(!LineTags) return true; // no tags
+
+	static ttstr jump_name(TJSMapGlobalStringMap(TJS_W("jump")));
+	static ttstr call_name(TJSMapGlobalStringMap(TJS_W("call")));
+	static ttstr storage_name(TJSMapGlobalStringMap(TJS_W("storage")));
+	for(tjs_int i = 0; i < LineCount; i++)
+	{
+		std::vector<tTag *> &tags = LineTags[i];
+		for(std::vector<tTag *>::iterator t = tags.begin(); t != tags.end(); t++)
+		{
+			if((*t)->Name != jump_name && (*t)->Name != call_name) continue;
+			for(std::vector<tTagAttribute>::iterator a = (*t)->Attributes.begin();
+				a != (*t)->Attributes.end(); a++)
+			{
+				if(a->Name != storage_name || a->Flags != 0 || a->Value.IsEmpty())
+					continue;
+				if(std::find(storages.begin(), storages.end(), a->Value) ==
+					storages.end())
+					storages.push_back(a->Value);
+			}
+		}
+	}
+	return true;
+}
+//---------------------------------------------------------------------------
+void tTVPScenarioCacheItem::SaveCompiledScenario(const ttstr & filename,
+	const tjs_uint8 digest[16], tjs_uint textlen)
+{
+	// tokenize all tags and write the compiled scenario.
+	// failures are silently ignored.
+	try
+	{
+		EnsureLabelCache();
+	}
+	catch(...)
+	{
+		return;
+	}
+
+	TokenizeAllTags();
+
+	tjs_int i;
+	// build the records
+	tTJSHashTable<ttstr, tjs_uint32> stringhash;
+	std::vector<ttstr> strings;
+	std::vector<tTVPCompiledScenarioLine> lines(LineCount);
+	std::vector<tTVPCompiledScenarioLabel> labels;
+	std::vector<tTVPCompiledScenarioTag> tags;
+	std::vector<tTVPCompiledScenarioAttribute> attribs;
+	const tjs_char *text = Buffer;
+	for(i = 0; i < LineCount; i++)
+	{
+		lines[i].Start = (tjs_uint32)(Lines[i].Start - text);
+		lines[i].Length = (tjs_uint32)Lines[i].Length;
+
+		const ttstr &label = LabelAliases[i];
+		if(!label.IsEmpty())
+		{
+			const tLabelCacheData *data = LabelCache.Find(label);
+			if(data)
+			{
+				tTVPCompiledScenarioLabel rec;
+				rec.Name = TVPAddCompiledScenarioString(stringhash, strings, label);
+				rec.Line = (tjs_uint32)data->Line;
+				rec.Count = (tjs_uint32)data->Count;
+				labels.push_back(rec);
+			}
+		}
+
+		if(!LineTags) continue;
+		std::vector<tTag *> &linetags = LineTags[i];
+		for(std::vector<tTag *>::iterator t = linetags.begin(); t != linetags.end(); t++)
+		{
+			tTVPCompiledScenarioTag rec;
+			rec.Line = (tjs_uint32)i;
+			rec.Start = (tjs_uint32)(*t)->Start;
+			rec.End = (tjs_uint32)(*t)->End;
+			rec.Name = TVPAddCompiledScenarioString(stringhash, strings, (*t)->Name);
+			rec.FirstAttribute = (tjs_uint32)attribs.size();
+			rec.AttributeCount = (tjs_uint32)(*t)->Attributes.size();
+			tags.push_back(rec);
+			for(std::vector<tTagAttribute>::iterator a = (*t)->Attributes.begin();
+				a != (*t)->Attributes.end(); a++)
+			{
+				tTVPCompiledScenarioAttribute arec;
+				arec.Name = TVPAddCompiledScenarioString(stringhash, strings, a->Name);
+				arec.Value = TVPAddCompiledScenarioString(stringhash, strings, a->Value);
+				arec.Flags = (tjs_uint32)a->Flags;
+				attribs.push_back(arec);
+			}
+		}
+	}
+
+	std::vector<tTVPCompiledScenarioString> stringrecs(strings.size());
+	std::vector<tjs_char> pool;
+	for(size_t s = 0; s < strings.size(); s++)
+	{
+		stringrecs[s].Offset = (tjs_uint32)pool.size();
+		stringrecs[s].Length = (tjs_uint32)strings[s].GetLen();
+		pool.insert(pool.end(), strings[s].c_str(),
+			strings[s].c_str() + strings[s].GetLen());
+	}
+
+	tTVPCompiledScenarioHeader header;
+	memcpy(header.Tag, TVPScenarioCacheTag, 8);
+	memcpy(header.Digest, digest, 16);
+	header.LineCount = (tjs_uint32)lines.size();
+	header.LabelCount = (tjs_uint32)labels.size();
+	header.TagCount = (tjs_uint32)tags.size();
+	header.AttributeCount = (tjs_uint32)attribs.size();
+	header.StringCount = (tjs_uint32)stringrecs.size();
+	header.TextLength = (tjs_uint32)textlen;
+	header.StringLength = (tjs_uint32)pool.size();
+
+	// write the file into a temporary file, and then rename it
+	try
+	{
+		TVPEnsureDataPathDirectory();
+		ttstr nativedir = TVPNativeDataPath + TJS_W("scenariocache/");
+		if(!TVPCheckExistentLocalFolder(nativedir))
+			TVPCreateFolders(nativedir);
+
+		ttstr tmpname = filename + TJS_W(".tmp");
+		bool ok;
+		{
+			tTVPStreamHolder stream(TVPDataPath + TJS_W("scenariocache/") + tmpname,
+				TJS_BS_WRITE);
+			#define TVP_WRITE_SECTION(vec) \
+				(vec.empty() || stream->Write(&vec[0], \
+					(tjs_uint)(vec.size() * sizeof(vec[0]))) == \
+					vec.size() * sizeof(vec[0]))
+			ok = stream->Write(&header, sizeof(header)) == sizeof(header) &&
+				TVP_WRITE_SECTION(lines) &&
+				TVP_WRITE_SECTION(labels) &&
+				TVP_WRITE_SECTION(tags) &&
+				TVP_WRITE_SECTION(attribs) &&
+				TVP_WRITE_SECTION(stringrecs) &&
+				stream->Write(text, textlen * sizeof(tjs_char)) ==
+					textlen * sizeof(tjs_char) &&
+				TVP_WRITE_SECTION(pool);
+			#undef TVP_WRITE_SECTION
+		}
+
+		if(ok)
+		{
+			TVPRemoveFile(nativedir + filename);
+			ok = TVPRenameFile(nativedir + tmpname, nativedir + filename);
+		}
+		if(!ok) TVPRemoveFile(nativedir + tmpname);
+	}
+	catch(...)
+	{
+	}
 }
 //---------------------------------------------------------------------------
 void tTVPScenarioCacheItem::EnsureLabelCache()
@@ -243,24 +836,466 @@ void tTVPScenarioCacheItem::EnsureLabelCache()
 
 }
 //---------------------------------------------------------------------------
+void tTVPScenarioCacheItem::ParseTag(const tjs_char *line, tjs_int pos,
+	tjs_char ldelim, tTag &tag)
+{
+	// tokenize a tag which starts at line[pos] ( '[' or '@' ).
+	// ldelim is the last delimiter of the tag; ']' or null terminater.
+	// tag name and attribute names are lower-cased and mapped to the global
+	// string map. expression entities and macro arguments are not
+	// evaluated here, they are evaluated every time the tag is processed.
+	tag.Start = pos;
+	tag.Attributes.clear();
+	pos ++;
+
+	if(line[pos] == 0) TVPThrowExceptionMessage(TVPKAGSyntaxError);
+
+	// tag name
+	while(TVPIsWS(line[pos])) pos ++;
+	if(line[pos] == 0) TVPThrowExceptionMessage(TVPKAGSyntaxError);
+	const tjs_char * tagnamestart = line + pos;
+	while(line[pos] && !TVPIsWS(line[pos]) && line[pos] != ldelim)
+		pos ++;
+
+	if(tagnamestart == line + pos)
+		TVPThrowExceptionMessage(TVPKAGSyntaxError);
+
+	ttstr tagname(tagnamestart, line + pos - tagnamestart);
+	tagname.ToLowerCase();
+	tag.Name = TJSMapGlobalStringMap(tagname);
+
+	// tag attributes
+	while(true)
+	{
+		while(TVPIsWS(line[pos])) pos ++;
+
+		if(line[pos] == ldelim) break; // tag ended
+
+		if(line[pos] == 0)
+			TVPThrowExceptionMessage(TVPKAGSyntaxError);
+
+		tag.Attributes.push_back(tTagAttribute());
+		tTagAttribute &attrib = tag.Attributes.back();
+		attrib.Flags = 0;
+
+		// attrib name
+		if(line[pos] == TJS_W('*'))
+		{
+			// macro entity all
+			attrib.Flags = tTagAttribute::aAllMacroArgs;
+			pos++;
+			while(line[pos] && TVPIsWS(line[pos])) pos ++;
+			continue;
+		}
+
+		const tjs_char *attribnamestart = line + pos;
+		while(line[pos] && !TVPIsWS(line[pos]) &&
+			line[pos] != TJS_W('=') && line[pos] != ldelim)
+				pos ++;
+
+		const tjs_char *attribnameend = line + pos;
+
+		ttstr attribname(attribnamestart, attribnameend - attribnamestart);
+		attribname.ToLowerCase();
+		attrib.Name = TJSMapGlobalStringMap(attribname);
+
+		// =
+		while(TVPIsWS(line[pos])) pos ++;
+
+		if(line[pos] != TJS_W('='))
+		{
+			// arrtibute value omitted
+			static ttstr true_value(TJS_W("true"));
+			attrib.Value = true_value; // always true
+			continue;
+		}
+
+		pos++;
+		if(line[pos] == 0)
+			TVPThrowExceptionMessage(TVPKAGSyntaxError);
+		while(line[pos] && TVPIsWS(line[pos])) pos ++;
+		if(line[pos] == 0)
+			TVPThrowExceptionMessage(TVPKAGSyntaxError);
+
+		// attrib value
+		tjs_char vdelim = 0; // value delimiter
+
+		if(line[pos] == TJS_W('&'))
+			attrib.Flags |= tTagAttribute::aEntity, pos++;
+		else if(line[pos] == TJS_W('%'))
+			attrib.Flags |= tTagAttribute::aMacroArg, pos++;
+
+		if(line[pos] == TJS_W('\"') || line[pos] == TJS_W('\''))
+		{
+			vdelim = line[pos];
+			pos++;
+		}
+
+		const tjs_char *valuestart = line + pos;
+
+		while(line[pos] &&
+			(vdelim ? (line[pos] != vdelim) :
+				(line[pos] != ldelim && !TVPIsWS(line[pos])) ) )
+		{
+			if(line[pos] == TJS_W('`'))
+			{
+				// escaped with '`'
+				pos++;
+				if(line[pos] == 0)
+					TVPThrowExceptionMessage(TVPKAGSyntaxError);
+			}
+			pos++;
+		}
+
+		if(ldelim != 0 && line[pos] == 0)
+			TVPThrowExceptionMessage(TVPKAGSyntaxError);
+		const tjs_char *valueend = line + pos;
+
+		if(vdelim) pos ++;
+
+		// unescape ` character of value
+		ttstr &value = attrib.Value;
+		value = ttstr(valuestart, valueend - valuestart);
+		if(valueend != valuestart)
+		{
+			// value has at least one character
+			tjs_char * vp = value.Independ();
+			tjs_char * wvp = vp;
+
+			if(!(attrib.Flags & tTagAttribute::aEntity) && *vp == TJS_W('&'))
+				attrib.Flags |= tTagAttribute::aEntity, vp++;
+			if(!(attrib.Flags & tTagAttribute::aMacroArg) && *vp == TJS_W('%'))
+				attrib.Flags |= tTagAttribute::aMacroArg, vp++;
+
+			while(*vp)
+			{
+				if(*vp == TJS_W('`'))
+				{
+					vp++;
+					if(!*vp) break;
+				}
+				*wvp = *vp;
+				vp++;
+				wvp++;
+			}
+			*wvp = 0;
+			value.FixLen();
+		}
+	}
+
+	tag.End = pos;
+}
+//---------------------------------------------------------------------------
+const tTVPScenarioCacheItem::tTag & tTVPScenarioCacheItem::GetTag(tjs_int line,
+	tjs_int pos, tjs_char ldelim)
+{
+	// returns the tag which starts at the position of the line.
+	// tags are tokenized at the first time and kept while this scenario
+	// cache item is alive; tag objects are never moved nor deleted until
+	// then.
+	if(!LineTags) LineTags = new std::vector<tTag *>[LineCount];
+
+	std::vector<tTag *> &tags = LineTags[line];
+	std::vector<tTag *>::iterator i;
+	for(i = tags.begin(); i != tags.end(); i++)
+	{
+		if((*i)->Start == pos) return **i;
+		if((*i)->Start > pos) break;
+	}
+
+	tTag *tag = new tTag();
+	try
+	{
+		ParseTag(Lines[line].Start, pos, ldelim, *tag);
+	}
+	catch(...)
+	{
+		delete tag;
+		throw;
+	}
+	tags.insert(i, tag);
+	return *tag;
+}
+//---------------------------------------------------------------------------
+
+
+
+
+
+
+//---------------------------------------------------------------------------
+// tTVPScenarioPreloader
+//---------------------------------------------------------------------------
+/*
+	reads and decodes the scenario files referenced by jump/call tags of the
+	loaded scenario on a background thread. the text is passed to the main
+	thread when TVPGetScenario misses the cache; splitting lines and
+	tokenizing tags are done on the main thread since the tokenizer uses
+	the global string map, which is not thread safe.
+	strings are handed between the threads only under the lock, and the
+	storage names are copied, so reference counters of the strings are
+	never touched by both threads at once.
+*/
+#define TVP_SCENARIO_MAX_PRELOAD_COUNT 16
+class tTVPScenarioPreloader : public tTVPThread
+{
+	struct tItem
+	{
+		ttstr Name; // storage name given by the tag
+		ttstr Place; // searched storage name
+		ttstr Text; // empty if failed
+		bool Loaded;
+		bool Discarded; // removed while loading
+	};
+
+	tTJSCriticalSection CS;
+	tTVPThreadEvent RequestEvent; // a request is pushed
+	tTVPThreadEvent LoadedEvent; // an item is loaded
+	std::deque<tItem *> Items; // in order of the requests
+	tItem *Loading; // the item being loaded by the thread
+
+public:
+	tTVPScenarioPreloader() : tTVPThread(true)
+	{
+		Loading = NULL;
+	}
+
+	~tTVPScenarioPreloader()
+	{
+		Terminate();
+		RequestEvent.Set();
+		WaitFor();
+		Clear();
+	}
+
+protected:
+	void Execute()
+	{
+		SetPriority(ttpLower);
+		while(!GetTerminated())
+		{
+			tItem *item = NULL;
+			{
+				tTJSCriticalSectionHolder holder(CS);
+				for(std::deque<tItem *>::iterator i = Items.begin();
+					i != Items.end(); i++)
+				{
+					if(!(*i)->Loaded) { item = *i; break; }
+				}
+				Loading = item;
+			}
+
+			if(!item)
+			{
+				// wait for the next request
+				RequestEvent.WaitFor(-1);
+				continue;
+			}
+
+			ttstr text;
+			iTJSTextReadStream * stream = NULL;
+			try
+			{
+				stream = TVPCreateTextStreamForRead(item->Place, TJS_W(""));
+				if(stream) stream->Read(text, 0);
+			}
+			catch(...)
+			{
+				// errors are reported when the scenario is loaded on the
+				// main thread
+				text.Clear();
+			}
+			if(stream) stream->Destruct();
+
+			{
+				tTJSCriticalSectionHolder holder(CS);
+				Loading = NULL;
+				if(item->Discarded)
+				{
+					text.Clear();
+					delete item;
+				}
+				else
+				{
+					item->Text = text;
+					text.Clear();
+					item->Loaded = true;
+				}
+			}
+			LoadedEvent.Set();
+		}
+	}
+
+public:
+	void Request(const ttstr &name)
+	{
+		// request to read the storage ( main thread ).
+		// the storage is searched on the main thread since the auto path
+		// cache is not thread safe.
+		ttstr place;
+		try
+		{
+			place = TVPSearchPlacedPath(name);
+		}
+		catch(...)
+		{
+			return; // missing storage is reported when the scenario is loaded
+		}
+
+		tTJSCriticalSectionHolder holder(CS);
+		for(std::deque<tItem *>::iterator i = Items.begin(); i != Items.end(); i++)
+			if((*i)->Name == name) return; // already requested
+
+		if(Items.size() >= TVP_SCENARIO_MAX_PRELOAD_COUNT)
+		{
+			// discard the oldest item
+			tItem *item = Items.front();
+			Items.pop_front();
+			if(item == Loading)
+				item->Discarded = true;
+			else
+				delete item;
+		}
+
+		tItem *item = new tItem();
+		item->Name = ttstr(name.c_str()); // not to share the string
+		item->Place = ttstr(place.c_str());
+		item->Loaded = false;
+		item->Discarded = false;
+		Items.push_back(item);
+		RequestEvent.Set();
+	}
+
+	bool Take(const ttstr &name, ttstr &text)
+	{
+		// take the text of the storage out of the preloader ( main thread ).
+		// waits if the storage is being loaded. returns false if the storage
+		// is not requested, not loaded yet or failed to load.
+		while(true)
+		{
+			{
+				tTJSCriticalSectionHolder holder(CS);
+				std::deque<tItem *>::iterator i;
+				for(i = Items.begin(); i != Items.end(); i++)
+					if((*i)->Name == name) break;
+				if(i == Items.end()) return false;
+
+				tItem *item = *i;
+				if(item != Loading)
+				{
+					Items.erase(i);
+					bool loaded = item->Loaded && !item->Text.IsEmpty();
+					if(loaded) text = item->Text;
+					delete item;
+					return loaded;
+				}
+			}
+
+			LoadedEvent.WaitFor(-1);
+		}
+	}
+
+	void Clear()
+	{
+		// discard all items
+		tTJSCriticalSectionHolder holder(CS);
+		while(Items.size())
+		{
+			tItem *item = Items.front();
+			Items.pop_front();
+			if(item == Loading)
+				item->Discarded = true;
+			else
+				delete item;
+		}
+	}
+};
+//---------------------------------------------------------------------------
+static tTVPScenarioPreloader *TVPScenarioPreloader = NULL;
+static bool TVPScenarioPreloadEnabled = false;
+//---------------------------------------------------------------------------
+static void TVPDeleteScenarioPreloader()
+{
+	if(TVPScenarioPreloader)
+		delete TVPScenarioPreloader, TVPScenarioPreloader = NULL;
+}
+//---------------------------------------------------------------------------
+static tTVPAtExit TVPDeleteScenarioPreloaderAtExit(TVP_ATEXIT_PRI_SHUTDOWN,
+	TVPDeleteScenarioPreloader);
+//---------------------------------------------------------------------------
+void TVPSetScenarioPreloadEnabled(bool b)
+{
+	TVPScenarioPreloadEnabled = b;
+	if(!b) TVPDeleteScenarioPreloader();
+}
+//---------------------------------------------------------------------------
+bool TVPGetScenarioPreloadEnabled()
+{
+	return TVPScenarioPreloadEnabled;
+}
+//---------------------------------------------------------------------------
 
 
 
 
-
-
 //---------------------------------------------------------------------------
 // tTVPScenarioCache
 //---------------------------------------------------------------------------
-#define TVP_SCENARIO_MAX_CACHE_SIZE 8
+/*
+	the scenario cache is limited by the total size of the cached scenarios,
+	not by the count of them. the most recently used scenario is always
+	kept even if it exceeds the limit.
+*/
+#define TVP_SCENARIO_DEFAULT_CACHE_LIMIT (8*1024*1024)
 typedef tTJSRefHolder<tTVPScenarioCacheItem> tTVPScenarioCacheItemHolder;
-typedef tTJSHashCache<ttstr, tTVPScenarioCacheItemHolder,  tTJSHashFunc<ttstr>,
-	(TVP_SCENARIO_MAX_CACHE_SIZE*2)> tTVPScenarioCache;
-tTVPScenarioCache TVPScenarioCache(TVP_SCENARIO_MAX_CACHE_SIZE);
+typedef tTJSHashTable<ttstr, tTVPScenarioCacheItemHolder> tTVPScenarioCache;
+tTVPScenarioCache TVPScenarioCache;
+static tjs_uint64 TVPScenarioCacheLimit = TVP_SCENARIO_DEFAULT_CACHE_LIMIT;
+static tjs_uint64 TVPScenarioCacheTotalBytes = 0;
+static tjs_uint TVPScenarioCacheHitCount = 0;
+static tjs_uint TVPScenarioCacheMissCount = 0;
+static tjs_uint TVPScenarioPreloadHitCount = 0;
+//---------------------------------------------------------------------------
+static void TVPCheckScenarioCacheLimit()
+{
+	while(TVPScenarioCacheTotalBytes > TVPScenarioCacheLimit &&
+		TVPScenarioCache.GetCount() > 1)
+	{
+		// chop last scenario
+		tTVPScenarioCache::tIterator i;
+		i = TVPScenarioCache.GetLast();
+		if(i.IsNull()) break;
+		TVPScenarioCacheTotalBytes -= i.GetValue().GetObjectNoAddRef()->GetSize();
+		TVPScenarioCache.ChopLast(1);
+	}
+}
 //---------------------------------------------------------------------------
 void TVPClearScnearioCache()
 {
 	TVPScenarioCache.Clear();
+	TVPScenarioCacheTotalBytes = 0;
+	if(TVPScenarioPreloader) TVPScenarioPreloader->Clear();
+}
+//---------------------------------------------------------------------------
+void TVPSetScenarioCacheLimit(tjs_uint64 limit)
+{
+	TVPScenarioCacheLimit = limit;
+	TVPCheckScenarioCacheLimit();
+}
+//---------------------------------------------------------------------------
+tjs_uint64 TVPGetScenarioCacheLimit()
+{
+	return TVPScenarioCacheLimit;
+}
+//---------------------------------------------------------------------------
+void TVPGetScenarioCacheStatistics(tTVPScenarioCacheStatistics &stat)
+{
+	stat.HitCount = TVPScenarioCacheHitCount;
+	stat.MissCount = TVPScenarioCacheMissCount;
+	stat.PreloadHitCount = TVPScenarioPreloadHitCount;
+	stat.Count = TVPScenarioCache.GetCount();
+	stat.TotalBytes = TVPScenarioCacheTotalBytes;
+	stat.Limit = TVPScenarioCacheLimit;
 }
 //---------------------------------------------------------------------------
 struct tTVPClearScenarioCacheCallback : public tTVPCompactEventCallbackIntf
@@ -301,16 +1336,30 @@ tTVPScenarioCacheItem * TVPGetScenario(const ttstr & storagename, bool isstring)
 	if(ptr)
 	{
 		// found in the cache
+		TVPScenarioCacheHitCount ++;
 		return ptr->GetObject();
 	}
 
 	// not found in the cache
-	tTVPScenarioCacheItem * item = new tTVPScenarioCacheItem(storagename, false);
+	TVPScenarioCacheMissCount ++;
+	tTVPScenarioCacheItem * item;
+	ttstr preloaded;
+	if(TVPScenarioPreloader && TVPScenarioPreloader->Take(storagename, preloaded))
+	{
+		TVPScenarioPreloadHitCount ++;
+		item = new tTVPScenarioCacheItem(storagename, false, &preloaded);
+	}
+	else
+	{
+		item = new tTVPScenarioCacheItem(storagename, false);
+	}
 	try
 	{
 		// push into scenario cache hash
 		tTVPScenarioCacheItemHolder holder(item);
 		TVPScenarioCache.AddWithHash(storagename, hash, holder);
+		TVPScenarioCacheTotalBytes += item->GetSize();
+		TVPCheckScenarioCacheLimit();
 	}
 	catch(...)
 	{
@@ -321,6 +1370,117 @@ tTVPScenarioCacheItem * TVPGetScenario(const ttstr & storagename, bool isstring)
 	return item;
 }
 //---------------------------------------------------------------------------
+static void TVPPreloadScenarioTargets(tTVPScenarioCacheItem *item)
+{
+	// request the preloader to read the storages which the scenario may
+	// jump to or call
+	if(!TVPScenarioPreloadEnabled) return;
+
+	std::vector<ttstr> storages;
+	if(!item->CollectStorageTargets(storages)) return;
+
+	for(std::vector<ttstr>::iterator i = storages.begin(); i != storages.end(); i++)
+	{
+		if(TVPScenarioCache.Find(*i)) continue; // already cached
+		if(!TVPScenarioPreloader)
+		{
+			TVPScenarioPreloader = new tTVPScenarioPreloader();
+			TVPScenarioPreloader->Resume();
+		}
+		TVPScenarioPreloader->Request(*i);
+	}
+}
+//---------------------------------------------------------------------------
+
+
+
+
+//---------------------------------------------------------------------------
+// tTVPKAGDictionaryImage
+//---------------------------------------------------------------------------
+class tTVPKAGDictionaryImageCallback : public tTJSDispatch
+{
+	// collects members into "Members", or compares members with "Compare"
+public:
+	std::vector<tTVPKAGDictionaryImage::tMember> *Members;
+	const std::vector<tTVPKAGDictionaryImage::tMember> *Compare;
+	tjs_uint Index;
+	bool Matched;
+
+	tTVPKAGDictionaryImageCallback() : Members(NULL), Compare(NULL),
+		Index(0), Matched(true) {;}
+
+	tjs_error TJS_INTF_METHOD FuncCall(tjs_uint32 flag, const tjs_char * membername,
+		tjs_uint32 *hint, tTJSVariant *result, tjs_int numparams,
+		tTJSVariant **param, iTJSDispatch2 *objthis)
+	{
+		// called from iTJSDispatch2::EnumMembers
+		if(numparams < 3) return TJS_E_BADPARAMCOUNT;
+
+		// hidden members are ignored, as Dictionary.assign does
+		tjs_uint32 flags = (tjs_int)*param[1];
+		if(!(flags & TJS_HIDDENMEMBER))
+		{
+			if(Members)
+			{
+				Members->push_back(tTVPKAGDictionaryImage::tMember());
+				tTVPKAGDictionaryImage::tMember &m = Members->back();
+				m.Name = param[0]->AsStringNoAddRef();
+				m.Flags = flags;
+				m.Value = *param[2];
+			}
+			else
+			{
+				if(Index >= Compare->size())
+				{
+					Matched = false;
+				}
+				else
+				{
+					const tTVPKAGDictionaryImage::tMember &m = (*Compare)[Index];
+					if(m.Flags != flags ||
+						!m.Value.DiscernCompareStrictReal(*param[2]) ||
+						m.Name != ttstr(param[0]->AsStringNoAddRef()))
+						Matched = false;
+				}
+				Index++;
+			}
+		}
+
+		if(result) *result = (tjs_int)Matched; // stop enumerating if mismatched
+		return TJS_S_OK;
+	}
+};
+//---------------------------------------------------------------------------
+tTVPKAGDictionaryImage::tTVPKAGDictionaryImage(iTJSDispatch2 *dic)
+{
+	RefCount = 1;
+	tTVPKAGDictionaryImageCallback callback;
+	callback.Members = &Members;
+	tTJSVariantClosure clo(&callback, NULL);
+	dic->EnumMembers(TJS_IGNOREPROP, &clo, dic);
+}
+//---------------------------------------------------------------------------
+bool tTVPKAGDictionaryImage::Matches(iTJSDispatch2 *dic) const
+{
+	tTVPKAGDictionaryImageCallback callback;
+	callback.Compare = &Members;
+	tTJSVariantClosure clo(&callback, NULL);
+	dic->EnumMembers(TJS_IGNOREPROP, &clo, dic);
+	return callback.Matched && callback.Index == Members.size();
+}
+//---------------------------------------------------------------------------
+void tTVPKAGDictionaryImage::AssignTo(iTJSDispatch2 *dic) const
+{
+	for(std::vector<tMember>::const_iterator i = Members.begin();
+		i != Members.end(); i++)
+	{
+		tTJSVariant val(i->Value);
+		dic->PropSetByVS(TJS_MEMBERENSURE|TJS_IGNOREPROP|i->Flags,
+			i->Name.AsVariantStringNoAddRef(), &val, dic);
+	}
+}
+//---------------------------------------------------------------------------
 
 
 
@@ -352,6 +1512,7 @@ tTJSNI_KAGParser::tTJSNI_KAGParser()
 	Interrupted = false;
 	MacroArgStackDepth = 0;
 	MacroArgStackBase = 0;
+	LastSnapshot = NULL;
 
 	// retrieve DictClear method and DictObj object
 	iTJSDispatch2 * dictclass;
@@ -406,6 +1567,7 @@ void TJS_INTF_METHOD tTJSNI_KAGParser::Invalidate()
 	if(DicClear) DicClear->Release();
 	if(DicObj) DicObj->Release();
 	if(Macros) Macros->Release();
+	if(LastSnapshot) LastSnapshot->Release(), LastSnapshot = NULL;
 
 	ClearMacroArgs();
 	ClearBuffer();
@@ -922,6 +2084,182 @@ void tTJSNI_KAGParser::Restore(iTJSDispatch2 *dic)
 	}
 }
 //---------------------------------------------------------------------------
+#define TVP_KAG_SNAPSHOT_VERSION 1
+static tjs_int32 TVPKAGSnapshotClassID = -1;
+//---------------------------------------------------------------------------
+tTJSNI_KAGParser::tSnapshot::tSnapshot()
+{
+	Version = TVP_KAG_SNAPSHOT_VERSION;
+	Macros = NULL;
+}
+//---------------------------------------------------------------------------
+tTJSNI_KAGParser::tSnapshot::~tSnapshot()
+{
+	if(Macros) Macros->Release();
+	for(std::vector<tTVPKAGDictionaryImage *>::iterator i = MacroArgs.begin();
+		i != MacroArgs.end(); i++)
+	{
+		(*i)->Release();
+	}
+}
+//---------------------------------------------------------------------------
+bool tTJSNI_KAGParser::tSnapshot::operator == (const tSnapshot &ref) const
+{
+	return Version == ref.Version && Macros == ref.Macros &&
+		MacroArgs == ref.MacroArgs &&
+		MacroArgStackBase == ref.MacroArgStackBase &&
+		CurLine == ref.CurLine && CurPos == ref.CurPos &&
+		LineBufferUsing == ref.LineBufferUsing &&
+		ExcludeLevel == ref.ExcludeLevel && IfLevel == ref.IfLevel &&
+		StorageName == ref.StorageName &&
+		StorageShortName == ref.StorageShortName &&
+		LineBuffer == ref.LineBuffer && CurLabel == ref.CurLabel &&
+		ExcludeLevelStack == ref.ExcludeLevelStack &&
+		IfLevelExecutedStack == ref.IfLevelExecutedStack &&
+		CallStack == ref.CallStack;
+}
+//---------------------------------------------------------------------------
+tTJSNI_KAGParser::tSnapshot * tTJSNI_KAGParser::GetSnapshot(iTJSDispatch2 *obj)
+{
+	if(!obj || TVPKAGSnapshotClassID == -1) return NULL;
+	tSnapshot *snap = NULL;
+	if(TJS_FAILED(obj->NativeInstanceSupport(TJS_NIS_GETINSTANCE,
+		TVPKAGSnapshotClassID, (iTJSNativeInstance**)&snap)))
+		return NULL;
+	return snap;
+}
+//---------------------------------------------------------------------------
+iTJSDispatch2 *tTJSNI_KAGParser::StoreSnapshot()
+{
+	// store current status into a native snapshot object.
+	// this stores the same status as Store does, but macros and macro
+	// arguments are shared with the last snapshot while they have the same
+	// members, and the last snapshot object itself is returned if nothing
+	// has changed since then. the snapshot can not be written to files;
+	// use Store for save data.
+	tSnapshot *last = GetSnapshot(LastSnapshot);
+
+	tSnapshot *snap = new tSnapshot();
+	try
+	{
+		// macros and macro arguments
+		if(last && last->Macros->Matches(Macros))
+			snap->Macros = last->Macros, snap->Macros->AddRef();
+		else
+			snap->Macros = new tTVPKAGDictionaryImage(Macros);
+
+		snap->MacroArgs.reserve(MacroArgStackDepth);
+		for(tjs_uint i = 0; i < MacroArgStackDepth; i++)
+		{
+			tTVPKAGDictionaryImage *image;
+			if(last && i < last->MacroArgs.size() &&
+				last->MacroArgs[i]->Matches(MacroArgs[i]))
+				image = last->MacroArgs[i], image->AddRef();
+			else
+				image = new tTVPKAGDictionaryImage(MacroArgs[i]);
+			snap->MacroArgs.push_back(image);
+		}
+		snap->MacroArgStackBase = MacroArgStackBase;
+
+		// other status; ( see Store for the members which are not stored )
+		snap->CallStack = CallStack;
+		snap->StorageName = StorageName;
+		snap->StorageShortName = StorageShortName;
+		snap->CurLine = CurLine;
+		snap->CurPos = CurPos;
+		snap->LineBuffer = LineBuffer;
+		snap->LineBufferUsing = LineBufferUsing;
+		snap->CurLabel = CurLabel;
+		snap->ExcludeLevel = ExcludeLevel;
+		snap->IfLevel = IfLevel;
+		snap->ExcludeLevelStack = ExcludeLevelStack;
+		snap->IfLevelExecutedStack = IfLevelExecutedStack;
+
+		if(last && *snap == *last)
+		{
+			// nothing has changed
+			delete snap;
+			LastSnapshot->AddRef();
+			return LastSnapshot;
+		}
+	}
+	catch(...)
+	{
+		delete snap;
+		throw;
+	}
+
+	if(TVPKAGSnapshotClassID == -1)
+		TVPKAGSnapshotClassID = TJSRegisterNativeClass(TJS_W("KAGParserSnapshot"));
+
+	iTJSDispatch2 *obj = TJSCreateCustomObject();
+	if(TJS_FAILED(obj->NativeInstanceSupport(TJS_NIS_REGISTER,
+		TVPKAGSnapshotClassID, (iTJSNativeInstance**)&snap)))
+	{
+		delete snap;
+		obj->Release();
+		TVPThrowInternalError;
+	}
+
+	obj->AddRef();
+	if(LastSnapshot) LastSnapshot->Release();
+	LastSnapshot = obj;
+	return obj;
+}
+//---------------------------------------------------------------------------
+void tTJSNI_KAGParser::RestoreSnapshot(iTJSDispatch2 *snapshot)
+{
+	// restore status from the snapshot object created by StoreSnapshot
+	tSnapshot *snap = GetSnapshot(snapshot);
+	if(!snap || snap->Version != TVP_KAG_SNAPSHOT_VERSION)
+		TVPThrowExceptionMessage(TVPKAGMalformedSaveData);
+
+	// restore macros; the dictionary is rebuilt only when it differs
+	if(!snap->Macros->Matches(Macros))
+	{
+		DicClear->FuncCall(0, NULL, NULL, NULL, 0, NULL, Macros);
+		snap->Macros->AssignTo(Macros);
+	}
+
+	// restore macro args
+	ClearMacroArgs();
+	for(std::vector<tTVPKAGDictionaryImage *>::iterator i = snap->MacroArgs.begin();
+		i != snap->MacroArgs.end(); i++)
+	{
+		iTJSDispatch2 *dsp = TJSCreateDictionaryObject();
+		MacroArgs.push_back(dsp);
+		(*i)->AssignTo(dsp);
+	}
+	MacroArgStackDepth = MacroArgs.size();
+	MacroArgStackBase = MacroArgs.size(); // later reset to MacroArgStackBase
+
+	// restore call stack, StorageName, StorageShortName, CurLabel
+	CallStack = snap->CallStack;
+	StorageName = snap->StorageName;
+	StorageShortName = snap->StorageShortName;
+	CurLabel = snap->CurLabel;
+
+	// load scenario
+	ttstr storage = StorageName, label = CurLabel;
+	ClearBuffer(); // ensure re-loading the scenario
+	LoadScenario(storage);
+	GoToLabel(label);
+
+	// ExcludeLevel, IfLevel, ExcludeLevelStack, IfLevelExecutedStack
+	ExcludeLevel = snap->ExcludeLevel;
+	IfLevel = snap->IfLevel;
+	ExcludeLevelStack = snap->ExcludeLevelStack;
+	IfLevelExecutedStack = snap->IfLevelExecutedStack;
+
+	// restore MacroArgStackBase
+	MacroArgStackBase = snap->MacroArgStackBase;
+
+	// later snapshots share the dictionary images with this one
+	snapshot->AddRef();
+	if(LastSnapshot) LastSnapshot->Release();
+	LastSnapshot = snapshot;
+}
+//---------------------------------------------------------------------------
 void tTJSNI_KAGParser::LoadScenario(const ttstr & name)
 {
 	// load scenario to buffer
@@ -956,6 +2294,7 @@ void tTJSNI_KAGParser::LoadScenario(const ttstr & name)
 		{
 			// else load from file
 			Scenario = TVPGetScenario(name, false);
+			TVPPreloadScenarioTargets(Scenario);
 		}
 
 		Lines = Scenario->GetLines();
@@ -1027,12 +2366,6 @@ void tTJSNI_KAGParser::BreakConditionAndMacro()
 		// clear macro argument down to current base stack position
 }
 //---------------------------------------------------------------------------
-static bool inline TVPIsWS(tjs_char ch)
-{
-	// is white space ?
-	return (ch == TJS_W(' ') || ch == TJS_W('\t'));
-}
-//---------------------------------------------------------------------------
 void tTJSNI_KAGParser::GoToLabel(const ttstr &name)
 {
 	// search label and set current position
@@ -1555,23 +2888,25 @@ parse_start:
 		bool condition = true;
 		TagLine = CurLine;
 		tjs_int tagstart = CurPos;
-		CurPos ++;
 
-		if(CurLineStr[CurPos] == 0) TVPThrowExceptionMessage(TVPKAGSyntaxError);
-
-		// tag name
-		while(TVPIsWS(CurLineStr[CurPos])) CurPos ++;
-		if(CurLineStr[CurPos] == 0) TVPThrowExceptionMessage(TVPKAGSyntaxError);
-		const tjs_char * tagnamestart = CurLineStr + CurPos;
-		while(CurLineStr[CurPos] && !TVPIsWS(CurLineStr[CurPos]) &&
-			CurLineStr[CurPos] != ldelim)
-				CurPos ++;
-
-		if(tagnamestart == CurLineStr + CurPos)
-			TVPThrowExceptionMessage(TVPKAGSyntaxError);
+		// tokenize the tag; tags in the scenario are tokenized only once,
+		// while tags in the line buffer are tokenized every time.
+		tTVPScenarioCacheItemHolder scenarioholder(Scenario);
+			// the scenario may be released by the event handlers
+		tTVPScenarioCacheItem::tTag linebuffertag;
+		const tTVPScenarioCacheItem::tTag *tokenized;
+		if(LineBufferUsing)
+		{
+			tTVPScenarioCacheItem::ParseTag(CurLineStr, tagstart, ldelim,
+				linebuffertag);
+			tokenized = &linebuffertag;
+		}
+		else
+		{
+			tokenized = &Scenario->GetTag(CurLine, tagstart, ldelim);
+		}
 
-		ttstr tagname(tagnamestart, CurLineStr + CurPos - tagnamestart);
-		tagname.ToLowerCase();
+		const ttstr tagname(tokenized->Name);
 		{
 
 			tTJSVariant tag_val(tagname);
@@ -1643,13 +2978,14 @@ parse_start:
 
 
 		// tag attributes
+		std::vector<tTVPScenarioCacheItem::tTagAttribute>::const_iterator
+			attrib = tokenized->Attributes.begin();
 		while(true)
 		{
-			while(TVPIsWS(CurLineStr[CurPos])) CurPos ++;
-
-			if(CurLineStr[CurPos] == ldelim)
+			if(attrib == tokenized->Attributes.end())
 			{
 				// tag ended
+				CurPos = tokenized->End;
 
 				bool ismacro = false;
 				ttstr macrocontent;
@@ -2066,11 +3402,8 @@ parse_start:
 				break;
 			}
 
-			if(CurLineStr[CurPos] == 0)
-				TVPThrowExceptionMessage(TVPKAGSyntaxError);
-
 			// attrib name
-			if(CurLineStr[CurPos] == TJS_W('*'))
+			if(attrib->Flags & tTVPScenarioCacheItem::tTagAttribute::aAllMacroArgs)
 			{
 				// macro entity all
 				if(!RecordingMacro)
@@ -2089,108 +3422,17 @@ parse_start:
 							// reset tag_name
 				}
 
-				CurPos++;
-				while(CurLineStr[CurPos] && TVPIsWS(CurLineStr[CurPos])) CurPos ++;
+				attrib++;
 				continue;
 			}
 
-			const tjs_char *attribnamestart = CurLineStr + CurPos;
-			while(CurLineStr[CurPos] && !TVPIsWS(CurLineStr[CurPos]) &&
-				CurLineStr[CurPos] != TJS_W('=') && CurLineStr[CurPos] != ldelim)
-					CurPos ++;
-
-			const tjs_char *attribnameend = CurLineStr + CurPos;
-
-			ttstr attribname(attribnamestart, attribnameend - attribnamestart);
-			attribname.ToLowerCase();
-
-			// =
-			while(TVPIsWS(CurLineStr[CurPos])) CurPos ++;
-
-			bool entity = false;
-			bool macroarg = false;
-			ttstr value;
-
-			if(CurLineStr[CurPos] != TJS_W('='))
-			{
-				// arrtibute value omitted
-				value = TJS_W("true"); // always true
-			}
-			else
-			{
-				if(CurLineStr[CurPos] == 0)
-					TVPThrowExceptionMessage(TVPKAGSyntaxError);
-				CurPos++;
-				if(CurLineStr[CurPos] == 0)
-					TVPThrowExceptionMessage(TVPKAGSyntaxError);
-				while(CurLineStr[CurPos] && TVPIsWS(CurLineStr[CurPos])) CurPos ++;
-				if(CurLineStr[CurPos] == 0)
-					TVPThrowExceptionMessage(TVPKAGSyntaxError);
-
-				// attrib value
-				tjs_char vdelim = 0; // value delimiter
-
-				if(CurLineStr[CurPos] == TJS_W('&'))
-					entity = true, CurPos++;
-				else if(CurLineStr[CurPos] == TJS_W('%'))
-					macroarg = true, CurPos++;
-
-				if(CurLineStr[CurPos] == TJS_W('\"') ||
-					CurLineStr[CurPos] == TJS_W('\''))
-				{
-					vdelim = CurLineStr[CurPos];
-					CurPos++;
-				}
-
-				const tjs_char *valuestart = CurLineStr + CurPos;
-
-				while(CurLineStr[CurPos] &&
-					(vdelim ? (CurLineStr[CurPos] != vdelim) :
-						(CurLineStr[CurPos] != ldelim &&
-							!TVPIsWS(CurLineStr[CurPos])) ) )
-				{
-					if(CurLineStr[CurPos] == TJS_W('`'))
-					{
-						// escaped with '`'
-						CurPos++;
-						if(CurLineStr[CurPos] == 0)
-							TVPThrowExceptionMessage(TVPKAGSyntaxError);
-					}
-					CurPos++;
-				}
-
-				if(ldelim != 0 && CurLineStr[CurPos] == 0)
-					TVPThrowExceptionMessage(TVPKAGSyntaxError);
-				const tjs_char *valueend = CurLineStr + CurPos;
-
-				if(vdelim) CurPos ++;
-
-				// unescape ` character of value
-				value = ttstr(valuestart, valueend - valuestart);
-				if(valueend != valuestart)
-				{
-					// value has at least one character
-					tjs_char * vp = value.Independ();
-					tjs_char * wvp = vp;
-
-					if(!entity && *vp == TJS_W('&')) entity = true, vp++;
-					if(!macroarg && *vp == TJS_W('%')) macroarg = true, vp++;
-
-					while(*vp)
-					{
-						if(*vp == TJS_W('`'))
-						{
-							vp++;
-							if(!*vp) break;
-						}
-						*wvp = *vp;
-						vp++;
-						wvp++;
-					}
-					*wvp = 0;
-					value.FixLen();
-				}
-			}
+			const ttstr &attribname = attrib->Name;
+			const ttstr &value = attrib->Value;
+			bool entity =
+				0 != (attrib->Flags & tTVPScenarioCacheItem::tTagAttribute::aEntity);
+			bool macroarg =
+				0 != (attrib->Flags & tTVPScenarioCacheItem::tTagAttribute::aMacroArg);
+			attrib++;
 
 			// special attibute processing
 			bool store = true;
@@ -2399,6 +3641,31 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/restore)
 }
 TJS_END_NATIVE_METHOD_DECL(/*func. name*/restore)
 //----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/storeSnapshot)
+{
+	TJS_GET_NATIVE_INSTANCE(/*var. name*/_this, /*var. type*/tTJSNI_KAGParser);
+
+	iTJSDispatch2 * dsp = _this->StoreSnapshot();
+	if(result) *result = tTJSVariant(dsp, dsp);
+	dsp->Release();
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_METHOD_DECL(/*func. name*/storeSnapshot)
+//----------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/restoreSnapshot)
+{
+	TJS_GET_NATIVE_INSTANCE(/*var. name*/_this, /*var. type*/tTJSNI_KAGParser);
+
+	if(numparams < 1) return TJS_E_BADPARAMCOUNT;
+	iTJSDispatch2 * dsp = param[0]->AsObjectNoAddRef();
+
+	_this->RestoreSnapshot(dsp);
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_METHOD_DECL(/*func. name*/restoreSnapshot)
+//----------------------------------------------------------------------
 TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/clearCallStack)
 {
 	TJS_GET_NATIVE_INSTANCE(/*var. name*/_this, /*var. type*/tTJSNI_KAGParser);
@@ -2643,6 +3910,90 @@ TJS_BEGIN_NATIVE_PROP_DECL(curLabel)
 }
 TJS_END_NATIVE_PROP_DECL(curLabel)
 //---------------------------------------------------------------------------
+TJS_BEGIN_NATIVE_PROP_DECL(scenarioCacheLimit)
+{
+	// total size of the scenario cache, in bytes
+	TJS_BEGIN_NATIVE_PROP_GETTER
+	{
+		*result = (tjs_int64)TVPGetScenarioCacheLimit();
+		return TJS_S_OK;
+	}
+	TJS_END_NATIVE_PROP_GETTER
+
+	TJS_BEGIN_NATIVE_PROP_SETTER
+	{
+		tjs_int64 limit = (tjs_int64)*param;
+		if(limit < 0) limit = 0;
+		TVPSetScenarioCacheLimit((tjs_uint64)limit);
+		return TJS_S_OK;
+	}
+	TJS_END_NATIVE_PROP_SETTER
+}
+TJS_END_NATIVE_STATIC_PROP_DECL(scenarioCacheLimit)
+//---------------------------------------------------------------------------
+TJS_BEGIN_NATIVE_PROP_DECL(scenarioPreload)
+{
+	// whether to read jump/call targets in background
+	TJS_BEGIN_NATIVE_PROP_GETTER
+	{
+		*result = TVPGetScenarioPreloadEnabled();
+		return TJS_S_OK;
+	}
+	TJS_END_NATIVE_PROP_GETTER
+
+	TJS_BEGIN_NATIVE_PROP_SETTER
+	{
+		TVPSetScenarioPreloadEnabled(param->operator bool());
+		return TJS_S_OK;
+	}
+	TJS_END_NATIVE_PROP_SETTER
+}
+TJS_END_NATIVE_STATIC_PROP_DECL(scenarioPreload)
+//---------------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/getScenarioCacheStatistics)
+{
+	// get the counters of the scenario cache
+	if(!result) return TJS_S_OK;
+
+	tTVPScenarioCacheStatistics stat;
+	TVPGetScenarioCacheStatistics(stat);
+
+	iTJSDispatch2 * dic = TJSCreateDictionaryObject();
+	try
+	{
+		tTJSVariant val;
+		val = (tjs_int64)stat.HitCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("hits"), NULL, &val, dic);
+		val = (tjs_int64)stat.MissCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("misses"), NULL, &val, dic);
+		val = (tjs_int64)stat.PreloadHitCount;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("preloadHits"), NULL, &val, dic);
+		val = (tjs_int64)stat.Count;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("count"), NULL, &val, dic);
+		val = (tjs_int64)stat.TotalBytes;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("bytes"), NULL, &val, dic);
+		val = (tjs_int64)stat.Limit;
+		dic->PropSet(TJS_MEMBERENSURE, TJS_W("limit"), NULL, &val, dic);
+		*result = tTJSVariant(dic, dic);
+	}
+	catch(...)
+	{
+		dic->Release();
+		throw;
+	}
+	dic->Release();
+
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/getScenarioCacheStatistics)
+//---------------------------------------------------------------------------
+TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/clearScenarioCache)
+{
+	TVPClearScnearioCache();
+	return TJS_S_OK;
+}
+TJS_END_NATIVE_STATIC_METHOD_DECL(/*func. name*/clearScenarioCache)
+//---------------------------------------------------------------------------
 
 //----------------------------------------------------------------------
 	TJS_END_NATIVE_MEMBERS
@@ -78,6 +78,15 @@ public:
 		memcpy(Buffer, ref.Buffer, BufferSize *sizeof(tjs_char));
 	}
 
+	tjs_char * Allocate(size_t size)
+	{
+		// allocate uninitialized buffer
+		Clear();
+		BufferSize = size;
+		Buffer = new tjs_char[BufferSize];
+		return Buffer;
+	}
+
 	void operator =(const tjs_char *ref)
 	{
 		Clear();
@@ -94,6 +103,8 @@ public:
 		return Buffer;
 	}
 
+	size_t GetSize() const { return BufferSize; }
+
 	operator tjs_char *()
 	{
 		return Buffer;
@@ -141,20 +152,68 @@ private:
 	tjs_int RefCount;
 
 public:
-	tTVPScenarioCacheItem(const ttstr & name, bool istring);
+	struct tTagAttribute
+	{
+		enum
+		{
+			aEntity = 1, // value is an expression entity ( '&' )
+			aMacroArg = 2, // value is a macro argument ( '%' )
+			aAllMacroArgs = 4 // '*' ; all macro arguments
+		};
+		ttstr Name; // lower-cased attribute name
+		ttstr Value; // attribute value ( '`' is already unescaped )
+		tjs_int Flags;
+	};
+
+	struct tTag
+	{
+		tjs_int Start; // position of '[' or '@'
+		tjs_int End; // position of the last delimiter
+		ttstr Name; // lower-cased tag name
+		std::vector<tTagAttribute> Attributes;
+	};
+
+private:
+	std::vector<tTag *> *LineTags; // tokenized tags for each line
+	bool StorageTargetsCollected;
+
+public:
+	tTVPScenarioCacheItem(const ttstr & name, bool istring,
+		const ttstr *preloaded = NULL);
 protected:
 	~tTVPScenarioCacheItem();
 public:
 	void AddRef();
 	void Release();
 private:
-	void LoadScenario(const ttstr & name, bool isstring);
+	void LoadScenario(const ttstr & name, bool isstring,
+		const ttstr *preloaded);
 		// load file or string to buffer
+	bool LoadCompiledScenario(const ttstr & filename, const tjs_uint8 digest[16]);
+		// load compiled scenario from the scenario cache folder
+	void SaveCompiledScenario(const ttstr & filename, const tjs_uint8 digest[16],
+		tjs_uint textlen);
+		// save compiled scenario into the scenario cache folder
 public:
 	const ttstr & GetLabelAliasFromLine(tjs_int line) const
 		{ return LabelAliases[line]; }
 	void EnsureLabelCache();
 
+	static void ParseTag(const tjs_char *line, tjs_int pos, tjs_char ldelim,
+		tTag &tag);
+		// tokenize a tag which starts at line[pos]
+	const tTag & GetTag(tjs_int line, tjs_int pos, tjs_char ldelim);
+		// get the tokenized tag; the tag is tokenized at the first time
+	void TokenizeAllTags();
+		// tokenize all tags in the scenario except inline scripts
+	bool CollectStorageTargets(std::vector<ttstr> &storages);
+		// get storages referenced by jump/call tags; returns false if
+		// already collected
+
+	size_t GetSize() const
+		{ return Buffer.GetSize() * sizeof(tjs_char) + LineCount * sizeof(tLine); }
+		// approximate memory size, without the tokenized tags
+
 	tLine * GetLines() const { return Lines; }
 	tjs_int GetLineCount() const { return LineCount; }
 	const tLabelCacheHash & GetLabelCache() const { return LabelCache; }
@@ -163,6 +222,45 @@ public:
 
 
 
+//---------------------------------------------------------------------------
+// tTVPKAGDictionaryImage
+//---------------------------------------------------------------------------
+/*
+	immutable copy of the members of a dictionary, which is shared between
+	the parser snapshots as long as the source dictionary has the same
+	members.
+*/
+class tTVPKAGDictionaryImage
+{
+public:
+	struct tMember
+	{
+		ttstr Name;
+		tjs_uint32 Flags;
+		tTJSVariant Value;
+	};
+
+private:
+	tjs_int RefCount;
+	std::vector<tMember> Members;
+
+public:
+	tTVPKAGDictionaryImage(iTJSDispatch2 *dic);
+
+	void AddRef() { RefCount++; }
+	void Release() { if(RefCount == 1) delete this; else RefCount--; }
+
+	bool Matches(iTJSDispatch2 *dic) const;
+		// whether "dic" has the same members in the same order
+	void AssignTo(iTJSDispatch2 *dic) const;
+		// copy members into "dic" ( "dic" is not cleared )
+
+	const std::vector<tMember> & GetMembers() const { return Members; }
+};
+//---------------------------------------------------------------------------
+
+
+
 //---------------------------------------------------------------------------
 // tTJSNI_KAGParser
 //---------------------------------------------------------------------------
@@ -218,9 +316,53 @@ private:
 			MacroArgStackDepth(macroargstackdepth),
 			ExcludeLevelStack(excludelevelstack), ExcludeLevel(excludelevel),
 			IfLevelExecutedStack(iflevelexecutedstack), IfLevel(iflevel) {;}
+
+		bool operator == (const tCallStackData &ref) const
+		{
+			return Offset == ref.Offset && Pos == ref.Pos &&
+				LineBufferUsing == ref.LineBufferUsing &&
+				MacroArgStackBase == ref.MacroArgStackBase &&
+				MacroArgStackDepth == ref.MacroArgStackDepth &&
+				ExcludeLevel == ref.ExcludeLevel && IfLevel == ref.IfLevel &&
+				Storage == ref.Storage && Label == ref.Label &&
+				OrgLineStr == ref.OrgLineStr && LineBuffer == ref.LineBuffer &&
+				ExcludeLevelStack == ref.ExcludeLevelStack &&
+				IfLevelExecutedStack == ref.IfLevelExecutedStack;
+		}
 	};
 	std::vector<tCallStackData> CallStack;
 
+	class tSnapshot : public tTJSNativeInstance
+	{
+		// native snapshot of the parser status, see StoreSnapshot
+	public:
+		tjs_uint Version;
+		tTVPKAGDictionaryImage * Macros;
+		std::vector<tTVPKAGDictionaryImage *> MacroArgs;
+		tjs_uint MacroArgStackBase;
+		std::vector<tCallStackData> CallStack;
+		ttstr StorageName;
+		ttstr StorageShortName;
+		tjs_int CurLine;
+		tjs_int CurPos;
+		ttstr LineBuffer;
+		bool LineBufferUsing;
+		ttstr CurLabel;
+		tjs_int ExcludeLevel;
+		tjs_int IfLevel;
+		std::vector<tjs_int> ExcludeLevelStack;
+		std::vector<bool> IfLevelExecutedStack;
+
+		tSnapshot();
+		~tSnapshot();
+
+		bool operator == (const tSnapshot &ref) const;
+			// dictionary images are compared by reference
+	};
+	iTJSDispatch2 * LastSnapshot; // the snapshot object stored last
+	static tSnapshot * GetSnapshot(iTJSDispatch2 *obj);
+		// returns NULL if "obj" is not a snapshot object
+
 	tTVPScenarioCacheItem * Scenario;
 	tTVPScenarioCacheItem::tLine * Lines; // is copied from Scenario
 	tjs_int LineCount; // is copied from Scenario
@@ -258,6 +400,8 @@ public:
 	void operator = (const tTJSNI_KAGParser & ref);
 	iTJSDispatch2 *Store();
 	void Restore(iTJSDispatch2 *dic);
+	iTJSDispatch2 *StoreSnapshot();
+	void RestoreSnapshot(iTJSDispatch2 *snapshot);
 
 	void Clear(); // clear all states
 
@@ -330,6 +474,26 @@ public:
 
 };
 
+//---------------------------------------------------------------------------
+// scenario cache
+//---------------------------------------------------------------------------
+struct tTVPScenarioCacheStatistics
+{
+	tjs_uint HitCount;
+	tjs_uint MissCount;
+	tjs_uint PreloadHitCount; // misses which used the preloaded text
+	tjs_uint Count;
+	tjs_uint64 TotalBytes;
+	tjs_uint64 Limit;
+};
+extern void TVPClearScnearioCache();
+extern void TVPSetScenarioCacheLimit(tjs_uint64 limit);
+extern tjs_uint64 TVPGetScenarioCacheLimit();
+extern void TVPSetScenarioPreloadEnabled(bool b);
+extern bool TVPGetScenarioPreloadEnabled();
+extern void TVPGetScenarioCacheStatistics(tTVPScenarioCacheStatistics &stat);
+//---------------------------------------------------------------------------
+
 extern iTJSDispatch2 * TVPCreateNativeClass_KAGParser();
 
 #if 0
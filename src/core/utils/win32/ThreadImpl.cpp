@@ -61,9 +61,10 @@ tTVPThread::~tTVPThread()
 void * tTVPThread::StartProc(void * arg)
 {
 	tTVPThread* _this = ((tTVPThread*)arg);
-	if (_this->Suspended) {
+	{
+		// Resume() may be called before waiting
 		std::unique_lock<std::mutex> lk(_this->_mutex);
-		_this->_cond.wait(lk);
+		while (_this->Suspended) _this->_cond.wait(lk);
 	}
 	_this->Execute();
 	return nullptr;
@@ -122,7 +123,10 @@ void tTVPThread::SetPriority(tTVPThreadPriority pri)
 //---------------------------------------------------------------------------
 void tTVPThread::Resume()
 {
-	Suspended = false;
+	{
+		std::lock_guard<std::mutex> lk(_mutex);
+		Suspended = false;
+	}
 	_cond.notify_one();
 	//while((tjs_int32)ResumeThread(Handle) > 1) ;
 }
@@ -139,20 +143,29 @@ void tTVPThread::Resume()
 //---------------------------------------------------------------------------
 void tTVPThreadEvent::Set()
 {
+	{
+		std::lock_guard<std::mutex> lk(Mutex);
+		Signaled = true;
+	}
 	Handle.notify_one();
 }
 //---------------------------------------------------------------------------
-void tTVPThreadEvent::WaitFor(tjs_uint timeout)
+bool tTVPThreadEvent::WaitFor(tjs_uint timeout)
 {
 	// wait for event;
 	// returns true if the event is set, otherwise (when timed out) returns false.
+	// timeout == (tjs_uint)-1 waits infinitely.
 
 	std::unique_lock<std::mutex> lk(Mutex);
 	if (timeout != (tjs_uint)-1) {
-		Handle.wait_for(lk, std::chrono::milliseconds(timeout));
+		Handle.wait_for(lk, std::chrono::milliseconds(timeout),
+			[this] { return Signaled; });
 	} else {
-		Handle.wait(lk);
+		Handle.wait(lk, [this] { return Signaled; });
 	}
+	bool signaled = Signaled;
+	Signaled = false;
+	return signaled;
 #if 0
 	DWORD state = WaitForSingleObject(Handle, timeout == 0 ? INFINITE : timeout);
 
@@ -63,12 +63,17 @@ public:
 //---------------------------------------------------------------------------
 class tTVPThreadEvent
 {
+	// an auto-reset event; a Set() which comes while nobody waits is kept
+	// until the next WaitFor().
 	std::condition_variable Handle;
 	std::mutex Mutex;
+	bool Signaled;
 
 public:
+	tTVPThreadEvent() : Signaled(false) {}
+
 	void Set();
-	void WaitFor(tjs_uint timeout);
+	bool WaitFor(tjs_uint timeout);
 };
 //---------------------------------------------------------------------------
 
@@ -39,8 +39,14 @@ class tTVPTimerThread : public tTVPThread
 	// normal Windows timer cannot call the timer callback routine at
 	// too short interval ( roughly less than 50ms ).
 
-	std::vector<tTJSNI_Timer *> List;
+	// enabled timers are kept in a binary min-heap ordered by the next tick;
+	// each timer knows its position in the heap ( tTJSNI_Timer::HeapIndex ),
+	// so adding, removing and rescheduling a timer is O(log n) and the
+	// thread only looks at the timers which are due.
+	std::vector<tTJSNI_Timer *> Heap;
+	tjs_uint Count; // count of the timer objects
 	std::vector<tTJSNI_Timer *> Pending; // timer object which has pending events
+		// removed items are left as NULL until the pending events are fired
 	bool PendingEventsAvailable;
 	tTVPThreadEvent Event;
 	
@@ -64,6 +70,13 @@ private:
 	void RemoveFromPendingItem(tTJSNI_Timer *item);
 	void RegisterToPendingItem(tTJSNI_Timer *item);
 
+	void Schedule(tTJSNI_Timer *item);
+	void Unschedule(tTJSNI_Timer *item);
+	void HeapUp(tjs_int index);
+	void HeapDown(tjs_int index);
+	void HeapSet(tjs_int index, tTJSNI_Timer *item)
+		{ Heap[index] = item; item->HeapIndex = index; }
+
 public:
 	void SetEnabled(tTJSNI_Timer *item, bool enabled); // managed by this class
 	void SetInterval(tTJSNI_Timer *item, tjs_uint64 interval); // managed by this class
@@ -82,6 +95,7 @@ public:
 //---------------------------------------------------------------------------
 tTVPTimerThread::tTVPTimerThread() : tTVPThread(true), EventQueue(this,&tTVPTimerThread::Proc)
 {
+	Count = 0;
 	PendingEventsAvailable = false;
 	SetPriority(TVPLimitTimerCapacity ? ttpNormal : ttpHighest);
 	EventQueue.Allocate();
@@ -101,7 +115,6 @@ void tTVPTimerThread::Execute()
 {
 	while(!GetTerminated())
 	{
-		tjs_uint64 step_next = (tjs_uint64)(tjs_int64)-1L; // invalid value
 		tjs_uint64 curtick = TVPGetTickCount() << TVP_SUBMILLI_FRAC_BITS;
 		tjs_uint32 sleeptime;
 
@@ -110,49 +123,36 @@ void tTVPTimerThread::Execute()
 
 			bool any_triggered = false;
 
-			std::vector<tTJSNI_Timer*>::iterator i;
-			for(i = List.begin(); i!=List.end(); i ++)
+			// trigger all timers which are due; they are processed in one
+			// wakeup in the order of their ticks.
+			while(Heap.size() && Heap[0]->GetNextTick() < curtick)
 			{
-				tTJSNI_Timer * item = *i;
-
-				if(!item->GetEnabled() || item->GetInterval() == 0) continue;
-
-				if(item->GetNextTick() < curtick)
-				{
-					tjs_uint n = static_cast<tjs_uint>( (curtick - item->GetNextTick()) / item->GetInterval() );
-					n++;
-					if(n > 40)
-					{
-						// too large amount of event at once; discard rest
-						item->Trigger(1);
-						any_triggered = true;
-						item->SetNextTick(curtick + item->GetInterval());
-					}
-					else
-					{
-						item->Trigger(n);
-						any_triggered = true;
-						item->SetNextTick(item->GetNextTick() +
-							n * item->GetInterval());
-					}
-				}
+				tTJSNI_Timer * item = Heap[0];
 
-
-				tjs_uint64 to_next = item->GetNextTick() - curtick;
-
-				if(step_next == (tjs_uint64)(tjs_int64)-1L)
+				tjs_uint n = static_cast<tjs_uint>( (curtick - item->GetNextTick()) / item->GetInterval() );
+				n++;
+				if(n > 40)
 				{
-					step_next = to_next;
+					// too large amount of event at once; discard rest
+					item->Trigger(1);
+					any_triggered = true;
+					item->SetNextTick(curtick + item->GetInterval());
 				}
 				else
 				{
-					if(step_next > to_next) step_next = to_next;
+					item->Trigger(n);
+					any_triggered = true;
+					item->SetNextTick(item->GetNextTick() +
+						n * item->GetInterval());
 				}
-			}
 
+				HeapDown(0); // the next tick is now later than curtick
+			}
 
-			if(step_next != (tjs_uint64)(tjs_int64)-1L)
+			if(Heap.size())
 			{
+				tjs_uint64 step_next = Heap[0]->GetNextTick() - curtick;
+
 				// too large step_next must be diminished to size of DWORD.
 				if(step_next >= 0x80000000)
 					sleeptime = 0x7fffffff; // smaller value than step_next is OK
@@ -164,8 +164,6 @@ void tTVPTimerThread::Execute()
 				sleeptime = INFINITE;
 			}
 
-			if(List.size() == 0) sleeptime = INFINITE;
-
 			if(any_triggered)
 			{
 				// triggered; post notification message to the UtilWindow
@@ -206,6 +204,8 @@ void tTVPTimerThread::Proc( NativeEvent& ev )
 		for(i = Pending.begin(); i!=Pending.end(); i ++)
 		{
 			tTJSNI_Timer * item = *i;
+			if(!item) continue; // removed
+			item->PendingIndex = -1;
 			item->FirePendingEventsAndClear();
 		}
 
@@ -222,35 +222,39 @@ void tTVPTimerThread::AddItem(tTJSNI_Timer * item)
 {
 	tTJSCriticalSectionHolder holder(TVPTimerCS);
 
-	if(std::find(List.begin(), List.end(), item) == List.end())
-		List.push_back(item);
+	if(!item->Registered)
+	{
+		item->Registered = true;
+		Count++;
+	}
+	if(item->GetEnabled()) Schedule(item);
 }
 //---------------------------------------------------------------------------
 bool tTVPTimerThread::RemoveItem(tTJSNI_Timer *item)
 {
 	tTJSCriticalSectionHolder holder(TVPTimerCS);
 
-	std::vector<tTJSNI_Timer *>::iterator i;
-
-	// remove from the List
-	for(i = List.begin(); i != List.end(); /**/)
+	// remove from the heap
+	Unschedule(item);
+	if(item->Registered)
 	{
-		if(*i == item) i = List.erase(i); else i++;
+		item->Registered = false;
+		Count--;
 	}
 
 	// also remove from the Pending list
 	RemoveFromPendingItem(item);
 
-	return List.size() != 0;
+	return Count != 0;
 }
 //---------------------------------------------------------------------------
 void tTVPTimerThread::RemoveFromPendingItem(tTJSNI_Timer *item)
 {
 	// remove item from pending list
- 	std::vector<tTJSNI_Timer *>::iterator i;
-	for(i = Pending.begin(); i != Pending.end(); /**/)
+	if(item->PendingIndex >= 0)
 	{
-		if(*i == item) i = Pending.erase(i); else i++;
+		Pending[item->PendingIndex] = NULL;
+		item->PendingIndex = -1;
 	}
 
 	item->ZeroPendingCount();
@@ -259,9 +263,76 @@ void tTVPTimerThread::RemoveFromPendingItem(tTJSNI_Timer *item)
 void tTVPTimerThread::RegisterToPendingItem(tTJSNI_Timer *item)
 {
 	// register item to the pending list
+	if(item->PendingIndex >= 0) return; // already listed
+	item->PendingIndex = (tjs_int)Pending.size();
 	Pending.push_back(item);
 }
 //---------------------------------------------------------------------------
+void tTVPTimerThread::Schedule(tTJSNI_Timer *item)
+{
+	// put the item into the heap, or move it to the proper position after
+	// its next tick is changed.
+	if(!item->GetEnabled() || item->GetInterval() == 0)
+	{
+		Unschedule(item);
+		return;
+	}
+
+	if(item->HeapIndex < 0)
+	{
+		Heap.push_back(item);
+		item->HeapIndex = (tjs_int)Heap.size() - 1;
+	}
+	HeapUp(item->HeapIndex);
+	HeapDown(item->HeapIndex);
+}
+//---------------------------------------------------------------------------
+void tTVPTimerThread::Unschedule(tTJSNI_Timer *item)
+{
+	tjs_int index = item->HeapIndex;
+	if(index < 0) return;
+	item->HeapIndex = -1;
+
+	tTJSNI_Timer *last = Heap.back();
+	Heap.pop_back();
+	if(last == item) return;
+
+	HeapSet(index, last);
+	HeapUp(index);
+	HeapDown(last->HeapIndex);
+}
+//---------------------------------------------------------------------------
+void tTVPTimerThread::HeapUp(tjs_int index)
+{
+	tTJSNI_Timer *item = Heap[index];
+	while(index > 0)
+	{
+		tjs_int parent = (index - 1) / 2;
+		if(!(item->GetNextTick() < Heap[parent]->GetNextTick())) break;
+		HeapSet(index, Heap[parent]);
+		index = parent;
+	}
+	HeapSet(index, item);
+}
+//---------------------------------------------------------------------------
+void tTVPTimerThread::HeapDown(tjs_int index)
+{
+	tTJSNI_Timer *item = Heap[index];
+	tjs_int count = (tjs_int)Heap.size();
+	while(true)
+	{
+		tjs_int child = index * 2 + 1;
+		if(child >= count) break;
+		if(child + 1 < count &&
+			Heap[child + 1]->GetNextTick() < Heap[child]->GetNextTick())
+			child++;
+		if(!(Heap[child]->GetNextTick() < item->GetNextTick())) break;
+		HeapSet(index, Heap[child]);
+		index = child;
+	}
+	HeapSet(index, item);
+}
+//---------------------------------------------------------------------------
 void tTVPTimerThread::SetEnabled(tTJSNI_Timer *item, bool enabled)
 {
 	{ // thread-protected
@@ -277,6 +348,7 @@ void tTVPTimerThread::SetEnabled(tTJSNI_Timer *item, bool enabled)
 			item->CancelEvents();
 			item->ZeroPendingCount();
 		}
+		Schedule(item);
 	} // end-of-thread-protected
 
 	if(enabled) Event.Set();
@@ -294,6 +366,7 @@ void tTVPTimerThread::SetInterval(tTJSNI_Timer *item, tjs_uint64 interval)
 			item->ZeroPendingCount();
 			item->SetNextTick((TVPGetTickCount()  << TVP_SUBMILLI_FRAC_BITS) + item->GetInterval());
 		}
+		Schedule(item);
 	} // end-of-thread-protected
 
 	if(item->GetEnabled()) Event.Set();
@@ -369,6 +442,9 @@ tTJSNI_Timer::tTJSNI_Timer()
 	Interval = 1000;
 	PendingCount = 0;
 	Enabled = false;
+	Registered = false;
+	HeapIndex = -1;
+	PendingIndex = -1;
 }
 //---------------------------------------------------------------------------
 tjs_error TJS_INTF_METHOD tTJSNI_Timer::Construct(tjs_int numparams,
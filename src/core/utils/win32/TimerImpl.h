@@ -27,6 +27,11 @@ class tTJSNI_Timer : public tTJSNI_BaseTimer
 	tjs_int PendingCount;
 	bool Enabled;
 
+	// managed by tTVPTimerThread
+	bool Registered; // added to the timer thread
+	tjs_int HeapIndex; // index in the deadline heap; -1 if not scheduled
+	tjs_int PendingIndex; // index in the pending list; -1 if not listed
+
 public:
 	tTJSNI_Timer();
 	tjs_error TJS_INTF_METHOD Construct(tjs_int numparams, tTJSVariant **param,
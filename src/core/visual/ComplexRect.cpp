@@ -212,6 +212,16 @@ void tTVPComplexRect::Clear()
 	Init();
 }
 //---------------------------------------------------------------------------
+void tTVPComplexRect::Swap(tTVPComplexRect &ref)
+{
+	// exchange the rectangle chains; no rectangle is copied
+	std::swap(Head, ref.Head);
+	std::swap(Current, ref.Current);
+	std::swap(Count, ref.Count);
+	std::swap(Bound, ref.Bound);
+	std::swap(BoundValid, ref.BoundValid);
+}
+//---------------------------------------------------------------------------
 void tTVPComplexRect::FreeAllRectangles()
 {
 	// free all rectangles
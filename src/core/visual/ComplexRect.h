@@ -295,6 +295,7 @@ public: // constructors and destructors
 
 public: // storage management
 	void Clear();
+	void Swap(tTVPComplexRect &ref); // exchange contents with ref
 
 private: // storage management
 	void FreeAllRectangles(); // free all rectangles
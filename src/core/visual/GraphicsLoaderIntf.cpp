@@ -35,8 +35,10 @@
 #include "Application.h"
 #include "BitmapIntf.h"
 #include "GraphicsLoadThread.h"
+#include "CharacterSet.h"
 #include <complex>
 #include <list>
+#include <algorithm>
 
 static void TVPLoadGraphicRouter(void* formatdata, void *callbackdata, tTVPGraphicSizeCallback sizecallback,
 	tTVPGraphicScanLineCallback scanlinecallback, tTVPMetaInfoPushCallback metainfopushcallback,
@@ -168,6 +170,8 @@ public:
 			TJS_W(".bpg"), TVPLoadGraphicRouter, TVPLoadHeaderRouter, nullptr, nullptr, NULL));
 		Handlers.push_back(tTVPGraphicHandlerType(
 			TJS_W(".webp"), TVPLoadGraphicRouter, TVPLoadHeaderRouter, nullptr, nullptr, NULL));
+		Handlers.push_back(tTVPGraphicHandlerType(
+			TJS_W(".dimg"), TVPLoadDeltaImage, TVPLoadHeaderDeltaImage, nullptr, nullptr, NULL));
 		ReCreateHash();
 		Avail = true;
 	}
@@ -1470,6 +1474,8 @@ tjs_uint64 TVPGetGraphicCacheTotalBytes() {
 	return TVPGraphicCacheTotalBytes;
 }
 //---------------------------------------------------------------------------
+static bool TVPChopDeltaImageBaseCache();
+static void TVPClearDeltaImageBaseCache();
 static void TVPCheckGraphicCacheLimit()
 {
 	while(TVPGraphicCacheTotalBytes > TVPGraphicCacheLimit)
@@ -1483,7 +1489,7 @@ static void TVPCheckGraphicCacheLimit()
 			TVPGraphicCacheTotalBytes -= size;
 			TVPGraphicCache.ChopLast(1);
 		}
-		else
+		else if(!TVPChopDeltaImageBaseCache())
 		{
 			break;
 		}
@@ -1492,6 +1498,7 @@ static void TVPCheckGraphicCacheLimit()
 //---------------------------------------------------------------------------
 void TVPClearGraphicCache()
 {
+	TVPClearDeltaImageBaseCache();
 	TVPGraphicCache.Clear();
 	TVPGraphicCacheTotalBytes = 0;
 }
@@ -1830,6 +1837,306 @@ static tTVPBitmap* TVPInternalLoadGraphic(const ttstr &_name,
 	return data.Dest;
 }
 //---------------------------------------------------------------------------
+// delta image container (.dimg)
+//---------------------------------------------------------------------------
+// a delta image is an utf-8 text which describes an image as a base image
+// and a list of patch images which overwrite rectangles of the base:
+//   base = <storage>
+//   patch = <x>, <y>, <storage>
+// lines beginning with '#' or ';' are comments.
+// recently used bases are kept decoded, so that expression variants of the
+// same character decode only their patches.
+// a base or a patch may be a delta image itself, up to
+// TVP_DELTA_IMAGE_MAX_DEPTH levels; an image which refers back to itself is
+// an error.
+//---------------------------------------------------------------------------
+#define TVP_DELTA_IMAGE_MAX_DEPTH 8
+//---------------------------------------------------------------------------
+struct tTVPDeltaImagePatch
+{
+	tjs_int X;
+	tjs_int Y;
+	ttstr Name;
+};
+//---------------------------------------------------------------------------
+static void TVPTrimDeltaImageToken(const tjs_char *&start, const tjs_char *&end)
+{
+	while(start < end && *start <= 0x20) start++;
+	while(start < end && end[-1] <= 0x20) end--;
+}
+//---------------------------------------------------------------------------
+static void TVPParseDeltaImage(tTJSBinaryStream *src, ttstr &base,
+	std::vector<tTVPDeltaImagePatch> &patches)
+{
+	tjs_uint size = (tjs_uint)(src->GetSize() - src->GetPosition());
+	std::vector<char> buf(size + 1);
+	if(size) src->ReadBuffer(&buf[0], size);
+	buf[size] = 0;
+
+	const char *text = &buf[0];
+	if(size >= 3 && !memcmp(text, "\xef\xbb\xbf", 3)) text += 3; // skip BOM
+	tjs_int len = TVPUtf8ToWideCharString(text, NULL);
+	if(len < 0)
+		TVPThrowExceptionMessage(TVPImageLoadError, TJS_W("Invalid delta image"));
+	std::vector<tjs_char> wbuf(len + 1);
+	TVPUtf8ToWideCharString(text, &wbuf[0]);
+	wbuf[len] = 0;
+
+	const tjs_char *p = &wbuf[0];
+	const tjs_char *lim = p + len;
+	while(p < lim)
+	{
+		const tjs_char *ls = p;
+		while(p < lim && *p != TJS_W('\n')) p++;
+		const tjs_char *le = p;
+		if(p < lim) p++;
+
+		TVPTrimDeltaImageToken(ls, le);
+		if(ls == le || *ls == TJS_W('#') || *ls == TJS_W(';')) continue;
+
+		const tjs_char *eq = ls;
+		while(eq < le && *eq != TJS_W('=')) eq++;
+		if(eq == le)
+			TVPThrowExceptionMessage(TVPImageLoadError, TJS_W("Invalid delta image"));
+		const tjs_char *ks = ls, *ke = eq;
+		const tjs_char *vs = eq + 1, *ve = le;
+		TVPTrimDeltaImageToken(ks, ke);
+		TVPTrimDeltaImageToken(vs, ve);
+		ttstr key(ks, (int)(ke - ks));
+		key.ToLowerCase();
+
+		if(key == TJS_W("base"))
+		{
+			base = ttstr(vs, (int)(ve - vs));
+		}
+		else if(key == TJS_W("patch"))
+		{
+			// x, y, storage ( the storage name may contain commas )
+			const tjs_char *c1 = vs;
+			while(c1 < ve && *c1 != TJS_W(',')) c1++;
+			const tjs_char *c2 = c1 < ve ? c1 + 1 : ve;
+			while(c2 < ve && *c2 != TJS_W(',')) c2++;
+			if(c2 == ve)
+				TVPThrowExceptionMessage(TVPImageLoadError, TJS_W("Invalid delta image"));
+			const tjs_char *ns = c2 + 1, *ne = ve;
+			TVPTrimDeltaImageToken(ns, ne);
+
+			tTVPDeltaImagePatch patch;
+			patch.X = TJS_atoi(ttstr(vs, (int)(c1 - vs)).c_str());
+			patch.Y = TJS_atoi(ttstr(c1 + 1, (int)(c2 - c1 - 1)).c_str());
+			patch.Name = ttstr(ns, (int)(ne - ns));
+			patches.push_back(patch);
+		}
+	}
+
+	if(base.IsEmpty())
+		TVPThrowExceptionMessage(TVPImageLoadError, TJS_W("Invalid delta image"));
+}
+//---------------------------------------------------------------------------
+// tTVPDeltaImageLoadGuard : detects recursive references of delta images
+//---------------------------------------------------------------------------
+class tTVPDeltaImageLoadGuard
+{
+	// storages of the bases and the patches being decoded by this thread
+	static thread_local std::vector<ttstr> Loading;
+
+public:
+	tTVPDeltaImageLoadGuard(const ttstr &nname)
+	{
+		if(Loading.size() >= TVP_DELTA_IMAGE_MAX_DEPTH ||
+			std::find(Loading.begin(), Loading.end(), nname) != Loading.end())
+			TVPThrowExceptionMessage(TVPImageLoadError,
+				TJS_W("Recursive delta image: ") + nname);
+		Loading.push_back(nname);
+	}
+	~tTVPDeltaImageLoadGuard() { Loading.pop_back(); }
+};
+thread_local std::vector<ttstr> tTVPDeltaImageLoadGuard::Loading;
+//---------------------------------------------------------------------------
+static tTVPBitmap * TVPLoadDeltaImagePart(const ttstr &nname,
+	tTVPGraphicLoadMode mode)
+{
+	// decodes a base or a patch of a delta image
+	tTVPDeltaImageLoadGuard guard(nname);
+	std::vector<tTVPGraphicMetaInfoPair> * mi = NULL;
+	tTVPBitmap *bmp = TVPInternalLoadGraphic(nname, TVP_clNone, 0, 0, &mi, mode, NULL);
+	if(mi) delete mi;
+	return bmp;
+}
+//---------------------------------------------------------------------------
+// tTVPDeltaImageBaseCache : keeps recently used base images decoded
+//---------------------------------------------------------------------------
+// handlers may run on the async image loading thread, so the bases are
+// decoded through TVPInternalLoadGraphic (no texture is created) and every
+// reference count operation on them is done under the lock.
+// the bases are counted in TVPGraphicCacheTotalBytes and are dropped, least
+// recently used first, when the graphic cache exceeds its limit.
+class tTVPDeltaImageBaseCache
+{
+	struct tItem
+	{
+		ttstr Name;
+		tTVPGraphicLoadMode Mode;
+		tTVPBitmap *Bitmap;
+		tjs_uint Size;
+	};
+	std::list<tItem> Items; // most recently used first
+	tTJSCriticalSection CS;
+
+	void ChopLastNoLock()
+	{
+		TVPGraphicCacheTotalBytes -= Items.back().Size;
+		Items.back().Bitmap->Release();
+		Items.pop_back();
+	}
+
+public:
+	~tTVPDeltaImageBaseCache() { Clear(); }
+
+	tTVPBitmap * Get(const ttstr &name, tTVPGraphicLoadMode mode)
+	{
+		// returns the base with a reference added; give it back by Release().
+		ttstr nname = TVPNormalizeStorageName(name);
+		{
+			tTJSCriticalSectionHolder holder(CS);
+			for(std::list<tItem>::iterator i = Items.begin(); i != Items.end(); i++)
+			{
+				if(i->Mode == mode && i->Name == nname)
+				{
+					Items.splice(Items.begin(), Items, i);
+					i->Bitmap->AddRef();
+					return i->Bitmap;
+				}
+			}
+		}
+
+		tTVPBitmap *bmp = TVPLoadDeltaImagePart(nname, mode);
+
+		tTJSCriticalSectionHolder holder(CS);
+		tItem item;
+		item.Name = nname;
+		item.Mode = mode;
+		item.Bitmap = bmp;
+		item.Size = bmp->GetWidth() * bmp->GetHeight() * bmp->GetBPP() / 8;
+		Items.push_front(item);
+		bmp->AddRef();
+		TVPGraphicCacheTotalBytes += item.Size;
+		while(!Items.empty() && (!TVPGraphicCacheEnabled ||
+			TVPGraphicCacheTotalBytes > TVPGraphicCacheLimit))
+			ChopLastNoLock();
+		return bmp;
+	}
+
+	bool ChopLast()
+	{
+		// drops the least recently used base; returns false if empty
+		tTJSCriticalSectionHolder holder(CS);
+		if(Items.empty()) return false;
+		ChopLastNoLock();
+		return true;
+	}
+
+	void Release(tTVPBitmap *bmp)
+	{
+		tTJSCriticalSectionHolder holder(CS);
+		bmp->Release();
+	}
+
+	void Clear()
+	{
+		tTJSCriticalSectionHolder holder(CS);
+		while(!Items.empty()) ChopLastNoLock();
+	}
+} static TVPDeltaImageBaseCache;
+//---------------------------------------------------------------------------
+static bool TVPChopDeltaImageBaseCache()
+{
+	return TVPDeltaImageBaseCache.ChopLast();
+}
+//---------------------------------------------------------------------------
+static void TVPClearDeltaImageBaseCache()
+{
+	TVPDeltaImageBaseCache.Clear();
+}
+//---------------------------------------------------------------------------
+void TVPLoadDeltaImage(void* formatdata, void *callbackdata, tTVPGraphicSizeCallback sizecallback,
+	tTVPGraphicScanLineCallback scanlinecallback, tTVPMetaInfoPushCallback metainfopushcallback,
+	tTJSBinaryStream *src, tjs_int keyidx, tTVPGraphicLoadMode mode)
+{
+	ttstr basename;
+	std::vector<tTVPDeltaImagePatch> patchdescs;
+	TVPParseDeltaImage(src, basename, patchdescs);
+
+	tjs_uint pixelbytes = mode == glmNormal ? 4 : 1;
+
+	tTVPBitmap *base = TVPDeltaImageBaseCache.Get(basename, mode);
+	std::vector<tTVPBitmap *> patches;
+	try
+	{
+		if(base->GetBPP() != pixelbytes * 8)
+			TVPThrowExceptionMessage(TVPImageLoadError, basename);
+
+		// only the patches are decoded here
+		for(std::vector<tTVPDeltaImagePatch>::iterator i = patchdescs.begin();
+			i != patchdescs.end(); i++)
+		{
+			tTVPBitmap *bmp = TVPLoadDeltaImagePart(
+				TVPNormalizeStorageName(i->Name), mode);
+			patches.push_back(bmp);
+			if(bmp->GetBPP() != pixelbytes * 8)
+				TVPThrowExceptionMessage(TVPImageLoadError, i->Name);
+		}
+
+		tjs_int w = base->GetWidth();
+		tjs_int h = base->GetHeight();
+		sizecallback(callbackdata, w, h);
+
+		for(tjs_int y = 0; y < h; y++)
+		{
+			tjs_uint8 *dest = (tjs_uint8*)scanlinecallback(callbackdata, y);
+			memcpy(dest, base->GetScanLine(y), w * pixelbytes);
+
+			// later patches overwrite earlier ones
+			for(tjs_uint n = 0; n < patches.size(); n++)
+			{
+				const tTVPDeltaImagePatch &pd = patchdescs[n];
+				tTVPBitmap *bmp = patches[n];
+				tjs_int py = y - pd.Y;
+				if(py < 0 || py >= (tjs_int)bmp->GetHeight()) continue;
+				tjs_int sx = pd.X < 0 ? -pd.X : 0;
+				tjs_int dx = pd.X < 0 ? 0 : pd.X;
+				tjs_int len = (tjs_int)bmp->GetWidth() - sx;
+				if(dx + len > w) len = w - dx;
+				if(len <= 0) continue;
+				memcpy(dest + dx * pixelbytes,
+					(const tjs_uint8*)bmp->GetScanLine(py) + sx * pixelbytes,
+					len * pixelbytes);
+			}
+
+			scanlinecallback(callbackdata, -1);
+		}
+	}
+	catch(...)
+	{
+		for(tjs_uint n = 0; n < patches.size(); n++) patches[n]->Release();
+		TVPDeltaImageBaseCache.Release(base);
+		throw;
+	}
+
+	for(tjs_uint n = 0; n < patches.size(); n++) patches[n]->Release();
+	TVPDeltaImageBaseCache.Release(base);
+}
+//---------------------------------------------------------------------------
+void TVPLoadHeaderDeltaImage(void* formatdata, tTJSBinaryStream *src, iTJSDispatch2** dic)
+{
+	// the header of a delta image is the one of its base
+	ttstr basename;
+	std::vector<tTVPDeltaImagePatch> patchdescs;
+	TVPParseDeltaImage(src, basename, patchdescs);
+	tTVPDeltaImageLoadGuard guard(TVPNormalizeStorageName(basename));
+	TVPLoadImageHeader(basename, dic);
+}
+//---------------------------------------------------------------------------
 
 void TVPLoadGraphicProvince(tTVPBaseBitmap *dest, const ttstr &name, tjs_int keyidx,
     tjs_uint desw, tjs_uint desh)
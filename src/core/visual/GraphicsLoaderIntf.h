@@ -176,6 +176,10 @@ extern void TVPLoadBPG(void* formatdata, void *callbackdata, tTVPGraphicSizeCall
 	tTVPGraphicScanLineCallback scanlinecallback, tTVPMetaInfoPushCallback metainfopushcallback,
 	tTJSBinaryStream *src, tjs_int keyidx, tTVPGraphicLoadMode mode);
 
+extern void TVPLoadDeltaImage(void* formatdata, void *callbackdata, tTVPGraphicSizeCallback sizecallback,
+	tTVPGraphicScanLineCallback scanlinecallback, tTVPMetaInfoPushCallback metainfopushcallback,
+	tTJSBinaryStream *src, tjs_int keyidx, tTVPGraphicLoadMode mode);
+
 //---------------------------------------------------------------------------
 // Image header handler
 // dic = %[
@@ -195,6 +199,7 @@ extern void TVPLoadHeaderJXR(void* formatdata, tTJSBinaryStream *src, iTJSDispat
 extern void TVPLoadHeaderTLG(void* formatdata, tTJSBinaryStream *src, iTJSDispatch2** dic);
 extern void TVPLoadHeaderWEBP(void* formatdata, tTJSBinaryStream *src, iTJSDispatch2** dic);
 extern void TVPLoadHeaderBPG(void* formatdata, tTJSBinaryStream *src, iTJSDispatch2** dic);
+extern void TVPLoadHeaderDeltaImage(void* formatdata, tTJSBinaryStream *src, iTJSDispatch2** dic);
 //---------------------------------------------------------------------------
 
 
@@ -4715,7 +4715,11 @@ tTVPBaseBitmap::tTVPBaseBitmap(tjs_uint w, tjs_uint h, tjs_uint bpp /*= 32*/) {
 }
 
 bool tTVPBaseBitmap::AssignBitmap(tTVPBitmap *bmp) {
-	return AssignTexture(TVPGetSoftwareRenderManager()->CreateTexture2D(bmp));
+	// the texture shares bmp's pixels until the first write
+	iTVPTexture2D *tex = TVPGetSoftwareRenderManager()->CreateTexture2D(bmp);
+	bool changed = AssignTexture(tex);
+	tex->Release(); // AssignTexture holds its own reference
+	return changed;
 }
 
 iTVPRenderManager* tTVPBaseBitmap::GetRenderManager() {
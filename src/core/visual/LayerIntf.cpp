@@ -28,6 +28,7 @@
 #include "TickCount.h"
 #include "DebugIntf.h"
 #include "LayerManager.h"
+#include "LayerRenderThread.h"
 #include "BitmapIntf.h"
 
 #include "TVPColor.h"
@@ -295,6 +296,7 @@ void TVPTempBitmapHolderRelease()
 //---------------------------------------------------------------------------
 tTVPGraphicSplitOperationType TVPGraphicSplitOperationType = gsotNone;// gsotSimple;
 bool TVPDefaultHoldAlpha = false;
+bool TVPPremultipliedAlphaLayers = false;
 //---------------------------------------------------------------------------
 
 
@@ -342,6 +344,7 @@ tTJSNI_BaseLayer::tTJSNI_BaseLayer()
 	// layer type management
 	DisplayType = Type = ltAlpha;
 		// later reset this if the layer becomes a primary layer
+	MainImagePremultiplied = false;
 	NeutralColor = TransparentColor = TVP_RGBA2COLOR(255, 255, 255, 0);
 
 	// geographical management
@@ -1455,6 +1458,7 @@ void tTJSNI_BaseLayer::SetType(tTVPLayerType type)
 	// set layer type to "type"
 	if(Type != type)
 	{
+		UnpremultiplyMainImage();
 		Type = type;
 		switch(Type)
 		{
@@ -1711,6 +1715,8 @@ void tTJSNI_BaseLayer::ConvertLayerType(tTVPDrawFace fromtype)
 {
 	// convert layer pixel representation method
 
+	UnpremultiplyMainImage();
+
 	if(DrawFace == dfAddAlpha && fromtype == dfAlpha)
 	{
 		// alpha -> additive alpha
@@ -1733,6 +1739,56 @@ void tTJSNI_BaseLayer::ConvertLayerType(tTVPDrawFace fromtype)
 	Update();
 }
 //---------------------------------------------------------------------------
+bool tTJSNI_BaseLayer::CanPremultiplyMainImage() const
+{
+	// transition handlers are given the layer type at the start, so the
+	// images are not converted during transitions.
+	return TVPPremultipliedAlphaLayers && Type == ltAlpha && Face == dfAuto &&
+		!InTransition && !TransDest;
+}
+//---------------------------------------------------------------------------
+void tTJSNI_BaseLayer::SetMainImagePremultiplied(bool b)
+{
+	// the layer is drawn as ltAddAlpha while MainImage is premultiplied;
+	// Type is still ltAlpha.
+	if(MainImagePremultiplied == b) return;
+	MainImagePremultiplied = b;
+	DisplayType = b ? ltAddAlpha : Type;
+	NotifyLayerTypeChange();
+	SetToCreateExposedRegion();
+}
+//---------------------------------------------------------------------------
+void tTJSNI_BaseLayer::PremultiplyMainImage()
+{
+	// convert the image just loaded into additive alpha form, so that
+	// blending, stretching and blurring do not need per-pixel division
+	if(MainImagePremultiplied || !MainImage || !CanPremultiplyMainImage()) return;
+
+	MainImage->ConvertAlphaToAddAlpha();
+	SetMainImagePremultiplied(true);
+}
+//---------------------------------------------------------------------------
+void tTJSNI_BaseLayer::UnpremultiplyMainImage()
+{
+	// convert the image back into alpha form; this is done before the
+	// operations which do not support additive alpha, and before the
+	// pixels are exposed as they are.
+	if(!MainImagePremultiplied) return;
+
+	if(MainImage) MainImage->ConvertAddAlphaToAlpha();
+	SetMainImagePremultiplied(false);
+
+	ImageModified = true;
+
+	Update();
+}
+//---------------------------------------------------------------------------
+tjs_uint32 tTJSNI_BaseLayer::ToImageColor(tjs_uint32 color) const
+{
+	if(MainImagePremultiplied) TVPConvertAlphaToAdditiveAlpha(&color, 1);
+	return color;
+}
+//---------------------------------------------------------------------------
 
 
 
@@ -2050,7 +2106,7 @@ void tTJSNI_BaseLayer::ChangeImageSize(tjs_uint width, tjs_uint height)
 	if(!width || !height)
 		TVPThrowExceptionMessage(TVPCannotCreateEmptyLayerImage);
 
-	if(MainImage) MainImage->SetSizeWithFill(width, height, NeutralColor);
+	if(MainImage) MainImage->SetSizeWithFill(width, height, ToImageColor(NeutralColor));
 	if(ProvinceImage) ProvinceImage->SetSizeWithFill(width, height, 0);
 
 	if(MainImage) ResetClip();  // cliprect is reset
@@ -2087,6 +2143,7 @@ void tTJSNI_BaseLayer::DeallocateImage()
 {
 	if(MainImage) delete MainImage, MainImage = NULL;
 	if(ProvinceImage) delete ProvinceImage, ProvinceImage = NULL;
+	SetMainImagePremultiplied(false);
 
 	ImageModified = true;
 }
@@ -2133,6 +2190,10 @@ void tTJSNI_BaseLayer::AssignImages(tTJSNI_BaseLayer *src)
 	// assign images
 	bool main_changed = true;
 
+	// the image is shared in the form of the source
+	if(src->MainImagePremultiplied && !CanPremultiplyMainImage())
+		src->UnpremultiplyMainImage();
+
 	if(src->MainImage)
 	{
 		if(MainImage)
@@ -2140,6 +2201,7 @@ void tTJSNI_BaseLayer::AssignImages(tTJSNI_BaseLayer *src)
 		else
 			MainImage = new tTVPBaseTexture(* src->MainImage);
 		FontChanged = true; // invalidate font assignment cache
+		SetMainImagePremultiplied(src->MainImagePremultiplied);
 	}
 	else
 	{
@@ -2183,6 +2245,7 @@ void tTJSNI_BaseLayer::AssignMainImageWithUpdate(iTVPBaseBitmap *bmp)
 		else
 			MainImage = new tTVPBaseTexture(*bmp);
 		FontChanged = true; // invalidate font assignment cache
+		SetMainImagePremultiplied(false);
 	}
 	else
 	{
@@ -2218,6 +2281,7 @@ void tTJSNI_BaseLayer::AssignMainImage(iTVPBaseBitmap *bmp)
 	}
 
 	bool main_changed = MainImage->Assign(*bmp);
+	SetMainImagePremultiplied(false);
 
 	if(main_changed)
 	{
@@ -2229,9 +2293,43 @@ void tTJSNI_BaseLayer::AssignMainImage(iTVPBaseBitmap *bmp)
 void tTJSNI_BaseLayer::CopyFromMainImage( tTJSNI_Bitmap* bmp )
 {
 	if(!MainImage) TVPThrowExceptionMessage(TVPNotDrawableLayerType);
+	UnpremultiplyMainImage();
 	bmp->CopyFrom( MainImage );
 }
 //---------------------------------------------------------------------------
+tTVPBaseTexture * tTJSNI_BaseLayer::GetMainImageForCopy(tTJSNI_BaseLayer *dest)
+{
+	// pixels are copied as they are; both must be in the same form
+	if(MainImagePremultiplied != dest->MainImagePremultiplied)
+	{
+		UnpremultiplyMainImage();
+		dest->UnpremultiplyMainImage();
+	}
+	ApplyFont();
+	return MainImage;
+}
+//---------------------------------------------------------------------------
+tTVPBaseTexture * tTJSNI_BaseLayer::GetMainImageForOperation(
+	tTJSNI_BaseLayer *dest, tTVPBlendOperationMode &mode)
+{
+	// alpha blending of the premultiplied image is the same as additive
+	// alpha blending of it, unless the destination is in alpha form
+	// ( bmAddAlphaOnAlpha has no stretching functions ).
+	if(MainImagePremultiplied)
+	{
+		if((mode == omAuto || mode == omAlpha) && dest->DrawFace != dfAlpha)
+		{
+			if(mode == omAlpha) mode = omAddAlpha;
+		}
+		else
+		{
+			UnpremultiplyMainImage();
+		}
+	}
+	ApplyFont();
+	return MainImage;
+}
+//---------------------------------------------------------------------------
 void tTJSNI_BaseLayer::SetHasImage(bool b)
 {
 	if(!CanHaveImage && b)
@@ -2443,7 +2541,9 @@ void tTJSNI_BaseLayer::IndependProvinceImage(bool copy)
 void tTJSNI_BaseLayer::SaveLayerImage(const ttstr &name, const ttstr &type)
 {
 	if(!MainImage) TVPThrowExceptionMessage(TVPNotDrawableLayerType);
-	
+
+	UnpremultiplyMainImage();
+
 	iTJSDispatch2 *dic = TJSCreateDictionaryObject();
 	try {
 		tTJSVariant val;
@@ -2502,6 +2602,7 @@ void tTJSNI_BaseLayer::AssignTexture(iTVPTexture2D *tex)
 {
 	if (!MainImage) TVPThrowExceptionMessage(TVPNotDrawableLayerType);
 	MainImage->AssignTexture(tex);
+	SetMainImagePremultiplied(false);
 	InternalSetImageSize(MainImage->GetWidth(), MainImage->GetHeight());
 	ImageModified = true;
 	ResetClip();  // cliprect is reset
@@ -2532,6 +2633,9 @@ iTJSDispatch2 * tTJSNI_BaseLayer::LoadImages(const ttstr &name, tjs_uint32 color
 	TVPLoadGraphic(MainImage, name, colorkey, 0, 0, glmNormal, &provincename, &metainfo);
 	try
 	{
+		// the loaded image is in alpha form
+		SetMainImagePremultiplied(false);
+		PremultiplyMainImage();
 
 		InternalSetImageSize(MainImage->GetWidth(), MainImage->GetHeight());
 
@@ -2606,7 +2710,9 @@ tjs_uint32 tTJSNI_BaseLayer::GetMainPixel(tjs_int x, tjs_int y) const
 {
 	if(!MainImage) TVPThrowExceptionMessage(TVPNotDrawableLayerType);
 
-	return TVPFromActualColor(MainImage->GetPoint(x, y) & 0xffffff);
+	tjs_uint32 color = MainImage->GetPoint(x, y);
+	if(MainImagePremultiplied) TVPConvertAdditiveAlphaToAlpha(&color, 1);
+	return TVPFromActualColor(color & 0xffffff);
 }
 //---------------------------------------------------------------------------
 void tTJSNI_BaseLayer::SetMainPixel(tjs_int x, tjs_int y, tjs_uint32 color)
@@ -2616,6 +2722,7 @@ void tTJSNI_BaseLayer::SetMainPixel(tjs_int x, tjs_int y, tjs_uint32 color)
 	if(x < ClipRect.left || y < ClipRect.top ||
 		x >= ClipRect.right || y >= ClipRect.bottom) return; // out of clipping rectangle
 
+	UnpremultiplyMainImage(); // the color must be kept on transparent pixels
 	MainImage->SetPointMain(x, y, TVPToActualColor(color));
 
 	ImageModified = true;
@@ -2641,6 +2748,7 @@ void tTJSNI_BaseLayer::SetMaskPixel(tjs_int x, tjs_int y, tjs_int mask)
 	if(x < ClipRect.left || y < ClipRect.top ||
 		x >= ClipRect.right || y >= ClipRect.bottom) return; // out of clipping rectangle
 
+	UnpremultiplyMainImage();
 	MainImage->SetPointMask(x, y, mask);
 
 	ImageModified = true;
@@ -2683,12 +2791,14 @@ void tTJSNI_BaseLayer::SetProvincePixel(tjs_int x, tjs_int y, tjs_int n)
 const void * tTJSNI_BaseLayer::GetMainImagePixelBuffer() const
 {
 	if(!MainImage) return NULL;
+	const_cast<tTJSNI_BaseLayer*>(this)->UnpremultiplyMainImage();
 	return MainImage->GetScanLine(0);
 }
 //---------------------------------------------------------------------------
 void * tTJSNI_BaseLayer::GetMainImagePixelBufferForWrite()
 {
 	if(!MainImage) return NULL;
+	UnpremultiplyMainImage();
 	ImageModified = true;
 	return MainImage->GetScanLineForWrite(0);
 }
@@ -3882,6 +3992,9 @@ void tTJSNI_BaseLayer::FillRect(const tTVPRect &rect, tjs_uint32 color)
 	tTVPRect destrect;
 	if(!TVPIntersectRect(&destrect, rect, ClipRect)) return; // out of the clipping rectangle
 
+	// the color of translucent fill must be kept in alpha form
+	if((color & 0xff000000) != 0xff000000) UnpremultiplyMainImage();
+
 	if(DrawFace == dfAlpha || DrawFace == dfAddAlpha || (DrawFace == dfOpaque && !HoldAlpha))
 	{
 		// main and mask
@@ -3952,6 +4065,9 @@ void tTJSNI_BaseLayer::ColorRect(const tTVPRect &rect, tjs_uint32 color, tjs_int
 	tTVPRect destrect;
 	if(!TVPIntersectRect(&destrect, rect, ClipRect)) return; // out of the clipping rectangle
 
+	// negative opacity is not supported on additive alpha
+	if(opa < 0) UnpremultiplyMainImage();
+
 	switch(DrawFace)
 	{
 	case dfAlpha: // main and mask
@@ -4046,6 +4162,8 @@ void tTJSNI_BaseLayer::DrawText(tjs_int x, tjs_int y, const ttstr &text,
 
 	tTVPBBBltMethod met;
 
+	if(opa < 0) UnpremultiplyMainImage();
+
 	switch(DrawFace)
 	{
 	case dfAlpha:
@@ -4089,6 +4207,8 @@ void tTJSNI_BaseLayer::DrawGlyph(tjs_int x, tjs_int y, iTJSDispatch2* glyph, tjs
 	if(!MainImage) TVPThrowExceptionMessage(TVPNotDrawableLayerType);
 	tTVPBBBltMethod met;
 
+	if(opa < 0) UnpremultiplyMainImage();
+
 	switch(DrawFace)
 	{
 	case dfAlpha:
@@ -4139,6 +4259,9 @@ void tTJSNI_BaseLayer::PiledCopy(tjs_int dx, tjs_int dy, tTJSNI_BaseLayer *src,
 	tTVPRect rect;
 	if(!ClipDestPointAndSrcRect(dx, dy, rect, srcrect)) return; // out of the clipping rect
 
+	// the piled image is in the form of the source
+	src->GetMainImageForCopy(this);
+
 	src->IncCacheEnabledCount(); // enable cache
 	try
 	{
@@ -4314,7 +4437,7 @@ void tTJSNI_BaseLayer::AffineCopy(const t2DAffineMatrix &matrix, iTVPBaseBitmap
 		if(!MainImage) TVPThrowExceptionMessage(TVPNotDrawableLayerType);
 		if(!src) TVPThrowExceptionMessage(TVPSourceLayerHasNoImage);
 		updated = MainImage->AffineBlt(ClipRect, src, srcrect, matrix,
-			bmCopy, 255, &updaterect, false, type, clear, NeutralColor);
+			bmCopy, 255, &updaterect, false, type, clear, ToImageColor(NeutralColor));
 		break;
 	  }
 
@@ -4355,7 +4478,7 @@ void tTJSNI_BaseLayer::AffineCopy(const tTVPPointD *points, iTVPBaseBitmap *src,
 		if(!MainImage) TVPThrowExceptionMessage(TVPNotDrawableLayerType);
 		if(!src) TVPThrowExceptionMessage(TVPSourceLayerHasNoImage);
 		updated = MainImage->AffineBlt(ClipRect, src, srcrect, points,
-			bmCopy, 255, &updaterect, false, type, clear, NeutralColor);
+			bmCopy, 255, &updaterect, false, type, clear, ToImageColor(NeutralColor));
 		break;
 	  }
 
@@ -4396,6 +4519,9 @@ void tTJSNI_BaseLayer::PileRect(tjs_int dx, tjs_int dy, tTJSNI_BaseLayer *src,
 	// the destination alpha is held on dfAlpha if 'HoldAlpha' is true, otherwide the
 	// alpha information is destroyed.
 
+	src->UnpremultiplyMainImage();
+	UnpremultiplyMainImage();
+
 	if(DrawFace != dfAlpha && DrawFace != dfOpaque)
 	{
 		TVPThrowExceptionMessage(TVPNotDrawableFaceType, TJS_W("pileRect"));
@@ -4447,6 +4573,9 @@ void tTJSNI_BaseLayer::BlendRect(tjs_int dx, tjs_int dy, tTJSNI_BaseLayer *src,
 	// mostly the same as 'PileRect', but this does treat src as completely
 	// opaque image. 
 
+	src->UnpremultiplyMainImage();
+	UnpremultiplyMainImage();
+
 	if(DrawFace != dfAlpha && DrawFace != dfOpaque)
 	{
 		TVPThrowExceptionMessage(TVPNotDrawableFaceType, TJS_W("blendRect"));
@@ -4499,6 +4628,10 @@ void tTJSNI_BaseLayer::OperateRect(tjs_int dx, tjs_int dy, iTVPBaseBitmap *src,
 	// It does not throw an exception in this case perhaps
 	if(mode == omAuto) TVPThrowExceptionMessage( TVPCannotAcceptModeAuto );
 
+	// other modes do not take additive alpha destination
+	if(mode != omAlpha && mode != omAddAlpha && mode != omOpaque)
+		UnpremultiplyMainImage();
+
 	// convert tTVPBlendOperationMode to tTVPBBBltMethod
 	tTVPBBBltMethod met;
 	if(!GetBltMethodFromOperationModeAndDrawFace(met, mode))
@@ -4532,6 +4665,9 @@ void tTJSNI_BaseLayer::StretchPile(const tTVPRect &destrect, tTJSNI_BaseLayer *s
 	// obsoleted (use OperateStretch)
 
 	// stretching pile
+	src->UnpremultiplyMainImage();
+	UnpremultiplyMainImage();
+
 	if(DrawFace != dfAlpha && DrawFace != dfOpaque)
 	{
 		TVPThrowExceptionMessage(TVPNotDrawableFaceType, TJS_W("stretchPile"));
@@ -4581,6 +4717,9 @@ void tTJSNI_BaseLayer::StretchBlend(const tTVPRect &destrect, tTJSNI_BaseLayer *
 	// obsoleted (use OperateStretch)
 
 	// stretching blend
+	src->UnpremultiplyMainImage();
+	UnpremultiplyMainImage();
+
 	if(DrawFace != dfAlpha && DrawFace != dfOpaque)
 	{
 		TVPThrowExceptionMessage(TVPNotDrawableFaceType, TJS_W("stretchBlend"));
@@ -4637,6 +4776,10 @@ void tTJSNI_BaseLayer::OperateStretch(const tTVPRect &destrect,
 	// It does not throw an exception in this case perhaps
 	if(mode == omAuto) TVPThrowExceptionMessage( TVPCannotAcceptModeAuto );
 
+	// other modes do not take additive alpha destination
+	if(mode != omAlpha && mode != omAddAlpha && mode != omOpaque)
+		UnpremultiplyMainImage();
+
 	// convert tTVPBlendOperationMode to tTVPBBBltMethod
 	tTVPBBBltMethod met;
 	if(!GetBltMethodFromOperationModeAndDrawFace(met, mode))
@@ -4671,6 +4814,9 @@ void tTJSNI_BaseLayer::AffinePile(const t2DAffineMatrix &matrix, tTJSNI_BaseLaye
 	tTVPRect updaterect;
 	bool updated;
 
+	src->UnpremultiplyMainImage();
+	UnpremultiplyMainImage();
+
 	if(DrawFace != dfAlpha && DrawFace != dfOpaque)
 	{
 		TVPThrowExceptionMessage(TVPNotDrawableFaceType, TJS_W("affinePile"));
@@ -4719,6 +4865,9 @@ void tTJSNI_BaseLayer::AffinePile(const tTVPPointD *points, tTJSNI_BaseLayer *sr
 	tTVPRect updaterect;
 	bool updated;
 
+	src->UnpremultiplyMainImage();
+	UnpremultiplyMainImage();
+
 	if(DrawFace != dfAlpha && DrawFace != dfOpaque)
 	{
 		TVPThrowExceptionMessage(TVPNotDrawableFaceType, TJS_W("affinePile"));
@@ -4767,6 +4916,9 @@ void tTJSNI_BaseLayer::AffineBlend(const t2DAffineMatrix &matrix, tTJSNI_BaseLay
 	tTVPRect updaterect;
 	bool updated;
 
+	src->UnpremultiplyMainImage();
+	UnpremultiplyMainImage();
+
 	if(DrawFace != dfAlpha && DrawFace != dfOpaque)
 	{
 		TVPThrowExceptionMessage(TVPNotDrawableFaceType, TJS_W("affineBlend"));
@@ -4816,6 +4968,9 @@ void tTJSNI_BaseLayer::AffineBlend(const tTVPPointD *points, tTJSNI_BaseLayer *s
 	tTVPRect updaterect;
 	bool updated;
 
+	src->UnpremultiplyMainImage();
+	UnpremultiplyMainImage();
+
 	if(DrawFace != dfAlpha && DrawFace != dfOpaque)
 	{
 		TVPThrowExceptionMessage(TVPNotDrawableFaceType, TJS_W("affineBlend"));
@@ -4867,6 +5022,10 @@ void tTJSNI_BaseLayer::OperateAffine(const t2DAffineMatrix &matrix,
 	// It does not throw an exception in this case perhaps
 	if(mode == omAuto) TVPThrowExceptionMessage( TVPCannotAcceptModeAuto );
 
+	// other modes do not take additive alpha destination
+	if(mode != omAlpha && mode != omAddAlpha && mode != omOpaque)
+		UnpremultiplyMainImage();
+
 	// convert tTVPBlendOperationMode to tTVPBBBltMethod
 	tTVPBBBltMethod met;
 	if(!GetBltMethodFromOperationModeAndDrawFace(met, mode))
@@ -4901,6 +5060,10 @@ void tTJSNI_BaseLayer::OperateAffine(const tTVPPointD *points, iTVPBaseBitmap *s
 	// It does not throw an exception in this case perhaps
 	if(mode == omAuto) TVPThrowExceptionMessage( TVPCannotAcceptModeAuto );
 
+	// other modes do not take additive alpha destination
+	if(mode != omAlpha && mode != omAddAlpha && mode != omOpaque)
+		UnpremultiplyMainImage();
+
 	// convert tTVPBlendOperationMode to tTVPBBBltMethod
 	tTVPBBBltMethod met;
 	if(!GetBltMethodFromOperationModeAndDrawFace(met, mode))
@@ -6792,17 +6955,24 @@ void tTJSNI_BaseLayer::CompleteForWindow(tTVPDrawable *drawable)
 	static bool isGPU = !TVPIsSoftwareRenderManager()
 		&& !IndividualConfigManager::GetInstance()->GetValueBool("ogl_accurate_render", false);
 
+	// take the update region of this frame; invalidation caused while
+	// completing (eg. by transition handlers) is kept for the next frame
+	// instead of being discarded with this one.
+	tTVPComplexRect frameregion;
+	if(!isGPU && Manager) Manager->TakeUpdateRegionSnapshot(frameregion);
+
 	if(Manager) Manager->GetLayerTreeOwner()->StartBitmapCompletion(Manager);
 	try
 	{
 		if (isGPU) {
 			Draw_GPU(drawable, 0, 0, Rect);
-		} else {
-			InternalComplete2(Manager->GetUpdateRegionForCompletion(), drawable);
+		} else if(!Manager || !Manager->CompleteOnRenderThread(frameregion)) {
+			InternalComplete2(frameregion, drawable);
 		}
 	}
 	catch(...)
 	{
+		if(!isGPU && Manager) Manager->RestoreUpdateRegionSnapshot(frameregion);
 		if(Manager) Manager->GetLayerTreeOwner()->EndBitmapCompletion(Manager);
 		throw;
 	}
@@ -6813,6 +6983,53 @@ void tTJSNI_BaseLayer::CompleteForWindow(tTVPDrawable *drawable)
 
 }
 //---------------------------------------------------------------------------
+bool tTJSNI_BaseLayer::CreateRenderNode(tTVPLayerRenderNode *node)
+{
+	// copy the states which are used by Draw() into "node".
+	// returns false if Draw() does what the render thread does not; caches,
+	// transitions and the layer types other than ltOpaque, ltAlpha and
+	// ltAddAlpha.
+	if(GetCacheEnabled() || InTransition) return false;
+	if(DisplayType != ltOpaque && DisplayType != ltAlpha && DisplayType != ltAddAlpha)
+		return false;
+
+	node->Rect = Rect;
+	node->DisplayType = DisplayType;
+	node->Opacity = Opacity;
+	if(MainImage)
+	{
+		iTVPTexture2D *tex = MainImage->GetTexture();
+		if(tex->GetFormat() != TVPTextureFormat::RGBA) return false;
+		tex->AddRef(); // released with the node, on the main thread
+		node->Image.Texture = tex;
+		node->Image.Width = tex->GetWidth();
+		node->Image.Height = tex->GetHeight();
+	}
+	node->ImageLeft = ImageLeft;
+	node->ImageTop = ImageTop;
+	node->NeutralColor = NeutralColor;
+	node->TransparentColor = TransparentColor;
+	node->HasVisibleChildren = GetVisibleChildrenCount() != 0;
+	if(!node->HasVisibleChildren) return true;
+
+	tTVPComplexRect::tIterator it = GetOverlappedRegion().GetIterator();
+	while(it.Step()) node->OverlappedRegion.push_back(*it);
+	it = GetExposedRegion().GetIterator();
+	while(it.Step()) node->ExposedRegion.push_back(*it);
+
+	TVP_LAYER_FOR_EACH_CHILD_NOLOCK_BEGIN(child)
+		if(child->IsSeen())
+		{
+			tTVPLayerRenderNode *childnode = new tTVPLayerRenderNode();
+			childnode->Parent = node;
+			node->Children.push_back(childnode);
+			if(!child->CreateRenderNode(childnode)) return false;
+		}
+	TVP_LAYER_FOR_EACH_CHILD_NOLOCK_END
+
+	return true;
+}
+//---------------------------------------------------------------------------
 tTVPBaseTexture * tTJSNI_BaseLayer::Complete(const tTVPRect & rect)
 {
 	class tCompleteDrawable : public tTVPDrawable
@@ -6926,6 +7143,10 @@ void tTJSNI_BaseLayer::StartTransition(const ttstr &name, bool withchildren,
 		TVPThrowExceptionMessage(TVPTransitionMutualSource);
 	}
 
+	// transition handlers work on the images in the form of the layer types
+	UnpremultiplyMainImage();
+	if(transsource) transsource->UnpremultiplyMainImage();
+
 	// pointers which must be released at last...
 	iTVPTransHandlerProvider *pro = NULL;
 	tTVPSimpleOptionProvider *sop = NULL;
@@ -7864,7 +8085,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/copyRect)
 			src = provinceSrc = NULL;
 		else
 		{
-			src = srclayer->GetMainImage();
+			src = srclayer->GetMainImageForCopy(_this);
 			provinceSrc = srclayer->GetProvinceImage();
 		}
 
@@ -7875,7 +8096,10 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/copyRect)
 				tTJSNC_Bitmap::ClassID, (iTJSNativeInstance**)&srcbmp)))
 				src = provinceSrc = NULL;
 			else
+			{
 				src = provinceSrc = srcbmp->GetBitmap();
+				_this->UnpremultiplyMainImage();
+			}
 		}
 	}
 	if(!src && !provinceSrc) TVPThrowExceptionMessage(TVPSpecifyLayerOrBitmap);
@@ -7969,7 +8193,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/copy9Patch)
 			src = NULL;
 		else
 		{
-			src = srclayer->GetMainImage();
+			src = srclayer->GetMainImageForCopy(_this);
 		}
 
 		if( src == NULL )
@@ -7979,7 +8203,10 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/copy9Patch)
 				tTJSNC_Bitmap::ClassID, (iTJSNativeInstance**)&srcbmp)))
 				src = NULL;
 			else
+			{
 				src = srcbmp->GetBitmap();
+				_this->UnpremultiplyMainImage();
+			}
 		}
 	}
 	if(!src) TVPThrowExceptionMessage(TVPSpecifyLayerOrBitmap);
@@ -8004,6 +8231,12 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/operateRect)
 	TJS_GET_NATIVE_INSTANCE(/*var. name*/_this, /*var. type*/tTJSNI_Layer);
 	if(numparams < 7) return TJS_E_BADPARAMCOUNT;
 
+	tTVPBlendOperationMode mode;
+	if(numparams >= 8 && param[7]->Type() != tvtVoid)
+		mode = (tTVPBlendOperationMode)(tjs_int)(*param[7]);
+	else
+		mode = omAuto;
+
 	iTVPBaseBitmap* src = NULL;
 	tTJSVariantClosure clo = param[2]->AsObjectClosureNoAddRef();
 	tTVPBlendOperationMode automode = omAlpha;
@@ -8014,7 +8247,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/operateRect)
 			tTJSNC_Layer::ClassID, (iTJSNativeInstance**)&srclayer)))
 			src = NULL;
 		else
-			src = srclayer->GetMainImage(), automode = srclayer->GetOperationModeFromType();
+			src = srclayer->GetMainImageForOperation(_this, mode), automode = srclayer->GetOperationModeFromType();
 
 		if( src == NULL )
 		{	// try to get bitmap interface
@@ -8032,12 +8265,6 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/operateRect)
 	rect.right += rect.left;
 	rect.bottom += rect.top;
 
-	tTVPBlendOperationMode mode;
-	if(numparams >= 8 && param[7]->Type() != tvtVoid)
-		mode = (tTVPBlendOperationMode)(tjs_int)(*param[7]);
-	else
-		mode = omAuto;
-
 	if(numparams >= 10 && param[9]->Type() != tvtVoid)
 	{
 		TVPAddLog(TVPFormatMessage(TVPHoldDestinationAlphaParameterIsNowDeprecated,
@@ -8069,7 +8296,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/stretchCopy)
 			tTJSNC_Layer::ClassID, (iTJSNativeInstance**)&srclayer)))
 			src = NULL;
 		else
-			src = srclayer->GetMainImage();
+			src = srclayer->GetMainImageForCopy(_this);
 
 		if( src == NULL )
 		{	// try to get bitmap interface
@@ -8078,7 +8305,10 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/stretchCopy)
 				tTJSNC_Bitmap::ClassID, (iTJSNativeInstance**)&srcbmp)))
 				src = NULL;
 			else
+			{
 				src = srcbmp->GetBitmap();
+				_this->UnpremultiplyMainImage();
+			}
 		}
 	}
 	if(!src) TVPThrowExceptionMessage(TVPSpecifyLayerOrBitmap);
@@ -8206,6 +8436,12 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/operateStretch)
 	TJS_GET_NATIVE_INSTANCE(/*var. name*/_this, /*var. type*/tTJSNI_Layer);
 	if(numparams < 9) return TJS_E_BADPARAMCOUNT;
 
+	tTVPBlendOperationMode mode;
+	if(numparams >= 10 && param[9]->Type() != tvtVoid)
+		mode = (tTVPBlendOperationMode)(tjs_int)(*param[9]);
+	else
+		mode = omAuto;
+
 	iTVPBaseBitmap* src = NULL;
 	tTJSVariantClosure clo = param[4]->AsObjectClosureNoAddRef();
 	tTVPBlendOperationMode automode = omAlpha;
@@ -8216,7 +8452,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/operateStretch)
 			tTJSNC_Layer::ClassID, (iTJSNativeInstance**)&srclayer)))
 			src = NULL;
 		else
-			src = srclayer->GetMainImage(), automode = srclayer->GetOperationModeFromType();
+			src = srclayer->GetMainImageForOperation(_this, mode), automode = srclayer->GetOperationModeFromType();
 
 		if( src == NULL )
 		{	// try to get bitmap interface
@@ -8238,12 +8474,6 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/operateStretch)
 	srcrect.right += srcrect.left;
 	srcrect.bottom += srcrect.top;
 
-	tTVPBlendOperationMode mode;
-	if(numparams >= 10 && param[9]->Type() != tvtVoid)
-		mode = (tTVPBlendOperationMode)(tjs_int)(*param[9]);
-	else
-		mode = omAuto;
-
 	tjs_int opa = 255;
 
 	if(numparams >= 11 && param[10]->Type() != tvtVoid)
@@ -8283,7 +8513,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/affineCopy)
 			tTJSNC_Layer::ClassID, (iTJSNativeInstance**)&srclayer)))
 			src = NULL;
 		else
-			src = srclayer->GetMainImage();
+			src = srclayer->GetMainImageForCopy(_this);
 
 		if( src == NULL )
 		{	// try to get bitmap interface
@@ -8292,7 +8522,10 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/affineCopy)
 				tTJSNC_Bitmap::ClassID, (iTJSNativeInstance**)&srcbmp)))
 				src = NULL;
 			else
+			{
 				src = srcbmp->GetBitmap();
+				_this->UnpremultiplyMainImage();
+			}
 		}
 	}
 	if(!src) TVPThrowExceptionMessage(TVPSpecifyLayerOrBitmap);
@@ -8471,6 +8704,12 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/operateAffine)
 	TJS_GET_NATIVE_INSTANCE(/*var. name*/_this, /*var. type*/tTJSNI_Layer);
 	if(numparams < 12) return TJS_E_BADPARAMCOUNT;
 
+	tTVPBlendOperationMode mode;
+	if(numparams >= 13 && param[12]->Type() != tvtVoid)
+		mode = (tTVPBlendOperationMode)(tjs_int)(*param[12]);
+	else
+		mode = omAuto;
+
 	iTVPBaseBitmap* src = NULL;
 	tTJSVariantClosure clo = param[0]->AsObjectClosureNoAddRef();
 	tTVPBlendOperationMode automode = omAlpha;
@@ -8481,7 +8720,7 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/operateAffine)
 			tTJSNC_Layer::ClassID, (iTJSNativeInstance**)&srclayer)))
 			src = NULL;
 		else
-			src = srclayer->GetMainImage(), automode = srclayer->GetOperationModeFromType();
+			src = srclayer->GetMainImageForOperation(_this, mode), automode = srclayer->GetOperationModeFromType();
 
 		if( src == NULL )
 		{	// try to get bitmap interface
@@ -8512,12 +8751,6 @@ TJS_BEGIN_NATIVE_METHOD_DECL(/*func. name*/operateAffine)
 			TJS_W("Layer.operateAffine"), TJS_W("16")));
 	}
 
-	tTVPBlendOperationMode mode;
-	if(numparams >= 13 && param[12]->Type() != tvtVoid)
-		mode = (tTVPBlendOperationMode)(tjs_int)(*param[12]);
-	else
-		mode = omAuto;
-
 	// get correct blend mode if the mode is omAuto
 	if(mode == omAuto) mode = automode;
 
@@ -49,6 +49,8 @@ enum tTVPGraphicSplitOperationType
 { gsotNone, gsotSimple, gsotInterlace, gsotBiDirection };
 extern tTVPGraphicSplitOperationType TVPGraphicSplitOperationType;
 extern bool TVPDefaultHoldAlpha;
+extern bool TVPPremultipliedAlphaLayers;
+	// "-premulalpha=yes"; images of ltAlpha layers are held premultiplied
 //---------------------------------------------------------------------------
 
 
@@ -178,6 +180,7 @@ TJS_EXP_FUNC_DEF(iTJSDispatch2 *, TVPGetObjectFrom_NI_BaseLayer,   (tTJSNI_BaseL
 class tTJSNI_BaseWindow;
 class tTVPBaseBitmap;
 class tTVPLayerManager;
+struct tTVPLayerRenderNode;
 class tTJSNI_BaseLayer :
 	public tTJSNativeInstance, public tTVPDrawable,
 	public tTVPCompactEventCallbackIntf
@@ -345,10 +348,23 @@ protected:
 	void NotifyLayerTypeChange();
 
 	void UpdateDrawFace(); // set DrawFace from Face and Type
+
+	bool MainImagePremultiplied;
+		// MainImage of ltAlpha layer is held in additive alpha form, and
+		// DisplayType is ltAddAlpha ( see TVPPremultipliedAlphaLayers )
+
+	bool CanPremultiplyMainImage() const;
+	void SetMainImagePremultiplied(bool b);
+	void PremultiplyMainImage();
+	tjs_uint32 ToImageColor(tjs_uint32 color) const;
+		// convert color into the form of MainImage
 public:
 	tTVPBlendOperationMode GetOperationModeFromType() const;
 		// returns corresponding blend operation mode from layer type
 
+	void UnpremultiplyMainImage();
+		// convert MainImage back into alpha form
+
 public:
 	tTVPLayerType GetType() const { return Type; }
 	void SetType(tTVPLayerType type);
@@ -459,6 +475,10 @@ private:
 	void ImageLayerSizeChanged(); // called from geographical management
 public:
 	tTVPBaseTexture * GetMainImage() { ApplyFont(); return MainImage; }
+	tTVPBaseTexture * GetMainImageForCopy(tTJSNI_BaseLayer *dest);
+	tTVPBaseTexture * GetMainImageForOperation(tTJSNI_BaseLayer *dest,
+		tTVPBlendOperationMode &mode);
+		// these return MainImage in the form which "dest" can take
 	tTVPBaseBitmap * GetProvinceImage() { ApplyFont(); return ProvinceImage; }
 		// exporting of these two members is a bit dangerous
 		// in the manner of protecting
@@ -699,7 +719,8 @@ protected:
 		// when the layer type is ltOpaque
 
 public:
-	void SetFace(tTVPDrawFace f) { Face = f; UpdateDrawFace(); }
+	void SetFace(tTVPDrawFace f)
+		{ if(f != dfAuto) UnpremultiplyMainImage(); Face = f; UpdateDrawFace(); }
 	tTVPDrawFace GetFace() const { return Face; }
 
 	void SetHoldAlpha(bool b)  { HoldAlpha = b; }
@@ -943,6 +964,8 @@ private:
 	void InternalComplete2(tTVPComplexRect & updateregion, tTVPDrawable *drawable);
 	void InternalComplete(tTVPComplexRect & updateregion, tTVPDrawable *drawable);
 	void CompleteForWindow(tTVPDrawable *drawable);
+	bool CreateRenderNode(tTVPLayerRenderNode *node);
+		// take the snapshot of the layer tree for the render thread
 public:
 private:
 	tTVPBaseTexture * Complete(const tTVPRect & rect);
@@ -21,6 +21,8 @@
 #include "TickCount.h"
 #include "DebugIntf.h"
 #include "LayerTreeOwner.h"
+#include "LayerRenderThread.h"
+#include "RenderManager.h"
 
 
 
@@ -33,6 +35,7 @@ tTVPLayerManager::tTVPLayerManager(iTVPLayerTreeOwner *owner)
 	LayerTreeOwner = owner;
 	DrawDeviceData = NULL;
 	DrawBuffer = NULL;
+	RenderThread = NULL;
 	DesiredLayerType = ltOpaque;
 
 	CaptureOwner = NULL;
@@ -50,6 +53,7 @@ tTVPLayerManager::tTVPLayerManager(iTVPLayerTreeOwner *owner)
 //---------------------------------------------------------------------------
 tTVPLayerManager::~tTVPLayerManager()
 {
+	if(RenderThread) delete RenderThread;
 	if(DrawBuffer) delete DrawBuffer;
 }
 //---------------------------------------------------------------------------
@@ -121,6 +125,15 @@ void tTVPLayerManager::DrawCompleted(const tTVPRect &destrect,
 	if (!LayerTreeOwner) return;
 	LayerTreeOwner->NotifyBitmapCompleted(this, destrect.left, destrect.top, bmp, cliprect, type, opacity);
 #else
+	if(!IsPrimaryLayerAttached()) return;
+	PrepareDrawBuffer();
+
+    DrawBuffer->Blt(destrect.left, destrect.top, bmp, cliprect, type, opacity, true);
+#endif
+}
+//---------------------------------------------------------------------------
+void tTVPLayerManager::PrepareDrawBuffer()
+{
     tjs_int w, h;
 	if(!/*LayerTreeOwner->*/GetPrimaryLayerSize(w, h)) return;
     //Window->GetDrawDevice()->GetSrcSize(w, h);
@@ -138,9 +151,6 @@ void tTVPLayerManager::DrawCompleted(const tTVPRect &destrect,
             DrawBuffer->SetSize(neww, bh > h ? bh : h);
 		}
     }
-
-    DrawBuffer->Blt(destrect.left, destrect.top, bmp, cliprect, type, opacity, true);
-#endif
 }
 //---------------------------------------------------------------------------
 void tTVPLayerManager::AttachPrimary(tTJSNI_BaseLayer *pri)
@@ -1078,6 +1088,61 @@ void tTVPLayerManager::AddUpdateRegion(const tTVPRect &rect)
 	NotifyWindowInvalidation();
 }
 //---------------------------------------------------------------------------
+void tTVPLayerManager::TakeUpdateRegionSnapshot(tTVPComplexRect &dest)
+{
+	// move the current update region to "dest" and start a new (empty) one.
+	// the snapshot is immutable during the completion of this frame;
+	// regions invalidated while completing go into the next frame.
+	dest.Clear();
+	dest.Swap(UpdateRegion);
+}
+//---------------------------------------------------------------------------
+void tTVPLayerManager::RestoreUpdateRegionSnapshot(const tTVPComplexRect &src)
+{
+	// give back the region which could not be completed (on error)
+	if(src.GetCount()) AddUpdateRegion(src);
+}
+//---------------------------------------------------------------------------
+bool tTVPLayerManager::CompleteOnRenderThread(tTVPComplexRect &region)
+{
+	// hand the snapshot of the layer tree to the render thread.
+	// the draw buffer receives the frame posted last time, so the window
+	// shows the frame one update later; the thread requests that update.
+	if(!Primary) return false;
+	if(!RenderThread)
+	{
+		// the thread composites software textures only
+		if(!TVPLayerRenderThreadEnabled || !TVPIsSoftwareRenderManager()) return false;
+		RenderThread = new tTVPLayerRenderThread(this);
+	}
+
+	PrepareDrawBuffer();
+	RenderThread->Flush(DrawBuffer);
+	if(!region.GetCount()) return true;
+
+	tTVPLayerRenderNode *root = new tTVPLayerRenderNode();
+	bool snapshot;
+	try
+	{
+		snapshot = Primary->CreateRenderNode(root);
+	}
+	catch(...)
+	{
+		delete root;
+		throw;
+	}
+	if(!snapshot)
+	{
+		// draw this frame synchronously, over the frame just flushed
+		delete root;
+		RenderThread->NotifyDrawnSynchronously(region);
+		return false;
+	}
+	RenderThread->Post(root, region, DrawBuffer);
+	region.Clear();
+	return true;
+}
+//---------------------------------------------------------------------------
 void TJS_INTF_METHOD tTVPLayerManager::UpdateToDrawDevice()
 {
 	// drawdevice -> layer
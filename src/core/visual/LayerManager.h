@@ -249,6 +249,7 @@ class tTVPLayerManager : public iTVPLayerManager, public tTVPDrawable
 	void * DrawDeviceData; //!< draw device specific information
 
 	tTVPBaseTexture * DrawBuffer;
+	class tTVPLayerRenderThread * RenderThread; // NULL unless -renderthread=yes
 	tTVPLayerType DesiredLayerType; //!< desired layer type by the draw device for this layer manager
 
 	tTJSNI_BaseLayer * CaptureOwner;
@@ -309,6 +310,9 @@ public: // methods from tTVPDrawable
 		tTVPLayerType type, tjs_int opacity) override;
 	virtual tTVPBaseTexture *GetDrawBuffer() { return DrawBuffer; }
 
+private:
+	void PrepareDrawBuffer(); // create or resize the draw buffer
+
 public:
 	void AttachPrimary(tTJSNI_BaseLayer *pri); // attach primary layer to the manager
 	void DetachPrimary(); // detach primary layer from the manager
@@ -321,6 +325,10 @@ public:
 	void NotifyPart(tTJSNI_BaseLayer *lay); // notifies layer parting from its parent
 
 	tTVPComplexRect & GetUpdateRegionForCompletion() { return UpdateRegion; }
+	void TakeUpdateRegionSnapshot(tTVPComplexRect &dest);
+	void RestoreUpdateRegionSnapshot(const tTVPComplexRect &src);
+	bool CompleteOnRenderThread(tTVPComplexRect &region);
+		// returns false if the region is to be completed synchronously
 
 private:
 
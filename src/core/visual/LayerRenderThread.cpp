@@ -0,0 +1,790 @@
+//---------------------------------------------------------------------------
+/*
+	TVP2 ( T Visual Presenter 2 )  A script authoring tool
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// Layer compositing thread
+//---------------------------------------------------------------------------
+#include "tjsCommHead.h"
+
+#include <string.h>
+#include <algorithm>
+#include "LayerRenderThread.h"
+#include "LayerManager.h"
+#include "LayerBitmapIntf.h"
+#include "RenderManager.h"
+#include "UserEvent.h"
+#include "tvpgl.h"
+
+//---------------------------------------------------------------------------
+bool TVPLayerRenderThreadEnabled = false;
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTVPRenderSurface
+//---------------------------------------------------------------------------
+void tTVPRenderSurface::SetSize(tjs_int w, tjs_int h)
+{
+	if(Buffer.size() < (size_t)(w * h)) Buffer.resize(w * h);
+	Bits = Buffer.empty() ? NULL : &Buffer[0];
+	Pitch = w;
+	Width = w;
+	Height = h;
+}
+//---------------------------------------------------------------------------
+const tjs_uint32 * tTVPRenderSurface::GetScanLine(tjs_int y) const
+{
+	// texture lines are read one by one; the lines of some static
+	// textures are not contiguous.
+	if(Texture) return (const tjs_uint32 *)Texture->GetScanLineForRead(y);
+	return Bits + Pitch * y;
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// pixel operations on the compositing thread
+//---------------------------------------------------------------------------
+// these do the same as the software render methods which are used by
+// tTVPBaseBitmap, but call the tvpgl functions directly; the render
+// methods hold their parameters and are not reentrant.
+//---------------------------------------------------------------------------
+static bool TVPClipRenderRect(const tTVPRenderSurface *dest, tjs_int x, tjs_int y,
+	const tTVPRenderSurface *ref, tTVPRect &refrect, tTVPRect &rect)
+{
+	// the same clipping as tTVPBaseBitmap::CopyRect and iTVPBaseBitmap::Blt
+	tjs_int bmpw, bmph;
+
+	bmpw = ref->Width;
+	bmph = ref->Height;
+
+	if(refrect.left < 0)
+		x -= refrect.left, refrect.left = 0;
+	if(refrect.right > bmpw)
+		refrect.right = bmpw;
+
+	if(refrect.left >= refrect.right) return false;
+
+	if(refrect.top < 0)
+		y -= refrect.top, refrect.top = 0;
+	if(refrect.bottom > bmph)
+		refrect.bottom = bmph;
+
+	if(refrect.top >= refrect.bottom) return false;
+
+	bmpw = dest->Width;
+	bmph = dest->Height;
+
+	rect.left = x;
+	rect.top = y;
+	rect.right = rect.left + refrect.get_width();
+	rect.bottom = rect.top + refrect.get_height();
+
+	if(rect.left < 0)
+	{
+		refrect.left += -rect.left;
+		rect.left = 0;
+	}
+
+	if(rect.right > bmpw)
+	{
+		refrect.right -= (rect.right - bmpw);
+		rect.right = bmpw;
+	}
+
+	if(refrect.left >= refrect.right) return false; // not drawable
+
+	if(rect.top < 0)
+	{
+		refrect.top += -rect.top;
+		rect.top = 0;
+	}
+
+	if(rect.bottom > bmph)
+	{
+		refrect.bottom -= (rect.bottom - bmph);
+		rect.bottom = bmph;
+	}
+
+	if(refrect.top >= refrect.bottom) return false; // not drawable
+
+	return true;
+}
+//---------------------------------------------------------------------------
+static void TVPRenderCopyRect(tTVPRenderSurface *dest, tjs_int x, tjs_int y,
+	const tTVPRenderSurface *ref, tTVPRect refrect)
+{
+	// copy main and mask; only main if the destination is the draw buffer
+	tTVPRect rect;
+	if(!TVPClipRenderRect(dest, x, y, ref, refrect, rect)) return;
+
+	tjs_int w = refrect.get_width();
+	tjs_int h = refrect.get_height();
+	for(tjs_int i = 0; i < h; i++)
+	{
+		tjs_uint32 *d = dest->GetScanLineForWrite(rect.top + i) + rect.left;
+		const tjs_uint32 *s = ref->GetScanLine(refrect.top + i) + refrect.left;
+		if(dest->MainOnly)
+			TVPCopyColor(d, s, w);
+		else
+			memmove(d, s, w * sizeof(tjs_uint32));
+	}
+}
+//---------------------------------------------------------------------------
+static void TVPRenderBlt(tTVPRenderSurface *dest, tjs_int x, tjs_int y,
+	const tTVPRenderSurface *ref, tTVPRect refrect, tTVPBBBltMethod method,
+	tjs_int opa, bool hda)
+{
+	if(opa == 255 && method == bmCopy && !hda)
+	{
+		TVPRenderCopyRect(dest, x, y, ref, refrect);
+		return;
+	}
+
+	if(opa == 0) return; // opacity==0 has no action
+
+	// select the function as tRenderMethodCache does
+	typedef void (*tBltFunc)(tjs_uint32 *, const tjs_uint32 *, tjs_int);
+	typedef void (*tBltOpaFunc)(tjs_uint32 *, const tjs_uint32 *, tjs_int, tjs_int);
+	tBltFunc func = NULL;
+	tBltOpaFunc opafunc = NULL;
+	bool copy = false;
+	switch(method)
+	{
+	case bmCopy:
+		if(opa == 255) copy = true; else opafunc = TVPConstAlphaBlend;
+		break;
+	case bmCopyOnAlpha:
+		if(opa == 255) func = TVPCopyOpaqueImage; else opafunc = TVPConstAlphaBlend_d;
+		break;
+	case bmCopyOnAddAlpha:
+		if(opa == 255) func = TVPCopyOpaqueImage; else opafunc = TVPConstAlphaBlend_a;
+		break;
+	case bmAlpha:
+		if(opa == 255) func = TVPAlphaBlend_HDA; else opafunc = TVPAlphaBlend_HDA_o;
+		break;
+	case bmAlphaOnAlpha:
+		if(opa == 255) func = TVPAlphaBlend_d; else opafunc = TVPAlphaBlend_do;
+		break;
+	case bmAlphaOnAddAlpha:
+		if(opa == 255) func = TVPAlphaBlend_a; else opafunc = TVPAlphaBlend_ao;
+		break;
+	case bmAddAlpha:
+		if(opa == 255) func = TVPAdditiveAlphaBlend_HDA; else opafunc = TVPAdditiveAlphaBlend_HDA_o;
+		break;
+	case bmAddAlphaOnAddAlpha:
+		if(opa == 255) func = TVPAdditiveAlphaBlend_a; else opafunc = TVPAdditiveAlphaBlend_ao;
+		break;
+	case bmAddAlphaOnAlpha:
+		if(opa == 255) func = TVPAdditiveAlphaBlend_d; else opafunc = TVPAdditiveAlphaBlend_do;
+		break;
+	default:
+		return;
+	}
+
+	tTVPRect rect;
+	if(!TVPClipRenderRect(dest, x, y, ref, refrect, rect)) return;
+
+	tjs_int w = refrect.get_width();
+	tjs_int h = refrect.get_height();
+	for(tjs_int i = 0; i < h; i++)
+	{
+		tjs_uint32 *d = dest->GetScanLineForWrite(rect.top + i) + rect.left;
+		const tjs_uint32 *s = ref->GetScanLine(refrect.top + i) + refrect.left;
+		if(copy)
+			memmove(d, s, w * sizeof(tjs_uint32));
+		else if(func)
+			func(d, s, w);
+		else
+			opafunc(d, s, w, opa);
+	}
+}
+//---------------------------------------------------------------------------
+static void TVPRenderFill(tTVPRenderSurface *dest, tTVPRect rect, tjs_uint32 value)
+{
+	// the same as iTVPBaseBitmap::Fill
+	if(rect.left < 0) rect.left = 0;
+	if(rect.top < 0) rect.top = 0;
+	if(rect.right > dest->Width) rect.right = dest->Width;
+	if(rect.bottom > dest->Height) rect.bottom = dest->Height;
+	if(rect.right - rect.left <= 0 || rect.bottom - rect.top <= 0) return;
+
+	value = TVP_REVRGB(value);
+	for(tjs_int y = rect.top; y < rect.bottom; y++)
+		TVPFillARGB(dest->GetScanLineForWrite(y) + rect.left, rect.get_width(), value);
+}
+//---------------------------------------------------------------------------
+static void TVPRenderBltImage(tTVPRenderSurface *dest, tTVPLayerType destlayertype,
+	tjs_int destx, tjs_int desty, const tTVPRenderSurface *src,
+	const tTVPRect &srcrect, tTVPLayerType drawtype, tjs_int opacity)
+{
+	// the same as tTJSNI_BaseLayer::BltImage for the types in the snapshot
+	tTVPBBBltMethod met;
+	switch(drawtype)
+	{
+	case ltOpaque:
+		if(TVPIsTypeUsingAlpha(destlayertype))
+			met = bmCopyOnAlpha;
+		else if(TVPIsTypeUsingAddAlpha(destlayertype))
+			met = bmCopyOnAddAlpha;
+		else
+			met = bmCopy;
+		break;
+
+	case ltAlpha:
+		if(TVPIsTypeUsingAlpha(destlayertype))
+			met = bmAlphaOnAlpha;
+		else if(TVPIsTypeUsingAddAlpha(destlayertype))
+			met = bmAlphaOnAddAlpha;
+		else
+			met = bmAlpha;
+		break;
+
+	case ltAddAlpha:
+		if(TVPIsTypeUsingAlpha(destlayertype))
+			met = bmAddAlphaOnAlpha;
+		else if(TVPIsTypeUsingAddAlpha(destlayertype))
+			met = bmAddAlphaOnAddAlpha;
+		else
+			met = bmAddAlpha;
+		break;
+
+	default:
+		return;
+	}
+
+	TVPRenderBlt(dest, destx, desty, src, srcrect, met, opacity, false);
+}
+//---------------------------------------------------------------------------
+static void TVPSubRenderRegion(std::vector<tTVPRect> &region, const tTVPRect &r)
+{
+	// subtract r from the region; the rectangles of the region never
+	// overlap each other.
+	std::vector<tTVPRect> result;
+	for(std::vector<tTVPRect>::iterator i = region.begin(); i != region.end(); i++)
+	{
+		const tTVPRect &s = *i;
+		tTVPRect is;
+		if(!TVPIntersectRect(&is, s, r))
+		{
+			result.push_back(s);
+			continue;
+		}
+		if(s.top < is.top)
+			result.push_back(tTVPRect(s.left, s.top, s.right, is.top));
+		if(s.left < is.left)
+			result.push_back(tTVPRect(s.left, is.top, is.left, is.bottom));
+		if(is.right < s.right)
+			result.push_back(tTVPRect(is.right, is.top, s.right, is.bottom));
+		if(is.bottom < s.bottom)
+			result.push_back(tTVPRect(s.left, is.bottom, s.right, s.bottom));
+	}
+	region.swap(result);
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTVPLayerRenderNode
+//---------------------------------------------------------------------------
+tTVPLayerRenderNode::tTVPLayerRenderNode()
+{
+	DisplayType = ltOpaque;
+	Opacity = 255;
+	ImageLeft = ImageTop = 0;
+	NeutralColor = TransparentColor = 0;
+	HasVisibleChildren = false;
+	Parent = NULL;
+	DirectTransferToParent = false;
+	UpdateBitmapForChild = NULL;
+	UpdateRectForChildOfsX = UpdateRectForChildOfsY = 0;
+	UpdateOfsX = UpdateOfsY = 0;
+}
+//---------------------------------------------------------------------------
+tTVPLayerRenderNode::~tTVPLayerRenderNode()
+{
+	if(Image.Texture) Image.Texture->Release();
+	for(std::vector<tTVPLayerRenderNode *>::iterator i = Children.begin();
+		i != Children.end(); i++)
+		delete *i;
+}
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTVPLayerRenderThread
+//---------------------------------------------------------------------------
+tTVPLayerRenderThread::tTVPLayerRenderThread(tTVPLayerManager *manager)
+: EventQueue(this,&tTVPLayerRenderThread::Proc), tTVPThread(true),
+  Manager(manager), Job(NULL), Rendering(false), TempCount(0)
+{
+	Target.MainOnly = true;
+	EventQueue.Allocate();
+	Resume();
+}
+//---------------------------------------------------------------------------
+tTVPLayerRenderThread::~tTVPLayerRenderThread()
+{
+	ExitRequest();
+	WaitFor();
+	EventQueue.Clear();
+	EventQueue.Deallocate();
+	delete Job;
+	for(std::vector<tTVPRenderSurface *>::iterator i = Temps.begin();
+		i != Temps.end(); i++)
+		delete *i;
+}
+//---------------------------------------------------------------------------
+void tTVPLayerRenderThread::ExitRequest()
+{
+	Terminate();
+	PostEvent.Set();
+}
+//---------------------------------------------------------------------------
+void tTVPLayerRenderThread::Execute()
+{
+	RenderingThread();
+}
+//---------------------------------------------------------------------------
+void tTVPLayerRenderThread::Proc( NativeEvent& ev )
+{
+	if(ev.Message != TVP_EV_LAYER_RENDER_THREAD) {
+		EventQueue.HandlerDefault(ev);
+		return;
+	}
+	// request the window update which shows the composited frame
+	Manager->NotifyWindowInvalidation();
+}
+//---------------------------------------------------------------------------
+void tTVPLayerRenderThread::RenderingThread()
+{
+	while( !GetTerminated() ) {
+		tTVPLayerRenderNode *job = NULL;
+		{ // Lock
+			tTJSCriticalSectionHolder cs(JobCS);
+			if( Rendering ) job = Job;
+		}
+		if( !job ) {
+			PostEvent.WaitFor(-1);
+			continue;
+		}
+
+		std::vector<tTVPRect>::iterator i;
+		for( i = JobRegion.begin(); i != JobRegion.end(); i++ ) {
+			tTVPRect r(*i);
+			r.add_offsets(job->Rect.left, job->Rect.top);
+
+			// the same stripes as tTJSNI_BaseLayer::InternalComplete2 does
+			// with gsotSimple
+			tjs_int oh;
+			if( job->HasVisibleChildren ) {
+				tjs_int rw = r.get_width();
+				if(rw < 40) oh = 128;
+				else if(rw < 80) oh = 64;
+				else if(rw < 160) oh = 32;
+				else if(rw < 320) oh = 16;
+				else oh = 8;
+			} else {
+				oh = r.get_height();
+			}
+			tTVPRect opr;
+			opr.left = r.left;
+			opr.right = r.right;
+			for( tjs_int y = r.top; y < r.bottom; y += oh ) {
+				opr.top = y;
+				opr.bottom = (y+oh < r.bottom) ? y+oh: r.bottom;
+				Draw(job, opr);
+			}
+		}
+
+		{ // Lock
+			tTJSCriticalSectionHolder cs(JobCS);
+			Rendering = false;
+		}
+		DoneEvent.Set();
+		NativeEvent ev(TVP_EV_LAYER_RENDER_THREAD);
+		EventQueue.PostEvent(ev);
+	}
+}
+//---------------------------------------------------------------------------
+void tTVPLayerRenderThread::Flush(iTVPBaseBitmap *drawbuffer)
+{
+	// main thread
+	while( true ) {
+		{ // Lock
+			tTJSCriticalSectionHolder cs(JobCS);
+			if( !Rendering ) break;
+		}
+		DoneEvent.WaitFor(-1);
+	}
+	if( !Job ) return;
+
+	// the thread is idle; copy the composited region into the draw buffer
+	tjs_int w = std::min((tjs_int)drawbuffer->GetWidth(), Target.Width);
+	tjs_int h = std::min((tjs_int)drawbuffer->GetHeight(), Target.Height);
+	std::vector<tTVPRect>::iterator i;
+	for( i = JobRegion.begin(); i != JobRegion.end(); i++ ) {
+		tTVPRect r;
+		if( !TVPIntersectRect(&r, *i, tTVPRect(0, 0, w, h)) ) continue;
+		for( tjs_int y = r.top; y < r.bottom; y++ ) {
+			memcpy((tjs_uint32*)drawbuffer->GetScanLineForWrite(y) + r.left,
+				Target.GetScanLine(y) + r.left, r.get_width() * sizeof(tjs_uint32));
+		}
+	}
+	JobRegion.clear();
+
+	// textures are released on the main thread
+	delete Job;
+	Job = NULL;
+}
+//---------------------------------------------------------------------------
+void tTVPLayerRenderThread::Post(tTVPLayerRenderNode *root,
+	const tTVPComplexRect &region, iTVPBaseBitmap *drawbuffer)
+{
+	// main thread; the thread is idle here
+	if( Target.Width != root->Rect.get_width() ||
+		Target.Height != root->Rect.get_height() ) {
+		// the primary layer is resized; take whole of the draw buffer
+		Target.SetSize(root->Rect.get_width(), root->Rect.get_height());
+		StaleRegion.Clear();
+		StaleRegion.Or(tTVPRect(0, 0, Target.Width, Target.Height));
+	}
+
+	// take the region which is drawn without the thread
+	if( StaleRegion.GetCount() ) {
+		tjs_int w = std::min((tjs_int)drawbuffer->GetWidth(), Target.Width);
+		tjs_int h = std::min((tjs_int)drawbuffer->GetHeight(), Target.Height);
+		tTVPComplexRect::tIterator it = StaleRegion.GetIterator();
+		while( it.Step() ) {
+			tTVPRect r;
+			if( !TVPIntersectRect(&r, *it, tTVPRect(0, 0, w, h)) ) continue;
+			for( tjs_int y = r.top; y < r.bottom; y++ ) {
+				memcpy(Target.GetScanLineForWrite(y) + r.left,
+					(const tjs_uint32*)drawbuffer->GetScanLine(y) + r.left,
+					r.get_width() * sizeof(tjs_uint32));
+			}
+		}
+		StaleRegion.Clear();
+	}
+
+	{ // Lock
+		tTJSCriticalSectionHolder cs(JobCS);
+		Job = root;
+		JobRegion.clear();
+		tTVPComplexRect::tIterator it = region.GetIterator();
+		while( it.Step() ) JobRegion.push_back(*it);
+		Rendering = true;
+	}
+	PostEvent.Set();
+}
+//---------------------------------------------------------------------------
+tTVPRenderSurface * tTVPLayerRenderThread::GetTemp(tjs_int w, tjs_int h)
+{
+	// temporary bitmaps are used as a stack, as tTVPTempBitmapHolder
+	if( TempCount == Temps.size() ) Temps.push_back(new tTVPRenderSurface());
+	tTVPRenderSurface *temp = Temps[TempCount++];
+	temp->SetSize(w, h);
+	return temp;
+}
+//---------------------------------------------------------------------------
+// the methods below mirror those of tTJSNI_BaseLayer ( and of
+// tTVPLayerManager for the primary layer, whose node has no Parent )
+//---------------------------------------------------------------------------
+void tTVPLayerRenderThread::Draw(tTVPLayerRenderNode *node, const tTVPRect &r)
+{
+	// "r" is a rectangle to be drawn in the parent's coordinates.
+	// nodes of the children which are not seen are not in the snapshot.
+	tTVPRect rect = r;
+	if(!TVPIntersectRect(&rect, rect, node->Rect)) return; // no intersection
+
+	rect.add_offsets(-node->Rect.left, -node->Rect.top);
+
+	node->DirectTransferToParent = false;
+	bool totalopaque = (node->DisplayType == ltOpaque && node->Opacity == 255);
+
+	if(!node->HasVisibleChildren)
+	{
+		// no visible children; no action needed
+		tTVPRect pr = rect;
+		pr.add_offsets(node->Rect.left, node->Rect.top);
+		tTVPRect cr = rect;
+		DrawSelf(node, pr, cr);
+		return;
+	}
+
+	// process overlapped region
+	node->DrawnRegion.clear();
+
+	std::vector<tTVPRect>::iterator it;
+	std::vector<tTVPLayerRenderNode *>::iterator ci;
+	for(it = node->OverlappedRegion.begin(); it != node->OverlappedRegion.end(); it++)
+	{
+		tTVPRect cr(*it);
+
+		// intersection check
+		if(!TVPIntersectRect(&cr, cr, rect)) continue;
+
+		tTVPRect updaterectforchild;
+		bool tempalloc = false;
+
+		// setup UpdateBitmapForChild and "updaterectforchild"
+		if(totalopaque)
+		{
+			node->UpdateBitmapForChild = GetDrawTargetBitmap(node->Parent,
+				cr, updaterectforchild);
+		}
+		else
+		{
+			node->UpdateBitmapForChild = GetTemp(cr.get_width(), cr.get_height());
+			tempalloc = true;
+			updaterectforchild.left = 0;
+			updaterectforchild.top = 0;
+			updaterectforchild.right = cr.get_width();
+			updaterectforchild.bottom = cr.get_height();
+		}
+
+		// copy self image to the target
+		CopySelf(node, node->UpdateBitmapForChild,
+			updaterectforchild.left, updaterectforchild.top, cr);
+
+		for(ci = node->Children.begin(); ci != node->Children.end(); ci++)
+		{
+			tTVPLayerRenderNode *child = *ci;
+
+			// intersection check
+			tTVPRect chrect;
+			if(!TVPIntersectRect(&chrect, cr, child->Rect))
+				continue;
+
+			// setup UpdateRectForChild
+			tjs_int ox = chrect.left - cr.left;
+			tjs_int oy = chrect.top - cr.top;
+
+			node->UpdateRectForChild = updaterectforchild;
+			node->UpdateRectForChild.add_offsets(ox, oy);
+			node->UpdateRectForChildOfsX = chrect.left - child->Rect.left;
+			node->UpdateRectForChildOfsY = chrect.top - child->Rect.top;
+
+			// setup UpdateOfsX, UpdateOfsY
+			node->UpdateOfsX = cr.left - updaterectforchild.left;
+			node->UpdateOfsY = cr.top - updaterectforchild.top;
+
+			Draw(child, chrect);
+		}
+
+		// send completion message to the target
+		tTVPRect pr = cr;
+		pr.add_offsets(node->Rect.left, node->Rect.top);
+		DrawCompleted(node->Parent, pr, node->UpdateBitmapForChild,
+			updaterectforchild, node->DisplayType, node->Opacity);
+
+		// release temporary bitmap
+		if(tempalloc) FreeTemp();
+	}
+
+	// process exposed region
+	node->DirectTransferToParent = true; // this flag is used only when the node has no image
+
+	for(it = node->ExposedRegion.begin(); it != node->ExposedRegion.end(); it++)
+	{
+		tTVPRect cr(*it);
+
+		// intersection check
+		if(!TVPIntersectRect(&cr, cr, rect)) continue;
+
+		if(node->Image.Texture)
+		{
+			tTVPRect pr = cr;
+			pr.add_offsets(node->Rect.left, node->Rect.top);
+			DrawSelf(node, pr, cr);
+		}
+		else
+		{
+			for(ci = node->Children.begin(); ci != node->Children.end(); ci++)
+			{
+				tTVPLayerRenderNode *child = *ci;
+
+				// intersection check
+				tTVPRect chrect;
+				if(!TVPIntersectRect(&chrect, cr, child->Rect))
+					continue;
+
+				Draw(child, chrect);
+			}
+		}
+	}
+	node->DirectTransferToParent = false;
+}
+//---------------------------------------------------------------------------
+void tTVPLayerRenderThread::DrawSelf(tTVPLayerRenderNode *node, tTVPRect &pr,
+	tTVPRect &cr)
+{
+	if(!node->Image.Texture)
+	{
+		if(node->DisplayType == ltOpaque)
+		{
+			// fill destination with specified color
+			tTVPRenderSurface *temp = GetTemp(cr.get_width(), cr.get_height());
+			tTVPRect bitmaprect = cr;
+			bitmaprect.set_offsets(0, 0);
+			CopySelf(node, temp, 0, 0, bitmaprect); // this fills temp with neutral color
+			DrawCompleted(node->Parent, pr, temp, bitmaprect, node->DisplayType,
+				node->Opacity);
+			FreeTemp();
+		}
+		return;
+	}
+
+	// draw self image(only) to target
+	cr.add_offsets(-node->ImageLeft, -node->ImageTop);
+	DrawCompleted(node->Parent, pr, &node->Image, cr, node->DisplayType,
+		node->Opacity);
+}
+//---------------------------------------------------------------------------
+void tTVPLayerRenderThread::CopySelf(tTVPLayerRenderNode *node,
+	tTVPRenderSurface *dest, tjs_int destx, tjs_int desty, const tTVPRect &r)
+{
+	// UpdateExcludeRect is not used; the area is covered by an opaque
+	// child anyway
+	tTVPRect cr = r;
+	cr.add_offsets(-node->ImageLeft, -node->ImageTop);
+
+	if(node->Image.Texture)
+	{
+		TVPRenderCopyRect(dest, destx, desty, &node->Image, cr);
+	}
+	else
+	{
+		// fill destination with TransparentColor
+		TVPRenderFill(dest, tTVPRect(destx, desty,
+			destx + cr.get_width(), desty + cr.get_height()),
+			node->DisplayType == ltOpaque ? node->NeutralColor : node->TransparentColor);
+	}
+}
+//---------------------------------------------------------------------------
+tTVPRenderSurface * tTVPLayerRenderThread::GetDrawTargetBitmap(
+	tTVPLayerRenderNode *node, const tTVPRect &rect, tTVPRect &cliprect)
+{
+	if(!node)
+	{
+		// the draw buffer
+		cliprect = rect;
+		return &Target;
+	}
+
+	if(!node->Image.Texture && node->DirectTransferToParent)
+	{
+		tTVPRect _rect(rect);
+		_rect.add_offsets(node->Rect.left, node->Rect.top);
+		return GetDrawTargetBitmap(node->Parent, _rect, cliprect);
+	}
+	cliprect = node->UpdateRectForChild;
+	cliprect.add_offsets(rect.left - node->UpdateRectForChildOfsX,
+		rect.top - node->UpdateRectForChildOfsY);
+	return node->UpdateBitmapForChild;
+}
+//---------------------------------------------------------------------------
+void tTVPLayerRenderThread::DrawCompleted(tTVPLayerRenderNode *node,
+	const tTVPRect &destrect, tTVPRenderSurface *bmp, const tTVPRect &cliprect,
+	tTVPLayerType type, tjs_int opacity)
+{
+	if(!node)
+	{
+		// the draw buffer; the same as tTVPLayerManager::DrawCompleted
+		tTVPBBBltMethod met;
+		switch(type)
+		{
+		case ltOpaque:	met = opacity == 255 ? bmCopyOnAlpha : bmCopy;	break;
+		case ltAlpha:	met = bmAlpha;	break;
+		case ltAddAlpha:	met = bmAddAlpha;	break;
+		default:	return;
+		}
+		TVPRenderBlt(&Target, destrect.left, destrect.top, bmp, cliprect, met,
+			opacity, true);
+		return;
+	}
+
+	if(!node->Image.Texture && node->DirectTransferToParent)
+	{
+		tTVPRect _destrect(destrect);
+		_destrect.add_offsets(node->Rect.left, node->Rect.top);
+		DrawCompleted(node->Parent, _destrect, bmp, cliprect, type, opacity);
+		return;
+	}
+
+	if(bmp == node->UpdateBitmapForChild) return;
+
+	if(node->Image.Texture)
+	{
+		TVPRenderBltImage(node->UpdateBitmapForChild, node->DisplayType,
+			destrect.left - node->UpdateOfsX,
+			destrect.top - node->UpdateOfsY,
+			bmp, cliprect, type, opacity);
+		return;
+	}
+
+	// special optimization for the layer without image
+	// (all the layer face is treated as transparent)
+	std::vector<tTVPRect> nr; // new region
+	nr.push_back(destrect);
+	std::vector<tTVPRect>::iterator it;
+	for(it = node->DrawnRegion.begin(); it != node->DrawnRegion.end(); it++)
+		TVPSubRenderRegion(nr, *it);
+
+	std::vector<tTVPRect> opr; // operation region
+	opr.push_back(destrect);
+	if(node->DisplayType == type && opacity == 255)
+	{
+		// just copy the target bitmap
+		for(it = nr.begin(); it != nr.end(); it++)
+		{
+			tTVPRect r(*it);
+			tTVPRect sr;
+			sr.left = cliprect.left + (r.left - destrect.left);
+			sr.top  = cliprect.top  + (r.top  - destrect.top );
+			sr.right = sr.left + r.get_width();
+			sr.bottom = sr.top + r.get_height();
+
+			TVPRenderCopyRect(node->UpdateBitmapForChild,
+				r.left - node->UpdateOfsX, r.top - node->UpdateOfsY, bmp, sr);
+			TVPSubRenderRegion(opr, r);
+		}
+	}
+	else
+	{
+		for(it = nr.begin(); it != nr.end(); it++)
+		{
+			tTVPRect r(*it);
+			r.add_offsets(-node->UpdateOfsX, -node->UpdateOfsY);
+			// fill r with transparent color
+			CopySelf(node, node->UpdateBitmapForChild, r.left, r.top, r);
+		}
+	}
+
+	// operate r
+	for(it = opr.begin(); it != opr.end(); it++)
+	{
+		tTVPRect r(*it);
+		tTVPRect sr;
+		sr.left = cliprect.left + (r.left - destrect.left);
+		sr.top  = cliprect.top  + (r.top  - destrect.top );
+		sr.right = sr.left + r.get_width();
+		sr.bottom = sr.top + r.get_height();
+
+		TVPRenderBltImage(node->UpdateBitmapForChild, node->DisplayType,
+			r.left - node->UpdateOfsX, r.top - node->UpdateOfsY,
+			bmp, sr, type, opacity);
+	}
+
+	// update DrawnRegion
+	node->DrawnRegion.push_back(destrect);
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,189 @@
+//---------------------------------------------------------------------------
+/*
+	TVP2 ( T Visual Presenter 2 )  A script authoring tool
+	Copyright (C) 2000 W.Dee <dee@kikyou.info> and contributors
+
+	See details of license at "license.txt"
+*/
+//---------------------------------------------------------------------------
+// Layer compositing thread
+//---------------------------------------------------------------------------
+#ifndef __LAYER_RENDER_THREAD_H__
+#define __LAYER_RENDER_THREAD_H__
+
+#include <vector>
+#include "ThreadIntf.h"
+#include "NativeEventQueue.h"
+#include "ComplexRect.h"
+#include "drawable.h"
+
+class iTVPTexture2D;
+class iTVPBaseBitmap;
+class tTVPLayerManager;
+//---------------------------------------------------------------------------
+// tTVPRenderSurface
+//---------------------------------------------------------------------------
+// 32bpp pixels which are read or written by the compositing thread
+struct tTVPRenderSurface
+{
+	iTVPTexture2D *Texture; // read only layer image, or NULL
+	tjs_uint32 *Bits; // pixels of the buffer (when Texture is NULL)
+	tjs_int Pitch; // in pixels
+	tjs_int Width;
+	tjs_int Height;
+	bool MainOnly; // copying into this keeps the alpha ( as tTVPDestTexture )
+	std::vector<tjs_uint32> Buffer;
+
+	tTVPRenderSurface() : Texture(NULL), Bits(NULL), Pitch(0), Width(0),
+		Height(0), MainOnly(false) {}
+
+	void SetSize(tjs_int w, tjs_int h);
+	const tjs_uint32 * GetScanLine(tjs_int y) const;
+	tjs_uint32 * GetScanLineForWrite(tjs_int y) { return Bits + Pitch * y; }
+};
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTVPLayerRenderNode
+//---------------------------------------------------------------------------
+/*
+	copy of a layer which is taken by the main thread at the end of the
+	frame ( see tTJSNI_BaseLayer::CreateRenderNode ). the image is held by
+	its texture; the layer bitmap makes its own copy of a texture which is
+	shared before writing into it ( tTVPNativeBaseBitmap::Independ ), so
+	the script can modify the layer while the node is composited.
+	nodes are created and deleted by the main thread only, because the
+	reference count of the texture is not thread safe.
+*/
+struct tTVPLayerRenderNode
+{
+	// states of the layer
+	tTVPRect Rect; // in the parent's coordinates
+	tTVPLayerType DisplayType; // ltOpaque, ltAlpha or ltAddAlpha
+	tjs_int Opacity;
+	tTVPRenderSurface Image; // Image.Texture is NULL if the layer has no image
+	tjs_int ImageLeft;
+	tjs_int ImageTop;
+	tjs_uint32 NeutralColor;
+	tjs_uint32 TransparentColor;
+	bool HasVisibleChildren;
+	std::vector<tTVPRect> OverlappedRegion;
+	std::vector<tTVPRect> ExposedRegion;
+	std::vector<tTVPLayerRenderNode *> Children; // seen children only
+	tTVPLayerRenderNode *Parent; // NULL for the primary layer
+
+	// used while compositing; these are the same as the members of
+	// tTJSNI_BaseLayer which are used by tTJSNI_BaseLayer::Draw
+	bool DirectTransferToParent;
+	tTVPRenderSurface *UpdateBitmapForChild;
+	tTVPRect UpdateRectForChild;
+	tjs_int UpdateRectForChildOfsX;
+	tjs_int UpdateRectForChildOfsY;
+	tjs_int UpdateOfsX;
+	tjs_int UpdateOfsY;
+	std::vector<tTVPRect> DrawnRegion;
+
+	tTVPLayerRenderNode();
+	~tTVPLayerRenderNode();
+};
+//---------------------------------------------------------------------------
+
+
+
+//---------------------------------------------------------------------------
+// tTVPLayerRenderThread
+//---------------------------------------------------------------------------
+/*
+	composites the window image of a layer manager from the snapshot of
+	its layer tree, while the script runs the next frame.
+	the thread draws into its own copy of the manager's draw buffer; the
+	updated region is copied into the draw buffer by the main thread when
+	the next frame is completed, so the window shows the frame one update
+	later than the synchronous completion does. the thread posts an event
+	after compositing to request that update.
+	the layers which can not be composited from the snapshot ( other layer
+	types, caches, transitions ) are completed synchronously into the draw
+	buffer; the region is copied back into the thread's buffer before the
+	next snapshot is posted.
+*/
+class tTVPLayerRenderThread : public tTVPThread
+{
+	/** lock for Job */
+	tTJSCriticalSection JobCS;
+
+	/** message queue to notify the manager on the main thread */
+	NativeEventQueue<tTVPLayerRenderThread> EventQueue;
+	/** event to tell the thread that a snapshot is posted */
+	tTVPThreadEvent PostEvent;
+	/** event to tell the main thread that the snapshot is composited */
+	tTVPThreadEvent DoneEvent;
+
+	tTVPLayerManager *Manager;
+
+	tTVPLayerRenderNode *Job; // snapshot posted; deleted by the main thread
+	std::vector<tTVPRect> JobRegion; // region of the snapshot to composite
+	bool Rendering; // Job is not composited yet
+
+	tTVPRenderSurface Target; // the thread's copy of the draw buffer
+	std::vector<tTVPRenderSurface *> Temps;
+	tjs_uint TempCount;
+
+	tTVPComplexRect StaleRegion;
+		// region of Target which is drawn synchronously ( main thread )
+
+private:
+	void RenderingThread();
+
+	tTVPRenderSurface * GetTemp(tjs_int w, tjs_int h);
+	void FreeTemp() { TempCount--; }
+
+	void Draw(tTVPLayerRenderNode *node, const tTVPRect &r);
+	void DrawSelf(tTVPLayerRenderNode *node, tTVPRect &pr, tTVPRect &cr);
+	void CopySelf(tTVPLayerRenderNode *node, tTVPRenderSurface *dest,
+		tjs_int destx, tjs_int desty, const tTVPRect &r);
+	tTVPRenderSurface * GetDrawTargetBitmap(tTVPLayerRenderNode *node,
+		const tTVPRect &rect, tTVPRect &cliprect);
+	void DrawCompleted(tTVPLayerRenderNode *node, const tTVPRect &destrect,
+		tTVPRenderSurface *bmp, const tTVPRect &cliprect,
+		tTVPLayerType type, tjs_int opacity);
+
+protected:
+	void Execute();
+
+public:
+	void Proc( NativeEvent& ev );
+
+public:
+	tTVPLayerRenderThread(tTVPLayerManager *manager);
+	~tTVPLayerRenderThread();
+
+	void ExitRequest();
+
+	/**
+	 * wait for the posted snapshot, and copy the composited region into
+	 * the draw buffer ( main thread ).
+	 */
+	void Flush(iTVPBaseBitmap *drawbuffer);
+
+	/**
+	 * post the snapshot of the primary layer ( main thread ).
+	 * the thread must be flushed. root is owned by the thread after the
+	 * call.
+	 */
+	void Post(tTVPLayerRenderNode *root, const tTVPComplexRect &region,
+		iTVPBaseBitmap *drawbuffer);
+
+	/**
+	 * notify that the region of the draw buffer is drawn by the main thread.
+	 */
+	void NotifyDrawnSynchronously(const tTVPComplexRect &region)
+		{ StaleRegion.Or(region); }
+};
+//---------------------------------------------------------------------------
+
+extern bool TVPLayerRenderThreadEnabled;
+	// "-renderthread=yes"; window images are composited on the thread
+
+#endif // __LAYER_RENDER_THREAD_H__
@@ -66,6 +66,27 @@ struct tTVPLayerBitmapMemoryRecord
 
 static uint64_t _totalVMemSize = 0;
 
+// a tTVPBitmap may be shared by several software textures (and by the
+// graphic cache); its pixel memory is counted only once.
+static std::unordered_map<const void*, std::pair<int, uint64_t> > _sharedBitsRefCount;
+static void TVPAddSharedBitsVMemSize(const void *bits, uint64_t size)
+{
+	std::pair<int, uint64_t> &rec = _sharedBitsRefCount[bits];
+	if (rec.first++ == 0) {
+		rec.second = size;
+		_totalVMemSize += size;
+	}
+}
+static void TVPRemoveSharedBitsVMemSize(const void *bits)
+{
+	auto it = _sharedBitsRefCount.find(bits);
+	if (it == _sharedBitsRefCount.end()) return;
+	if (--it->second.first == 0) {
+		_totalVMemSize -= it->second.second;
+		_sharedBitsRefCount.erase(it);
+	}
+}
+
 //---------------------------------------------------------------------------
 static void * TVPAllocBitmapBits(tjs_uint size, tjs_uint width, tjs_uint height)
 {
@@ -373,18 +394,129 @@ public:
 static const tjs_uint8 __empty_line[EMPTY_LINE_BYTES + 32] = {}; // at most 2048 pixels per line
 static const tjs_uint8* _empty_line = (const tjs_uint8*)(((intptr_t)(&__empty_line) + 15)&~15);
 
+//---------------------------------------------------------------------------
+// tTVPScanLineStore : process-wide content-addressed store of static scanlines
+//---------------------------------------------------------------------------
+// identical scanlines of all static textures (transparent padding, common
+// frame borders, rows repeated across a character's sprite set) are stored
+// once and reference counted. lines are compared byte by byte on hash match,
+// so a hash collision never shares different pixels.
+class tTVPScanLineStore {
+	struct tLine {
+		tjs_uint8 *Data;
+		tjs_uint Size;
+		tjs_int RefCount;
+	};
+	typedef std::unordered_multimap<tjs_uint32, tLine> tLineMap;
+	tLineMap Lines;
+	tTJSCriticalSection CS;
+
+	tjs_uint64 StoredBytes = 0; // bytes actually allocated
+	tjs_uint64 ReferencedBytes = 0; // bytes that would be used without sharing
+	bool ShutdownRequested = false;
+
+	static tjs_uint32 Hash(const tjs_uint8 *p, tjs_uint size) { return XXH32(p, size, 0); }
+
+public:
+	const tjs_uint8 * Acquire(const tjs_uint8 *src, tjs_uint size) {
+		tTJSCriticalSectionHolder cs_holder(CS);
+		ReferencedBytes += size;
+		if (size <= EMPTY_LINE_BYTES && !memcmp(src, _empty_line, size))
+			return _empty_line; // fully transparent line needs no storage
+		tjs_uint32 hash = Hash(src, size);
+		std::pair<tLineMap::iterator, tLineMap::iterator> range = Lines.equal_range(hash);
+		for (tLineMap::iterator it = range.first; it != range.second; ++it) {
+			tLine &line = it->second;
+			if (line.Size == size && !memcmp(line.Data, src, size)) {
+				++line.RefCount;
+				return line.Data;
+			}
+		}
+		tLine line;
+		line.Data = (tjs_uint8*)TVPAllocBitmapBits(size, size, 1);
+		line.Size = size;
+		line.RefCount = 1;
+		memcpy(line.Data, src, size);
+		Lines.insert(std::make_pair(hash, line));
+		StoredBytes += size;
+		_totalVMemSize += size;
+		return line.Data;
+	}
+
+	bool Release(const tjs_uint8 *data, tjs_uint size) {
+		// returns true when the store is shut down and no line is referenced
+		// any longer; the caller must delete the store then.
+		tTJSCriticalSectionHolder cs_holder(CS);
+		ReferencedBytes -= size;
+		if (data != _empty_line) {
+			std::pair<tLineMap::iterator, tLineMap::iterator> range = Lines.equal_range(Hash(data, size));
+			tLineMap::iterator it = range.first;
+			for (; it != range.second; ++it) {
+				if (it->second.Data == data) break;
+			}
+			assert(it != range.second); // not a line of this store
+			if (it != range.second && --it->second.RefCount == 0) {
+				TVPFreeBitmapBits(it->second.Data);
+				StoredBytes -= size;
+				_totalVMemSize -= size;
+				Lines.erase(it);
+			}
+		}
+		return ShutdownRequested && ReferencedBytes == 0;
+	}
+
+	bool Shutdown() {
+		// called at the engine shutdown; returns true if the store can be
+		// deleted now, otherwise the store is deleted with its last line.
+		tTJSCriticalSectionHolder cs_holder(CS);
+		ShutdownRequested = true;
+		return ReferencedBytes == 0;
+	}
+
+	void GetStat(tjs_uint &lines, tjs_uint64 &stored, tjs_uint64 &referenced) {
+		tTJSCriticalSectionHolder cs_holder(CS);
+		lines = (tjs_uint)Lines.size();
+		stored = StoredBytes;
+		referenced = ReferencedBytes;
+	}
+};
+
+static tTVPScanLineStore *TVPScanLineStore = nullptr;
+	// created by the software render manager when the static textures are
+	// stored by lines; textures still alive at the engine shutdown (they may
+	// be released in the static destruction) keep the store until they are
+	// released.
+static void TVPInitScanLineStore()
+{
+	if (!TVPScanLineStore) TVPScanLineStore = new tTVPScanLineStore();
+}
+static void TVPUninitScanLineStore()
+{
+	if (TVPScanLineStore && TVPScanLineStore->Shutdown()) {
+		delete TVPScanLineStore;
+		TVPScanLineStore = nullptr;
+	}
+}
+static tTVPAtExit TVPUninitScanLineStoreAtExit
+	(TVP_ATEXIT_PRI_CLEANUP, TVPUninitScanLineStore);
+
+void TVPGetScanLineStoreStat(tjs_uint &lines, tjs_uint64 &stored, tjs_uint64 &referenced)
+{
+	if (!TVPScanLineStore) {
+		lines = 0;
+		stored = referenced = 0;
+		return;
+	}
+	TVPScanLineStore->GetStat(lines, stored, referenced);
+}
+
 class tTVPSoftwareTexture2D_half : public tTVPSoftwareTexture2D_static, public tTVPContinuousEventCallbackIntf {
 	std::vector<const tjs_uint8*> _scanline;
-	std::vector<tjs_uint8*> _scanlineData;
+	tjs_uint LineBytes; // bytes in a stored line
 	//tTVPBitmap *Bitmap = nullptr;
 	tjs_uint8 *PixelData = nullptr;
 	tjs_int PixelFrameLife = 0;
 
-	static bool all_of_zero(const tjs_uint8 *p, int n) {
-		while (--n > 0 && !p[n]);
-		return n < 0;
-	}
-
 public:
 	tTVPSoftwareTexture2D_half(tTVPBitmap *bmp, const void *pixel, int pitch, unsigned int w, unsigned int h, TVPTextureFormat::e format)
 		: tTVPSoftwareTexture2D_static(nullptr, pitch, w, h, format)
@@ -392,40 +524,29 @@ public:
 		const tjs_uint8 *src = static_cast<const tjs_uint8*>(pixel);
 		if (format == TVPTextureFormat::RGB) w *= 3;
 		else if (format == TVPTextureFormat::RGBA) w *= 4;
+		LineBytes = w;
 		h = (h + 1) / 2;
 		int pitch2 = pitch * 2;
 		_scanline.resize(h);
-		std::unordered_map<tjs_uint32, const tjs_uint8*> usedPixel;
-		tjs_uint32 seed = (intptr_t)bmp;
-		if (w <= EMPTY_LINE_BYTES) usedPixel[XXH32(_empty_line, w, seed)] = _empty_line;
-		
+		assert(TVPScanLineStore);
 		for (unsigned int l = 0; l < h; ++l, src += pitch2) {
-			tjs_uint32 hash = XXH32(src, w, seed);
-			auto it = usedPixel.find(hash);
-			if (it == usedPixel.end()) {
-				tjs_uint8* line = (tjs_uint8*)TVPAllocBitmapBits(w, Width, h);
-				_scanlineData.push_back(line);
-				memcpy(line, src, w);
-				usedPixel[hash] = line;
-				_scanline[l] = line;
-			} else {
-				_scanline[l] = it->second;
-			}
+			_scanline[l] = TVPScanLineStore->Acquire(src, w);
 		}
-		_totalVMemSize += _scanlineData.size() * w;
 	}
 
 	virtual ~tTVPSoftwareTexture2D_half() {
-		unsigned int w = Width;
-		if (Format == TVPTextureFormat::RGB) w *= 3;
-		else if (Format == TVPTextureFormat::RGBA) w *= 4;
-		_totalVMemSize -= _scanlineData.size() * w;
 		if (BmpData) {
 			TVPFreeBitmapBits(BmpData);
 			BmpData = nullptr;
 		}
-		for (tjs_uint8* line : _scanlineData) {
-			TVPFreeBitmapBits(line);
+		bool unused = false;
+		for (const tjs_uint8* line : _scanline) {
+			unused = TVPScanLineStore->Release(line, LineBytes);
+		}
+		if (unused) {
+			// the last texture after the engine shutdown
+			delete TVPScanLineStore;
+			TVPScanLineStore = nullptr;
 		}
 		if (PixelData) delete[] PixelData;
 	}
@@ -497,7 +618,7 @@ public:
 		return PixelData;
 	}
 
-	virtual size_t GetBitmapSize() override { return Pitch * _scanlineData.size() * (Format == TVPTextureFormat::RGBA ? 4 : 1); }
+	virtual size_t GetBitmapSize() override { return LineBytes * _scanline.size(); }
 
 	virtual void OnContinuousCallback(tjs_uint64 tick) override {
 		if (--PixelFrameLife) return;
@@ -517,7 +638,7 @@ class tTVPSoftwareTexture2D : public tTVPSoftwareTexture2D_static {
 	{
 		Bitmap = bmp;
 		/*if (Bitmap)*/ Bitmap->AddRef();
-		_totalVMemSize += Pitch * Height;
+		TVPAddSharedBitsVMemSize(Bitmap->GetBits(), Pitch * Height);
 	}
 public:
 	tTVPBitmap *Bitmap;
@@ -541,7 +662,7 @@ public:
 		Pitch = Bitmap->GetPitch();
 		BmpData = (tjs_uint8*)Bitmap->GetBits();
 
-		_totalVMemSize += Pitch * Height;
+		TVPAddSharedBitsVMemSize(Bitmap->GetBits(), Pitch * Height);
 	}
 	
 	static iTVPTexture2D * CreateFromBitmap(tTVPBitmap *bmp) {
@@ -593,11 +714,13 @@ public:
 		}
 		Pitch = Bitmap->GetPitch();
 		BmpData = (tjs_uint8*)Bitmap->GetBits();
-		_totalVMemSize += Pitch * Height;
+		TVPAddSharedBitsVMemSize(Bitmap->GetBits(), Pitch * Height);
 	}
 	~tTVPSoftwareTexture2D() {
-		_totalVMemSize -= Pitch * Height;
-		if (Bitmap) Bitmap->Release();
+		if (Bitmap) {
+			TVPRemoveSharedBitsVMemSize(Bitmap->GetBits());
+			Bitmap->Release();
+		}
 	}
 	virtual void Update(const void *pixel, TVPTextureFormat::e format, int pitch, const tTVPRect& rc) {
 		assert(rc.left == 0);
@@ -636,7 +759,9 @@ public:
 		else
 			*((tjs_uint8*)Bitmap->GetScanLine(y) + x) = (tjs_uint8)clr; // 8bpp
 	}
-	virtual bool IsStatic() { return false; }
+	// pixels shared with another owner (eg. the graphic cache) are read-only;
+	// the holder must Independ() (copy on write) before modifying them.
+	virtual bool IsStatic() { return !Bitmap->IsIndependent(); }
 };
 
 class tTVPRenderMethod_Software : public iTVPRenderMethod {
@@ -1972,7 +2097,8 @@ struct tRenderMethodCache {
 		Info[bmScreen].Init(mgr, nullptr, nullptr, "ScreenBlend", nullptr);
 		Info[bmAddAlpha].Init(mgr, nullptr, nullptr, "AdditiveAlphaBlend", nullptr);
 		Info[bmAddAlphaOnAddAlpha].Init(mgr, nullptr, nullptr, "AdditiveAlphaBlend_a", nullptr);
-		//Info[bmAddAlphaOnAlpha].Init(mgr, nullptr, nullptr, nullptr, nullptr);
+		if (mgr->IsSoftware()) // only the software renderer has this
+			Info[bmAddAlphaOnAlpha].Init(mgr, nullptr, nullptr, "AdditiveAlphaBlend_d", nullptr);
 		Info[bmAlphaOnAddAlpha].Init(mgr, nullptr, nullptr, "AlphaBlend_a", nullptr);
 		Info[bmCopyOnAddAlpha].Init(mgr, "CopyOpaqueImage", nullptr, "ConstAlphaBlend_a", nullptr);
 		Info[bmPsNormal].Init(mgr, nullptr, nullptr, "PsAlphaBlend", nullptr);
@@ -2087,8 +2213,9 @@ iTVPRenderMethod* iTVPRenderManager::GetRenderMethod(tjs_int opa, bool hda, int/
 		break;
 	case bmAddAlphaOnAlpha:
 		// additive alpha on simple alpha
-		// Not yet implemented
-		return nullptr;
+		// implemented by the software renderer only ( may loose additive stuff )
+		if (!RenderMethodCache->Info[method].WithOpa) return nullptr;
+		return RenderMethodCache->Info[method].GetMethodWithOpa(opa);
 	default:
 		return nullptr;
 	}
@@ -2343,6 +2470,10 @@ public:
 			static tTVPRenderMethod_BltAndOpa<52, TVPAdditiveAlphaBlend_a, TVPAdditiveAlphaBlend_ao> method;
 			RegisterRenderMethod("AdditiveAlphaBlend_a", &method);
 		}
+		{
+			static tTVPRenderMethod_BltAndOpa<52, TVPAdditiveAlphaBlend_d, TVPAdditiveAlphaBlend_do> method;
+			RegisterRenderMethod("AdditiveAlphaBlend_d", &method);
+		}
 		REGISER_BLEND_4(32, PsAlpha);
 		REGISER_BLEND_4(30, PsAdd);
 		REGISER_BLEND_4(29, PsSub);
@@ -2367,7 +2498,10 @@ public:
 	{
 		_createStaticTexture2D = tTVPSoftwareTexture2D::Create;
 		std::string compTexMethod = IndividualConfigManager::GetInstance()->GetValueString("software_compress_tex", "none");
-		if (compTexMethod == "halfline") _createStaticTexture2D = tTVPSoftwareTexture2D_half::Create;
+		if (compTexMethod == "halfline") {
+			TVPInitScanLineStore();
+			_createStaticTexture2D = tTVPSoftwareTexture2D_half::Create;
+		}
 
 		Register_1();
 		Register_2();
@@ -258,4 +258,6 @@ void TVPRegisterRenderManager(const char* name, iTVPRenderManager*(*func)());
 iTVPRenderManager *TVPGetRenderManager();
 namespace TJS { class tTJSString; }
 iTVPRenderManager *TVPGetRenderManager(const TJS::tTJSString &name);
-bool TVPIsSoftwareRenderManager();
\ No newline at end of file
+bool TVPIsSoftwareRenderManager();
+// statistics of the shared static scanline store (software renderer)
+void TVPGetScanLineStoreStat(tjs_uint &lines, tjs_uint64 &stored, tjs_uint64 &referenced);
\ No newline at end of file
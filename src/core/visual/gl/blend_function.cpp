@@ -492,10 +492,6 @@ TVP##DEST_FUNC##_HDA = TVP_##FUNC##_HDA;		\
 TVP##DEST_FUNC##_o = TVP_##FUNC##_o;			\
 TVP##DEST_FUNC##_HDA_o = TVP_##FUNC##_HDA_o;
 
-// dummy
-static void (*TVPAdditiveAlphaBlend_d)(tjs_uint32*,const tjs_uint32*,tjs_int);
-static void (*TVPAdditiveAlphaBlend_do)(tjs_uint32*,const tjs_uint32*,tjs_int,tjs_int);
-
 extern void TVP_ch_blur_add_mul_copy65_sse2_c( tjs_uint8 *dest, const tjs_uint8 *src, tjs_int len, tjs_int opa );
 extern void TVP_ch_blur_add_mul_copy_sse2_c( tjs_uint8 *dest, const tjs_uint8 *src, tjs_int len, tjs_int opa );
 extern void TVP_ch_blur_mul_copy65_sse2_c( tjs_uint8 *dest, const tjs_uint8 *src, tjs_int len, tjs_int opa );
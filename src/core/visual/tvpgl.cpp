@@ -965,19 +965,37 @@ TVP_GL_FUNC_DECL(void, TVPAdditiveAlphaBlend_HDA_o_c, (tjs_uint32 *dest, const t
 	}
 }
 
-/*not export*/
+/* additive alpha on simple alpha; the source is brought back into simple
+   alpha form and then blended as TVPAlphaBlend_d does. sopa is the opacity of
+   the source pixel. */
+static tjs_uint32 TVP_INLINE_FUNC TVPAddAlphaBlend_d_a_core(tjs_uint32 d, tjs_uint32 s, tjs_uint32 sopa)
+{
+	tjs_uint32 d1, addr, destalpha;
+	const tjs_uint8 * t = ((s >> 16) & 0xff00) + TVPDivTable;
+	s = (t[(s >> 16) & 0xff] << 16) + (t[(s >> 8) & 0xff] << 8) + t[s & 0xff];
+	addr = (sopa << 8) + (d >> 24);
+	destalpha = TVPNegativeMulTable[addr]<<24;
+	sopa = TVPOpacityOnOpacityTable[addr];
+	d1 = d & 0xff00ff;
+	d1 = (d1 + (((s & 0xff00ff) - d1) * sopa >> 8)) & 0xff00ff;
+	d &= 0xff00;
+	s &= 0xff00;
+	return d1 + ((d + ((s - d) * sopa >> 8)) & 0xff00) + destalpha;
+}
+
+/*export*/
 TVP_GL_FUNC_DECL(void, TVPAdditiveAlphaBlend_d_c, (tjs_uint32 *dest, const tjs_uint32 *src, tjs_int len))
-{/*YET NOT IMPLEMENTED*//*MAY LOOSE ADDITIVE STUFF*/
+{/*MAY LOOSE ADDITIVE STUFF*/
 	{
 		int ___index = 0;
 		len -= (4-1);
 
 		while(___index < len)
 		{
-	dest[(___index+0)] = 0;
-	dest[(___index+1)] = 0;
-	dest[(___index+2)] = 0;
-	dest[(___index+3)] = 0;
+	dest[(___index+0)] = TVPAddAlphaBlend_d_a_core(dest[(___index+0)], src[(___index+0)], src[(___index+0)] >> 24);
+	dest[(___index+1)] = TVPAddAlphaBlend_d_a_core(dest[(___index+1)], src[(___index+1)], src[(___index+1)] >> 24);
+	dest[(___index+2)] = TVPAddAlphaBlend_d_a_core(dest[(___index+2)], src[(___index+2)], src[(___index+2)] >> 24);
+	dest[(___index+3)] = TVPAddAlphaBlend_d_a_core(dest[(___index+3)], src[(___index+3)], src[(___index+3)] >> 24);
 			___index += 4;
 		}
 
@@ -985,7 +1003,7 @@ TVP_GL_FUNC_DECL(void, TVPAdditiveAlphaBlend_d_c, (tjs_uint32 *dest, const tjs_u
 
 		while(___index < len)
 		{
-	dest[___index] = 0;
+	dest[___index] = TVPAddAlphaBlend_d_a_core(dest[___index], src[___index], src[___index] >> 24);
 			___index ++;
 		}
 	}
@@ -1017,19 +1035,19 @@ TVP_GL_FUNC_DECL(void, TVPAdditiveAlphaBlend_a_c, (tjs_uint32 *dest, const tjs_u
 	}
 }
 
-/*not export*/
+/*export*/
 TVP_GL_FUNC_DECL(void, TVPAdditiveAlphaBlend_do_c, (tjs_uint32 *dest, const tjs_uint32 *src, tjs_int len, tjs_int opa))
-{/*YET NOT IMPLEMENTED*//*MAY LOOSE ADDITIVE STUFF*/
+{/*MAY LOOSE ADDITIVE STUFF*/
 	{
 		int ___index = 0;
 		len -= (4-1);
 
 		while(___index < len)
 		{
-	dest[(___index+0)] = 0;
-	dest[(___index+1)] = 0;
-	dest[(___index+2)] = 0;
-	dest[(___index+3)] = 0;
+	dest[(___index+0)] = TVPAddAlphaBlend_d_a_core(dest[(___index+0)], src[(___index+0)], (src[(___index+0)] >> 24) * opa >> 8);
+	dest[(___index+1)] = TVPAddAlphaBlend_d_a_core(dest[(___index+1)], src[(___index+1)], (src[(___index+1)] >> 24) * opa >> 8);
+	dest[(___index+2)] = TVPAddAlphaBlend_d_a_core(dest[(___index+2)], src[(___index+2)], (src[(___index+2)] >> 24) * opa >> 8);
+	dest[(___index+3)] = TVPAddAlphaBlend_d_a_core(dest[(___index+3)], src[(___index+3)], (src[(___index+3)] >> 24) * opa >> 8);
 			___index += 4;
 		}
 
@@ -1037,7 +1055,7 @@ TVP_GL_FUNC_DECL(void, TVPAdditiveAlphaBlend_do_c, (tjs_uint32 *dest, const tjs_
 
 		while(___index < len)
 		{
-	dest[___index] = 0;
+	dest[___index] = TVPAddAlphaBlend_d_a_core(dest[___index], src[___index], (src[___index] >> 24) * opa >> 8);
 			___index ++;
 		}
 	}
@@ -9102,8 +9120,10 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg16_d_c, (tjs_uint32 *dest, tjs_uint16 *sum
 /*export*/
 TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_c, (tjs_uint32 *dest, tjs_uint32 *sum, const tjs_uint32 * add, const tjs_uint32 * sub, tjs_int n, tjs_int len))
 {
-	/* This function is very slow since using divisiion in loop. Function written in assembly should be used. */
-	tjs_int half_n = n >> 1;
+	/* division by n is done by multiplying its 55bit fixed point reciprocal; */
+	/* this is exact while n < 2^23 since every sum is less than 256 * n. */
+	tjs_uint64 rcp = (((tjs_uint64)1 << 55) + n - 1) / n;
+	tjs_uint64 half_n = n >> 1;
 	{
 		int ___index = 0;
 		len -= (4-1);
@@ -9112,10 +9132,10 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_c, (tjs_uint32 *dest, tjs_uint32 *sum,
 		{
 {
 	dest[(___index+0)] =
-		(((sum[0] + half_n) / n)       )+
-		(((sum[1] + half_n) / n) << 8  )+
-		(((sum[2] + half_n) / n) << 16 )+
-		(((sum[3] + half_n) / n) << 24 );
+		(((sum[0] + half_n) * rcp >> 55)       )+
+		(((sum[1] + half_n) * rcp >> 55) << 8  )+
+		(((sum[2] + half_n) * rcp >> 55) << 16 )+
+		(((sum[3] + half_n) * rcp >> 55) << 24 );
 
 	sum[0] += add[(___index+0)*4+0] - sub[(___index+0)*4+0];
 	sum[1] += add[(___index+0)*4+1] - sub[(___index+0)*4+1];
@@ -9124,10 +9144,10 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_c, (tjs_uint32 *dest, tjs_uint32 *sum,
 }
 {
 	dest[(___index+1)] =
-		(((sum[0] + half_n) / n)       )+
-		(((sum[1] + half_n) / n) << 8  )+
-		(((sum[2] + half_n) / n) << 16 )+
-		(((sum[3] + half_n) / n) << 24 );
+		(((sum[0] + half_n) * rcp >> 55)       )+
+		(((sum[1] + half_n) * rcp >> 55) << 8  )+
+		(((sum[2] + half_n) * rcp >> 55) << 16 )+
+		(((sum[3] + half_n) * rcp >> 55) << 24 );
 
 	sum[0] += add[(___index+1)*4+0] - sub[(___index+1)*4+0];
 	sum[1] += add[(___index+1)*4+1] - sub[(___index+1)*4+1];
@@ -9136,10 +9156,10 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_c, (tjs_uint32 *dest, tjs_uint32 *sum,
 }
 {
 	dest[(___index+2)] =
-		(((sum[0] + half_n) / n)       )+
-		(((sum[1] + half_n) / n) << 8  )+
-		(((sum[2] + half_n) / n) << 16 )+
-		(((sum[3] + half_n) / n) << 24 );
+		(((sum[0] + half_n) * rcp >> 55)       )+
+		(((sum[1] + half_n) * rcp >> 55) << 8  )+
+		(((sum[2] + half_n) * rcp >> 55) << 16 )+
+		(((sum[3] + half_n) * rcp >> 55) << 24 );
 
 	sum[0] += add[(___index+2)*4+0] - sub[(___index+2)*4+0];
 	sum[1] += add[(___index+2)*4+1] - sub[(___index+2)*4+1];
@@ -9148,10 +9168,10 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_c, (tjs_uint32 *dest, tjs_uint32 *sum,
 }
 {
 	dest[(___index+3)] =
-		(((sum[0] + half_n) / n)       )+
-		(((sum[1] + half_n) / n) << 8  )+
-		(((sum[2] + half_n) / n) << 16 )+
-		(((sum[3] + half_n) / n) << 24 );
+		(((sum[0] + half_n) * rcp >> 55)       )+
+		(((sum[1] + half_n) * rcp >> 55) << 8  )+
+		(((sum[2] + half_n) * rcp >> 55) << 16 )+
+		(((sum[3] + half_n) * rcp >> 55) << 24 );
 
 	sum[0] += add[(___index+3)*4+0] - sub[(___index+3)*4+0];
 	sum[1] += add[(___index+3)*4+1] - sub[(___index+3)*4+1];
@@ -9167,10 +9187,10 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_c, (tjs_uint32 *dest, tjs_uint32 *sum,
 		{
 {
 	dest[___index] =
-		(((sum[0] + half_n) / n)       )+
-		(((sum[1] + half_n) / n) << 8  )+
-		(((sum[2] + half_n) / n) << 16 )+
-		(((sum[3] + half_n) / n) << 24 );
+		(((sum[0] + half_n) * rcp >> 55)       )+
+		(((sum[1] + half_n) * rcp >> 55) << 8  )+
+		(((sum[2] + half_n) * rcp >> 55) << 16 )+
+		(((sum[3] + half_n) * rcp >> 55) << 24 );
 
 	sum[0] += add[___index*4+0] - sub[___index*4+0];
 	sum[1] += add[___index*4+1] - sub[___index*4+1];
@@ -9185,8 +9205,10 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_c, (tjs_uint32 *dest, tjs_uint32 *sum,
 /*export*/
 TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_d_c, (tjs_uint32 *dest, tjs_uint32 *sum, const tjs_uint32 * add, const tjs_uint32 * sub, tjs_int n, tjs_int len))
 {
-	/* This function is very slow since using divisiion in loop. Function written in assembly should be used. */
-	tjs_int half_n = n >> 1;
+	/* division by n is done by multiplying its 55bit fixed point reciprocal; */
+	/* this is exact while n < 2^23 since every sum is less than 256 * n. */
+	tjs_uint64 rcp = (((tjs_uint64)1 << 55) + n - 1) / n;
+	tjs_uint64 half_n = n >> 1;
 	{
 		int ___index = 0;
 		len -= (4-1);
@@ -9194,12 +9216,12 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_d_c, (tjs_uint32 *dest, tjs_uint32 *sum
 		while(___index < len)
 		{
 {
-	tjs_int a = ((sum[3] + half_n) / n);
+	tjs_int a = ((sum[3] + half_n) * rcp >> 55);
 	tjs_uint8 * t = TVPDivTable + (a << 8);
 	dest[(___index+0)] =
-		(t[(sum[0] + half_n) / n]       )+
-		(t[(sum[1] + half_n) / n] << 8  )+
-		(t[(sum[2] + half_n) / n] << 16 )+
+		(t[(sum[0] + half_n) * rcp >> 55]       )+
+		(t[(sum[1] + half_n) * rcp >> 55] << 8  )+
+		(t[(sum[2] + half_n) * rcp >> 55] << 16 )+
 		(a << 24 );
 
 	sum[0] += add[(___index+0)*4+0] - sub[(___index+0)*4+0];
@@ -9208,12 +9230,12 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_d_c, (tjs_uint32 *dest, tjs_uint32 *sum
 	sum[3] += add[(___index+0)*4+3] - sub[(___index+0)*4+3];
 }
 {
-	tjs_int a = ((sum[3] + half_n) / n);
+	tjs_int a = ((sum[3] + half_n) * rcp >> 55);
 	tjs_uint8 * t = TVPDivTable + (a << 8);
 	dest[(___index+1)] =
-		(t[(sum[0] + half_n) / n]       )+
-		(t[(sum[1] + half_n) / n] << 8  )+
-		(t[(sum[2] + half_n) / n] << 16 )+
+		(t[(sum[0] + half_n) * rcp >> 55]       )+
+		(t[(sum[1] + half_n) * rcp >> 55] << 8  )+
+		(t[(sum[2] + half_n) * rcp >> 55] << 16 )+
 		(a << 24 );
 
 	sum[0] += add[(___index+1)*4+0] - sub[(___index+1)*4+0];
@@ -9222,12 +9244,12 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_d_c, (tjs_uint32 *dest, tjs_uint32 *sum
 	sum[3] += add[(___index+1)*4+3] - sub[(___index+1)*4+3];
 }
 {
-	tjs_int a = ((sum[3] + half_n) / n);
+	tjs_int a = ((sum[3] + half_n) * rcp >> 55);
 	tjs_uint8 * t = TVPDivTable + (a << 8);
 	dest[(___index+2)] =
-		(t[(sum[0] + half_n) / n]       )+
-		(t[(sum[1] + half_n) / n] << 8  )+
-		(t[(sum[2] + half_n) / n] << 16 )+
+		(t[(sum[0] + half_n) * rcp >> 55]       )+
+		(t[(sum[1] + half_n) * rcp >> 55] << 8  )+
+		(t[(sum[2] + half_n) * rcp >> 55] << 16 )+
 		(a << 24 );
 
 	sum[0] += add[(___index+2)*4+0] - sub[(___index+2)*4+0];
@@ -9236,12 +9258,12 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_d_c, (tjs_uint32 *dest, tjs_uint32 *sum
 	sum[3] += add[(___index+2)*4+3] - sub[(___index+2)*4+3];
 }
 {
-	tjs_int a = ((sum[3] + half_n) / n);
+	tjs_int a = ((sum[3] + half_n) * rcp >> 55);
 	tjs_uint8 * t = TVPDivTable + (a << 8);
 	dest[(___index+3)] =
-		(t[(sum[0] + half_n) / n]       )+
-		(t[(sum[1] + half_n) / n] << 8  )+
-		(t[(sum[2] + half_n) / n] << 16 )+
+		(t[(sum[0] + half_n) * rcp >> 55]       )+
+		(t[(sum[1] + half_n) * rcp >> 55] << 8  )+
+		(t[(sum[2] + half_n) * rcp >> 55] << 16 )+
 		(a << 24 );
 
 	sum[0] += add[(___index+3)*4+0] - sub[(___index+3)*4+0];
@@ -9257,12 +9279,12 @@ TVP_GL_FUNC_DECL(void, TVPDoBoxBlurAvg32_d_c, (tjs_uint32 *dest, tjs_uint32 *sum
 		while(___index < len)
 		{
 {
-	tjs_int a = ((sum[3] + half_n) / n);
+	tjs_int a = ((sum[3] + half_n) * rcp >> 55);
 	tjs_uint8 * t = TVPDivTable + (a << 8);
 	dest[___index] =
-		(t[(sum[0] + half_n) / n]       )+
-		(t[(sum[1] + half_n) / n] << 8  )+
-		(t[(sum[2] + half_n) / n] << 16 )+
+		(t[(sum[0] + half_n) * rcp >> 55]       )+
+		(t[(sum[1] + half_n) * rcp >> 55] << 8  )+
+		(t[(sum[2] + half_n) * rcp >> 55] << 16 )+
 		(a << 24 );
 
 	sum[0] += add[___index*4+0] - sub[___index*4+0];
@@ -12028,7 +12050,9 @@ TVP_GL_FUNC_PTR_DECL(void, TVPAdditiveAlphaBlend_HDA,  (tjs_uint32 *dest, const
 TVP_GL_FUNC_PTR_DECL(void, TVPAdditiveAlphaBlend_o,  (tjs_uint32 *dest, const tjs_uint32 *src, tjs_int len, tjs_int opa));
 TVP_GL_FUNC_PTR_DECL(void, TVPAdditiveAlphaBlend_HDA_o,  (tjs_uint32 *dest, const tjs_uint32 *src, tjs_int len, tjs_int opa));
 TVP_GL_FUNC_PTR_DECL(void, TVPAdditiveAlphaBlend_a,  (tjs_uint32 *dest, const tjs_uint32 *src, tjs_int len));
+TVP_GL_FUNC_PTR_DECL(void, TVPAdditiveAlphaBlend_d,  (tjs_uint32 *dest, const tjs_uint32 *src, tjs_int len));
 TVP_GL_FUNC_PTR_DECL(void, TVPAdditiveAlphaBlend_ao,  (tjs_uint32 *dest, const tjs_uint32 *src, tjs_int len, tjs_int opa));
+TVP_GL_FUNC_PTR_DECL(void, TVPAdditiveAlphaBlend_do,  (tjs_uint32 *dest, const tjs_uint32 *src, tjs_int len, tjs_int opa));
 TVP_GL_FUNC_PTR_DECL(void, TVPConvertAdditiveAlphaToAlpha,  (tjs_uint32 *buf, tjs_int len));
 TVP_GL_FUNC_PTR_DECL(void, TVPConvertAlphaToAdditiveAlpha,  (tjs_uint32 *buf, tjs_int len));
 TVP_GL_FUNC_PTR_DECL(void, TVPStretchAlphaBlend,  (tjs_uint32 *dest, tjs_int len, const tjs_uint32 *src, tjs_int srcstart, tjs_int srcstep));
@@ -12304,6 +12328,8 @@ TVP_GL_FUNC_DECL(void, TVPInitTVPGL, ())
 	TVPAdditiveAlphaBlend_HDA_o = TVPAdditiveAlphaBlend_HDA_o_c;
 	TVPAdditiveAlphaBlend_a = TVPAdditiveAlphaBlend_a_c;
 	TVPAdditiveAlphaBlend_ao = TVPAdditiveAlphaBlend_ao_c;
+	TVPAdditiveAlphaBlend_d = TVPAdditiveAlphaBlend_d_c;
+	TVPAdditiveAlphaBlend_do = TVPAdditiveAlphaBlend_do_c;
 	TVPConvertAdditiveAlphaToAlpha = TVPConvertAdditiveAlphaToAlpha_c;
 	TVPConvertAlphaToAdditiveAlpha = TVPConvertAlphaToAdditiveAlpha_c;
 #endif
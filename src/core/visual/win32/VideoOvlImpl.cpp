@@ -943,6 +943,7 @@ void tTJSNI_VideoOverlay::SetMixingLayer( tTJSNI_BaseLayer *l )
 					DeleteDC( hdc );
 				}
 #endif
+				l->UnpremultiplyMainImage();
 				VideoOverlay->SetMixingBitmap(l->GetMainImage(), alpha);
 			}
 			else
@@ -250,6 +250,7 @@ void layerExMovie::onUpdate() {
 	tTVPBaseTexture *frontbmp = VideoOverlay->GetFrontBuffer();
 	if (frontbmp) {
 		iTVPTexture2D* src = frontbmp->GetTexture();
+		_this->UnpremultiplyMainImage();
 		iTVPTexture2D* dst = _this->GetMainImage()->GetTextureForRender(false, nullptr);
 		tTVPRect rcdst(_clipLeft, _clipTop, _clipLeft + _clipWidth, _clipTop + _clipHeight);
 		iTVPRenderMethod *method;
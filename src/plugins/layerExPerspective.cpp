@@ -188,6 +188,8 @@ static tjs_error PerspectiveCopy_GL( tTJSVariant *result,
 	static iTVPRenderMethod *method = TVPGetRenderManager()->GetRenderMethod("PerspectiveAlphaBlend_a");
 	static int id_opa = method->EnumParameterID("opacity");
 	method->SetParameterOpa(id_opa, 255);
+	src->UnpremultiplyMainImage();
+	_this->UnpremultiplyMainImage();
 	iTVPTexture2D *tex = src->GetMainImage()->GetTexture();
 	tRenderTexQuadArray::Element src_tex[] = {
 		tRenderTexQuadArray::Element(tex, srcpt)